@@ -55,14 +55,14 @@ DefineFunction(
     'desc'   => "Caches a variable in the data store, only if it's not already stored. Unlike many other mechanisms in PHP, variables stored using apc_add() will persist between requests (until the value is removed from the cache).",
     'flags'  =>  HasDocComment | AllowIntercept,
     'return' => array(
-      'type'   => Boolean,
-      'desc'   => "Returns TRUE on success or FALSE on failure.",
+      'type'   => Variant,
+      'desc'   => "Returns TRUE on success or FALSE on failure. When key is an array, returns an array of the keys that failed.",
     ),
     'args'   => array(
       array(
         'name'   => "key",
-        'type'   => String,
-        'desc'   => "Store the variable using this name. keys are cache-unique, so attempting to use apc_add() to store data with a key that already exists will not overwrite the existing data, and will instead return FALSE. (This is the only difference between apc_add() and apc_store().)",
+        'type'   => Variant,
+        'desc'   => "Store the variable using this name, or an array of name => value pairs to store them all, in which case var is ignored. keys are cache-unique, so attempting to use apc_add() to store data with a key that already exists will not overwrite the existing data, and will instead return FALSE. (This is the only difference between apc_add() and apc_store().)",
       ),
       array(
         'name'   => "var",
@@ -89,14 +89,14 @@ DefineFunction(
     'desc'   => "Cache a variable in the data store. Unlike many other mechanisms in PHP, variables stored using apc_store() will persist between requests (until the value is removed from the cache).",
     'flags'  =>  HasDocComment | AllowIntercept,
     'return' => array(
-      'type'   => Boolean,
-      'desc'   => "Returns TRUE on success or FALSE on failure.",
+      'type'   => Variant,
+      'desc'   => "Returns TRUE on success or FALSE on failure. When key is an array, returns an array of the keys that failed.",
     ),
     'args'   => array(
       array(
         'name'   => "key",
-        'type'   => String,
-        'desc'   => "Store the variable using this name. keys are cache-unique, so storing a second value with the same key will overwrite the original value.",
+        'type'   => Variant,
+        'desc'   => "Store the variable using this name, or an array of name => value pairs to store them all, in which case var is ignored. keys are cache-unique, so storing a second value with the same key will overwrite the original value.",
       ),
       array(
         'name'   => "var",
@@ -146,6 +146,40 @@ DefineFunction(
     ),
   ));
 
+DefineFunction(
+  array(
+    'name'   => "apc_fetch_or_compute",
+    'desc'   => "Fetches a stored variable, or computes and stores it when it's missing or expired. Only one caller computes a key at a time. While it does, the others get the expired value if there is one, or wait for the new one for up to LeaseTimeout milliseconds.",
+    'flags'  =>  HasDocComment | AllowIntercept,
+    'return' => array(
+      'type'   => Variant,
+      'desc'   => "The stored or computed variable.",
+    ),
+    'args'   => array(
+      array(
+        'name'   => "key",
+        'type'   => String,
+        'desc'   => "The key used to store the value.",
+      ),
+      array(
+        'name'   => "compute",
+        'type'   => Variant,
+        'desc'   => "A callback that takes no arguments and returns the value.",
+      ),
+      array(
+        'name'   => "ttl",
+        'type'   => Int64,
+        'value'  => "0",
+        'desc'   => "Time To Live of the computed value, as with apc_store().",
+      ),
+      array(
+        'name'   => "cache_id",
+        'type'   => Int64,
+        'value'  => "0",
+      ),
+    ),
+  ));
+
 DefineFunction(
   array(
     'name'   => "apc_delete",
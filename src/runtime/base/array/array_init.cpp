@@ -17,6 +17,7 @@
 #include <runtime/base/array/zend_array.h>
 #include <runtime/base/array/hphp_array.h>
 #include <runtime/base/array/small_array.h>
+#include <runtime/base/array/vector_array.h>
 #include <runtime/base/runtime_option.h>
 
 namespace HPHP {
@@ -29,7 +30,9 @@ ArrayInit::ArrayInit(ssize_t n, bool isVector /* = false */,
     if (keepRef) {
       m_data = StaticEmptyZendArray::Get();
     } else {
-      if (RuntimeOption::UseSmallArray) {
+      if (RuntimeOption::UseVectorArray) {
+        m_data = StaticEmptyVectorArray::Get();
+      } else if (RuntimeOption::UseSmallArray) {
         m_data = StaticEmptySmallArray::Get();
       } else if (RuntimeOption::UseHphpArray) {
         m_data = StaticEmptyHphpArray::Get();
@@ -41,7 +44,9 @@ ArrayInit::ArrayInit(ssize_t n, bool isVector /* = false */,
     if (keepRef) {
       m_data = NEW(ZendArray)(n);
     } else {
-      if (RuntimeOption::UseSmallArray && n <= SmallArray::SARR_SIZE) {
+      if (RuntimeOption::UseVectorArray && isVector) {
+        m_data = NEW(VectorArray)(n);
+      } else if (RuntimeOption::UseSmallArray && n <= SmallArray::SARR_SIZE) {
         m_data = NEW(SmallArray)();
       } else if (RuntimeOption::UseHphpArray) {
         m_data = NEW(HphpArray)(n);
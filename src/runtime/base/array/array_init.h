@@ -72,46 +72,46 @@ public:
   }
 
   ArrayInit &set(CVarRef v) {
-    m_data->append(v, false);
+    escalate(m_data->append(v, false));
     return *this;
   }
 
   ArrayInit &setRef(CVarRef v) {
     v.setContagious();
-    m_data->append(v, false);
+    escalate(m_data->append(v, false));
     return *this;
   }
 
   ArrayInit &set(int64 name, CVarRef v, bool keyConverted = false) {
-    m_data->set(name, v, false);
+    escalate(m_data->set(name, v, false));
     return *this;
   }
 
   ArrayInit &set(litstr name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else {
-      m_data->set(String(name).toKey(), v, false);
+      escalate(m_data->set(String(name).toKey(), v, false));
     }
     return *this;
   }
 
   ArrayInit &set(CStrRef name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else if (!name.isNull()) {
-      m_data->set(name.toKey(), v, false);
+      escalate(m_data->set(name.toKey(), v, false));
     }
     return *this;
   }
 
   ArrayInit &set(CVarRef name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else {
       Variant k(name.toKey());
       if (!k.isNull()) {
-        m_data->set(k, v, false);
+        escalate(m_data->set(k, v, false));
       }
     }
     return *this;
@@ -120,18 +120,18 @@ public:
   template<typename T>
   ArrayInit &set(const T &name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else {
       Variant k(Variant(name).toKey());
       if (!k.isNull()) {
-        m_data->set(k, v, false);
+        escalate(m_data->set(k, v, false));
       }
     }
     return *this;
   }
 
   ArrayInit &add(int64 name, CVarRef v, bool keyConverted = false) {
-    m_data->add(name, v, false);
+    escalate(m_data->add(name, v, false));
     return *this;
   }
 
@@ -141,20 +141,20 @@ public:
 
   ArrayInit &add(CStrRef name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
-      m_data->add(name, v, false);
+      escalate(m_data->add(name, v, false));
     } else if (!name.isNull()) {
-      m_data->add(name.toKey(), v, false);
+      escalate(m_data->add(name.toKey(), v, false));
     }
     return *this;
   }
 
   ArrayInit &add(CVarRef name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
-      m_data->add(name, v, false);
+      escalate(m_data->add(name, v, false));
     } else {
       Variant k(name.toKey());
       if (!k.isNull()) {
-        m_data->add(k, v, false);
+        escalate(m_data->add(k, v, false));
       }
     }
     return *this;
@@ -163,11 +163,11 @@ public:
   template<typename T>
   ArrayInit &add(const T &name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
-      m_data->add(name, v, false);
+      escalate(m_data->add(name, v, false));
     } else {
       Variant k(Variant(name).toKey());
       if (!k.isNull()) {
-        m_data->add(k, v, false);
+        escalate(m_data->add(k, v, false));
       }
     }
     return *this;
@@ -175,16 +175,16 @@ public:
 
   ArrayInit &setRef(int64 name, CVarRef v, bool keyConverted = false) {
     v.setContagious();
-    m_data->set(name, v, false);
+    escalate(m_data->set(name, v, false));
     return *this;
   }
 
   ArrayInit &setRef(litstr name, CVarRef v, bool keyConverted = false) {
     v.setContagious();
     if (keyConverted) {
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else {
-      m_data->set(String(name).toKey(), v, false);
+      escalate(m_data->set(String(name).toKey(), v, false));
     }
     return *this;
   }
@@ -192,9 +192,9 @@ public:
   ArrayInit &setRef(CStrRef name, CVarRef v, bool keyConverted = false) {
     v.setContagious();
     if (keyConverted) {
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else {
-      m_data->set(name.toKey(), v, false);
+      escalate(m_data->set(name.toKey(), v, false));
     }
     return *this;
   }
@@ -202,12 +202,12 @@ public:
   ArrayInit &setRef(CVarRef name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
       v.setContagious();
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else {
       Variant key(name.toKey());
       if (!key.isNull()) {
         v.setContagious();
-        m_data->set(key, v, false);
+        escalate(m_data->set(key, v, false));
       } else {
         v.clearContagious();
       }
@@ -219,12 +219,12 @@ public:
   ArrayInit &setRef(const T &name, CVarRef v, bool keyConverted = false) {
     if (keyConverted) {
       v.setContagious();
-      m_data->set(name, v, false);
+      escalate(m_data->set(name, v, false));
     } else {
       Variant key(Variant(name).toKey());
       if (!key.isNull()) {
         v.setContagious();
-        m_data->set(key, v, false);
+        escalate(m_data->set(key, v, false));
       } else {
         v.clearContagious();
       }
@@ -243,6 +243,15 @@ public:
   ArrayInit (ArrayData *data) {  m_data = data;}
 private:
   ArrayData *m_data;
+
+  // A VectorArray escalates on its first non-sequential key, for example when
+  // isVector was passed but keys are still given explicitly.
+  void escalate(ArrayData *escalated) {
+    if (escalated) {
+      m_data->release();
+      m_data = escalated;
+    }
+  }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
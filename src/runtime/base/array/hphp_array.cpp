@@ -20,10 +20,16 @@
 #include <runtime/base/runtime_option.h>
 #include <runtime/base/runtime_error.h>
 #include <runtime/base/variable_serializer.h>
+#include <runtime/base/string_intern_table.h>
 #include <util/hash.h>
 #include <util/lock.h>
+#include <runtime/base/memory/memory_manager.h>
 #include <util/alloc.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // If PEDANTIC is defined, extra checks are performed to ensure correct
 // function even as an array approaches 2^31 elements.  In practice this is
 // just wasted effort though, since such an array would require on the order of
@@ -58,6 +64,26 @@ static inline size_t computeTableMask(uint32 lgTableSize) {
   return computeTableSize(lgTableSize) - 1;
 }
 
+// Hash tags are scanned 16 at a time, so small tables get padding tags that
+// stay empty forever.
+static const size_t TagGroupSize = 16;
+
+static inline size_t computeTagsSize(size_t tableSize) {
+  return tableSize < TagGroupSize ? TagGroupSize : tableSize;
+}
+
+static inline size_t computeHashSize(uint32 lgTableSize, bool tagged) {
+  size_t tableSize = computeTableSize(lgTableSize);
+  return (tableSize * sizeof(HphpArray::ElmInd))
+         + (tagged ? computeTagsSize(tableSize) : 0);
+}
+
+static inline size_t computeDataSize(uint32 lgTableSize, bool tagged) {
+  return (computeMaxElms(lgTableSize) * sizeof(HphpArray::Elm))
+         + computeHashSize(lgTableSize, tagged)
+         + HphpArray::ElmAlignment; // <-- pad
+}
+
 static inline uint32 computeLgTableSize(uint32 nEntries) {
   ASSERT(nEntries <= 0x7fffffffU);
   uint32 lgTableSize = HphpArray::MinLgTableSize;
@@ -104,24 +130,107 @@ static inline bool validElmInd(const HphpArray::ElmInd ei) {
   //           != HphpArray::ElmIndTombstone);
 }
 
-static inline void initHash(HphpArray::ElmInd* hash, size_t tableSize) {
+// Hash tags.  A full slot's tag is the top 7 bits of a multiplicative hash of
+// the key's h, so it is independent of the bits that pick the slot.  Empty and
+// tombstone slots have the high bit set, so they never match a full tag.
+static const uint8 TagEmpty     = 0x80;
+static const uint8 TagTombstone = 0xfe;
+
+static inline uint8 computeTag(int64 h) {
+  return uint8((uint64(h) * 0x9e3779b97f4a7c15ULL) >> 57);
+}
+
+static inline void initHash(HphpArray::ElmInd* hash, size_t tableSize,
+                            bool tagged) {
   ASSERT(HphpArray::ElmIndEmpty == -1);
   memset(hash, 0xffU, tableSize * sizeof(HphpArray::ElmInd));
-}
+  if (tagged) {
+    memset(hash + tableSize, TagEmpty, computeTagsSize(tableSize));
+  }
+}
+
+// Probe sequence over the groups of TagGroupSize hash tags.  The first group is
+// the one h would land in with the untagged layout, and groups are then visited
+// quadratically, which visits every group exactly once since the group count is
+// a power of 2.  Tables smaller than a group are a single partial group.
+class TagProbe {
+public:
+  TagProbe(uint32 lgTableSize, int64 h) : m_i(0) {
+    size_t tableSize = computeTableSize(lgTableSize);
+    if (tableSize < TagGroupSize) {
+      m_groupMask = 0;
+      m_validMask = (1U << tableSize) - 1;
+      m_group = 0;
+    } else {
+      m_groupMask = (tableSize / TagGroupSize) - 1;
+      m_validMask = 0xffffU;
+      m_group = (size_t(h) & (tableSize - 1)) / TagGroupSize;
+    }
+  }
+
+  size_t base() const { return m_group * TagGroupSize; }
+  void next() {
+    ++m_i;
+    ASSERT(m_i <= m_groupMask);
+    m_group = (m_group + m_i) & m_groupMask;
+  }
+
+  // Bit i of the result is set iff tag i of the current group equals tag.
+  uint32 match(const uint8* tags, uint8 tag) const {
+    const uint8* g = tags + base();
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i*)g);
+    __m128i eq = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag));
+    return uint32(_mm_movemask_epi8(eq)) & m_validMask;
+#else
+    uint32 ret = 0;
+    for (size_t i = 0; i < TagGroupSize; ++i) {
+      if (g[i] == tag) ret |= (1U << i);
+    }
+    return ret & m_validMask;
+#endif
+  }
+
+  // Empty or tombstone slots of the current group.
+  uint32 matchFree(const uint8* tags) const {
+    const uint8* g = tags + base();
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i*)g);
+    return uint32(_mm_movemask_epi8(group)) & m_validMask;
+#else
+    uint32 ret = 0;
+    for (size_t i = 0; i < TagGroupSize; ++i) {
+      if (g[i] & 0x80) ret |= (1U << i);
+    }
+    return ret & m_validMask;
+#endif
+  }
+
+  uint32 matchEmpty(const uint8* tags) const {
+    return match(tags, TagEmpty);
+  }
+
+private:
+  size_t m_group;
+  size_t m_groupMask;
+  size_t m_i;
+  uint32 m_validMask;
+};
 
 //=============================================================================
 // Construction/destruction.
 
 HphpArray::HphpArray(uint nSize /* = 0 */)
   : m_data(NULL), m_nextKI(0), m_nElms(0), m_hLoad(0), m_lastE(ElmIndEmpty),
-    m_linear(false), m_siPastEnd(false) {
+    m_linear(false), m_siPastEnd(false),
+    m_tagged(RuntimeOption::UseTaggedHphpArray) {
   m_lgTableSize = computeLgTableSize(nSize);
   size_t maxElms = computeMaxElms(m_lgTableSize);
   size_t tableSize = computeTableSize(m_lgTableSize);
   reallocData(maxElms, tableSize);
   Elm* elms = data2Elms(m_data);
   m_hash = elms2Hash(elms, maxElms);
-  initHash(m_hash, tableSize);
+  initHash(m_hash, tableSize, m_tagged);
   m_pos = ArrayData::invalid_index;
 }
 
@@ -146,7 +255,7 @@ HphpArray::~HphpArray() {
   }
   if (m_data != NULL) {
     if (!m_linear) {
-      free(m_data);
+      smart_free(m_data, computeDataSize(m_lgTableSize, m_tagged));
     }
   }
 }
@@ -443,7 +552,34 @@ static inline size_t qProbe(size_t k, size_t i, size_t tableMask) {
   return (k + ((i + i*i) >> 1)) & tableMask;
 }
 
+inline uint8* HphpArray::hashTags() const {
+  ASSERT(m_tagged);
+  return (uint8*)(m_hash + computeTableSize(m_lgTableSize));
+}
+
+#define TAGGED_FIND_BODY(h0, hit)                                             \
+  size_t maxElms = computeMaxElms(m_lgTableSize);                             \
+  Elm* elms = hash2Elms(m_hash, maxElms);                                     \
+  const uint8* tags = hashTags();                                             \
+  uint8 tag = computeTag(h0);                                                 \
+  for (TagProbe probe(m_lgTableSize, h0);; probe.next()) {                    \
+    for (uint32 m = probe.match(tags, tag); m != 0; m &= m - 1) {             \
+      ElmInd pos = m_hash[probe.base() + __builtin_ctz(m)];                   \
+      ASSERT(validElmInd(pos));                                               \
+      Elm* e = &elms[pos];                                                    \
+      if (hit) {                                                              \
+        return pos;                                                           \
+      }                                                                       \
+    }                                                                         \
+    if (probe.matchEmpty(tags) != 0) {                                        \
+      return ElmIndEmpty;                                                     \
+    }                                                                         \
+  }
+
 #define FIND_BODY(h0, hit)                                                    \
+  if (m_tagged) {                                                             \
+    TAGGED_FIND_BODY(h0, hit)                                                 \
+  }                                                                           \
   size_t maxElms = computeMaxElms(m_lgTableSize);                             \
   size_t tableMask = computeTableMask(m_lgTableSize);                         \
   size_t h = size_t(h0) & tableMask;                                          \
@@ -481,8 +617,44 @@ HphpArray::ElmInd HphpArray::find(const char* k, int len, int64 prehash) const {
   FIND_BODY(prehash, hitStringKey(e, k, len, prehash))
 }
 #undef FIND_BODY
+#undef TAGGED_FIND_BODY
+
+#define TAGGED_FIND_FOR_INSERT_BODY(h0, hit)                                  \
+  ASSERT(!m_linear);                                                          \
+  ElmInd* ret = NULL;                                                         \
+  size_t maxElms = computeMaxElms(m_lgTableSize);                             \
+  Elm* elms = hash2Elms(m_hash, maxElms);                                     \
+  const uint8* tags = hashTags();                                             \
+  uint8 tag = computeTag(h0);                                                 \
+  for (TagProbe probe(m_lgTableSize, h0);; probe.next()) {                    \
+    for (uint32 m = probe.match(tags, tag); m != 0; m &= m - 1) {             \
+      ElmInd* ei = &m_hash[probe.base() + __builtin_ctz(m)];                  \
+      ASSERT(validElmInd(*ei));                                               \
+      Elm* e = &elms[*ei];                                                    \
+      if (hit) {                                                              \
+        ASSERT(m_hLoad <= computeMaxElms(m_lgTableSize));                     \
+        return ei;                                                            \
+      }                                                                       \
+    }                                                                         \
+    if (ret == NULL) {                                                        \
+      uint32 m = probe.matchFree(tags);                                       \
+      if (m != 0) {                                                           \
+        ret = &m_hash[probe.base() + __builtin_ctz(m)];                       \
+      }                                                                       \
+    }                                                                         \
+    if (probe.matchEmpty(tags) != 0) {                                        \
+      ASSERT((*ret == ElmIndEmpty)                                            \
+             ? (m_hLoad < computeMaxElms(m_lgTableSize))                      \
+             : (m_hLoad <= computeMaxElms(m_lgTableSize))                     \
+             );                                                               \
+      return ret;                                                             \
+    }                                                                         \
+  }
 
 #define FIND_FOR_INSERT_BODY(h0, hit)                                         \
+  if (m_tagged) {                                                             \
+    TAGGED_FIND_FOR_INSERT_BODY(h0, hit)                                      \
+  }                                                                           \
   ASSERT(!m_linear);                                                          \
   ElmInd* ret = NULL;                                                         \
   size_t maxElms = computeMaxElms(m_lgTableSize);                             \
@@ -545,6 +717,7 @@ HphpArray::ElmInd* HphpArray::findForInsert(const char* k, int len,
   FIND_FOR_INSERT_BODY(prehash, hitStringKey(e, k, len, prehash))
 }
 #undef FIND_FOR_INSERT_BODY
+#undef TAGGED_FIND_FOR_INSERT_BODY
 
 bool HphpArray::exists(int64 k) const {
   return find(k) != ElmIndEmpty;
@@ -691,7 +864,7 @@ ssize_t HphpArray::getIndex(CVarRef k) const {
 //=============================================================================
 // Append/insert/update.
 
-HphpArray::Elm* HphpArray::allocElm(ElmInd* ei) {
+HphpArray::Elm* HphpArray::allocElm(ElmInd* ei, int64 h) {
   ASSERT(!m_linear);
   ASSERT(!validElmInd(*ei));
   ASSERT(m_nElms != 0 || m_lastE == ElmIndEmpty);
@@ -712,6 +885,9 @@ HphpArray::Elm* HphpArray::allocElm(ElmInd* ei) {
 #endif
   ++m_lastE;
   (*ei) = m_lastE;
+  if (m_tagged) {
+    hashTags()[ei - m_hash] = computeTag(h);
+  }
   Elm* elms = data2Elms(m_data);
   Elm* e = &elms[m_lastE];
   if (m_pos == ArrayData::invalid_index) {
@@ -738,7 +914,8 @@ HphpArray::Elm* HphpArray::allocElm(ElmInd* ei) {
   return e;
 }
 
-void HphpArray::reallocData(size_t maxElms, size_t tableSize) {
+void HphpArray::reallocData(size_t maxElms, size_t tableSize,
+                            size_t oldSize /* = 0 */) {
   // Allocate extra padding space so that if the resulting region is not
   // Elm-aligned, there is enough padding to be able to leave the first bytes
   // unused and start the element table at an Elm alignment boundary.
@@ -750,13 +927,11 @@ void HphpArray::reallocData(size_t maxElms, size_t tableSize) {
   // reallocate if alignment was inadquate.  However, this would not save very
   // much memory in practice, and recovering from the OOM failure case for the
   // reallocation would be messy to handle correctly.
-  void* data = realloc(m_linear ? NULL : m_data,
-                       (maxElms * sizeof(Elm))
-                       + (tableSize * sizeof(ElmInd))
-                       + ElmAlignment); // <-- pad
-  if (data == NULL) {
-    throw OutOfMemoryException(tableSize);
-  }
+  size_t size = (maxElms * sizeof(Elm))
+                + (tableSize * sizeof(ElmInd))
+                + (m_tagged ? computeTagsSize(tableSize) : 0)
+                + ElmAlignment; // <-- pad
+  void* data = smart_realloc(m_linear ? NULL : m_data, oldSize, size);
   if (!m_linear) {
     size_t oldPad = uintptr_t(data2Elms(m_data)) - uintptr_t(m_data);
     size_t pad = uintptr_t(data2Elms(data)) - uintptr_t(data);
@@ -783,7 +958,8 @@ void HphpArray::delinearize() {
   Elm* elms = data2Elms(m_data);
   ElmInd* oldHash = m_hash;
   m_hash = elms2Hash(elms, maxElms);
-  memcpy((void*)m_hash, (void*)oldHash, tableSize * sizeof(ElmInd));
+  memcpy((void*)m_hash, (void*)oldHash,
+         computeHashSize(m_lgTableSize, m_tagged));
 }
 
 inline void HphpArray::resize() {
@@ -806,17 +982,18 @@ inline void HphpArray::resize() {
 }
 
 void HphpArray::grow() {
+  size_t oldSize = computeDataSize(m_lgTableSize, m_tagged);
   ++m_lgTableSize;
   ASSERT(m_lgTableSize <= 32);
   size_t maxElms = computeMaxElms(m_lgTableSize);
   size_t tableSize = computeTableSize(m_lgTableSize);
-  reallocData(maxElms, tableSize);
+  reallocData(maxElms, tableSize, oldSize);
   Elm* elms = data2Elms(m_data); // m_hash is currently invalid.
   m_hash = elms2Hash(elms, maxElms);
 
   // All the elements have been copied and their offsets from the base are
   // still the same, so we just need to build the new hash table.
-  initHash(m_hash, tableSize);
+  initHash(m_hash, tableSize, m_tagged);
 #ifdef DEBUG
   // Wait to set m_hLoad to m_nElms until after rebuilding is complete, in
   // order to maintain invariants in findForInsert().
@@ -833,6 +1010,20 @@ void HphpArray::grow() {
       if (e->data.m_type == KindOfTombstone) {
         continue;
       }
+      if (m_tagged) {
+        // No tombstones yet, so the first free tag is an empty slot.
+        uint8* tags = hashTags();
+        for (TagProbe probe(m_lgTableSize, e->h);; probe.next()) {
+          uint32 m = probe.matchFree(tags);
+          if (m != 0) {
+            size_t probeIndex = probe.base() + __builtin_ctz(m);
+            m_hash[probeIndex] = pos;
+            tags[probeIndex] = computeTag(e->h);
+            break;
+          }
+        }
+        continue;
+      }
       size_t h = size_t(e->h) & tableMask;
       for (size_t i = 0;; ++i) {
         ASSERT(i < tableSize);
@@ -886,7 +1077,7 @@ void HphpArray::compact(bool renumber /* = false */) {
   size_t maxElms = computeMaxElms(m_lgTableSize);
   size_t tableSize = computeTableSize(m_lgTableSize);
   Elm* elms = hash2Elms(m_hash, maxElms);
-  initHash(m_hash, tableSize);
+  initHash(m_hash, tableSize, m_tagged);
 #ifdef DEBUG
   // Wait to set m_hLoad to m_nElms until after rebuilding is complete, in
   // order to maintain invariants in findForInsert().
@@ -917,6 +1108,9 @@ void HphpArray::compact(bool renumber /* = false */) {
       ie = findForInsert(toE->h);
     }
     *ie = toPos;
+    if (m_tagged) {
+      hashTags()[ie - m_hash] = computeTag(toE->h);
+    }
     ++frPos;
   }
   m_lastE = m_nElms - 1;
@@ -959,7 +1153,7 @@ bool HphpArray::nextInsert(CVarRef data) {
   ASSERT(!validElmInd(*ei));
 
   // Allocate a new element.
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, ki);
   // Set key.
   e->h = ki;
   e->key = NULL;
@@ -987,7 +1181,7 @@ bool HphpArray::addLvalImpl(int64 ki, Variant** pDest,
     return false;
   }
 
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, ki);
 
   e->h = ki;
   e->key = NULL;
@@ -1018,10 +1212,10 @@ bool HphpArray::addLvalImpl(StringData* key, int64 h, Variant** pDest,
     return false;
   }
 
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, h);
   // Set key.
   e->h = h;
-  e->key = key;
+  e->key = StringInternTable::Intern(key);
   e->key->incRefCount();
   // Initialize element to null and store the address of the element into
   // *pDest.
@@ -1046,7 +1240,7 @@ inline bool HphpArray::addVal(int64 ki, CVarRef data,
     ASSERT(!validElmInd(*ei));
   }
 
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, ki);
 
   e->data.m_data.num = 0;
   e->data._count = 0;
@@ -1077,10 +1271,10 @@ inline bool HphpArray::addVal(StringData* key, CVarRef data,
     ASSERT(!validElmInd(*ei));
   }
 
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, h);
 
   e->h = h;
-  e->key = key;
+  e->key = StringInternTable::Intern(key);
   e->key->incRefCount();
 
   e->data.m_data.num = 0;
@@ -1104,7 +1298,7 @@ bool HphpArray::update(int64 ki, CVarRef data) {
     return true;
   }
 
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, ki);
 
   e->h = ki;
   e->key = NULL;
@@ -1136,7 +1330,7 @@ bool HphpArray::update(litstr key, CVarRef data) {
     return true;
   }
 
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, h);
 
   e->data.m_data.num = 0;
   e->data._count = 0;
@@ -1164,10 +1358,10 @@ bool HphpArray::update(StringData* key, CVarRef data) {
     return true;
   }
 
-  Elm* e = allocElm(ei);
+  Elm* e = allocElm(ei, h);
 
   e->h = h;
-  e->key = key;
+  e->key = StringInternTable::Intern(key);
   e->key->incRefCount();
 
   e->data.m_data.num = 0;
@@ -1460,6 +1654,9 @@ void HphpArray::erase(ElmInd* ei) {
 
   // Mark the hash entry as "deleted".
   *ei = ElmIndTombstone;
+  if (m_tagged) {
+    hashTags()[ei - m_hash] = TagTombstone;
+  }
 
   resize();
 
@@ -1557,11 +1754,24 @@ HphpArray* HphpArray::copyImpl() const {
   target->m_siPastEnd = false;
   size_t maxElms = computeMaxElms(m_lgTableSize);
   size_t tableSize = computeTableSize(m_lgTableSize);
+  if (m_nElms == 0) {
+    // Nothing to copy, so start over with the configured hash table layout.
+    // This matters for StaticEmptyHphpArray, which is constructed before
+    // runtime options are loaded.
+    target->m_tagged = RuntimeOption::UseTaggedHphpArray;
+    target->m_hLoad = 0;
+    target->reallocData(maxElms, tableSize);
+    Elm* targetElms = data2Elms(target->m_data);
+    target->m_hash = elms2Hash(targetElms, maxElms);
+    initHash(target->m_hash, tableSize, target->m_tagged);
+    return target;
+  }
+  target->m_tagged = m_tagged;
   target->reallocData(maxElms, tableSize);
   Elm* targetElms = data2Elms(target->m_data);
   target->m_hash = elms2Hash(targetElms, maxElms);
-  // Copy the hash.
-  memcpy(target->m_hash, m_hash, tableSize * sizeof(ElmInd));
+  // Copy the hash (and its tags).
+  memcpy(target->m_hash, m_hash, computeHashSize(m_lgTableSize, m_tagged));
   // Copy the elements and bump up refcounts as needed.
   if (m_nElms > 0) {
     Elm* elms = hash2Elms(m_hash, maxElms);
@@ -1835,7 +2045,7 @@ CVarRef HphpArray::endRef() {
 bool HphpArray::calculate(int& size) {
   size += sizeof(void*); // Pointer to aligned data (starts out NULL).
   size += computeMaxElms(m_lgTableSize) * sizeof(Elm); // Array elements.
-  size += computeTableSize(m_lgTableSize) * sizeof(ElmInd); // Hash table.
+  size += computeHashSize(m_lgTableSize, m_tagged); // Hash table and tags.
   size += ElmAlignment; // Padding to allow for alignment in restore().
   return true;
 }
@@ -1847,7 +2057,7 @@ void HphpArray::backup(LinearAllocator& allocator) {
   allocator.backup((const char*)elms,
                    computeMaxElms(m_lgTableSize) * sizeof(Elm));
   allocator.backup((const char*)m_hash,
-                   computeTableSize(m_lgTableSize) * sizeof(ElmInd));
+                   computeHashSize(m_lgTableSize, m_tagged));
   Elm pad;
   memset((void*)&pad, 0, sizeof(Elm));
   allocator.backup((const char*)&pad, sizeof(Elm));
@@ -1856,7 +2066,7 @@ void HphpArray::backup(LinearAllocator& allocator) {
 
 void HphpArray::restore(const char*& data) {
   size_t maxElms = computeMaxElms(m_lgTableSize);
-  size_t tableSize = computeTableSize(m_lgTableSize);
+  size_t hashSize = computeHashSize(m_lgTableSize, m_tagged);
   void** alignedData = (void**)data;
   data += sizeof(void*);
 
@@ -1865,8 +2075,7 @@ void HphpArray::restore(const char*& data) {
     if (m_data != data) {
       // Move data in order to guarantee proper alignment.  This only happens
       // (at most) the first time restore() is called for this linearized array.
-      memmove(m_data, data,
-              (maxElms * sizeof(Elm)) + (tableSize * sizeof(ElmInd)));
+      memmove(m_data, data, (maxElms * sizeof(Elm)) + hashSize);
     }
     *alignedData = m_data;
   } else {
@@ -1877,7 +2086,7 @@ void HphpArray::restore(const char*& data) {
   m_hash = elms2Hash(elms, maxElms);
 
   data += maxElms * sizeof(Elm);
-  data += tableSize * sizeof(ElmInd);
+  data += hashSize;
   data += ElmAlignment;
   m_linear = true;
   m_strongIterators.m_data = NULL;
@@ -1886,7 +2095,7 @@ void HphpArray::restore(const char*& data) {
 void HphpArray::sweep() {
   if (m_data != NULL) {
     if (!m_linear) {
-      free(m_data);
+      smart_free(m_data, computeDataSize(m_lgTableSize, m_tagged));
     }
     m_data = NULL;
   }
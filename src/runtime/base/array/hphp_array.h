@@ -164,8 +164,14 @@ private:
   //            +--------------------+
   // m_hash --> |                    | 2^m_lgTableSize hash table entries.
   //            +--------------------+
+  //            | hash tags?         | max(2^m_lgTableSize, 16) bytes, only if
+  //            +--------------------+ m_tagged.
   //            | alignment padding? |
   //            +--------------------+
+  //
+  // A tagged table keeps a 1-byte tag per hash table slot, derived from the
+  // hash of the key stored there, so lookups can filter a group of 16 slots
+  // with a single SIMD compare and only touch elements whose tag matches.
   void*   m_data;        // Contains elements and hash table.
   ElmInd* m_hash;        // Hash table.
   int64   m_nextKI;      // Next integer key to use for append.
@@ -175,9 +181,12 @@ private:
   ElmInd  m_lastE;       // Index of last used element.
   bool    m_linear;      // (true) ? m_data came from linear allocator.
   bool    m_siPastEnd;   // (true) ? strong iterators possibly past end.
+  bool    m_tagged;      // (true) ? hash table is followed by hash tags.
 
   void dumpDebugInfo() const;
 
+  uint8* hashTags() const;
+
   ElmInd nextElm(Elm* elms, ElmInd ei) const;
 
   ElmInd find(int64 ki) const;
@@ -198,8 +207,8 @@ private:
   void erase(ElmInd* ei);
   HphpArray* copyImpl() const;
 
-  Elm* allocElm(ElmInd* ei);
-  void reallocData(size_t maxElms, size_t tableSize);
+  Elm* allocElm(ElmInd* ei, int64 h);
+  void reallocData(size_t maxElms, size_t tableSize, size_t oldSize = 0);
   void delinearize();
   inline void resize();
   void grow();
@@ -0,0 +1,829 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/array/vector_array.h>
+#include <runtime/base/array/array_init.h>
+#include <runtime/base/array/zend_array.h>
+#include <runtime/base/array/hphp_array.h>
+#include <runtime/base/runtime_option.h>
+#include <runtime/base/runtime_error.h>
+#include <runtime/base/memory/memory_manager.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+IMPLEMENT_SMART_ALLOCATION(VectorArray, SmartAllocatorImpl::NeedRestoreOnce);
+
+StaticEmptyVectorArray StaticEmptyVectorArray::s_theEmptyArray;
+
+static inline void initElm(TypedValue *tv) {
+  tv->m_data.num = 0;
+  tv->_count = 0;
+  tv->m_type = KindOfNull;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// constructor/destructor
+
+VectorArray::VectorArray(uint nSize /* = 0 */)
+  : m_elems(NULL), m_size(0), m_capacity(0), m_linear(false),
+    m_siPastEnd(false) {
+  if (nSize) {
+    reallocElems(nSize);
+  }
+  m_pos = ArrayData::invalid_index;
+}
+
+VectorArray::~VectorArray() {
+  for (uint32 i = 0; i < m_size; i++) {
+    TypedValue *tv = &m_elems[i];
+    if (IS_REFCOUNTED_TYPE(tv->m_type)) {
+      tvDecRef(tv);
+    }
+  }
+  if (m_elems && !m_linear) {
+    smart_free(m_elems, m_capacity * sizeof(TypedValue));
+  }
+}
+
+void VectorArray::reallocElems(uint32 capacity) {
+  ASSERT(capacity >= m_size);
+  if (m_linear) {
+    TypedValue *elems =
+      (TypedValue *)smart_malloc(capacity * sizeof(TypedValue));
+    memcpy(elems, m_elems, m_size * sizeof(TypedValue));
+    m_elems = elems;
+    m_linear = false;
+  } else {
+    m_elems = (TypedValue *)smart_realloc(m_elems,
+                                          m_capacity * sizeof(TypedValue),
+                                          capacity * sizeof(TypedValue));
+  }
+  m_capacity = capacity;
+}
+
+ArrayData *VectorArray::escalateToHashArray() const {
+  ArrayData *ret;
+  if (RuntimeOption::UseHphpArray) {
+    ret = NEW(HphpArray)(m_size);
+  } else {
+    ret = NEW(ZendArray)(m_size);
+  }
+  for (uint32 i = 0; i < m_size; i++) {
+    CVarRef v = tvAsCVarRef(&m_elems[i]);
+    if (v.isReferenced()) v.setContagious();
+    ret->add((int64)i, v, false);
+  }
+  // Set m_pos in the escalated array
+  if (m_pos != ArrayData::invalid_index) {
+    ret->setPosition(ret->getIndex((int64)m_pos));
+  } else {
+    // each array kind has its own idea of "past the end"
+    ret->end();
+    ret->next();
+  }
+  return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// iterations
+
+ssize_t VectorArray::iter_begin() const {
+  return m_size ? 0 : ArrayData::invalid_index;
+}
+
+ssize_t VectorArray::iter_end() const {
+  return m_size ? (ssize_t)m_size - 1 : ArrayData::invalid_index;
+}
+
+ssize_t VectorArray::iter_advance(ssize_t prev) const {
+  if (prev == ArrayData::invalid_index) {
+    return ArrayData::invalid_index;
+  }
+  ssize_t next = prev + 1;
+  return next < (ssize_t)m_size ? next : ArrayData::invalid_index;
+}
+
+ssize_t VectorArray::iter_rewind(ssize_t prev) const {
+  if (prev <= 0) {
+    return ArrayData::invalid_index;
+  }
+  return prev - 1;
+}
+
+Variant VectorArray::getKey(ssize_t pos) const {
+  ASSERT(pos >= 0 && pos < (ssize_t)m_size);
+  return (int64)pos;
+}
+
+Variant VectorArray::getValue(ssize_t pos) const {
+  ASSERT(pos >= 0 && pos < (ssize_t)m_size);
+  return tvAsCVarRef(&m_elems[pos]);
+}
+
+void VectorArray::fetchValue(ssize_t pos, Variant &v) const {
+  ASSERT(pos >= 0 && pos < (ssize_t)m_size);
+  v = tvAsCVarRef(&m_elems[pos]);
+}
+
+CVarRef VectorArray::getValueRef(ssize_t pos) const {
+  ASSERT(pos >= 0 && pos < (ssize_t)m_size);
+  return tvAsCVarRef(&m_elems[pos]);
+}
+
+Variant VectorArray::reset() {
+  if (m_size > 0) {
+    m_pos = 0;
+    return tvAsCVarRef(&m_elems[0]);
+  }
+  m_pos = ArrayData::invalid_index;
+  return false;
+}
+
+Variant VectorArray::prev() {
+  if (m_pos != ArrayData::invalid_index) {
+    m_pos = iter_rewind(m_pos);
+    if (m_pos != ArrayData::invalid_index) {
+      return tvAsCVarRef(&m_elems[m_pos]);
+    }
+  }
+  return false;
+}
+
+Variant VectorArray::next() {
+  if (m_pos != ArrayData::invalid_index) {
+    m_pos = iter_advance(m_pos);
+    if (m_pos != ArrayData::invalid_index) {
+      return tvAsCVarRef(&m_elems[m_pos]);
+    }
+  }
+  return false;
+}
+
+Variant VectorArray::end() {
+  if (m_size > 0) {
+    m_pos = m_size - 1;
+    return tvAsCVarRef(&m_elems[m_pos]);
+  }
+  m_pos = ArrayData::invalid_index;
+  return false;
+}
+
+Variant VectorArray::key() const {
+  if (m_pos != ArrayData::invalid_index) {
+    ASSERT(m_pos < (ssize_t)m_size);
+    return (int64)m_pos;
+  }
+  return null;
+}
+
+Variant VectorArray::value(ssize_t &pos) const {
+  if (pos != ArrayData::invalid_index) {
+    ASSERT(pos < (ssize_t)m_size);
+    return tvAsCVarRef(&m_elems[pos]);
+  }
+  return false;
+}
+
+Variant VectorArray::current() const {
+  if (m_pos != ArrayData::invalid_index) {
+    ASSERT(m_pos < (ssize_t)m_size);
+    return tvAsCVarRef(&m_elems[m_pos]);
+  }
+  return false;
+}
+
+static StaticString s_value("value");
+static StaticString s_key("key");
+
+Variant VectorArray::each() {
+  if (m_pos != ArrayData::invalid_index) {
+    ArrayInit init(4, false);
+    Variant key = (int64)m_pos;
+    Variant value = getValue(m_pos);
+    init.set(int64(1), value);
+    init.set(s_value, value, true);
+    init.set(int64(0), key);
+    init.set(s_key, key, true);
+    m_pos = iter_advance(m_pos);
+    return Array(init.create());
+  }
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// lookups
+
+bool VectorArray::exists(int64 k) const {
+  return inRange(k);
+}
+
+bool VectorArray::exists(litstr k) const {
+  return false;
+}
+
+bool VectorArray::exists(CStrRef k) const {
+  return false;
+}
+
+bool VectorArray::exists(CVarRef k) const {
+  if (k.isNumeric()) {
+    return inRange(k.toInt64());
+  }
+  return false;
+}
+
+bool VectorArray::idxExists(ssize_t idx) const {
+  return (idx != ArrayData::invalid_index);
+}
+
+Variant VectorArray::get(int64 k, bool error /* = false */) const {
+  if (inRange(k)) {
+    return tvAsCVarRef(&m_elems[k]);
+  }
+  if (error) {
+    raise_notice("Undefined index: %lld", k);
+  }
+  return null;
+}
+
+Variant VectorArray::get(litstr k, bool error /* = false */) const {
+  if (error) {
+    raise_notice("Undefined index: %s", k);
+  }
+  return null;
+}
+
+Variant VectorArray::get(CStrRef k, bool error /* = false */) const {
+  if (error) {
+    raise_notice("Undefined index: %s", k.data());
+  }
+  return null;
+}
+
+Variant VectorArray::get(CVarRef k, bool error /* = false */) const {
+  if (k.isNumeric()) {
+    return get(k.toInt64(), error);
+  }
+  if (error) {
+    raise_notice("Undefined index: %s", k.toString().data());
+  }
+  return null;
+}
+
+void VectorArray::load(CVarRef k, Variant &v) const {
+  if (k.isNumeric()) {
+    int64 ki = k.toInt64();
+    if (inRange(ki)) {
+      CVarRef elm = tvAsCVarRef(&m_elems[ki]);
+      if (elm.isReferenced()) {
+        v = ref(elm);
+      } else {
+        v = elm;
+      }
+    }
+  }
+}
+
+ssize_t VectorArray::getIndex(int64 k) const {
+  return inRange(k) ? (ssize_t)k : ArrayData::invalid_index;
+}
+
+ssize_t VectorArray::getIndex(litstr k) const {
+  return ArrayData::invalid_index;
+}
+
+ssize_t VectorArray::getIndex(CStrRef k) const {
+  return ArrayData::invalid_index;
+}
+
+ssize_t VectorArray::getIndex(CVarRef k) const {
+  if (k.isNumeric()) {
+    return getIndex(k.toInt64());
+  }
+  return ArrayData::invalid_index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// append/insert/update
+
+TypedValue *VectorArray::allocElm() {
+  if (m_size == m_capacity) {
+    uint32 capacity = m_capacity ? m_capacity : MinCapacity;
+    while (capacity <= m_size) {
+      capacity <<= 1;
+    }
+    reallocElems(capacity);
+  } else if (m_linear) {
+    delinearize();
+  }
+  uint32 pos = m_size++;
+  TypedValue *tv = &m_elems[pos];
+  initElm(tv);
+  if (m_pos == ArrayData::invalid_index) {
+    m_pos = pos;
+  }
+  // If there could be any strong iterators that are past the end, we need to
+  // do a pass and update these iterators to point to the newly added element.
+  if (m_siPastEnd) {
+    m_siPastEnd = false;
+    int sz = m_strongIterators.size();
+    bool shouldWarn = false;
+    for (int i = 0; i < sz; ++i) {
+      if (m_strongIterators[i]->primary == ArrayData::invalid_index) {
+        m_strongIterators[i]->primary = pos;
+        shouldWarn = true;
+      }
+    }
+    if (shouldWarn) {
+      raise_warning("An element was added to an array while a foreach by"
+                    " reference loop was iterating over the last element of the"
+                    " array. This may lead to unexpeced results.");
+    }
+  }
+  return tv;
+}
+
+void VectorArray::nextInsert(CVarRef v) {
+  tvAsVariant(allocElm()) = v;
+}
+
+Variant *VectorArray::nextLval() {
+  return &tvAsVariant(allocElm());
+}
+
+ArrayData *VectorArray::lval(Variant *&ret, bool copy) {
+  ASSERT(m_size > 0);
+  if (copy) {
+    VectorArray *a = copyImpl();
+    ret = &tvAsVariant(&a->m_elems[m_size - 1]);
+    return a;
+  }
+  if (m_linear) {
+    delinearize();
+  }
+  ret = &tvAsVariant(&m_elems[m_size - 1]);
+  return NULL;
+}
+
+ArrayData *VectorArray::lval(int64 k, Variant *&ret, bool copy,
+                             bool checkExist /* = false */) {
+  if (inRange(k)) {
+    if (copy && !checkExist) {
+      VectorArray *a = copyImpl();
+      ret = &tvAsVariant(&a->m_elems[k]);
+      return a;
+    }
+    if (!copy && m_linear) {
+      delinearize();
+    }
+    ret = &tvAsVariant(&m_elems[k]);
+    return NULL;
+  }
+  if (k == (int64)m_size) {
+    if (copy) {
+      VectorArray *a = copyImpl();
+      ret = a->nextLval();
+      return a;
+    }
+    ret = nextLval();
+    return NULL;
+  }
+  ArrayData *a = escalateToHashArray();
+  a->lval(k, ret, false, checkExist);
+  return a;
+}
+
+ArrayData *VectorArray::lval(litstr k, Variant *&ret, bool copy,
+                             bool checkExist /* = false */) {
+  ArrayData *a = escalateToHashArray();
+  a->lval(k, ret, false, checkExist);
+  return a;
+}
+
+ArrayData *VectorArray::lval(CStrRef k, Variant *&ret, bool copy,
+                             bool checkExist /* = false */) {
+  ArrayData *a = escalateToHashArray();
+  a->lval(k, ret, false, checkExist);
+  return a;
+}
+
+ArrayData *VectorArray::lval(CVarRef k, Variant *&ret, bool copy,
+                             bool checkExist /* = false */) {
+  if (k.isNumeric()) {
+    return lval(k.toInt64(), ret, copy, checkExist);
+  }
+  return lval(k.toString(), ret, copy, checkExist);
+}
+
+ArrayData *VectorArray::lvalPtr(CStrRef k, Variant *&ret, bool copy,
+                                bool create) {
+  if (create) {
+    ArrayData *a = escalateToHashArray();
+    a->lvalPtr(k, ret, false, create);
+    return a;
+  }
+  // string keys are never there
+  ret = NULL;
+  return NULL;
+}
+
+ArrayData *VectorArray::set(int64 k, CVarRef v, bool copy) {
+  if (inRange(k)) {
+    if (copy) {
+      VectorArray *a = copyImpl();
+      tvAsVariant(&a->m_elems[k]) = v;
+      return a;
+    }
+    if (m_linear) {
+      delinearize();
+    }
+    tvAsVariant(&m_elems[k]) = v;
+    return NULL;
+  }
+  if (k == (int64)m_size) {
+    return append(v, copy);
+  }
+  ArrayData *a = escalateToHashArray();
+  a->set(k, v, false);
+  return a;
+}
+
+ArrayData *VectorArray::set(litstr k, CVarRef v, bool copy) {
+  ArrayData *a = escalateToHashArray();
+  a->set(k, v, false);
+  return a;
+}
+
+ArrayData *VectorArray::set(CStrRef k, CVarRef v, bool copy) {
+  ArrayData *a = escalateToHashArray();
+  a->set(k, v, false);
+  return a;
+}
+
+ArrayData *VectorArray::set(CVarRef k, CVarRef v, bool copy) {
+  if (k.isNumeric()) {
+    return set(k.toInt64(), v, copy);
+  }
+  return set(k.toString(), v, copy);
+}
+
+ArrayData *VectorArray::add(int64 k, CVarRef v, bool copy) {
+  ASSERT(!exists(k));
+  if (k == (int64)m_size) {
+    return append(v, copy);
+  }
+  ArrayData *a = escalateToHashArray();
+  a->add(k, v, false);
+  return a;
+}
+
+ArrayData *VectorArray::add(CStrRef k, CVarRef v, bool copy) {
+  ArrayData *a = escalateToHashArray();
+  a->add(k, v, false);
+  return a;
+}
+
+ArrayData *VectorArray::add(CVarRef k, CVarRef v, bool copy) {
+  if (k.isNumeric()) {
+    return add(k.toInt64(), v, copy);
+  }
+  return add(k.toString(), v, copy);
+}
+
+ArrayData *VectorArray::addLval(int64 k, Variant *&ret, bool copy) {
+  ASSERT(!exists(k));
+  if (k == (int64)m_size) {
+    if (copy) {
+      VectorArray *a = copyImpl();
+      ret = a->nextLval();
+      return a;
+    }
+    ret = nextLval();
+    return NULL;
+  }
+  ArrayData *a = escalateToHashArray();
+  a->addLval(k, ret, false);
+  return a;
+}
+
+ArrayData *VectorArray::addLval(CStrRef k, Variant *&ret, bool copy) {
+  ArrayData *a = escalateToHashArray();
+  a->addLval(k, ret, false);
+  return a;
+}
+
+ArrayData *VectorArray::addLval(CVarRef k, Variant *&ret, bool copy) {
+  if (k.isNumeric()) {
+    return addLval(k.toInt64(), ret, copy);
+  }
+  return addLval(k.toString(), ret, copy);
+}
+
+ArrayData *VectorArray::copy() const {
+  return copyImpl();
+}
+
+VectorArray *VectorArray::copyImpl() const {
+  VectorArray *a = NEW(VectorArray)(m_capacity);
+  for (uint32 i = 0; i < m_size; i++) {
+    CVarRef v = tvAsCVarRef(&m_elems[i]);
+    if (v.isReferenced()) v.setContagious();
+    TypedValue *tv = &a->m_elems[i];
+    initElm(tv);
+    tvAsVariant(tv) = v;
+  }
+  a->m_size = m_size;
+  a->m_pos = m_pos;
+  return a;
+}
+
+ArrayData *VectorArray::append(CVarRef v, bool copy) {
+  if (copy) {
+    VectorArray *a = copyImpl();
+    a->nextInsert(v);
+    return a;
+  }
+  nextInsert(v);
+  return NULL;
+}
+
+ArrayData *VectorArray::append(const ArrayData *elems, ArrayOp op, bool copy) {
+  if (copy) {
+    VectorArray *a = copyImpl();
+    ArrayData *escalated = a->append(elems, op, false);
+    if (escalated) {
+      a->release();
+      return escalated;
+    }
+    return a;
+  }
+
+  if (op == Plus) {
+    // Only keys 0..n-1 can be added to a vector. Anything else goes to the
+    // hashed array, which skips the keys that are already there, so it is
+    // fine to hand over in the middle of the loop.
+    for (ArrayIter it(elems); !it.end(); it.next()) {
+      Variant key = it.first();
+      if (key.isNumeric()) {
+        int64 k = key.toInt64();
+        if (inRange(k)) continue;
+        if (k == (int64)m_size) {
+          if (elems->supportValueRef()) {
+            CVarRef value = it.secondRef();
+            if (value.isReferenced()) value.setContagious();
+            nextInsert(value);
+          } else {
+            nextInsert(it.second());
+          }
+          continue;
+        }
+      }
+      ArrayData *a = escalateToHashArray();
+      a->append(elems, op, false);
+      return a;
+    }
+    return NULL;
+  }
+
+  ASSERT(op == Merge);
+  if (!elems->isVectorData()) {
+    ArrayData *a = escalateToHashArray();
+    a->append(elems, op, false);
+    return a;
+  }
+  if (m_size + elems->size() > m_capacity) {
+    reallocElems(m_size + elems->size());
+  }
+  if (elems->supportValueRef()) {
+    for (ArrayIter it(elems); !it.end(); it.next()) {
+      CVarRef value = it.secondRef();
+      if (value.isReferenced()) value.setContagious();
+      nextInsert(value);
+    }
+  } else {
+    for (ArrayIter it(elems); !it.end(); it.next()) {
+      nextInsert(it.second());
+    }
+  }
+  return NULL;
+}
+
+ArrayData *VectorArray::prepend(CVarRef v, bool copy) {
+  if (copy) {
+    VectorArray *a = copyImpl();
+    a->prepend(v, false);
+    return a;
+  }
+  // To match PHP-like semantics, we invalidate all strong iterators when an
+  // element is added to the beginning of the array.
+  if (!m_strongIterators.empty()) {
+    freeStrongIterators();
+  }
+  // Make room at the end first, then shift everything up by one. Keys are
+  // positions, so this is all the renumbering there is to do.
+  allocElm();
+  memmove(&m_elems[1], &m_elems[0], (m_size - 1) * sizeof(TypedValue));
+  initElm(&m_elems[0]);
+  tvAsVariant(&m_elems[0]) = v;
+  // To match PHP-like semantics, the prepend operation resets the array's
+  // internal iterator.
+  m_pos = 0;
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// delete
+
+ArrayData *VectorArray::remove(int64 k, bool copy) {
+  if (!inRange(k)) return NULL;
+  // Even removing the last element escalates: the next append has to use
+  // key n, not n-1.
+  ArrayData *a = escalateToHashArray();
+  a->remove(k, false);
+  return a;
+}
+
+ArrayData *VectorArray::remove(litstr k, bool copy) {
+  return NULL;
+}
+
+ArrayData *VectorArray::remove(CStrRef k, bool copy) {
+  return NULL;
+}
+
+ArrayData *VectorArray::remove(CVarRef k, bool copy) {
+  if (k.isNumeric()) {
+    return remove(k.toInt64(), copy);
+  }
+  return NULL;
+}
+
+ArrayData *VectorArray::pop(Variant &value) {
+  if (getCount() > 1) {
+    VectorArray *a = copyImpl();
+    a->pop(value);
+    return a;
+  }
+  if (m_size > 0) {
+    if (m_linear) {
+      delinearize();
+    }
+    uint32 pos = m_size - 1;
+    bool nextElementUnsetInsideForeachByReference = false;
+    int nsi = m_strongIterators.size();
+    for (int i = 0; i < nsi; ++i) {
+      if (m_strongIterators[i]->primary == (ssize_t)pos) {
+        nextElementUnsetInsideForeachByReference = true;
+        m_strongIterators[i]->primary = ArrayData::invalid_index;
+        m_siPastEnd = true;
+      }
+    }
+    // Detach the element before releasing it, in case a destructor looks at
+    // this array.
+    TypedValue tv = m_elems[pos];
+    m_size = pos;
+    value = tvAsCVarRef(&tv);
+    if (IS_REFCOUNTED_TYPE(tv.m_type)) {
+      tvDecRef(&tv);
+    }
+    if (nextElementUnsetInsideForeachByReference) {
+      if (RuntimeOption::EnableHipHopErrors) {
+        raise_error("Cannot unset the next element inside foreach by "
+                    "reference");
+      }
+    }
+  } else {
+    value = null;
+  }
+  // To match PHP-like semantics, the pop operation resets the array's
+  // internal iterator.
+  m_pos = iter_begin();
+  return NULL;
+}
+
+ArrayData *VectorArray::dequeue(Variant &value) {
+  if (getCount() > 1) {
+    VectorArray *a = copyImpl();
+    a->dequeue(value);
+    return a;
+  }
+  // To match PHP-like semantics, we invalidate all strong iterators when an
+  // element is removed from the beginning of the array.
+  if (!m_strongIterators.empty()) {
+    freeStrongIterators();
+  }
+  if (m_size > 0) {
+    if (m_linear) {
+      delinearize();
+    }
+    TypedValue tv = m_elems[0];
+    --m_size;
+    memmove(&m_elems[0], &m_elems[1], m_size * sizeof(TypedValue));
+    value = tvAsCVarRef(&tv);
+    if (IS_REFCOUNTED_TYPE(tv.m_type)) {
+      tvDecRef(&tv);
+    }
+  } else {
+    value = null;
+  }
+  // To match PHP-like semantics, the dequeue operation resets the array's
+  // internal iterator.
+  m_pos = iter_begin();
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// misc
+
+void VectorArray::onSetStatic() {
+  for (uint32 i = 0; i < m_size; i++) {
+    tvAsVariant(&m_elems[i]).setStatic();
+  }
+}
+
+void VectorArray::getFullPos(FullPos &pos) {
+  ASSERT(pos.container == (ArrayData *)this);
+  pos.primary = m_pos;
+  if (pos.primary == ArrayData::invalid_index) {
+    // Record that there is a strong iterator out there that is past the end.
+    m_siPastEnd = true;
+  }
+}
+
+bool VectorArray::setFullPos(const FullPos &pos) {
+  ASSERT(pos.container == (ArrayData *)this);
+  if (pos.primary != ArrayData::invalid_index) {
+    m_pos = pos.primary;
+    return true;
+  }
+  return false;
+}
+
+CVarRef VectorArray::currentRef() {
+  ASSERT(m_pos >= 0 && m_pos < (ssize_t)m_size);
+  if (m_linear) {
+    delinearize();
+  }
+  return tvAsCVarRef(&m_elems[m_pos]);
+}
+
+CVarRef VectorArray::endRef() {
+  ASSERT(m_size > 0);
+  if (m_linear) {
+    delinearize();
+  }
+  return tvAsCVarRef(&m_elems[m_size - 1]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// memory allocator methods.
+
+bool VectorArray::calculate(int &size) {
+  size += m_size * sizeof(TypedValue);
+  return true;
+}
+
+void VectorArray::backup(LinearAllocator &allocator) {
+  if (m_size) {
+    allocator.backup((const char *)m_elems, m_size * sizeof(TypedValue));
+  }
+  ASSERT(m_strongIterators.empty());
+}
+
+void VectorArray::restore(const char *&data) {
+  if (m_size) {
+    m_elems = (TypedValue *)data;
+    data += m_size * sizeof(TypedValue);
+    m_linear = true;
+  } else {
+    m_elems = NULL;
+    m_linear = false;
+  }
+  m_capacity = m_size;
+  m_strongIterators.m_data = NULL;
+}
+
+void VectorArray::sweep() {
+  if (m_elems && !m_linear) {
+    smart_free(m_elems, m_capacity * sizeof(TypedValue));
+  }
+  m_elems = NULL;
+  m_strongIterators.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,172 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_VECTOR_ARRAY_H__
+#define __HPHP_VECTOR_ARRAY_H__
+
+#include <runtime/base/types.h>
+#include <runtime/base/array/array_data.h>
+#include <runtime/base/memory/smart_allocator.h>
+#include <runtime/base/complex_types.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A packed array for lists: keys are always 0..n-1 in order, so there are no
+ * keys or hash table to store, only a contiguous vector of TypedValues, and an
+ * element's position is its key.
+ *
+ * Appends, pops, prepends and dequeues keep an array packed. Any other write
+ * that would break the 0..n-1 shape, like a string key, an integer key past
+ * the end or an unset, escalates to a hashed array first, the same way
+ * SmallArray escalates when it runs out of buckets.
+ */
+class VectorArray : public ArrayData {
+public:
+  static const uint32 MinCapacity = 4;
+
+  VectorArray(uint nSize = 0);
+  virtual ~VectorArray();
+
+  virtual ssize_t size() const { return m_size; }
+
+  virtual Variant getKey(ssize_t pos) const;
+  virtual Variant getValue(ssize_t pos) const;
+  virtual void fetchValue(ssize_t pos, Variant &v) const;
+  virtual CVarRef getValueRef(ssize_t pos) const;
+  virtual bool isVectorData() const { return true; }
+  virtual bool supportValueRef() const { return true; }
+
+  virtual ssize_t iter_begin() const;
+  virtual ssize_t iter_end() const;
+  virtual ssize_t iter_advance(ssize_t prev) const;
+  virtual ssize_t iter_rewind(ssize_t prev) const;
+
+  virtual Variant reset();
+  virtual Variant prev();
+  virtual Variant current() const;
+  virtual Variant next();
+  virtual Variant end();
+  virtual Variant key() const;
+  virtual Variant value(ssize_t &pos) const;
+  virtual Variant each();
+
+  virtual bool exists(int64   k) const;
+  virtual bool exists(litstr  k) const;
+  virtual bool exists(CStrRef k) const;
+  virtual bool exists(CVarRef k) const;
+
+  virtual bool idxExists(ssize_t idx) const;
+
+  virtual Variant get(int64   k, bool error = false) const;
+  virtual Variant get(litstr  k, bool error = false) const;
+  virtual Variant get(CStrRef k, bool error = false) const;
+  virtual Variant get(CVarRef k, bool error = false) const;
+
+  virtual void load(CVarRef k, Variant &v) const;
+
+  virtual ssize_t getIndex(int64 k) const;
+  virtual ssize_t getIndex(litstr k) const;
+  virtual ssize_t getIndex(CStrRef k) const;
+  virtual ssize_t getIndex(CVarRef k) const;
+
+  virtual ArrayData *lval(Variant *&ret, bool copy);
+  virtual ArrayData *lval(int64   k, Variant *&ret, bool copy,
+                          bool checkExist = false);
+  virtual ArrayData *lval(litstr  k, Variant *&ret, bool copy,
+                          bool checkExist = false);
+  virtual ArrayData *lval(CStrRef k, Variant *&ret, bool copy,
+                          bool checkExist = false);
+  virtual ArrayData *lval(CVarRef k, Variant *&ret, bool copy,
+                          bool checkExist = false);
+  virtual ArrayData *lvalPtr(CStrRef k, Variant *&ret, bool copy,
+                             bool create);
+
+  virtual ArrayData *set(int64   k, CVarRef v, bool copy);
+  virtual ArrayData *set(litstr  k, CVarRef v, bool copy);
+  virtual ArrayData *set(CStrRef k, CVarRef v, bool copy);
+  virtual ArrayData *set(CVarRef k, CVarRef v, bool copy);
+
+  virtual ArrayData *add(int64   k, CVarRef v, bool copy);
+  virtual ArrayData *add(CStrRef k, CVarRef v, bool copy);
+  virtual ArrayData *add(CVarRef k, CVarRef v, bool copy);
+  virtual ArrayData *addLval(int64   k, Variant *&ret, bool copy);
+  virtual ArrayData *addLval(CStrRef k, Variant *&ret, bool copy);
+  virtual ArrayData *addLval(CVarRef k, Variant *&ret, bool copy);
+
+  virtual ArrayData *remove(int64   k, bool copy);
+  virtual ArrayData *remove(litstr  k, bool copy);
+  virtual ArrayData *remove(CStrRef k, bool copy);
+  virtual ArrayData *remove(CVarRef k, bool copy);
+
+  virtual ArrayData *copy() const;
+  virtual ArrayData *append(CVarRef v, bool copy);
+  virtual ArrayData *append(const ArrayData *elems, ArrayOp op, bool copy);
+  virtual ArrayData *pop(Variant &value);
+  virtual ArrayData *dequeue(Variant &value);
+  virtual ArrayData *prepend(CVarRef v, bool copy);
+  virtual void onSetStatic();
+
+  virtual void getFullPos(FullPos &pos);
+  virtual bool setFullPos(const FullPos &pos);
+  virtual CVarRef currentRef();
+  virtual CVarRef endRef();
+
+private:
+  TypedValue *m_elems;     // m_size values followed by unused capacity
+  uint32      m_size;
+  uint32      m_capacity;
+  bool        m_linear;    // (true) ? m_elems came from linear allocator
+  bool        m_siPastEnd; // (true) ? strong iterators possibly past end
+
+  bool inRange(int64 k) const { return (uint64)k < (uint64)m_size; }
+
+  ArrayData *escalateToHashArray() const;
+
+  VectorArray *copyImpl() const;
+  void reallocElems(uint32 capacity);
+  void delinearize() { reallocElems(m_capacity); }
+
+  TypedValue *allocElm();
+  void nextInsert(CVarRef v);
+  Variant *nextLval();
+
+  // Memory allocator methods.
+  DECLARE_SMART_ALLOCATION(VectorArray, SmartAllocatorImpl::NeedRestoreOnce);
+  bool calculate(int &size);
+  void backup(LinearAllocator &allocator);
+  void restore(const char *&data);
+  void sweep();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Vector empty arrays
+
+class StaticEmptyVectorArray : public VectorArray {
+public:
+  StaticEmptyVectorArray() { setStatic(); }
+
+  static VectorArray *Get() { return &s_theEmptyArray; }
+
+private:
+  static StaticEmptyVectorArray s_theEmptyArray;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_VECTOR_ARRAY_H__
@@ -57,10 +57,10 @@ bool MemFile::open(CStrRef filename, CStrRef mode) {
   int len = -1;
   bool compressed = false;
   char *data =
-    StaticContentCache::TheFileCache->read(filename.c_str(), len, compressed);
+    StaticContentCache::TheFileCache->read(filename.c_str(), len, compressed,
+                                           m_pin);
   if (len != -1) {
     if (compressed) {
-      ASSERT(RuntimeOption::EnableOnDemandUncompress);
       data = gzdecode(data, len);
       if (data == NULL) {
         throw FatalErrorException("cannot unzip compressed data");
@@ -88,6 +88,7 @@ bool MemFile::closeImpl() {
     free(m_data);
     m_data = NULL;
   }
+  m_pin.reset();
   File::closeImpl();
   return true;
 }
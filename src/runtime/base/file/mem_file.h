@@ -19,6 +19,7 @@
 
 #include <runtime/base/file/file.h>
 #include <runtime/base/complex_types.h>
+#include <util/file_cache.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -58,6 +59,7 @@ protected:
   int64 m_len;        // length of the memory file
   int64 m_cursor;     // m_data's read position
   bool m_malloced;    // whether to free m_data on delete
+  FileCache::Pin m_pin; // keeps m_data alive if it's from a file cache block
 
   bool closeImpl();
 };
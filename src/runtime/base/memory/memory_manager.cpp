@@ -34,6 +34,7 @@ MemoryManager::MemoryManager() : m_enabled(false), m_checkpoint(false) {
   }
   resetStats();
   m_stats.maxBytes = 0;
+  m_sizeClassAllocator.registerStats(&m_stats);
 }
 
 void MemoryManager::resetStats() {
@@ -79,6 +80,10 @@ void MemoryManager::protectUnsafePointers() {
   }
 }
 
+void MemoryManager::baseline() {
+  m_sizeClassAllocator.baseline();
+}
+
 void MemoryManager::checkpoint() {
   ASSERT(!m_checkpoint);
   m_checkpoint = true;
@@ -95,10 +100,12 @@ void MemoryManager::checkpoint() {
     m_smartAllocators[i]->backupObjects(m_linearAllocator);
   }
   m_linearAllocator.endBackup();
+  m_sizeClassAllocator.checkpoint();
 }
 
 void MemoryManager::sweepAll() {
   Sweepable::SweepAll();
+  m_sizeClassAllocator.sweep();
 }
 
 void MemoryManager::rollback() {
@@ -107,6 +114,10 @@ void MemoryManager::rollback() {
     m_smartAllocators[i]->rollbackObjects(m_linearAllocator);
   }
   m_linearAllocator.endRestore();
+
+  // Rolling back objects above has swept or linearized everything that was
+  // still holding on to smart_malloc-ed memory, so the slabs can go in bulk.
+  m_sizeClassAllocator.rollback();
   protectUnsafePointers();
 }
 
@@ -123,6 +134,7 @@ void MemoryManager::logStats() {
   for (unsigned int i = 0; i < m_smartAllocators.size(); i++) {
     m_smartAllocators[i]->logStats();
   }
+  m_sizeClassAllocator.logStats();
   LeakDetectable::LogMallocStats();
 }
 
@@ -137,6 +149,7 @@ void MemoryManager::checkMemory(bool detailed) {
   for (unsigned int i = 0; i < m_smartAllocators.size(); i++) {
     m_smartAllocators[i]->checkMemory(detailed);
   }
+  m_sizeClassAllocator.checkMemory(detailed);
   m_linearAllocator.checkMemory(detailed);
   printf("Unsafe pointers: %d\n", (int)m_unsafePointers.size());
 }
@@ -19,6 +19,7 @@
 
 #include <runtime/base/memory/smart_allocator.h>
 #include <runtime/base/memory/linear_allocator.h>
+#include <runtime/base/memory/size_class_allocator.h>
 #include <runtime/base/memory/unsafe_pointer.h>
 
 namespace HPHP {
@@ -32,7 +33,8 @@ namespace HPHP {
  *     exactly the same size.
  *  2. Interally malloc-ed and variable sized memory held by fixed size
  *     objects, for example, StringData's m_data. These memory can be backed up
- *     and restored by LinearAllocator.
+ *     and restored by LinearAllocator. Most of it comes from the thread's
+ *     SizeClassAllocator through smart_malloc() and friends.
  *  3. Unsafe pointers held by fixed size objects, for example, ObjectData*
  *     held by Object. These pointers point to some external memory that's out
  *     of the control of MemoryManager, and therefore they are only interfaced
@@ -68,6 +70,19 @@ public:
    */
   void remove(UnsafePointer *p);
 
+  /**
+   * Variable sized memory held by fixed size objects. See smart_malloc().
+   */
+  void *smartMalloc(size_t nbytes) {
+    return m_sizeClassAllocator.alloc(nbytes);
+  }
+  void *smartRealloc(void *p, size_t oldBytes, size_t newBytes) {
+    return m_sizeClassAllocator.realloc(p, oldBytes, newBytes);
+  }
+  void smartFree(void *p, size_t nbytes) {
+    m_sizeClassAllocator.dealloc(p, nbytes);
+  }
+
   /**
    * Whether a checkpoint has been taken.
    */
@@ -78,6 +93,12 @@ public:
     return m_enabled && m_checkpoint;
   }
 
+  /**
+   * Mark what is allocated so far as living as long as the process does.
+   * Without a checkpoint, sweepAll() never goes further back than this.
+   */
+  void baseline();
+
   /**
    * Mark current allocator's position as starting point of a new generation.
    */
@@ -134,11 +155,34 @@ private:
 
   std::vector<SmartAllocatorImpl*> m_smartAllocators;
   LinearAllocator m_linearAllocator;
+  SizeClassAllocator m_sizeClassAllocator;
   std::set<UnsafePointer*> m_unsafePointers;
 
   MemoryUsageStats m_stats;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Request memory that doesn't fit a SmartAllocator, like string and array
+ * bodies. Callers remember the size they asked for and hand it back when
+ * freeing. Small sizes come out of thread-local slabs, so only free memory
+ * from the same thread that allocated it, and never hand it to code that
+ * calls free() on it.
+ */
+inline void *smart_malloc(size_t nbytes) {
+  return MemoryManager::TheMemoryManager()->smartMalloc(nbytes);
+}
+
+inline void *smart_realloc(void *p, size_t oldBytes, size_t newBytes) {
+  return MemoryManager::TheMemoryManager()->smartRealloc(p, oldBytes,
+                                                         newBytes);
+}
+
+inline void smart_free(void *p, size_t nbytes) {
+  MemoryManager::TheMemoryManager()->smartFree(p, nbytes);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
 
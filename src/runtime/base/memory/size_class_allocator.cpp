@@ -0,0 +1,175 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/memory/size_class_allocator.h>
+#include <runtime/base/server/server_stats.h>
+
+using namespace std;
+using namespace boost;
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+const size_t SizeClassAllocator::s_classSizes[NumSizeClasses] = {
+    16,   32,   48,   64,   80,   96,  112,  128,
+   160,  192,  224,  256,
+   320,  384,  448,  512,
+   640,  768,  896, 1024,
+  1280, 1536, 1792, 2048,
+  2560, 3072, 3584, 4096,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// constructor and destructor
+
+SizeClassAllocator::SizeClassAllocator()
+  : m_front(NULL), m_limit(NULL), m_checkpointed(false), m_stats(NULL) {
+  memset(m_freelists, 0, sizeof(m_freelists));
+}
+
+SizeClassAllocator::~SizeClassAllocator() {
+  for (unsigned int i = 0; i < m_slabs.size(); i++) {
+    free(m_slabs[i]);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// allocation
+
+void SizeClassAllocator::newSlab() {
+  char *slab = (char *)Util::safe_malloc(SLAB_SIZE);
+  m_slabs.push_back(slab);
+  m_front = slab;
+  m_limit = slab + SLAB_SIZE;
+
+  if (m_stats) {
+    m_stats->alloc += SLAB_SIZE;
+    if (m_stats->alloc > m_stats->peakAlloc) {
+      m_stats->peakAlloc = m_stats->alloc;
+    }
+  }
+}
+
+void *SizeClassAllocator::realloc(void *p, size_t oldSize, size_t newSize) {
+  if (p == NULL) {
+    return alloc(newSize);
+  }
+  if (oldSize > MaxSmallSize && newSize > MaxSmallSize) {
+    return Util::safe_realloc(p, newSize);
+  }
+  if (oldSize <= MaxSmallSize && newSize <= MaxSmallSize &&
+      SizeClass(oldSize) == SizeClass(newSize)) {
+    return p;
+  }
+  void *ret = alloc(newSize);
+  memcpy(ret, p, oldSize < newSize ? oldSize : newSize);
+  dealloc(p, oldSize);
+  return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MemoryManager methods
+
+void SizeClassAllocator::mark(Mark &m) {
+  m.slabs = m_slabs.size();
+  m.front = m_front;
+  m.limit = m_limit;
+  for (int i = 0; i < NumSizeClasses; i++) {
+    std::vector<void *> &backup = m.freelists[i];
+    backup.clear();
+    for (FreeNode *node = m_freelists[i]; node; node = node->next) {
+      backup.push_back(node);
+    }
+  }
+}
+
+void SizeClassAllocator::restore(const Mark &m) {
+  // throw away everything allocated since the mark in one go
+  for (unsigned int i = m.slabs; i < m_slabs.size(); i++) {
+    free(m_slabs[i]);
+  }
+  if (m_stats) {
+    m_stats->alloc -= (int64)(m_slabs.size() - m.slabs) * SLAB_SIZE;
+  }
+  m_slabs.resize(m.slabs);
+  m_front = m.front;
+  m_limit = m.limit;
+
+  // free lists only ever point into slabs that survived the mark
+  for (int i = 0; i < NumSizeClasses; i++) {
+    const std::vector<void *> &backup = m.freelists[i];
+    FreeNode *head = NULL;
+    for (int j = backup.size() - 1; j >= 0; j--) {
+      FreeNode *node = (FreeNode *)backup[j];
+      node->next = head;
+      head = node;
+    }
+    m_freelists[i] = head;
+  }
+}
+
+void SizeClassAllocator::baseline() {
+  mark(m_baseline);
+}
+
+void SizeClassAllocator::checkpoint() {
+  m_checkpointed = true;
+  mark(m_checkpoint);
+}
+
+void SizeClassAllocator::sweep() {
+  // after a checkpoint, rollback() knows which slabs have to stay
+  if (m_checkpointed) return;
+  restore(m_baseline);
+}
+
+void SizeClassAllocator::rollback() {
+  if (!m_checkpointed) return;
+  restore(m_checkpoint);
+}
+
+void SizeClassAllocator::logStats() {
+  for (int i = 0; i < NumSizeClasses; i++) {
+    int freed = 0;
+    for (FreeNode *node = m_freelists[i]; node; node = node->next) {
+      freed++;
+    }
+    if (freed) {
+      string key = string("mem.SizeClass.") +
+        lexical_cast<string>(s_classSizes[i]);
+      ServerStats::Log(key + ".freed", freed);
+    }
+  }
+  ServerStats::Log("mem.SizeClass.slabs", m_slabs.size());
+}
+
+void SizeClassAllocator::checkMemory(bool detailed) {
+  printf("%16s (%6d slabs of %d bytes)\n", "SizeClass",
+         (int)m_slabs.size(), SLAB_SIZE);
+  if (detailed) {
+    for (int i = 0; i < NumSizeClasses; i++) {
+      int freed = 0;
+      for (FreeNode *node = m_freelists[i]; node; node = node->next) {
+        freed++;
+      }
+      printf("%16s (%6d bytes): %8d free\n", "",
+             (int)s_classSizes[i], freed);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
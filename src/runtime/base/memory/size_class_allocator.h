@@ -0,0 +1,152 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_SIZE_CLASS_ALLOCATOR_H__
+#define __HPHP_SIZE_CLASS_ALLOCATOR_H__
+
+#include <runtime/base/memory/smart_allocator.h>
+#include <util/alloc.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A SizeClassAllocator serves the variable sized memory held by fixed size
+ * objects, like StringData's or HphpArray's m_data. Small requests are rounded
+ * up to one of NumSizeClasses sizes and carved out of SLAB_SIZE slabs owned by
+ * the calling thread, so the common case is a free list pop or a pointer bump
+ * without ever taking malloc's arena locks. Requests bigger than MaxSmallSize
+ * go straight to malloc().
+ *
+ * There is no per-block header: callers have to pass dealloc() and realloc()
+ * the size they asked for (or any size that rounds to the same size class).
+ *
+ * Slabs are never returned to malloc one by one. A checkpoint remembers the
+ * slabs and free lists in use, and rollback() throws away everything that was
+ * allocated after it in bulk. Without a checkpoint, sweep() does the same at
+ * the end of a request, back to the baseline taken once the process finished
+ * initializing, so static arrays and the like outlive every request.
+ */
+class SizeClassAllocator {
+public:
+  static const size_t MaxSmallSize = 4096;
+  static const int NumSizeClasses = 28;
+
+  /**
+   * Size class that "size" bytes round up to. Sizes up to 128 bytes are
+   * 16 bytes apart, after that there are 4 classes per power of two.
+   */
+  static int SizeClass(size_t size) {
+    ASSERT(size > 0 && size <= MaxSmallSize);
+    if (size <= 128) return (size - 1) >> 4;
+    size_t s = size - 1;
+    int lg = 63 - __builtin_clzl(s);
+    return 8 + ((lg - 7) << 2) + ((s >> (lg - 2)) & 3);
+  }
+  static size_t ClassSize(int index) {
+    ASSERT(index >= 0 && index < NumSizeClasses);
+    return s_classSizes[index];
+  }
+
+public:
+  SizeClassAllocator();
+  ~SizeClassAllocator();
+
+  void registerStats(MemoryUsageStats *stats) { m_stats = stats;}
+
+  /**
+   * Allocation/deallocation of variable sized memory.
+   */
+  void *alloc(size_t size) {
+    if (size > MaxSmallSize) return Util::safe_malloc(size);
+    int index = SizeClass(size);
+    FreeNode *node = m_freelists[index];
+    if (node) {
+      m_freelists[index] = node->next;
+      return node;
+    }
+    size_t bytes = s_classSizes[index];
+    if (m_front + bytes > m_limit) {
+      newSlab();
+    }
+    void *ret = m_front;
+    m_front += bytes;
+    return ret;
+  }
+
+  void dealloc(void *p, size_t size) {
+    if (p) {
+      if (size > MaxSmallSize) {
+        free(p);
+        return;
+      }
+      int index = SizeClass(size);
+      FreeNode *node = (FreeNode *)p;
+      node->next = m_freelists[index];
+      m_freelists[index] = node;
+    }
+  }
+
+  void *realloc(void *p, size_t oldSize, size_t newSize);
+
+  /**
+   * MemoryManager functions.
+   */
+  void baseline();
+  void checkpoint();
+  void rollback();
+  void sweep();
+  void logStats();
+  void checkMemory(bool detailed);
+
+private:
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  /**
+   * Where the slabs and free lists stood at a baseline or a checkpoint.
+   */
+  struct Mark {
+    Mark() : slabs(0), front(NULL), limit(NULL) {}
+    unsigned int slabs;
+    char *front;
+    char *limit;
+    std::vector<void *> freelists[NumSizeClasses];
+  };
+
+  static const size_t s_classSizes[NumSizeClasses];
+
+  char *m_front; // next free byte of the current slab
+  char *m_limit; // end of the current slab
+  std::vector<char *> m_slabs;
+  FreeNode *m_freelists[NumSizeClasses];
+
+  Mark m_baseline;
+  bool m_checkpointed;
+  Mark m_checkpoint;
+
+  MemoryUsageStats *m_stats;
+
+  void newSlab() __attribute__((noinline));
+  void mark(Mark &m);
+  void restore(const Mark &m);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_SIZE_CLASS_ALLOCATOR_H__
@@ -31,6 +31,7 @@
 #include <runtime/base/server/admin_request_handler.h>
 #include <runtime/base/server/server_stats.h>
 #include <runtime/base/server/server_note.h>
+#include <runtime/base/string_intern_table.h>
 #include <runtime/base/memory/memory_manager.h>
 #include <util/process.h>
 #include <util/capability.h>
@@ -815,13 +816,18 @@ void hphp_process_init() {
   XboxServer::Restart();
   Extension::InitModules();
   apc_load(RuntimeOption::ApcLoadThread);
+  apc_load_snapshot(RuntimeOption::ApcLoadThread);
   StaticString::FinishInit();
   Eval::Debugger::StartServer();
+
+  // static arrays keep their smart_malloc-ed data across requests
+  MemoryManager::TheMemoryManager()->baseline();
 }
 
 void hphp_session_init() {
   ThreadInfo::s_threadInfo->onSessionInit();
   MemoryManager::TheMemoryManager()->resetStats();
+  StringInternTable::Enable();
 
   if (!s_warmup_state->done) {
     free_global_variables(); // just to be safe
@@ -1002,6 +1008,7 @@ void hphp_session_exit() {
   // Server note has to live long enough for the access log to fire.
   // RequestLocal is too early.
   ServerNote::Reset();
+  StringInternTable::Reset();
   g_context.reset();
 
   MemoryManager *mm = MemoryManager::TheMemoryManager().get();
@@ -1030,6 +1037,7 @@ void hphp_session_exit() {
   } else {
     ServerStatsHelper ssh("free");
     free_global_variables();
+    mm->sweepAll();
   }
 
   ThreadInfo::s_threadInfo->onSessionExit();
@@ -83,17 +83,29 @@ int RuntimeOption::ServerThreadCount = 50;
 bool RuntimeOption::ServerThreadRoundRobin = false;
 int RuntimeOption::ServerThreadDropCacheTimeoutSeconds = 0;
 bool RuntimeOption::ServerThreadJobLIFO = false;
+bool RuntimeOption::ServerThreadWorkStealing = false;
+int RuntimeOption::ServerQueueTargetMilliSeconds = 0;
+int RuntimeOption::ServerQueueIntervalMilliSeconds = 100;
+std::set<std::string> RuntimeOption::ServerPriorityURLs;
+int RuntimeOption::ServerEventLoopCount = 1;
+bool RuntimeOption::ServerReusePort = false;
 int RuntimeOption::PageletServerThreadCount = 0;
+bool RuntimeOption::PageletServerThreadWorkStealing = false;
 int RuntimeOption::FiberCount = 0;
 int RuntimeOption::RequestTimeoutSeconds = 0;
 int RuntimeOption::RequestMemoryMaxBytes = -1;
 int RuntimeOption::ImageMemoryMaxBytes = 0;
-int RuntimeOption::ResponseQueueCount;
+int RuntimeOption::ResponseQueueSize = 64;
 int RuntimeOption::ServerGracefulShutdownWait;
 bool RuntimeOption::ServerHarshShutdown = true;
 bool RuntimeOption::ServerEvilShutdown = true;
 int RuntimeOption::ServerDanglingWait;
 int RuntimeOption::GzipCompressionLevel = 3;
+bool RuntimeOption::GzipAdaptiveCompression = false;
+int RuntimeOption::GzipMinCompressionLevel = 1;
+int RuntimeOption::GzipHighCPUPercent = 80;
+int RuntimeOption::GzipLowCPUPercent = 50;
+int RuntimeOption::GzipHighQueueMilliSeconds = 10;
 std::string RuntimeOption::ForceCompressionURL;
 std::string RuntimeOption::ForceCompressionCookie;
 std::string RuntimeOption::ForceCompressionParam;
@@ -132,6 +144,7 @@ IpBlockMapPtr RuntimeOption::IpBlocks;
 SatelliteServerInfoPtrVec RuntimeOption::SatelliteServerInfos;
 
 int RuntimeOption::XboxServerThreadCount = 0;
+bool RuntimeOption::XboxServerThreadWorkStealing = false;
 int RuntimeOption::XboxServerPort = 0;
 int RuntimeOption::XboxDefaultLocalTimeoutMilliSeconds = 500;
 int RuntimeOption::XboxDefaultRemoteTimeoutSeconds = 5;
@@ -146,6 +159,7 @@ std::string RuntimeOption::XboxPassword;
 std::string RuntimeOption::SourceRoot;
 std::vector<std::string> RuntimeOption::IncludeSearchPaths;
 std::string RuntimeOption::FileCache;
+int64 RuntimeOption::FileCacheBlockCacheSize = 64 * 1024 * 1024;
 std::string RuntimeOption::DefaultDocument;
 std::string RuntimeOption::ErrorDocument404;
 std::string RuntimeOption::ErrorDocument500;
@@ -248,6 +262,9 @@ bool RuntimeOption::EnableMemoryManager = true;
 bool RuntimeOption::CheckMemory = false;
 bool RuntimeOption::UseHphpArray = false;
 bool RuntimeOption::UseSmallArray = false;
+bool RuntimeOption::UseTaggedHphpArray = false;
+bool RuntimeOption::InternArrayKeys = false;
+bool RuntimeOption::UseVectorArray = false;
 bool RuntimeOption::UseDirectCopy = false;
 bool RuntimeOption::EnableApc = true;
 bool RuntimeOption::EnableConstLoad = false;
@@ -265,6 +282,12 @@ size_t RuntimeOption::ApcMaximumCapacity = 0;
 int RuntimeOption::ApcKeyFrequencyUpdatePeriod = 1000;
 bool RuntimeOption::ApcExpireOnSets = false;
 int RuntimeOption::ApcPurgeFrequency = 4096;
+int64 RuntimeOption::ApcMemoryLimit = 0;
+int RuntimeOption::ApcLeaseTimeout = 1000;
+bool RuntimeOption::ApcPackArrays = false;
+std::string RuntimeOption::ApcSnapshotFile;
+int RuntimeOption::ApcSnapshotInterval = 0;
+int RuntimeOption::ApcKeyStatsSampleRate = 0;
 
 bool RuntimeOption::EnableDnsCache = false;
 int RuntimeOption::DnsCacheTTL = 10 * 60; // 10 minutes
@@ -520,13 +543,18 @@ void RuntimeOption::Load(Hdf &config) {
     ServerThreadDropCacheTimeoutSeconds =
       server["ThreadDropCacheTimeoutSeconds"].getInt32(0);
     ServerThreadJobLIFO = server["ThreadJobLIFO"].getBool();
+    ServerThreadWorkStealing = server["ThreadWorkStealing"].getBool();
+    ServerQueueTargetMilliSeconds =
+      server["QueueTargetMilliSeconds"].getInt32(0);
+    ServerQueueIntervalMilliSeconds =
+      server["QueueIntervalMilliSeconds"].getInt32(100);
+    server["PriorityURLs"].get(ServerPriorityURLs);
+    ServerEventLoopCount = server["EventLoopCount"].getInt32(1);
+    ServerReusePort = server["ReusePort"].getBool();
     RequestTimeoutSeconds = server["RequestTimeoutSeconds"].getInt32(0);
     RequestMemoryMaxBytes = server["RequestMemoryMaxBytes"].getInt32(-1);
-    ResponseQueueCount = server["ResponseQueueCount"].getInt32(0);
-    if (ResponseQueueCount <= 0) {
-      ResponseQueueCount = ServerThreadCount / 10;
-      if (ResponseQueueCount <= 0) ResponseQueueCount = 1;
-    }
+    ResponseQueueSize = server["ResponseQueueSize"].getInt32(64);
+    if (ResponseQueueSize <= 0) ResponseQueueSize = 64;
     ServerGracefulShutdownWait = server["GracefulShutdownWait"].getInt16(0);
     ServerHarshShutdown = server["HarshShutdown"].getBool(true);
     ServerEvilShutdown = server["EvilShutdown"].getBool(true);
@@ -535,6 +563,12 @@ void RuntimeOption::Load(Hdf &config) {
       ServerGracefulShutdownWait = ServerDanglingWait;
     }
     GzipCompressionLevel = server["GzipCompressionLevel"].getInt16(3);
+    GzipAdaptiveCompression = server["GzipAdaptiveCompression"].getBool();
+    GzipMinCompressionLevel = server["GzipMinCompressionLevel"].getInt16(1);
+    GzipHighCPUPercent = server["GzipHighCPUPercent"].getInt16(80);
+    GzipLowCPUPercent = server["GzipLowCPUPercent"].getInt16(50);
+    GzipHighQueueMilliSeconds =
+      server["GzipHighQueueMilliSeconds"].getInt32(10);
 
     ForceCompressionURL    = server["ForceCompression"]["URL"].getString();
     ForceCompressionCookie = server["ForceCompression"]["Cookie"].getString();
@@ -583,6 +617,9 @@ void RuntimeOption::Load(Hdf &config) {
     IncludeSearchPaths.insert(IncludeSearchPaths.begin(), "./");
 
     FileCache = server["FileCache"].getString();
+    FileCacheBlockCacheSize =
+      server["FileCacheBlockCacheSize"].getInt64(64 * 1024 * 1024);
+    FileCache::BlockCacheSize = FileCacheBlockCacheSize;
     DefaultDocument = server["DefaultDocument"].getString();
     ErrorDocument404 = server["ErrorDocument404"].getString();
     normalizePath(ErrorDocument404);
@@ -639,6 +676,9 @@ void RuntimeOption::Load(Hdf &config) {
     CheckMemory = server["CheckMemory"].getBool();
     UseHphpArray = server["UseHphpArray"].getBool(false);
     UseSmallArray = server["UseSmallArray"].getBool(false);
+    UseTaggedHphpArray = server["UseTaggedHphpArray"].getBool(false);
+    InternArrayKeys = server["InternArrayKeys"].getBool(false);
+    UseVectorArray = server["UseVectorArray"].getBool(false);
     UseDirectCopy = server["UseDirectCopy"].getBool(false);
     AlwaysUseRelativePath = server["AlwaysUseRelativePath"].getBool(false);
 
@@ -673,6 +713,12 @@ void RuntimeOption::Load(Hdf &config) {
 
     ApcExpireOnSets = apc["ExpireOnSets"].getBool();
     ApcPurgeFrequency = apc["PurgeFrequency"].getInt32(4096);
+    ApcMemoryLimit = apc["MemoryLimit"].getInt64(0) * (1 << 20);
+    ApcLeaseTimeout = apc["LeaseTimeout"].getInt32(1000);
+    ApcPackArrays = apc["PackArrays"].getBool(false);
+    ApcSnapshotFile = apc["SnapshotFile"].getString();
+    ApcSnapshotInterval = apc["SnapshotInterval"].getInt32(0);
+    ApcKeyStatsSampleRate = apc["KeyStatsSampleRate"].getInt32(0);
 
     ApcKeyMaturityThreshold = apc["KeyMaturityThreshold"].getInt32(20);
     ApcMaximumCapacity = apc["MaximumCapacity"].getInt64(0);
@@ -752,6 +798,8 @@ void RuntimeOption::Load(Hdf &config) {
   {
     Hdf xbox = config["Xbox"];
     XboxServerThreadCount = xbox["ServerInfo.ThreadCount"].getInt32(0);
+    XboxServerThreadWorkStealing =
+      xbox["ServerInfo.ThreadWorkStealing"].getBool();
     XboxServerPort = xbox["ServerInfo.Port"].getInt32(0);
     XboxDefaultLocalTimeoutMilliSeconds =
       xbox["DefaultLocalTimeoutMilliSeconds"].getInt32(500);
@@ -767,6 +815,8 @@ void RuntimeOption::Load(Hdf &config) {
   }
   {
     PageletServerThreadCount = config["PageletServer.ThreadCount"].getInt32(0);
+    PageletServerThreadWorkStealing =
+      config["PageletServer.ThreadWorkStealing"].getBool();
     FiberCount = config["Fiber.ThreadCount"].getInt32(0);
     if (FiberCount > 0) {
       FiberAsyncFunc::Restart();
@@ -78,17 +78,29 @@ public:
   static bool ServerThreadRoundRobin;
   static int ServerThreadDropCacheTimeoutSeconds;
   static bool ServerThreadJobLIFO;
+  static bool ServerThreadWorkStealing;
+  static int ServerQueueTargetMilliSeconds;
+  static int ServerQueueIntervalMilliSeconds;
+  static std::set<std::string> ServerPriorityURLs;
+  static int ServerEventLoopCount;
+  static bool ServerReusePort;
   static int PageletServerThreadCount;
+  static bool PageletServerThreadWorkStealing;
   static int FiberCount;
   static int RequestTimeoutSeconds;
   static int RequestMemoryMaxBytes;
   static int ImageMemoryMaxBytes;
-  static int ResponseQueueCount;
+  static int ResponseQueueSize;
   static int ServerGracefulShutdownWait;
   static int ServerDanglingWait;
   static bool ServerHarshShutdown;
   static bool ServerEvilShutdown;
   static int GzipCompressionLevel;
+  static bool GzipAdaptiveCompression;
+  static int GzipMinCompressionLevel;
+  static int GzipHighCPUPercent;
+  static int GzipLowCPUPercent;
+  static int GzipHighQueueMilliSeconds;
   static std::string ForceCompressionURL;
   static std::string ForceCompressionCookie;
   static std::string ForceCompressionParam;
@@ -128,6 +140,7 @@ public:
   static std::string SSLCertificateKeyFile;
 
   static int XboxServerThreadCount;
+  static bool XboxServerThreadWorkStealing;
   static int XboxServerPort;
   static int XboxDefaultLocalTimeoutMilliSeconds;
   static int XboxDefaultRemoteTimeoutSeconds;
@@ -142,6 +155,7 @@ public:
   static std::string SourceRoot;
   static std::vector<std::string> IncludeSearchPaths;
   static std::string FileCache;
+  static int64 FileCacheBlockCacheSize;
   static std::string DefaultDocument;
   static std::string ErrorDocument404;
   static std::string ErrorDocument500;
@@ -244,6 +258,9 @@ public:
   static bool CheckMemory;
   static bool UseHphpArray;
   static bool UseSmallArray;
+  static bool UseTaggedHphpArray;
+  static bool InternArrayKeys;
+  static bool UseVectorArray;
   static bool UseDirectCopy;
   static bool EnableApc;
   static bool EnableConstLoad;
@@ -269,6 +286,12 @@ public:
   static int ApcKeyFrequencyUpdatePeriod;
   static bool ApcExpireOnSets;
   static int ApcPurgeFrequency;
+  static int64 ApcMemoryLimit;
+  static int ApcLeaseTimeout;
+  static bool ApcPackArrays;
+  static std::string ApcSnapshotFile;
+  static int ApcSnapshotInterval;
+  static int ApcKeyStatsSampleRate;
 
   static bool EnableDnsCache;
   static int DnsCacheTTL;
@@ -30,6 +30,7 @@
 #include <runtime/base/memory/leak_detectable.h>
 #include <runtime/ext/mysql_stats.h>
 #include <runtime/base/shared/shared_store_stats.h>
+#include <runtime/base/shared/shared_store_key_stats.h>
 #include <util/alloc.h>
 #include <runtime/ext/ext_fb.h>
 #include <runtime/ext/ext_apc.h>
@@ -84,6 +85,8 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
         "/check-load:      how many threads are actively handling requests\n"
         "/check-queued:    how many http requests are queued waiting to be\n"
         "                  handled\n"
+        "/check-queue-latency: histogram of how long http requests were\n"
+        "                  queued, and how many were shed\n"
         "/check-mem:       report memory quick statistics in log file\n"
         "/check-apc:       report APC quick statistics\n"
         "/check-sql:       report SQL table statistics\n"
@@ -129,7 +132,13 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
         "                  only valid when EnableAPCSizeDetail is true\n"
         "    keysample     optional, only dump keys that belongs to the same\n"
         "                  group as <keysample>\n"
+        "/apc-ks:          get sampled fetches, hits, stores and sizes of the\n"
+        "                  key skeletons fetched the most\n"
+        "    count         optional, how many skeletons, 100 by default\n"
+        "/apc-ks-clear:    reset sampled key statistics\n"
         "/dump-apc:        dump all current value in APC to /tmp/apc_dump\n"
+        "/dump-apc-snapshot: write APC to APC.SnapshotFile, to be loaded at\n"
+        "                  the next startup\n"
         "/dump-const:      dump all constant value in constant map to\n"
         "                  /tmp/const_map_dump\n"
 
@@ -235,6 +244,10 @@ void AdminRequestHandler::handleRequest(Transport *transport) {
         handleAPCSizeRequest(cmd, transport)) {
       break;
     }
+    if (strncmp(cmd.c_str(), "apc-ks", 6) == 0 &&
+        handleAPCKeyStatsRequest(cmd, transport)) {
+      break;
+    }
     if (strncmp(cmd.c_str(), "dump", 4) == 0 &&
         handleDumpCacheRequest(cmd, transport)) {
       break;
@@ -417,6 +430,11 @@ bool AdminRequestHandler::handleCheckRequest(const std::string &cmd,
     transport->sendString(lexical_cast<string>(count));
     return true;
   }
+  if (cmd == "check-queue-latency") {
+    transport->sendString
+      (HttpServer::Server->getPageServer()->getQueueLatency());
+    return true;
+  }
   if (cmd == "check-mem") {
     return toggle_switch(transport, RuntimeOption::CheckMemory);
   }
@@ -756,6 +774,25 @@ bool AdminRequestHandler::handleAPCSizeRequest (const std::string &cmd,
   return false;
 }
 
+bool AdminRequestHandler::handleAPCKeyStatsRequest(const std::string &cmd,
+                                                   Transport *transport) {
+  if (RuntimeOption::ApcKeyStatsSampleRate <= 0) {
+    transport->sendString("Not Enabled\n");
+    return true;
+  }
+  if (cmd == "apc-ks") {
+    int count = transport->getIntParam("count");
+    transport->sendString(SharedStoreKeyStats::Report(count ? count : 100));
+    return true;
+  }
+  if (cmd == "apc-ks-clear") {
+    SharedStoreKeyStats::Clear();
+    transport->sendString("OK\n");
+    return true;
+  }
+  return false;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Dump cache content
 
@@ -781,6 +818,14 @@ bool AdminRequestHandler::handleDumpCacheRequest(const std::string &cmd,
     transport->sendString("Done");
     return true;
   }
+  if (cmd == "dump-apc-snapshot") {
+    if (!RuntimeOption::EnableApc || RuntimeOption::ApcSnapshotFile.empty()) {
+      transport->sendString("No APC snapshot file\n");
+      return true;
+    }
+    transport->sendString(apc_dump_snapshot() ? "Done" : "Failed");
+    return true;
+  }
   return false;
 }
 
@@ -0,0 +1,105 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#include <runtime/base/server/compression_policy.h>
+#include <runtime/base/runtime_option.h>
+#include <util/process.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+int CompressionPolicy::s_level = -1;
+int CompressionPolicy::s_checking = 0;
+int64 CompressionPolicy::s_lastCheck = 0;
+int64 CompressionPolicy::s_lastCPU = 0;
+volatile int64 CompressionPolicy::s_maxQueueTime = 0;
+
+static const int64 CheckInterval = 1000000; // in microseconds
+
+static int64 to_usec(const timeval &tv) {
+  return tv.tv_sec * (int64)1000000 + tv.tv_usec;
+}
+
+static int max_level() {
+  // zlib's default is 6
+  return RuntimeOption::GzipCompressionLevel < 0 ?
+    6 : RuntimeOption::GzipCompressionLevel;
+}
+
+int CompressionPolicy::GetLevel() {
+  if (!RuntimeOption::GzipAdaptiveCompression) {
+    return RuntimeOption::GzipCompressionLevel;
+  }
+
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  int64 now = to_usec(tv);
+  if (now - s_lastCheck >= CheckInterval &&
+      __sync_bool_compare_and_swap(&s_checking, 0, 1)) {
+    if (now - s_lastCheck >= CheckInterval) {
+      adjust(now);
+    }
+    __sync_lock_release(&s_checking);
+  }
+  int level = s_level;
+  return level < 0 ? max_level() : level;
+}
+
+void CompressionPolicy::OnQueueTime(int64 usec) {
+  if (!RuntimeOption::GzipAdaptiveCompression) return;
+  int64 old;
+  while (usec > (old = s_maxQueueTime) &&
+         !__sync_bool_compare_and_swap(&s_maxQueueTime, old, usec)) {
+  }
+}
+
+void CompressionPolicy::adjust(int64 now) {
+  rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  int64 cpu = to_usec(ru.ru_utime) + to_usec(ru.ru_stime);
+  int64 queued = __sync_lock_test_and_set(&s_maxQueueTime, (int64)0);
+
+  int maxLevel = max_level();
+  int minLevel = RuntimeOption::GzipMinCompressionLevel;
+  if (minLevel < 1) minLevel = 1;
+  if (minLevel > maxLevel) minLevel = maxLevel;
+
+  int level = s_level < 0 ? maxLevel : s_level;
+  if (s_lastCheck > 0) {
+    static int cpuCount = Process::GetCPUCount();
+    int64 elapsed = (now - s_lastCheck) * (cpuCount > 0 ? cpuCount : 1);
+    int percent = (int)((cpu - s_lastCPU) * 100 / elapsed);
+    int64 queueLimit = RuntimeOption::GzipHighQueueMilliSeconds * 1000;
+
+    if (percent >= RuntimeOption::GzipHighCPUPercent ||
+        (queueLimit > 0 && queued >= queueLimit)) {
+      level -= 2;
+    } else if (percent < RuntimeOption::GzipLowCPUPercent &&
+               (queueLimit <= 0 || queued < queueLimit / 2)) {
+      level++;
+    }
+  }
+  if (level < minLevel) level = minLevel;
+  if (level > maxLevel) level = maxLevel;
+
+  s_level = level;
+  s_lastCPU = cpu;
+  s_lastCheck = now;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,57 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+#ifndef __HPHP_COMPRESSION_POLICY_H__
+#define __HPHP_COMPRESSION_POLICY_H__
+
+#include <util/base.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Picks the gzip level for responses. Without Server.GzipAdaptiveCompression
+ * that's always Server.GzipCompressionLevel. With it, the level is checked
+ * once a second against how busy the CPUs were and how long requests were
+ * queued since the last check:
+ *
+ *   - above GzipHighCPUPercent, or queued GzipHighQueueMilliSeconds or more,
+ *     the level drops by two, down to GzipMinCompressionLevel;
+ *   - below GzipLowCPUPercent, and queued less than half that, it goes up by
+ *     one, up to GzipCompressionLevel.
+ */
+class CompressionPolicy {
+public:
+  static int GetLevel();
+
+  /**
+   * Workers report how long each request waited, in microseconds.
+   */
+  static void OnQueueTime(int64 usec);
+
+private:
+  static int s_level;
+  static int s_checking;
+  static int64 s_lastCheck;  // wall time, in microseconds
+  static int64 s_lastCPU;    // process CPU time, in microseconds
+  static volatile int64 s_maxQueueTime;
+
+  static void adjust(int64 now);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_COMPRESSION_POLICY_H__
@@ -475,6 +475,92 @@ void HttpProtocol::DecodeRfc1867(Transport *transport,
                      data, size, boundary);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// conditional and partial requests
+
+std::string HttpProtocol::MakeETag(int size, time_t mtime) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "\"%x-%lx\"", size, (unsigned long)mtime);
+  return buf;
+}
+
+bool HttpProtocol::MatchETag(const std::string &header,
+                             const std::string &etag) {
+  if (etag.empty()) return false;
+  if (header == "*") return true;
+
+  // a list of quoted tags, any of which may be weak
+  size_t pos = 0;
+  while ((pos = header.find(etag, pos)) != string::npos) {
+    size_t end = pos + etag.size();
+    if ((end == header.size() || header[end] == ',' || header[end] == ' ') &&
+        (pos == 0 || header[pos - 1] == ',' || header[pos - 1] == ' ' ||
+         header[pos - 1] == '/')) {
+      return true;
+    }
+    pos = end;
+  }
+  return false;
+}
+
+bool HttpProtocol::IsNotModified(Transport *transport, const string &etag,
+                                 time_t mtime) {
+  // If-None-Match takes precedence when both are present
+  string tags = transport->getHeader("If-None-Match");
+  if (!tags.empty()) {
+    return MatchETag(tags, etag);
+  }
+  if (mtime) {
+    string since = transport->getHeader("If-Modified-Since");
+    if (!since.empty()) {
+      struct tm tm;
+      memset(&tm, 0, sizeof(tm));
+      if (strptime(since.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm)) {
+        return mtime <= timegm(&tm);
+      }
+    }
+  }
+  return false;
+}
+
+int HttpProtocol::ParseRange(const string &range, int size, int &start,
+                             int &end) {
+  if (strncasecmp(range.c_str(), "bytes=", 6) != 0) return 0;
+  const char *spec = range.c_str() + 6;
+  while (*spec == ' ') spec++;
+  if (strchr(spec, ',')) return 0; // not sending multipart/byteranges
+
+  char *p;
+  if (*spec == '-') {
+    // the last n bytes
+    if (!isdigit(spec[1])) return 0;
+    int64 n = strtoll(spec + 1, &p, 10);
+    if (*p) return 0;
+    if (n == 0 || size == 0) return -1;
+    start = n < size ? size - n : 0;
+    end = size - 1;
+    return 1;
+  }
+
+  if (!isdigit(*spec)) return 0;
+  int64 first = strtoll(spec, &p, 10);
+  if (*p++ != '-') return 0;
+  int64 last = size - 1;
+  if (*p) {
+    if (!isdigit(*p)) return 0;
+    last = strtoll(p, &p, 10);
+    if (*p) return 0;
+    if (last < first) return 0;
+    if (last >= size) last = size - 1;
+  }
+  if (first >= size) return -1;
+  start = first;
+  end = last;
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 const char *HttpProtocol::GetReasonString(int code) {
   switch (code) {
   case 100: return "Continue";
@@ -52,6 +52,24 @@ public:
 
   static const char *GetReasonString(int code);
 
+  /**
+   * Conditional and partial requests for static content, so they can be
+   * answered from a size and a modification time without the body.
+   */
+  static std::string MakeETag(int size, time_t mtime);
+  static bool MatchETag(const std::string &header, const std::string &etag);
+  static bool IsNotModified(Transport *transport, const std::string &etag,
+                            time_t mtime);
+
+  /**
+   * Parses a "Range: bytes=..." header against a body of size bytes.
+   * Returns 1 with the inclusive [start, end] of a single range, -1 if the
+   * range can't be satisfied, or 0 if it should be ignored and the whole
+   * body sent, e.g. for syntax errors or multiple ranges.
+   */
+  static int ParseRange(const std::string &range, int size, int &start,
+                        int &end);
+
 private:
   static void CopyParams(Variant &dest, Variant &src);
 };
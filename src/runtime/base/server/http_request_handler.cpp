@@ -47,11 +47,13 @@ HttpRequestHandler::HttpRequestHandler()
   : m_pathTranslation(true) {
 }
 
-void HttpRequestHandler::sendStaticContent(Transport *transport,
-                                           const char *data, int len,
-                                           time_t mtime,
-                                           bool compressed,
-                                           const std::string &cmd) {
+int HttpRequestHandler::sendStaticContent(Transport *transport,
+                                          const char *data, int len,
+                                          time_t mtime,
+                                          bool compressed,
+                                          const std::string &cmd,
+                                          const std::string &etag,
+                                          int fd /* = -1 */) {
   size_t pos = cmd.rfind('.');
   ASSERT(pos != string::npos);
   const char *ext = cmd.c_str() + pos + 1;
@@ -83,6 +85,12 @@ void HttpRequestHandler::sendStaticContent(Transport *transport,
     transport->addHeader
       ("Last-Modified", DateTime(mtime, true).toString(DateTime::HttpHeader));
   }
+  if (!etag.empty()) {
+    transport->addHeader("ETag", etag.c_str());
+  }
+  if (compressed) {
+    transport->addHeader("Vary", "Accept-Encoding");
+  }
   transport->addHeader("Accept-Ranges", "bytes");
 
   for (unsigned int i = 0; i < RuntimeOption::FilesMatches.size(); i++) {
@@ -99,7 +107,87 @@ void HttpRequestHandler::sendStaticContent(Transport *transport,
   // should not attempt to compress it.
   transport->disableCompression();
 
-  transport->sendRaw((void*)data, len, 200, compressed);
+  // answered from headers alone, so the body isn't touched
+  if ((!etag.empty() || mtime) &&
+      HttpProtocol::IsNotModified(transport, etag, mtime)) {
+    transport->sendRaw((void*)"", 0, 304, compressed);
+    return 304;
+  }
+
+  string range = transport->getHeader("Range");
+  if (!range.empty()) {
+    string ifRange = transport->getHeader("If-Range");
+    int start, end;
+    int ret = 0;
+    if (ifRange.empty() || HttpProtocol::MatchETag(ifRange, etag)) {
+      ret = HttpProtocol::ParseRange(range, len, start, end);
+    }
+    char buf[64];
+    if (ret > 0) {
+      snprintf(buf, sizeof(buf), "bytes %d-%d/%d", start, end, len);
+      transport->addHeader("Content-Range", buf);
+      return sendStaticBody(transport, data, fd, start, end - start + 1, 206,
+                            compressed);
+    }
+    if (ret < 0) {
+      snprintf(buf, sizeof(buf), "bytes */%d", len);
+      transport->addHeader("Content-Range", buf);
+      transport->sendRaw((void*)"", 0, 416, compressed);
+      return 416;
+    }
+  }
+
+  return sendStaticBody(transport, data, fd, 0, len, 200, compressed);
+}
+
+int HttpRequestHandler::sendStaticBody(Transport *transport,
+                                       const char *data, int fd,
+                                       int start, int size, int code,
+                                       bool compressed) {
+  if (data || size == 0) {
+    transport->sendRaw((void*)(data ? data + start : ""), size, code,
+                       compressed);
+    return code;
+  }
+  ASSERT(fd >= 0);
+  char *buf = (char *)malloc(size);
+  int nread = 0;
+  while (nread < size) {
+    ssize_t ret = pread(fd, buf + nread, size - nread, start + nread);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) break;
+    nread += ret;
+  }
+  if (nread == size) {
+    transport->sendRaw(buf, size, code, compressed);
+  } else {
+    // the file got shorter since it was stat-ed
+    code = 500;
+    transport->sendString("Internal Server Error", code);
+  }
+  free(buf);
+  return code;
+}
+
+/**
+ * Reads only what a 304 or a range needs. It doesn't map the file, since a
+ * file truncated during a deploy would then SIGBUS the server.
+ */
+bool HttpRequestHandler::sendStaticFile(Transport *transport,
+                                        const char *filename,
+                                        const std::string &cmd, int &code) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+  int len = st.st_size;
+  code = sendStaticContent(transport, NULL, len, st.st_mtime, false, cmd,
+                           HttpProtocol::MakeETag(len, st.st_mtime), fd);
+  close(fd);
+  return true;
 }
 
 void HttpRequestHandler::handleRequest(Transport *transport) {
@@ -160,8 +248,10 @@ void HttpRequestHandler::handleRequest(Transport *transport) {
   if (ext && strcasecmp(ext, "php") != 0) {
     if (RuntimeOption::EnableStaticContentCache) {
       bool original = compressed;
+      FileCache::Pin pin;
       // check against static content cache
-      if (StaticContentCache::TheCache.find(path, data, len, compressed)) {
+      if (StaticContentCache::TheCache.find(path, data, len, compressed,
+                                            pin)) {
         struct stat st;
         st.st_mtime = 0;
         String str;
@@ -177,26 +267,25 @@ void HttpRequestHandler::handleRequest(Transport *transport) {
           compressed = false;
           str.assign(data, len, AttachString);
         }
-        sendStaticContent(transport, data, len, st.st_mtime, compressed, path);
+        time_t cacheTime = StaticContentCache::TheCache.getMTime();
+        int code = sendStaticContent(transport, data, len, st.st_mtime,
+                                     compressed, path,
+                                     cacheTime ?
+                                     HttpProtocol::MakeETag(len, cacheTime) :
+                                     string());
         StaticContentCache::TheFileCache->adviseOutMemory();
-        ServerStats::LogPage(path, 200);
+        ServerStats::LogPage(path, code);
         return;
       }
     }
 
     if (RuntimeOption::EnableStaticContentFromDisk) {
       String translated = File::TranslatePath(String(absPath));
-      if (!translated.empty()) {
-        StringBuffer sb(translated.data());
-        if (sb.valid()) {
-          struct stat st;
-          st.st_mtime = 0;
-          stat(translated.data(), &st);
-          sendStaticContent(transport, sb.data(), sb.size(), st.st_mtime,
-                            false, path);
-          ServerStats::LogPage(path, 200);
-          return;
-        }
+      int code;
+      if (!translated.empty() &&
+          sendStaticFile(transport, translated.data(), path, code)) {
+        ServerStats::LogPage(path, code);
+        return;
       }
     }
 
@@ -206,8 +295,9 @@ void HttpRequestHandler::handleRequest(Transport *transport) {
       ASSERT(transport->getUrl());
       string key = path + transport->getUrl();
       if (DynamicContentCache::TheCache.find(key, data, len, compressed)) {
-        sendStaticContent(transport, data, len, 0, compressed, path);
-        ServerStats::LogPage(path, 200);
+        int code = sendStaticContent(transport, data, len, 0, compressed,
+                                     path);
+        ServerStats::LogPage(path, code);
         return;
       }
     }
@@ -45,9 +45,16 @@ private:
   bool m_pathTranslation;
 
   bool handleProxyRequest(Transport *transport, bool force);
-  void sendStaticContent(Transport *transport, const char *data, int len,
-                         time_t mtime, bool compressed,
-                         const std::string &cmd);
+  // these return or set the status code that was sent
+  int sendStaticContent(Transport *transport, const char *data, int len,
+                        time_t mtime, bool compressed,
+                        const std::string &cmd,
+                        const std::string &etag = "", int fd = -1);
+  // without data, only the part being sent is read from fd
+  int sendStaticBody(Transport *transport, const char *data, int fd,
+                     int start, int size, int code, bool compressed);
+  bool sendStaticFile(Transport *transport, const char *filename,
+                      const std::string &cmd, int &code);
   bool executePHPRequest(Transport *transport, RequestURI &reqURI,
                          SourceRootInfo &sourceRootInfo,
                          bool cachableDynamicContent);
@@ -36,6 +36,7 @@
 #include <util/db_conn.h>
 #include <util/log_aggregator.h>
 #include <runtime/ext/ext_apc.h>
+#include <runtime/base/shared/shared_store_key_stats.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <util/ssl_init.h>
@@ -61,11 +62,15 @@ HttpServer::HttpServer(void *sslCTX /* = NULL */)
   LockProfiler::s_pfunc_profile = server_stats_log_mutex;
 
   if (RuntimeOption::TakeoverFilename.empty()) {
-    m_pageServer = ServerPtr
+    LibEventServer *server =
       (new TypedServer<LibEventServer, HttpRequestHandler>
        (RuntimeOption::ServerIP, RuntimeOption::ServerPort,
         RuntimeOption::ServerThreadCount,
         RuntimeOption::RequestTimeoutSeconds));
+    server->setAdmissionControl(true);
+    server->setEventLoopCount(RuntimeOption::ServerEventLoopCount,
+                              RuntimeOption::ServerReusePort);
+    m_pageServer = ServerPtr(server);
   } else {
     LibEventServerWithTakeover* server =
       (new TypedServer<LibEventServerWithTakeover, HttpRequestHandler>
@@ -73,6 +78,9 @@ HttpServer::HttpServer(void *sslCTX /* = NULL */)
         RuntimeOption::ServerThreadCount,
         RuntimeOption::RequestTimeoutSeconds));
     server->setTransferFilename(RuntimeOption::TakeoverFilename);
+    server->setAdmissionControl(true);
+    server->setEventLoopCount(RuntimeOption::ServerEventLoopCount,
+                              RuntimeOption::ServerReusePort);
     server->addTakeoverListener(this);
     m_pageServer = ServerPtr(server);
   }
@@ -397,6 +405,18 @@ void HttpServer::watchDog() {
         checkMemory();
       }
     }
+
+    if (RuntimeOption::ApcSnapshotInterval > 0) {
+      noneed = false;
+      if ((count % RuntimeOption::ApcSnapshotInterval) == 0) {
+        apc_dump_snapshot();
+      }
+    }
+
+    if (RuntimeOption::ApcKeyStatsSampleRate > 0) {
+      noneed = false;
+      SharedStoreKeyStats::Merge();
+    }
   }
 }
 
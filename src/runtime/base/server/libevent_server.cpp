@@ -19,6 +19,15 @@
 #include <runtime/base/memory/memory_manager.h>
 #include <runtime/base/server/server_stats.h>
 #include <runtime/base/server/http_protocol.h>
+#include <runtime/base/server/compression_policy.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // static handler
@@ -45,33 +54,29 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 // LibEventJob
 
-LibEventJob::LibEventJob(evhttp_request *req) : request(req) {
-  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+static int64 now_usec() {
 #if defined(__APPLE__)
-    gettimeofday(&start, NULL);
+  timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec * (int64)1000000 + now.tv_usec;
 #else
-    clock_gettime(CLOCK_MONOTONIC, &start);
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * (int64)1000000 + now.tv_nsec / 1000;
 #endif
-  }
 }
 
-void LibEventJob::stopTimer() {
+LibEventJob::LibEventJob(evhttp_request *req, bool prio /* = false */,
+                         int lp /* = 0 */)
+  : request(req), priority(prio), loop(lp), start(now_usec()) {
+}
+
+int64 LibEventJob::stopTimer() {
+  int64 dusec = now_usec() - start;
   if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
-#if defined(__APPLE__)
-    timeval end;
-    gettimeofday(&end, NULL);
-    time_t dsec = end.tv_sec - start.tv_sec;
-    long dnsec = end.tv_usec - start.tv_usec;
-    int64 dusec = dsec * 1000000 + dnsec;
-#else
-    timespec end;
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_t dsec = end.tv_sec - start.tv_sec;
-    long dnsec = end.tv_nsec - start.tv_nsec;
-    int64 dusec = dsec * 1000000 + dnsec / 1000;
-#endif
     ServerStats::Log("page.wall.queuing", dusec);
   }
+  return dusec;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -84,11 +89,18 @@ LibEventWorker::~LibEventWorker() {
 }
 
 void LibEventWorker::doJob(LibEventJobPtr job) {
-  job->stopTimer();
+  int64 queued = job->stopTimer();
   evhttp_request *request = job->request;
   ASSERT(m_opaque);
   LibEventServer *server = (LibEventServer*)m_opaque;
 
+  server->setWorkerLoop(m_id, job->loop);
+  if (server->onDequeue(job, queued)) {
+    LibEventTransport transport(server, request, m_id);
+    transport.sendString("Service Unavailable", 503);
+    return;
+  }
+
   if (m_handler == NULL || server->supportReset()) {
     m_handler = server->createRequestHandler();
     ASSERT(m_handler);
@@ -156,10 +168,14 @@ LibEventServer::LibEventServer(const std::string &address, int port,
     m_accept_sock_ssl(-1),
     m_timeoutThreadData(thread, timeoutSeconds),
     m_timeoutThread(&m_timeoutThreadData, &TimeoutThread::run),
+    m_eventLoopCount(1), m_reusePort(false), m_workerLoops(thread),
     m_dispatcher(thread, RuntimeOption::ServerThreadRoundRobin,
                  RuntimeOption::ServerThreadDropCacheTimeoutSeconds,
-                 this, RuntimeOption::ServerThreadJobLIFO),
-    m_dispatcherThread(this, &LibEventServer::dispatch) {
+                 this, RuntimeOption::ServerThreadJobLIFO,
+                 RuntimeOption::ServerThreadWorkStealing),
+    m_dispatcherThread(this, &LibEventServer::dispatch),
+    m_admissionControl(false), m_admission(now_usec()),
+    m_responseQueue(thread) {
   m_eventBase = event_base_new();
   m_server = evhttp_new(m_eventBase);
   m_server_ssl = NULL;
@@ -181,11 +197,161 @@ LibEventServer::~LibEventServer() {
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// extra event loops
+
+LibEventServer::EventLoop::EventLoop(LibEventServer *s, int i)
+  : server(s), id(i), acceptSock(-1), ownSocket(false),
+    responseQueue(s->m_workerLoops.size()), thread(this, &EventLoop::run),
+    m_done(false) {
+  eventBase = event_base_new();
+  http = evhttp_new(eventBase);
+  evhttp_set_gencb(http, on_loop_request, this);
+#ifdef EVHTTP_PORTABLE_READ_LIMITING
+  evhttp_set_read_limit(http, RuntimeOption::RequestBodyReadLimit);
+#endif
+  responseQueue.create(eventBase);
+  if (!m_pipeCommand.open()) {
+    throw FatalErrorException("unable to create pipe for event loop");
+  }
+  event_set(&m_eventCommand, m_pipeCommand.getOut(), EV_READ|EV_PERSIST,
+            on_loop_command, this);
+  event_base_set(eventBase, &m_eventCommand);
+  event_add(&m_eventCommand, NULL);
+}
+
+void LibEventServer::EventLoop::on_loop_request(evhttp_request *request,
+                                                void *obj) {
+  ASSERT(obj);
+  EventLoop *loop = (EventLoop*)obj;
+  loop->server->onRequest(request, loop->id);
+}
+
+void LibEventServer::EventLoop::on_loop_command(int fd, short events,
+                                                void *obj) {
+  ASSERT(obj);
+  ((EventLoop*)obj)->onCommand();
+}
+
+LibEventServer::EventLoop::~EventLoop() {
+  // evhttp_free() closes the sockets it accepts on, but the shared one is
+  // closed by the first loop's, and an owned one only once, below
+  if (acceptSock >= 0) {
+    evhttp_del_accept_socket(http, acceptSock);
+  }
+  evhttp_free(http);
+  if (ownSocket && acceptSock >= 0) {
+    close(acceptSock);
+  }
+  event_base_free(eventBase);
+}
+
+void LibEventServer::EventLoop::run() {
+  while (server->getStatus() != STOPPED) {
+    event_base_loop(eventBase, EVLOOP_ONCE);
+  }
+  event_del(&m_eventCommand);
+
+  // flushing all responses
+  if (!responseQueue.empty()) {
+    responseQueue.process();
+  }
+  responseQueue.close();
+
+  // flusing all remaining events
+  if (RuntimeOption::ServerGracefulShutdownWait) {
+    server->dispatchWithTimeout(eventBase,
+                                RuntimeOption::ServerGracefulShutdownWait);
+  }
+}
+
+/**
+ * 'a' stops accepting, 's' breaks out of the loop so it sees the server
+ * has stopped.
+ */
+void LibEventServer::EventLoop::command(char cmd, bool wait) {
+  Lock lock(this);
+  m_done = false;
+  if (write(m_pipeCommand.getIn(), &cmd, 1) < 0) {
+    Logger::Error("unable to signal event loop %d", id);
+    return;
+  }
+  while (wait && !m_done) {
+    Synchronizable::wait();
+  }
+}
+
+void LibEventServer::EventLoop::onCommand() {
+  char cmd;
+  if (read(m_pipeCommand.getOut(), &cmd, 1) != 1) return;
+  if (cmd == 'a') {
+    if (acceptSock >= 0 && evhttp_del_accept_socket(http, acceptSock) < 0) {
+      Logger::Error("Unable to delete accept socket of event loop %d", id);
+    }
+  } else if (cmd == 's') {
+    event_base_loopbreak(eventBase);
+  }
+  Lock lock(this);
+  m_done = true;
+  notify();
+}
+
+static int bind_reuse_port(const std::string &address, int port) {
+  struct addrinfo hints, *ai;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  char service[16];
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(address.empty() ? NULL : address.c_str(), service,
+                  &hints, &ai) != 0) {
+    return -1;
+  }
+  int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  if (fd >= 0) {
+    int on = 1;
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+        fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0 ||
+        bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+        listen(fd, 128) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(ai);
+  return fd;
+}
+
+void LibEventServer::setEventLoopCount(int count, bool reusePort) {
+  ASSERT(getStatus() == NOT_YET_STARTED);
+  m_eventLoopCount = count > 1 ? count : 1;
+  m_reusePort = reusePort;
+}
+
+void LibEventServer::dropAcceptSocket() {
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->command('a', true);
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // implementing HttpServer
 
 int LibEventServer::getAcceptSocket() {
   int ret;
+  if (m_reusePort && m_eventLoopCount > 1) {
+    ret = bind_reuse_port(m_address, m_port);
+    if (ret < 0 || evhttp_accept_socket(m_server, ret) < 0) {
+      if (ret >= 0) close(ret);
+      Logger::Error("Fail to bind port %d", m_port);
+      return -1;
+    }
+    m_accept_sock = ret;
+    return 0;
+  }
   ret = evhttp_bind_socket_with_fd(m_server, m_address.c_str(), m_port);
   if (ret < 0) {
     Logger::Error("Fail to bind port %d", m_port);
@@ -213,30 +379,53 @@ void LibEventServer::start() {
     Logger::Info("Listen on ssl port %d",m_port_ssl);
   }
 
+  for (int i = 1; i < m_eventLoopCount; i++) {
+    EventLoopPtr loop(new EventLoop(this, i));
+    if (m_reusePort) {
+      loop->acceptSock = bind_reuse_port(m_address, m_port);
+      loop->ownSocket = true;
+    } else {
+      loop->acceptSock = m_accept_sock;
+    }
+    if (loop->acceptSock < 0 ||
+        evhttp_accept_socket(loop->http, loop->acceptSock) < 0) {
+      Logger::Error("Fail to listen on port %d in event loop %d", m_port, i);
+      throw FailedToListenException(m_address, m_port);
+    }
+    m_loops.push_back(loop);
+  }
+
   setStatus(RUNNING);
   m_dispatcher.start();
   m_dispatcherThread.start();
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->thread.start();
+  }
   m_timeoutThread.start();
 }
 
 void LibEventServer::waitForEnd() {
   m_dispatcherThread.waitForEnd();
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->thread.waitForEnd();
+  }
 
   m_timeoutThreadData.stop();
   m_timeoutThread.waitForEnd();
 }
 
-void LibEventServer::dispatchWithTimeout(int timeoutSeconds) {
+void LibEventServer::dispatchWithTimeout(event_base *eventBase,
+                                         int timeoutSeconds) {
   struct timeval timeout;
   timeout.tv_sec = timeoutSeconds;
   timeout.tv_usec = 0;
 
   event eventTimeout;
-  event_set(&eventTimeout, -1, 0, on_timer, m_eventBase);
-  event_base_set(m_eventBase, &eventTimeout);
+  event_set(&eventTimeout, -1, 0, on_timer, eventBase);
+  event_base_set(eventBase, &eventTimeout);
   event_add(&eventTimeout, &timeout);
 
-  event_base_loop(m_eventBase, EVLOOP_ONCE);
+  event_base_loop(eventBase, EVLOOP_ONCE);
 
   event_del(&eventTimeout);
 }
@@ -262,7 +451,8 @@ void LibEventServer::dispatch() {
 
   // flusing all remaining events
   if (RuntimeOption::ServerGracefulShutdownWait) {
-    dispatchWithTimeout(RuntimeOption::ServerGracefulShutdownWait);
+    dispatchWithTimeout(m_eventBase,
+                        RuntimeOption::ServerGracefulShutdownWait);
   }
 }
 
@@ -282,6 +472,13 @@ void LibEventServer::stop() {
     // an error occured but we're in shutdown already, so ignore
   }
   m_dispatcherThread.waitForEnd();
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->command('s', false);
+  }
+  for (unsigned int i = 0; i < m_loops.size(); i++) {
+    m_loops[i]->thread.waitForEnd();
+  }
+  m_loops.clear();
   evhttp_free(m_server);
   m_server = NULL;
 }
@@ -325,7 +522,8 @@ void LibEventServer::onThreadEnter() {
     (&ThreadInfo::s_threadInfo->m_reqInjectionData);
 }
 
-void LibEventServer::onRequest(struct evhttp_request *request) {
+void LibEventServer::onRequest(struct evhttp_request *request,
+                               int loop /* = 0 */) {
   if (RuntimeOption::EnableKeepAlive &&
       RuntimeOption::ConnectionTimeoutSeconds > 0) {
     // before processing request, set the connection timeout
@@ -334,12 +532,61 @@ void LibEventServer::onRequest(struct evhttp_request *request) {
                                   RuntimeOption::ConnectionTimeoutSeconds);
   }
   if (getStatus() == RUNNING) {
-    m_dispatcher.enqueue(LibEventJobPtr(new LibEventJob(request)));
+    bool priority = false;
+    if (m_admissionControl && !RuntimeOption::ServerPriorityURLs.empty()) {
+      const char *uri = request->uri;
+      const char *query = strchr(uri, '?');
+      std::string path = query ? std::string(uri, query - uri) : uri;
+      priority = RuntimeOption::ServerPriorityURLs.find(path) !=
+        RuntimeOption::ServerPriorityURLs.end();
+    }
+    m_dispatcher.enqueue(LibEventJobPtr(new LibEventJob(request, priority,
+                                                        loop)),
+                         priority);
   } else {
     Logger::Error("throwing away one new request while shutting down");
   }
 }
 
+bool LibEventServer::onDequeue(LibEventJobPtr job, int64 queued) {
+  m_admission.record(queued);
+  CompressionPolicy::OnQueueTime(queued);
+
+  if (!m_admissionControl ||
+      RuntimeOption::ServerQueueTargetMilliSeconds <= 0) {
+    return false;
+  }
+  if (!m_admission.shed(queued, now_usec(), getQueuedJobs() == 0,
+                        job->priority,
+                        RuntimeOption::ServerQueueTargetMilliSeconds * 1000,
+                        RuntimeOption::ServerQueueIntervalMilliSeconds *
+                        1000)) {
+    return false;
+  }
+  if (RuntimeOption::EnableStats && RuntimeOption::EnableWebStats) {
+    ServerStats::Log("page.shed", 1);
+  }
+  return true;
+}
+
+std::string LibEventServer::getQueueLatency() {
+  std::ostringstream out;
+  out << "{\n";
+  out << "\"QueueLatency\": {\n";
+  for (int i = 0; i < QueueAdmission::LatencyBuckets; i++) {
+    if (i < QueueAdmission::LatencyBuckets - 1) {
+      out << "  \"<" << (1 << i) << "ms\": ";
+    } else {
+      out << "  \">=" << (1 << (i - 1)) << "ms\": ";
+    }
+    out << m_admission.getLatency(i) << ",\n";
+  }
+  out << "  \"Shed\": " << m_admission.getShed() << "\n";
+  out << "}\n";
+  out << "}\n";
+  return out.str();
+}
+
 void LibEventServer::onResponse(int worker, evhttp_request *request,
                                 int code) {
   int nwritten = 0;
@@ -352,44 +599,52 @@ void LibEventServer::onResponse(int worker, evhttp_request *request,
     const char *reason = HttpProtocol::GetReasonString(code);
     nwritten = evhttp_send_reply_sync_begin(request, code, reason, NULL);
   }
-  m_responseQueue.enqueue(worker, request, code, nwritten);
+  getResponseQueue(worker).enqueue(worker, request, code, nwritten);
 }
 
 void LibEventServer::onChunkedResponse(int worker, evhttp_request *request,
                                        int code, evbuffer *chunk,
                                        bool firstChunk) {
-  m_responseQueue.enqueue(worker, request, code, chunk, firstChunk);
+  getResponseQueue(worker).enqueue(worker, request, code, chunk, firstChunk);
 }
 
 void LibEventServer::onChunkedResponseEnd(int worker,
                                           evhttp_request *request) {
-  m_responseQueue.enqueue(worker, request);
+  getResponseQueue(worker).enqueue(worker, request);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // PendingResponseQueue
 
-PendingResponseQueue::PendingResponseQueue() {
-  ASSERT(RuntimeOption::ResponseQueueCount > 0);
-  for (int i = 0; i < RuntimeOption::ResponseQueueCount; i++) {
-    m_responseQueues.push_back(ResponseQueuePtr(new ResponseQueue()));
+PendingResponseQueue::PendingResponseQueue(int workerCount) {
+  ASSERT(RuntimeOption::ResponseQueueSize > 0);
+  for (int i = 0; i < workerCount; i++) {
+    m_rings.push_back(new ResponseRing(RuntimeOption::ResponseQueueSize));
+  }
+}
+
+PendingResponseQueue::~PendingResponseQueue() {
+  for (unsigned int i = 0; i < m_rings.size(); i++) {
+    Response res;
+    while (m_rings[i]->pop(res)) {
+      if (res.chunk) evbuffer_free(res.chunk);
+    }
+    delete m_rings[i];
   }
 }
 
 bool PendingResponseQueue::empty() {
-  for (int i = 0; i < RuntimeOption::ResponseQueueCount; i++) {
-    ResponseQueue &q = *m_responseQueues[i];
-    Lock lock(q.m_mutex);
-    if (!q.m_responses.empty()) return false;
+  for (unsigned int i = 0; i < m_rings.size(); i++) {
+    if (!m_rings[i]->empty()) return false;
   }
   return true;
 }
 
 void PendingResponseQueue::create(event_base *eventBase) {
   if (!m_ready.open()) {
-    throw FatalErrorException("unable to create pipe for ready signal");
+    throw FatalErrorException("unable to create ready signal");
   }
-  event_set(&m_event, m_ready.getOut(), EV_READ|EV_PERSIST, on_response, this);
+  event_set(&m_event, m_ready.getFd(), EV_READ|EV_PERSIST, on_response, this);
   event_base_set(eventBase, &m_event);
   event_add(&m_event, NULL);
 }
@@ -398,102 +653,94 @@ void PendingResponseQueue::close() {
   event_del(&m_event);
 }
 
-void PendingResponseQueue::enqueue(int worker, ResponsePtr response) {
-  {
-    int i = worker % RuntimeOption::ResponseQueueCount;
-    ResponseQueue &q = *m_responseQueues[i];
-    Lock lock(q.m_mutex);
-    q.m_responses.push_back(response);
+void PendingResponseQueue::enqueue(int worker, const Response &res) {
+  ASSERT(worker >= 0 && worker < (int)m_rings.size());
+  ResponseRing &ring = *m_rings[worker];
+  while (!ring.push(res)) {
+    // the event loop has been signaled already and will make room
+    sched_yield();
   }
 
-  // signal to call process()
-  if (write(m_ready.getIn(), &response, 1) < 0) {
-    // an error occured but nothing we can really do
-  }
+  // signal to call process(), unless it's been signaled and not run yet
+  m_ready.signal();
 }
 
 void PendingResponseQueue::enqueue(int worker, evhttp_request *request,
                                    int code, int nwritten) {
-  ResponsePtr res(new Response());
-  res->request = request;
-  res->code = code;
-  res->nwritten = nwritten;
+  Response res;
+  res.request = request;
+  res.code = code;
+  res.nwritten = nwritten;
+  res.chunked = false;
+  res.firstChunk = false;
+  res.chunk = NULL;
   enqueue(worker, res);
 }
 
 void PendingResponseQueue::enqueue(int worker, evhttp_request *request,
                                    int code, evbuffer *chunk,
                                    bool firstChunk) {
-  ResponsePtr res(new Response());
-  res->request = request;
-  res->code = code;
-  res->chunked = true;
-  res->chunk = chunk;
-  res->firstChunk = firstChunk;
+  Response res;
+  res.request = request;
+  res.code = code;
+  res.nwritten = 0;
+  res.chunked = true;
+  res.firstChunk = firstChunk;
+  res.chunk = chunk;
   enqueue(worker, res);
 }
 
 void PendingResponseQueue::enqueue(int worker, evhttp_request *request) {
-  ResponsePtr res(new Response());
-  res->request = request;
-  res->chunked = true;
+  Response res;
+  res.request = request;
+  res.code = 0;
+  res.nwritten = 0;
+  res.chunked = true;
+  res.firstChunk = false;
+  res.chunk = NULL;
   enqueue(worker, res);
 }
 
 void PendingResponseQueue::process() {
-  // clean up the pipe for next signals
-  char buf[512];
-  if (read(m_ready.getOut(), buf, sizeof(buf)) < 0) {
-    // an error occured but nothing we can really do
-  }
-
-  // making a copy so we don't hold up the mutex very long
-  ResponsePtrVec responses;
-  for (int i = 0; i < RuntimeOption::ResponseQueueCount; i++) {
-    ResponseQueue &q = *m_responseQueues[i];
-    Lock lock(q.m_mutex);
-    responses.insert(responses.end(),
-                     q.m_responses.begin(), q.m_responses.end());
-    q.m_responses.clear();
+  // anything a worker pushes from here on needs another signal
+  m_ready.clear();
+
+  // each worker's responses in the order it queued them, which chunked
+  // responses rely on
+  for (unsigned int i = 0; i < m_rings.size(); i++) {
+    ResponseRing &ring = *m_rings[i];
+    Response res;
+    while (ring.pop(res)) {
+      send(res);
+    }
   }
+}
 
-  for (unsigned int i = 0; i < responses.size(); i++) {
-    Response &res = *responses[i];
-    evhttp_request *request = res.request;
-    int code = res.code;
+void PendingResponseQueue::send(Response &res) {
+  evhttp_request *request = res.request;
+  int code = res.code;
 
-    bool skip_sync = false;
+  bool skip_sync = false;
 #ifdef _EVENT_USE_OPENSSL
-    skip_sync = evhttp_is_connection_ssl(request->evcon);
+  skip_sync = evhttp_is_connection_ssl(request->evcon);
 #endif
 
-    if (res.chunked) {
-      if (res.chunk) {
-        if (res.firstChunk) {
-          const char *reason = HttpProtocol::GetReasonString(code);
-          evhttp_send_reply_start(request, code, reason);
-        }
-        evhttp_send_reply_chunk(request, res.chunk);
-      } else {
-        evhttp_send_reply_end(request);
+  if (res.chunked) {
+    if (res.chunk) {
+      if (res.firstChunk) {
+        const char *reason = HttpProtocol::GetReasonString(code);
+        evhttp_send_reply_start(request, code, reason);
       }
-    } else if (RuntimeOption::LibEventSyncSend && !skip_sync) {
-      evhttp_send_reply_sync_end(res.nwritten, request);
+      evhttp_send_reply_chunk(request, res.chunk);
+      evbuffer_free(res.chunk);
     } else {
-      const char *reason = HttpProtocol::GetReasonString(code);
-      evhttp_send_reply(request, code, reason, NULL);
+      evhttp_send_reply_end(request);
     }
-  }
-}
-
-PendingResponseQueue::Response::Response()
-  : request(NULL), code(0), nwritten(0),
-    chunked(false), firstChunk(false), chunk(NULL) {
-}
-
-PendingResponseQueue::Response::~Response() {
-  if (chunk) {
-    evbuffer_free(chunk);
+  } else if (RuntimeOption::LibEventSyncSend && !skip_sync) {
+    evhttp_send_reply_sync_end(res.nwritten, request);
+  } else {
+    const char *reason = HttpProtocol::GetReasonString(code);
+    evhttp_send_reply(request, code, reason, NULL);
   }
 }
 
@@ -22,6 +22,9 @@
 #include <runtime/base/timeout_thread.h>
 #include <util/job_queue.h>
 #include <util/process.h>
+#include <util/queue_admission.h>
+#include <util/ring_buffer.h>
+#include <util/ready_signal.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -33,17 +36,19 @@ namespace HPHP {
 DECLARE_BOOST_TYPES(LibEventJob);
 class LibEventJob {
 public:
-  LibEventJob(evhttp_request *req);
-  void stopTimer();
+  LibEventJob(evhttp_request *req, bool prio = false, int lp = 0);
+
+  /**
+   * Returns how long the job was queued, in microseconds.
+   */
+  int64 stopTimer();
 
   evhttp_request *request;
+  bool priority; // not subject to admission control
+  int loop;      // the event loop that received it
 
 private:
-#if defined(__APPLE__)
-  timeval start;
-#else
-  timespec start;
-#endif
+  int64 start; // in microseconds
 };
 
 /**
@@ -72,11 +77,16 @@ private:
 };
 
 /**
- * Helper class for queuing up response sending back to event loop.
+ * Helper class for queuing up response sending back to event loop. Every
+ * worker has a ring of its own that only it writes and only the event loop
+ * reads, so handing over a response takes neither a lock nor an allocation.
+ * The event loop is woken through a ReadySignal, only once for however many
+ * responses are queued before it gets around to process().
  */
 class PendingResponseQueue {
 public:
-  PendingResponseQueue();
+  PendingResponseQueue(int workerCount);
+  ~PendingResponseQueue();
 
   bool empty();
   void create(event_base *eventBase);
@@ -88,39 +98,32 @@ public:
   void close();
 
 private:
-  DECLARE_BOOST_TYPES(Response);
-  class Response {
-  public:
-    Response();
-    ~Response();
-
+  struct Response {
     evhttp_request *request;
     int code;
     int nwritten;
 
     bool chunked;
     bool firstChunk;
-    evbuffer *chunk;
+    evbuffer *chunk; // freed once it's sent
   };
 
-  DECLARE_BOOST_TYPES(ResponseQueue);
-  class ResponseQueue {
-  public:
-    Mutex m_mutex;
-    std::deque<ResponsePtr> m_responses;
-  };
+  typedef RingBuffer<Response> ResponseRing;
 
   // signal between worker thread and response processing thread
   event m_event;
-  CPipe m_ready;
-  ResponseQueuePtrVec m_responseQueues;
+  ReadySignal m_ready;
+  std::vector<ResponseRing *> m_rings;
 
-  void enqueue(int worker, ResponsePtr response);
+  void enqueue(int worker, const Response &res);
+  void send(Response &res);
 };
 
 /**
  * Implementing an evhttp based HTTP server with JobQueueDispatcher. This
- * server will have one dispather thread and multiple worker threads.
+ * server will have one dispather thread and multiple worker threads, or
+ * with setEventLoopCount(), several dispatcher threads each running an
+ * event loop of its own.
  */
 class LibEventServer : public Server {
 public:
@@ -141,13 +144,47 @@ public:
   virtual int getQueuedJobs() {
     return m_dispatcher.getQueuedJobs();
   }
+  virtual std::string getQueueLatency();
+
+  /**
+   * Turns on admission control: a job that has waited longer than it's
+   * allowed to is answered with 503 instead of being handled. It's allowed
+   * Server.QueueIntervalMilliSeconds while the queue keeps emptying, and
+   * Server.QueueTargetMilliSeconds once the queue hasn't been empty for
+   * that long, so a standing queue drains quickly. Paths in
+   * Server.PriorityURLs are never shed and are taken before other jobs.
+   */
+  void setAdmissionControl(bool enabled) { m_admissionControl = enabled; }
+
+  /**
+   * Called by workers with how long a job was queued. Returns true if the
+   * job should be shed.
+   */
+  bool onDequeue(LibEventJobPtr job, int64 queued);
+
+  /**
+   * Runs count event loops instead of one, each on a thread of its own with
+   * its own evhttp and response queue, so accepting connections, parsing
+   * requests and sending responses isn't limited to one core. The extra
+   * loops accept on the main loop's socket, or with reusePort, on sockets
+   * of their own bound with SO_REUSEPORT, which the kernel balances
+   * connections across. SSL is only served by the main loop. Has to be
+   * called before start().
+   */
+  void setEventLoopCount(int count, bool reusePort);
+
+  /**
+   * Called by a worker before it handles a job, so responses go back to the
+   * event loop the request came from.
+   */
+  void setWorkerLoop(int worker, int loop) { m_workerLoops[worker] = loop; }
 
   void onThreadEnter();
 
   /**
    * Request handler called by evhttp library.
    */
-  void onRequest(evhttp_request *request);
+  void onRequest(evhttp_request *request, int loop = 0);
   void onChunkedRead();
 
   /**
@@ -172,6 +209,12 @@ protected:
   virtual int getAcceptSocket();
   virtual int getAcceptSocketSSL();
 
+  /**
+   * Makes the extra event loops stop accepting on m_accept_sock, waiting
+   * until they have.
+   */
+  void dropAcceptSocket();
+
   int m_accept_sock;
   int m_accept_sock_ssl;
   event_base *m_eventBase;
@@ -187,16 +230,63 @@ protected:
   TimeoutThread m_timeoutThreadData;
   AsyncFunc<TimeoutThread> m_timeoutThread;
 
+  int m_eventLoopCount;
+  bool m_reusePort;
+
 private:
+  /**
+   * An event loop besides the main one. It's told what to do through a pipe
+   * that it reads on its own thread, since event bases aren't thread safe.
+   */
+  DECLARE_BOOST_TYPES(EventLoop);
+  class EventLoop : public Synchronizable {
+  public:
+    EventLoop(LibEventServer *server, int id);
+    ~EventLoop();
+
+    void run();
+    void command(char cmd, bool wait);
+    void onCommand();
+
+    // evhttp and event callbacks, with the EventLoop as obj
+    static void on_loop_request(evhttp_request *request, void *obj);
+    static void on_loop_command(int fd, short events, void *obj);
+
+    LibEventServer *server;
+    int id;
+    event_base *eventBase;
+    evhttp *http;
+    int acceptSock;
+    bool ownSocket;
+    PendingResponseQueue responseQueue;
+    AsyncFunc<EventLoop> thread;
+
+  private:
+    CPipe m_pipeCommand;
+    event m_eventCommand;
+    bool m_done;
+  };
+  EventLoopPtrVec m_loops;
+  std::vector<int> m_workerLoops; // which loop each worker's request is from
+
+  PendingResponseQueue &getResponseQueue(int worker) {
+    int loop = m_workerLoops[worker];
+    return loop ? m_loops[loop - 1]->responseQueue : m_responseQueue;
+  }
+
   JobQueueDispatcher<LibEventJobPtr, LibEventWorker> m_dispatcher;
   AsyncFunc<LibEventServer> m_dispatcherThread;
 
+  // admission control
+  bool m_admissionControl;
+  QueueAdmission m_admission;
+
   PendingResponseQueue m_responseQueue;
 
   // dispatcher thread runs this function
   void dispatch();
 
-  void dispatchWithTimeout(int timeoutSeconds);
+  void dispatchWithTimeout(event_base *eventBase, int timeoutSeconds);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -107,6 +107,7 @@ int LibEventServerWithTakeover::afdtRequest(String request, String* response) {
       // log message is not too harmful.
       Logger::Error("Unable to delete accept socket");
     }
+    dropAcceptSocket();
     return m_accept_sock;
   } else if (request == P_VERSION C_TERM_REQ) {
     Logger::Info("takeover: request is a terminate request");
@@ -262,6 +263,8 @@ void LibEventServerWithTakeover::start() {
     m_accept_sock_ssl = -2;
   }
 
+  // the extra event loops have to share the socket we hand over
+  m_reusePort = false;
   LibEventServer::start();
 
   if (m_took_over) {
@@ -232,7 +232,7 @@ void PageletServer::Restart() {
       (RuntimeOption::PageletServerThreadCount,
        RuntimeOption::ServerThreadRoundRobin,
        RuntimeOption::ServerThreadDropCacheTimeoutSeconds,
-       NULL);
+       NULL, false, RuntimeOption::PageletServerThreadWorkStealing);
     Logger::Info("pagelet server started");
     s_dispatcher->start();
   }
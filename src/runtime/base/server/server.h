@@ -160,6 +160,11 @@ public:
    */
   virtual int getQueuedJobs() = 0;
 
+  /**
+   * Histogram of how long jobs were queued, and how many were shed.
+   */
+  virtual std::string getQueueLatency() = 0;
+
   /**
    * This is for TypedServer to specialize a worker class to use.
    */
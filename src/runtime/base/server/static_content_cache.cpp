@@ -30,7 +30,7 @@ namespace HPHP {
 StaticContentCache StaticContentCache::TheCache;
 FileCachePtr StaticContentCache::TheFileCache;
 
-StaticContentCache::StaticContentCache() : m_totalSize(0) {
+StaticContentCache::StaticContentCache() : m_totalSize(0), m_mtime(0) {
 }
 
 void StaticContentCache::load() {
@@ -46,6 +46,10 @@ void StaticContentCache::load() {
       TheFileCache->load(RuntimeOption::FileCache.c_str(),
                          RuntimeOption::EnableOnDemandUncompress, version);
     }
+    struct stat sb;
+    if (stat(RuntimeOption::FileCache.c_str(), &sb) == 0) {
+      m_mtime = sb.st_mtime;
+    }
     Logger::Info("loaded file cache from %s",
                  RuntimeOption::FileCache.c_str());
     return;
@@ -94,6 +98,11 @@ void StaticContentCache::load() {
         f->file = sb;
         m_files[url] = f;
 
+        struct stat st;
+        if (stat(out[i].c_str(), &st) == 0 && st.st_mtime > m_mtime) {
+          m_mtime = st.st_mtime;
+        }
+
         // prepare gzipped content, skipping image and swf files
         if (iter->second.find("image/") != 0 && iter->first != "swf") {
           int len = sb->size();
@@ -117,9 +126,10 @@ void StaticContentCache::load() {
 }
 
 bool StaticContentCache::find(const std::string &name, const char *&data,
-                              int &len, bool &compressed) const {
+                              int &len, bool &compressed,
+                              FileCache::Pin &pin) const {
   if (TheFileCache) {
-    return data = TheFileCache->read(name.c_str(), len, compressed);
+    return data = TheFileCache->read(name.c_str(), len, compressed, pin);
   }
 
   StringToResourceFilePtrMap::const_iterator iter = m_files.find(name);
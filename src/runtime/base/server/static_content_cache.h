@@ -40,10 +40,16 @@ public:
    * Find a file from cache.
    */
   bool find(const std::string &name, const char *&data, int &len,
-            bool &compressed) const;
+            bool &compressed, FileCache::Pin &pin) const;
+
+  /**
+   * When the cached content last changed, for ETags.
+   */
+  time_t getMTime() const { return m_mtime; }
 
 private:
   int m_totalSize;
+  time_t m_mtime;
 
   DECLARE_BOOST_TYPES(ResourceFile);
   struct ResourceFile {
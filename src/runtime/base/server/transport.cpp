@@ -18,8 +18,10 @@
 #include <runtime/base/server/server.h>
 #include <runtime/base/server/upload.h>
 #include <runtime/base/server/server_stats.h>
+#include <runtime/base/server/compression_policy.h>
 #include <runtime/base/file/file.h>
 #include <util/compression.h>
+#include <util/timer.h>
 #include <util/util.h>
 #include <util/logger.h>
 #include <runtime/base/string_util.h>
@@ -38,7 +40,8 @@ Transport::Transport()
     m_chunkedEncoding(false), m_headerSent(false),
     m_responseCode(-1), m_firstHeaderSet(false), m_firstHeaderLine(0),
     m_responseSize(0), m_sendContentType(true),
-    m_compression(true), m_compressor(NULL), m_isSSL(false),
+    m_compression(true), m_compressor(NULL), m_compressionLevel(0),
+    m_isSSL(false),
     m_compressionDecision(NotDecidedYet), m_threadType(RequestThread) {
 }
 
@@ -49,9 +52,7 @@ Transport::~Transport() {
   if (m_postData) {
     free(m_postData);
   }
-  if (m_compressor) {
-    delete m_compressor;
-  }
+  StreamCompressor::Release(m_compressor);
 }
 
 const char *Transport::getMethodName() {
@@ -619,10 +620,16 @@ String Transport::prepareResponse(const void *data, int size, bool &compressed,
   // where we don't really know if next chunk will benefit from compresseion.
   if (m_chunkedEncoding || size > 1000 ||
       m_compressionDecision == HasToCompress) {
+    bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableWebStats;
     if (m_compressor == NULL) {
-      m_compressor = new StreamCompressor(RuntimeOption::GzipCompressionLevel,
-                                          CODING_GZIP, true);
+      m_compressionLevel = CompressionPolicy::GetLevel();
+      m_compressor = StreamCompressor::Acquire(m_compressionLevel,
+                                               CODING_GZIP, true);
+      if (stats) {
+        ServerStats::Log("network.gzip.level", m_compressionLevel);
+      }
     }
+    Timer timer(Timer::WallTime);
     int len = size;
     char *compressedData =
       m_compressor->compress((const char*)data, len, last);
@@ -633,9 +640,14 @@ String Transport::prepareResponse(const void *data, int size, bool &compressed,
         response = deleter;
         compressed = true;
       }
+      if (stats) {
+        ServerStats::Log("network.gzip.in", size);
+        ServerStats::Log("network.gzip.out", len);
+        ServerStats::Log("network.gzip.usec", timer.getMicroSeconds());
+      }
     } else {
       Logger::Error("Unable to compress response: level=%d len=%d",
-                    RuntimeOption::GzipCompressionLevel, len);
+                    m_compressionLevel, len);
     }
   }
 
@@ -342,6 +342,7 @@ protected:
   bool m_sendContentType;
   bool m_compression;
   StreamCompressor *m_compressor;
+  int m_compressionLevel;
 
   bool m_isSSL;
 
@@ -177,7 +177,7 @@ void XboxServer::Restart() {
       (RuntimeOption::XboxServerThreadCount,
        RuntimeOption::ServerThreadRoundRobin,
        RuntimeOption::ServerThreadDropCacheTimeoutSeconds,
-       NULL);
+       NULL, false, RuntimeOption::XboxServerThreadWorkStealing);
     Logger::Info("xbox server started");
     s_dispatcher->start();
   }
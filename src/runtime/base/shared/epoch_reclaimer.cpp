@@ -0,0 +1,149 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/shared/epoch_reclaimer.h>
+#include <util/lock.h>
+#include <util/thread_local.h>
+#include <tbb/atomic.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Every thread that has ever read gets a slot, and slots are reused but never
+ * freed, so Reclaim() can walk them while threads come and go. A slot's epoch
+ * is 0 while its thread isn't reading. Otherwise it is odd, and the rest of it
+ * (epoch >> 1) is one more than the global epoch when the thread started.
+ */
+struct EpochSlot {
+  char padBefore[64];          // the epoch gets a cache line of its own
+  tbb::atomic<uint64> epoch;
+  tbb::atomic<int> used;
+  int depth;                   // only touched by the owning thread
+  EpochSlot *next;
+  char padAfter[64];
+};
+
+static tbb::atomic<uint64> s_epoch;
+static tbb::atomic<EpochSlot *> s_slots;
+
+static EpochSlot *claim_slot() {
+  for (EpochSlot *slot = s_slots; slot; slot = slot->next) {
+    if (slot->used == 0 && slot->used.compare_and_swap(1, 0) == 0) {
+      return slot;
+    }
+  }
+  EpochSlot *slot = new EpochSlot();
+  slot->epoch = 0;
+  slot->used = 1;
+  slot->depth = 0;
+  EpochSlot *head;
+  do {
+    head = s_slots;
+    slot->next = head;
+  } while (s_slots.compare_and_swap(slot, head) != head);
+  return slot;
+}
+
+class EpochSlotOwner {
+public:
+  EpochSlotOwner() : m_slot(claim_slot()) {}
+  ~EpochSlotOwner() {
+    ASSERT(m_slot->depth == 0);
+    m_slot->used = 0;
+  }
+  EpochSlot *m_slot;
+};
+static IMPLEMENT_THREAD_LOCAL(EpochSlotOwner, s_slotOwner);
+
+struct RetiredObject {
+  void *p;
+  EpochReclaimer::Destroyer destroy;
+  uint64 epoch;
+};
+static Mutex s_retiredMutex;
+static std::vector<RetiredObject> s_retired;
+
+// how many retired objects wait before Reclaim() walks the slots
+static const unsigned int ReclaimBatch = 32;
+
+///////////////////////////////////////////////////////////////////////////////
+
+void EpochReclaimer::Enter() {
+  EpochSlot *slot = s_slotOwner->m_slot;
+  if (slot->depth++ == 0) {
+    // a locked exchange, so no read that follows can happen before other
+    // threads see this one as reading
+    slot->epoch.fetch_and_store(((s_epoch + 1) << 1) | 1);
+  }
+}
+
+void EpochReclaimer::Leave() {
+  EpochSlot *slot = s_slotOwner->m_slot;
+  ASSERT(slot->depth > 0);
+  if (--slot->depth == 0) {
+    slot->epoch = 0;
+  }
+}
+
+void EpochReclaimer::Retire(void *p, Destroyer destroy) {
+  RetiredObject obj;
+  obj.p = p;
+  obj.destroy = destroy;
+  // p is unlinked already, and anyone who sees this increment sees that too
+  obj.epoch = s_epoch.fetch_and_increment() + 2;
+  bool reclaim;
+  {
+    Lock lock(s_retiredMutex);
+    s_retired.push_back(obj);
+    reclaim = s_retired.size() >= ReclaimBatch;
+  }
+  if (reclaim) Reclaim();
+}
+
+int EpochReclaimer::Reclaim() {
+  // objects retired while the slots are walked aren't covered by the walk
+  uint64 oldest = s_epoch + 1;
+  for (EpochSlot *slot = s_slots; slot; slot = slot->next) {
+    uint64 epoch = slot->epoch;
+    if ((epoch & 1) && (epoch >> 1) < oldest) {
+      oldest = epoch >> 1;
+    }
+  }
+
+  std::vector<RetiredObject> ready;
+  int waiting;
+  {
+    Lock lock(s_retiredMutex);
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < s_retired.size(); i++) {
+      if (s_retired[i].epoch <= oldest) {
+        ready.push_back(s_retired[i]);
+      } else {
+        s_retired[kept++] = s_retired[i];
+      }
+    }
+    s_retired.resize(kept);
+    waiting = kept;
+  }
+  for (unsigned int i = 0; i < ready.size(); i++) {
+    ready[i].destroy(ready[i].p);
+  }
+  return waiting;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,70 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_EPOCH_RECLAIMER_H__
+#define __HPHP_EPOCH_RECLAIMER_H__
+
+#include <runtime/base/types.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Lets readers walk shared data without taking any lock. A writer unlinks
+ * what it removes, so new readers can't find it, and retires it instead of
+ * freeing it. It's freed once every reader that was already reading at that
+ * point is done.
+ *
+ * Readers only ever write to their own thread's slot, so they don't fight
+ * over a cache line the way they do over a reader-writer lock. Retiring never
+ * waits for readers, which matters because a reader may run PHP code, say
+ * __wakeup() while unserializing, and that code may write to the same data.
+ */
+class EpochReclaimer {
+public:
+  /**
+   * The current thread is reading for as long as a ReadSection is alive.
+   * Sections nest.
+   */
+  class ReadSection {
+  public:
+    ReadSection() { Enter();}
+    ~ReadSection() { Leave();}
+  };
+
+  typedef void (*Destroyer)(void *p);
+
+  /**
+   * Calls destroy(p) once no reader can be looking at p anymore, which may be
+   * right away. p has to be unlinked already.
+   */
+  static void Retire(void *p, Destroyer destroy);
+
+  /**
+   * Destroys whatever was retired and is safe to destroy now. Returns how
+   * many retired objects are still waiting.
+   */
+  static int Reclaim();
+
+private:
+  static void Enter();
+  static void Leave();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_EPOCH_RECLAIMER_H__
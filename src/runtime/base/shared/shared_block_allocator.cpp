@@ -0,0 +1,135 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/shared/shared_block_allocator.h>
+#include <util/alloc.h>
+#include <util/lock.h>
+#include <tbb/atomic.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Chunks are aligned to ChunkSize, so a block finds its chunk by masking its
+ * address. Every block is preceded by its size, which is negative for a big
+ * block that has a malloc of its own.
+ *
+ * A chunk's live count is the bytes of its blocks that haven't been freed,
+ * plus ChunkSize while it's the chunk new blocks come from. Whoever brings it
+ * to zero frees the chunk.
+ */
+struct SharedChunk {
+  tbb::atomic<int64> live;
+  int64 used;                   // final once it isn't the current chunk
+};
+
+static const int64 BlockHeader = 8;
+static const int64 BigBlock = SharedBlockAllocator::ChunkSize / 8;
+static const int64 ChunkHeader = (sizeof(SharedChunk) + 7) & ~7LL;
+
+static Mutex s_mutex;
+static SharedChunk *s_current;
+static tbb::atomic<int64> s_held;
+static tbb::atomic<int64> s_live;
+
+static SharedChunk *chunk_of(const void *block) {
+  return (SharedChunk *)((int64)block & ~(SharedBlockAllocator::ChunkSize - 1));
+}
+
+static void release_chunk(SharedChunk *chunk, int64 bytes) {
+  if ((chunk->live -= bytes) == 0) {
+    s_held -= SharedBlockAllocator::ChunkSize;
+    free(chunk);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void *SharedBlockAllocator::Alloc(int64 size) {
+  size = (size + BlockHeader + 7) & ~7LL;
+  s_live += size;
+  if (size > BigBlock) {
+    int64 *header = (int64 *)Util::safe_malloc(size);
+    *header = -size;
+    s_held += size;
+    return header + 1;
+  }
+
+  int64 *header;
+  {
+    Lock lock(s_mutex);
+    if (s_current == NULL || s_current->used + size > ChunkSize) {
+      void *p;
+      if (posix_memalign(&p, ChunkSize, ChunkSize) != 0) {
+        throw OutOfMemoryException(ChunkSize);
+      }
+      s_held += ChunkSize;
+      SharedChunk *chunk = (SharedChunk *)p;
+      chunk->live = ChunkSize;
+      chunk->used = ChunkHeader;
+      if (s_current) release_chunk(s_current, ChunkSize);
+      s_current = chunk;
+    }
+    header = (int64 *)((char *)s_current + s_current->used);
+    s_current->used += size;
+    s_current->live += size;
+  }
+  *header = size;
+  return header + 1;
+}
+
+void SharedBlockAllocator::Free(void *block) {
+  int64 *header = (int64 *)block - 1;
+  int64 size = *header;
+  if (size < 0) {
+    s_live += size;
+    s_held += size;
+    free(header);
+    return;
+  }
+  s_live -= size;
+  release_chunk(chunk_of(header), size);
+}
+
+int64 SharedBlockAllocator::Size(const void *block) {
+  int64 size = *((const int64 *)block - 1);
+  return (size < 0 ? -size : size) - BlockHeader;
+}
+
+bool SharedBlockAllocator::NeedsCompaction() {
+  int64 held = s_held;
+  int64 live = s_live;
+  return held - live > 8 * ChunkSize && held - live > live / 2;
+}
+
+bool SharedBlockAllocator::IsSparse(const void *block) {
+  const int64 *header = (const int64 *)block - 1;
+  if (*header < 0) return false;
+  SharedChunk *chunk = chunk_of(header);
+  if (chunk == s_current) return false;
+  return chunk->live * 2 < chunk->used;
+}
+
+int64 SharedBlockAllocator::HeldBytes() {
+  return s_held;
+}
+
+int64 SharedBlockAllocator::LiveBytes() {
+  return s_live;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,62 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_SHARED_BLOCK_ALLOCATOR_H__
+#define __HPHP_SHARED_BLOCK_ALLOCATOR_H__
+
+#include <runtime/base/types.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Allocates the blocks that packed APC values live in. Blocks are carved one
+ * after another out of large chunks, and a chunk goes back to malloc once
+ * every block in it has been freed. Blocks too big to share a chunk get a
+ * malloc of their own.
+ *
+ * Nothing is ever moved by the allocator itself. A block holds no pointers
+ * into itself, so its owner can copy it to a new block with memcpy() and
+ * free the old one, and Compact() is the owner asking which blocks are worth
+ * copying: those left alone in chunks that are mostly free.
+ */
+class SharedBlockAllocator {
+public:
+  static const int64 ChunkSize = 1 << 20;
+
+  static void *Alloc(int64 size);
+  static void Free(void *block);
+  static int64 Size(const void *block);
+
+  /**
+   * Whether chunks hold enough freed bytes they can't give back to be worth
+   * a compaction pass, and whether block is in one of those chunks.
+   */
+  static bool NeedsCompaction();
+  static bool IsSparse(const void *block);
+
+  /**
+   * Bytes held in chunks and big blocks, and the part of it that's in live
+   * blocks.
+   */
+  static int64 HeldBytes();
+  static int64 LiveBytes();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_SHARED_BLOCK_ALLOCATOR_H__
@@ -25,9 +25,19 @@
 #include <runtime/base/server/server_stats.h>
 #include <util/lfu_table.h>
 #include <tbb/concurrent_hash_map.h>
+#include <tbb/atomic.h>
 #include <queue>
 #include <runtime/base/shared/shared_store_stats.h>
+#include <runtime/base/shared/epoch_reclaimer.h>
 #include <runtime/base/variable_serializer.h>
+#include <runtime/base/array/array_init.h>
+#include <runtime/base/shared/shared_store_snapshot.h>
+#include <runtime/base/shared/shared_store_key_stats.h>
+#include <runtime/base/shared/shared_block_allocator.h>
+#include <runtime/base/util/string_buffer.h>
+#include <runtime/ext/ext_apc.h>
+#include <util/async_func.h>
+#include <util/logger.h>
 
 using namespace std;
 using namespace boost;
@@ -48,8 +58,12 @@ public:
                      bool overwrite = true);
   virtual int64 inc(CStrRef key, int64 step, bool &found);
   virtual bool cas(CStrRef key, int64 old, int64 val);
+  virtual Array getMulti(const std::vector<String> &keys);
+  virtual Array storeMulti(CArrRef vars, int64 ttl, bool overwrite = true);
   virtual void prime(const std::vector<KeyValuePair> &vars);
 protected:
+  bool storeLocked(CStrRef key, SharedVariant *var, int64 ttl,
+                   bool overwrite);
   virtual bool find(CStrRef key, StoreValue *&v, bool &expired) = 0;
   virtual void set(CStrRef key, SharedVariant* v, int64 ttl) = 0;
   virtual bool eraseImpl(CStrRef key, bool expired);
@@ -236,7 +250,7 @@ public:
       wrapped->incRef();
       return wrapped;
     }
-    return new ThreadSharedVariant(v, false);
+    return createNew(v);
   }
   inline SharedVariant* create(litstr str, int len, CStrRef v,
                            bool serialized) {
@@ -253,11 +267,19 @@ public:
       wrapped->incRef();
       return wrapped;
     }
-    return new ThreadSharedVariant(v, false);
+    return createNew(v);
   }
 protected:
   Mutex *m_locks;
 
+  static SharedVariant *createNew(CVarRef v) {
+    if (RuntimeOption::ApcPackArrays && v.isArray()) {
+      ThreadSharedVariant *packed = ThreadSharedVariant::Pack(v);
+      if (packed) return packed;
+    }
+    return new ThreadSharedVariant(v, false);
+  }
+
   inline Mutex* getLock(const char *data, int len) {
     ssize_t hash = hash_string(data, len);
     return &m_locks[hash % SharedStore::s_lockCount];
@@ -591,32 +613,50 @@ private:
 class ConcurrentTableSharedStore : public SharedStore,
                                    private ThreadSharedVariantFactory {
 public:
-  ConcurrentTableSharedStore(int id) : SharedStore(id), m_purgeCounter(0) {}
+  ConcurrentTableSharedStore(int id, int64 memoryLimit)
+    : SharedStore(id), m_memoryLimit(memoryLimit), m_hand(0),
+      m_purgeCounter(0) {
+    m_table = NewTable(InitialBuckets);
+    m_count = 0;
+    m_bytes = 0;
+    m_hits = m_misses = m_evictions = 0;
+    m_evicting = 0;
+    m_compacting = 0;
+    m_nextCompaction = 0;
+  }
+  virtual ~ConcurrentTableSharedStore() {
+    DestroyTable(m_table, true);
+  }
 
   virtual int size() {
-    return m_vars.size();
+    return m_count;
   }
   virtual void count(int &reachable, int &expired, int &persistent) {
     reachable = expired = persistent = 0;
     int now = time(NULL);
-    WriteLock l(m_lock);
-    for (Map::const_iterator iter = m_vars.begin();
-         iter != m_vars.end(); ++iter) {
-      reachable += iter->second.var->countReachable();
+    EpochReclaimer::ReadSection rs;
+    Table *t = m_table;
+    for (size_t i = 0; i <= t->mask; i++) {
+      for (Node *node = t->buckets[i]; node; node = node->next) {
+        reachable += node->value.var->countReachable();
 
-      int64 expiration = iter->second.expiry;
-      if (expiration == 0) {
-        persistent++;
-      } else if (expiration <= now) {
-        expired++;
+        int64 expiration = node->value.expiry;
+        if (expiration == 0) {
+          persistent++;
+        } else if (expiration <= now) {
+          expired++;
+        }
       }
     }
   }
   virtual bool get(CStrRef key, Variant &value);
+  virtual bool getStale(CStrRef key, Variant &value, bool &stale);
   virtual bool store(CStrRef key, CVarRef val, int64 ttl,
                      bool overwrite = true);
   virtual int64 inc(CStrRef key, int64 step, bool &found);
   virtual bool cas(CStrRef key, int64 old, int64 val);
+  virtual Array getMulti(const std::vector<String> &keys);
+  virtual Array storeMulti(CArrRef vars, int64 ttl, bool overwrite = true);
   virtual void prime(const std::vector<SharedStore::KeyValuePair> &vars);
   virtual SharedVariant* construct(litstr str, int len, CStrRef v,
                                    bool serialized) {
@@ -626,84 +666,263 @@ public:
     return create(str, len, v);
   }
 
+  virtual std::string reportStats(int &reachable, int indent);
+
   // debug support
   virtual void dump(std::ostream & out);
 
+  virtual bool dumpSnapshot(const char *file);
+  virtual bool loadSnapshot(const char *file, int threads);
+
 protected:
   virtual SharedVariant* construct(CStrRef key, CVarRef v) {
     return create(key, v);
   }
 
-  struct charHashCompare {
-    bool equal(const char *s1, const char *s2) const {
-      ASSERT(s1 && s2);
-      return strcmp(s1, s2) == 0;
+  class SnapshotLoader {
+  public:
+    SnapshotLoader(ConcurrentTableSharedStore *store,
+                   const SharedStoreSnapshot *snapshot, int begin, int end)
+      : m_store(store), m_snapshot(snapshot), m_begin(begin), m_end(end) {}
+    void load() { m_store->loadSnapshot(*m_snapshot, m_begin, m_end);}
+  private:
+    ConcurrentTableSharedStore *m_store;
+    const SharedStoreSnapshot *m_snapshot;
+    int m_begin;
+    int m_end;
+  };
+  void loadSnapshot(const SharedStoreSnapshot &snapshot, int begin, int end);
+
+  /**
+   * Readers walk the table without locks, inside an
+   * EpochReclaimer::ReadSection. Writers lock the stripe that covers the
+   * bucket, and never change a node that has been published: they link in a
+   * new one and retire the old one, whose value is released once no reader
+   * can be looking at it anymore. Growing the table and clear() lock every
+   * stripe and retire the whole old table.
+   *
+   * Keys are hashed with StringData's hash, so a key that already knows its
+   * hash isn't hashed again.
+   *
+   * With a memory limit, every node knows how many bytes it holds, and
+   * evict() runs a clock over the buckets once the total is over the limit.
+   * A hit bumps the node's saturating frequency, which costs readers a write
+   * only until the frequency tops out, and each pass of the clock hand
+   * decrements it. A node is evicted when the hand finds it at zero, so keys
+   * that are stored and never fetched again, as in a scan, go first while hot
+   * keys survive several passes. Primed nodes are never evicted.
+   *
+   * With APC.PackArrays, compact() moves packed arrays out of the allocator's
+   * mostly free chunks by replacing their nodes with copies, so the chunks
+   * can go back to malloc once readers are done with the old blocks.
+   */
+  struct Node {
+    tbb::atomic<Node *> next;
+    StoreValue value;
+    int64 hash;
+    int64 size;
+    int len;
+    tbb::atomic<char> frequency;
+    bool primed;
+    char key[1];
+  };
+  struct Table {
+    size_t mask;
+    tbb::atomic<Node *> *buckets;
+  };
+
+  static const size_t InitialBuckets = 1024;
+  static const int LockCount = 64; // no more than InitialBuckets
+  static const char MaxFrequency = 3;
+  static const int SampleRate = 64; // hits and misses counted 1 in 64
+  static const int CompactionInterval = 10; // in seconds
+
+  tbb::atomic<Table *> m_table;
+  tbb::atomic<int> m_count;
+  Mutex m_locks[LockCount];
+
+  int64 m_memoryLimit;         // in bytes, 0 for no limit
+  tbb::atomic<int64> m_bytes;
+  tbb::atomic<int64> m_hits;
+  tbb::atomic<int64> m_misses;
+  tbb::atomic<int64> m_evictions;
+  tbb::atomic<int> m_evicting; // only one thread runs the clock at a time
+  tbb::atomic<int> m_compacting;
+  int64 m_nextCompaction;      // no compaction pass before this time
+  size_t m_hand;               // next bucket the clock looks at
+
+  Mutex &lockFor(int64 hash) { return m_locks[hash & (LockCount - 1)];}
+  void lockAll() {
+    for (int i = 0; i < LockCount; i++) m_locks[i].lock();
+  }
+  void unlockAll() {
+    for (int i = LockCount - 1; i >= 0; i--) m_locks[i].unlock();
+  }
+
+  static Table *NewTable(size_t buckets) {
+    Table *t = new Table();
+    t->mask = buckets - 1;
+    t->buckets = new tbb::atomic<Node *>[buckets];
+    for (size_t i = 0; i < buckets; i++) {
+      t->buckets[i] = NULL;
     }
-    size_t hash(const char *s) const {
-      ASSERT(s);
-      return hash_string(s);
+    return t;
+  }
+  static void DestroyTable(Table *t, bool values) {
+    for (size_t i = 0; i <= t->mask; i++) {
+      Node *next;
+      for (Node *node = t->buckets[i]; node; node = next) {
+        next = node->next;
+        if (values) node->value.var->decRef();
+        free(node);
+      }
     }
-  };
+    delete [] t->buckets;
+    delete t;
+  }
+  static void DestroyClearedTable(void *p) {
+    DestroyTable((Table *)p, true);
+  }
+  static void DestroyResizedTable(void *p) {
+    // the nodes of the new table own the values now
+    DestroyTable((Table *)p, false);
+  }
+  static void DestroyNode(void *p) {
+    Node *node = (Node *)p;
+    node->value.var->decRef();
+    free(node);
+  }
 
-  typedef tbb::concurrent_hash_map<const char*, StoreValue, charHashCompare>
-    Map;
+  static Node *NewNode(const char *key, int len, int64 hash,
+                       const StoreValue &value, int64 size) {
+    Node *node = (Node *)malloc(sizeof(Node) + len);
+    node->next = NULL;
+    node->value = value;
+    node->hash = hash;
+    node->size = size;
+    node->len = len;
+    node->frequency = 0;
+    node->primed = false;
+    memcpy(node->key, key, len);
+    node->key[len] = '\0';
+    return node;
+  }
 
-  virtual void clear() {
-    WriteLock l(m_lock);
-    if (RuntimeOption::EnableAPCSizeStats) {
-      SharedStoreStats::onClear();
+  /**
+   * What an entry costs, counted only when there's a limit to hold it to.
+   */
+  int64 entrySize(int len, SharedVariant *var) const {
+    if (m_memoryLimit == 0) return 0;
+    SharedVariantStats stats;
+    var->getStats(&stats);
+    return sizeof(Node) + len + stats.dataTotalSize;
+  }
+
+  void touch(Node *node) {
+    char frequency = node->frequency;
+    if (frequency < MaxFrequency) node->frequency = frequency + 1;
+  }
+
+  void countAccess(tbb::atomic<int64> &counter) {
+    if (m_memoryLimit && (++s_accessTicks % SampleRate) == 0) {
+      counter += SampleRate;
     }
-    for (Map::iterator iter = m_vars.begin(); iter != m_vars.end();
-         ++iter) {
-      iter->second.var->decRef();
-      free((void *)iter->first);
+  }
+  static __thread unsigned int s_accessTicks;
+
+  /**
+   * The link that points to the key's node, or to NULL at the end of the
+   * chain when it's not there.
+   */
+  static tbb::atomic<Node *> *FindLink(Table *t, const char *key, int len,
+                                       int64 hash) {
+    tbb::atomic<Node *> *link = &t->buckets[hash & t->mask];
+    for (Node *node = *link; node; node = *link) {
+      if (node->hash == hash && node->len == len &&
+          memcmp(node->key, key, len) == 0) {
+        break;
+      }
+      link = &node->next;
     }
-    m_vars.clear();
+    return link;
+  }
+  static Node *Find(Table *t, const char *key, int len, int64 hash) {
+    return *FindLink(t, key, len, hash);
   }
 
   /**
-   * The Map::accessor here establishes a write lock, which means that other
-   * threads, protected by read locks through Map::const_accessor, will not
-   * read erased values from APC.
-   * The ReadLock here is to sync with clear(), which only has a WriteLock,
-   * not a specific accessor.
+   * Links a copy of node with a new value in place of node, and returns
+   * node for the caller to retire once it has unlocked.
    */
+  Node *replace(tbb::atomic<Node *> *link, Node *node,
+                const StoreValue &value) {
+    Node *copy = NewNode(node->key, node->len, node->hash, value,
+                         entrySize(node->len, value.var));
+    copy->frequency = (char)node->frequency;
+    copy->primed = node->primed;
+    copy->next = node->next;
+    m_bytes += copy->size - node->size;
+    *link = copy;
+    return node;
+  }
+
+  bool storeLocked(CStrRef key, int64 hash, const StoreValue &sval,
+                   int64 ttl, int64 size, bool overwrite, Node *&old);
+  void logStore(CStrRef key, bool updated);
+
+  void growIfNeeded();
+  void evictIfNeeded() {
+    if (m_memoryLimit && m_bytes > m_memoryLimit) evict();
+  }
+  void evict();
+  void compactIfNeeded() {
+    if (RuntimeOption::ApcPackArrays && time(NULL) >= m_nextCompaction &&
+        SharedBlockAllocator::NeedsCompaction()) {
+      compact();
+    }
+  }
+  void compact();
+
+  virtual void clear() {
+    if (RuntimeOption::EnableAPCSizeStats) {
+      SharedStoreStats::onClear();
+    }
+    Table *old;
+    lockAll();
+    old = m_table;
+    m_table = NewTable(InitialBuckets);
+    m_count = 0;
+    m_bytes = 0;
+    unlockAll();
+    EpochReclaimer::Retire(old, DestroyClearedTable);
+    EpochReclaimer::Reclaim();
+  }
+
   virtual bool eraseImpl(CStrRef key, bool expired) {
     if (key.isNull()) return false;
-    ReadLock l(m_lock);
-    Map::accessor acc;
-    if (m_vars.find(acc, key.data())) {
-      if (expired && !acc->second.expired()) {
+    int64 hash = key->hash();
+    Node *node;
+    {
+      Lock lock(lockFor(hash));
+      tbb::atomic<Node *> *link = FindLink(m_table, key.data(), key.size(),
+                                           hash);
+      node = *link;
+      if (node == NULL || (expired && !node->value.expired())) {
         return false;
       }
       if (RuntimeOption::EnableAPCSizeStats) {
-        SharedStoreStats::onDelete(key.get(), acc->second.var, false);
+        SharedStoreStats::onDelete(key.get(), node->value.var, false);
       }
-      eraseAcc(acc);
-      return true;
+      *link = node->next;
+      --m_count;
+      m_bytes -= node->size;
     }
-    return false;
-  }
-
-  void eraseAcc(Map::accessor &acc) {
-    acc->second.var->decRef();
-    const char *pkey = acc->first;
-    m_vars.erase(acc);
-    free((void *)pkey);
+    EpochReclaimer::Retire(node, DestroyNode);
+    return true;
   }
-  void eraseAcc(Map::const_accessor &acc) {
-    acc->second.var->decRef();
-    const char *pkey = acc->first;
-    m_vars.erase(acc);
-    free((void *)pkey);
-  }
-
-  Map m_vars;
-  // Read lock is acquired whenever using concurrent ops
-  // Write lock is acquired for whole table operations
-  ReadWriteMutex m_lock;
 
-  typedef std::pair<const char*, time_t> ExpirationPair;
+  // keys are binary safe, so they're kept with their lengths
+  typedef std::pair<std::string, time_t> ExpirationPair;
   class ExpirationCompare {
   public:
     bool operator()(const ExpirationPair &p1, const ExpirationPair &p2) {
@@ -716,7 +935,7 @@ protected:
   ReadWriteMutex m_expirationQueueLock;
   uint64 m_purgeCounter;
 
-  // Should be called outside m_lock
+  // Should be called with no stripe locked
   void purgeExpired() {
     if ((atomic_add(m_purgeCounter, (uint64)1) %
          RuntimeOption::ApcPurgeFrequency) != 0) return;
@@ -732,7 +951,7 @@ protected:
     // Purge items n at a time. The only operation under the write lock is
     // the pop
 #define PURGE_RATE 256
-    const char* s[PURGE_RATE];
+    std::string s[PURGE_RATE];
     while (true) {
       int i;
       {
@@ -745,8 +964,7 @@ protected:
         }
       }
       for (int j = 0; j < i; ++j) {
-        eraseImpl(s[j], true);
-        free((void *)s[j]);
+        eraseImpl(String(s[j].data(), s[j].size(), AttachLiteral), true);
       }
       if (i < PURGE_RATE) {
         // No work left
@@ -755,9 +973,8 @@ protected:
     }
   }
 
-  void addToExpirationQueue(const char* key, int64 etime) {
-    const char *copy = strdup(key);
-    ExpirationPair p(copy, etime);
+  void addToExpirationQueue(const char* key, int len, int64 etime) {
+    ExpirationPair p(std::string(key, len), etime);
     WriteLock lock(m_expirationQueueLock);
     m_expirationQueue.push(p);
   }
@@ -793,6 +1010,71 @@ std::string SharedStore::GetSkeleton(CStrRef key) {
   return ret;
 }
 
+bool SharedStore::getStale(CStrRef key, Variant &value, bool &stale) {
+  stale = false;
+  return get(key, value);
+}
+
+static int64 lease_clock() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+bool SharedStore::tryLease(CStrRef key) {
+  int64 now = lease_clock();
+  std::string k(key.data(), key.size());
+  Lock lock(m_leaseMonitor.getMutex());
+  std::map<std::string, int64>::iterator iter = m_leases.find(k);
+  if (iter != m_leases.end() && iter->second > now) {
+    return false;
+  }
+  m_leases[k] = now + RuntimeOption::ApcLeaseTimeout;
+  return true;
+}
+
+void SharedStore::releaseLease(CStrRef key) {
+  std::string k(key.data(), key.size());
+  Lock lock(m_leaseMonitor.getMutex());
+  m_leases.erase(k);
+  m_leaseMonitor.notifyAll();
+}
+
+bool SharedStore::waitForLease(CStrRef key) {
+  std::string k(key.data(), key.size());
+  Lock lock(m_leaseMonitor.getMutex());
+  while (true) {
+    std::map<std::string, int64>::iterator iter = m_leases.find(k);
+    if (iter == m_leases.end()) return true;
+    int64 left = iter->second - lease_clock();
+    if (left <= 0) return false;
+    m_leaseMonitor.wait(left / 1000, (left % 1000) * 1000000);
+  }
+}
+
+Array SharedStore::getMulti(const std::vector<String> &keys) {
+  ArrayInit init(keys.size(), false);
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    Variant v;
+    if (get(keys[i], v)) {
+      init.set(keys[i], v, true);
+    }
+  }
+  return init.create();
+}
+
+Array SharedStore::storeMulti(CArrRef vars, int64 ttl,
+                              bool overwrite /* = true */) {
+  Array failed = Array::Create();
+  for (ArrayIter iter(vars); iter; ++iter) {
+    String key = iter.first().toString();
+    if (!store(key, iter.secondRef(), ttl, overwrite)) {
+      failed.set(key, -1);
+    }
+  }
+  return failed;
+}
+
 void LockedSharedStore::clear() {
   lockMap();
   clearImpl();
@@ -814,74 +1096,195 @@ bool LockedSharedStore::get(CStrRef key, Variant &value) {
     if (stats) {
       ServerStats::Log("apc.miss", 1);
     }
+    SharedStoreKeyStats::OnFetch(key, NULL);
     return false;
   }
   value = getVar(val->var)->toLocal();
+  SharedStoreKeyStats::OnFetch(key, getVar(val->var));
   readUnlockMap();
   if (stats) ServerStats::Log("apc.hit", 1);
   return true;
 }
 
+Array LockedSharedStore::getMulti(const std::vector<String> &keys) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+
+  ArrayInit init(keys.size(), false);
+  std::vector<int> expiredKeys;
+  int hits = 0;
+  readLockMap();
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    StoreValue *val;
+    bool expired = false;
+    if (find(keys[i], val, expired)) {
+      init.set(keys[i], getVar(val->var)->toLocal(), true);
+      SharedStoreKeyStats::OnFetch(keys[i], getVar(val->var));
+      hits++;
+    } else {
+      if (expired) expiredKeys.push_back(i);
+      SharedStoreKeyStats::OnFetch(keys[i], NULL);
+    }
+  }
+  readUnlockMap();
+  for (unsigned int i = 0; i < expiredKeys.size(); i++) {
+    erase(keys[expiredKeys[i]], true);
+  }
+  if (stats) {
+    if (hits) ServerStats::Log("apc.hit", hits);
+    if (hits < (int)keys.size()) {
+      ServerStats::Log("apc.miss", keys.size() - hits);
+    }
+  }
+  return init.create();
+}
+
 
 bool ConcurrentTableSharedStore::get(CStrRef key, Variant &value) {
- bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
- const StoreValue *val;
- ReadLock l(m_lock);
- bool expired = false;
- {
-   Map::const_accessor acc;
-   if (!m_vars.find(acc, key.data())) {
-     if (stats) ServerStats::Log("apc.miss", 1);
-     return false;
-   } else {
-     val = &acc->second;
-     if (val->expired()) {
-       // Because it only has a read lock on the data, deletion from
-       // expiration has to happen after the lock is released
-       expired = true;
-     } else {
-       value = val->var->toLocal();
-       if (RuntimeOption::EnableAPCSizeStats &&
-           RuntimeOption::EnableAPCSizeDetail &&
-           RuntimeOption::EnableAPCFetchStats) {
-         SharedStoreStats::onGet(key.get(), val->var);
-       }
-     }
-   }
- }
- if (expired) {
-   if (stats) {
-     ServerStats::Log("apc.miss", 1);
-   }
-   eraseImpl(key, true);
-   return false;
- }
- if (stats) {
-   ServerStats::Log("apc.hit", 1);
- }
- return true;
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  bool expired = false;
+  {
+    EpochReclaimer::ReadSection rs;
+    Node *node = Find(m_table, key.data(), key.size(), key->hash());
+    if (node == NULL) {
+      countAccess(m_misses);
+      if (stats) ServerStats::Log("apc.miss", 1);
+      SharedStoreKeyStats::OnFetch(key, NULL);
+      return false;
+    }
+    if (node->value.expired()) {
+      // deleting it takes the stripe lock, so it's done outside of here
+      expired = true;
+    } else {
+      touch(node);
+      value = node->value.var->toLocal();
+      SharedStoreKeyStats::OnFetch(key, node->value.var);
+      if (RuntimeOption::EnableAPCSizeStats &&
+          RuntimeOption::EnableAPCSizeDetail &&
+          RuntimeOption::EnableAPCFetchStats) {
+        SharedStoreStats::onGet(key.get(), node->value.var);
+      }
+    }
+  }
+  if (expired) {
+    countAccess(m_misses);
+    if (stats) {
+      ServerStats::Log("apc.miss", 1);
+    }
+    SharedStoreKeyStats::OnFetch(key, NULL);
+    eraseImpl(key, true);
+    return false;
+  }
+  countAccess(m_hits);
+  if (stats) {
+    ServerStats::Log("apc.hit", 1);
+  }
+  return true;
+}
+
+bool ConcurrentTableSharedStore::getStale(CStrRef key, Variant &value,
+                                          bool &stale) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  {
+    EpochReclaimer::ReadSection rs;
+    Node *node = Find(m_table, key.data(), key.size(), key->hash());
+    if (node == NULL) {
+      countAccess(m_misses);
+      if (stats) ServerStats::Log("apc.miss", 1);
+      SharedStoreKeyStats::OnFetch(key, NULL);
+      return false;
+    }
+    // an expired node stays until it's replaced, so it can be served stale
+    stale = node->value.expired();
+    touch(node);
+    value = node->value.var->toLocal();
+    SharedStoreKeyStats::OnFetch(key, stale ? NULL : node->value.var);
+  }
+  countAccess(stale ? m_misses : m_hits);
+  if (stats) ServerStats::Log(stale ? "apc.stale" : "apc.hit", 1);
+  return true;
 }
 
+Array ConcurrentTableSharedStore::getMulti(const std::vector<String> &keys) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+
+  int count = keys.size();
+  std::vector<int64> hashes(count);
+  for (int i = 0; i < count; i++) {
+    hashes[i] = keys[i]->hash();
+  }
+
+  ArrayInit init(count, false);
+  std::vector<int> expiredKeys;
+  int hits = 0;
+  {
+    EpochReclaimer::ReadSection rs;
+    Table *t = m_table;
+    // the buckets and their first nodes are all over memory, so they're
+    // fetched for every key before any chain is walked
+    std::vector<Node *> heads(count);
+    for (int i = 0; i < count; i++) {
+      __builtin_prefetch(&t->buckets[hashes[i] & t->mask]);
+    }
+    for (int i = 0; i < count; i++) {
+      heads[i] = t->buckets[hashes[i] & t->mask];
+      if (heads[i]) __builtin_prefetch(heads[i]);
+    }
+    for (int i = 0; i < count; i++) {
+      Node *node = heads[i] ?
+        Find(t, keys[i].data(), keys[i].size(), hashes[i]) : NULL;
+      if (node == NULL || node->value.expired()) {
+        if (node) expiredKeys.push_back(i);
+        SharedStoreKeyStats::OnFetch(keys[i], NULL);
+        continue;
+      }
+      touch(node);
+      init.set(keys[i], node->value.var->toLocal(), true);
+      SharedStoreKeyStats::OnFetch(keys[i], node->value.var);
+      if (RuntimeOption::EnableAPCSizeStats &&
+          RuntimeOption::EnableAPCSizeDetail &&
+          RuntimeOption::EnableAPCFetchStats) {
+        SharedStoreStats::onGet(keys[i].get(), node->value.var);
+      }
+      hits++;
+    }
+  }
+  for (unsigned int i = 0; i < expiredKeys.size(); i++) {
+    eraseImpl(keys[expiredKeys[i]], true);
+  }
+  for (int i = 0; i < count; i++) {
+    countAccess(i < hits ? m_hits : m_misses);
+  }
+  if (stats) {
+    if (hits) ServerStats::Log("apc.hit", hits);
+    if (hits < count) ServerStats::Log("apc.miss", count - hits);
+  }
+  return init.create();
+}
 
 bool LfuTableSharedStore::get(CStrRef key, Variant &value) {
   class GetReader : public Map::AtomicReader {
   public:
-    GetReader(Variant &v) : expired(false), value(v) {}
+    GetReader(CStrRef k, Variant &v) : expired(false), key(k), value(v) {}
     void read(StringData* const &k, const StoreValue &val) {
       value = val.var->toLocal();
       expired = val.expired();
+      // the caller's key, since a String around the table's own key would
+      // free it when it goes out of scope
+      if (!expired) SharedStoreKeyStats::OnFetch(key, val.var);
     }
     bool expired;
+    CStrRef key;
     Variant &value;
   };
   bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
-  GetReader reader(value);
+  GetReader reader(key, value);
   if (!m_vars.atomicRead(key.get(), reader) || reader.expired) {
     if (reader.expired) {
       erase(key, true);
     }
     value = false;
     if (stats) ServerStats::Log("apc.miss", 1);
+    SharedStoreKeyStats::OnFetch(key, NULL);
     return false;
   }
   if (stats) ServerStats::Log("apc.hit", 1);
@@ -890,11 +1293,43 @@ bool LfuTableSharedStore::get(CStrRef key, Variant &value) {
 
 bool LockedSharedStore::store(CStrRef key, CVarRef val, int64 ttl,
                               bool overwrite /* = true */) {
-  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  lockMap();
+  SharedVariant* var = construct(key, val);
+  bool added = storeLocked(key, var, ttl, overwrite);
+  unlockMap();
 
+  if (!added) var->decRef();
+
+  return added;
+}
+
+Array LockedSharedStore::storeMulti(CArrRef vars, int64 ttl,
+                                    bool overwrite /* = true */) {
+  Array failed = Array::Create();
+  std::vector<SharedVariant *> rejected;
   lockMap();
+  for (ArrayIter iter(vars); iter; ++iter) {
+    String key = iter.first().toString();
+    SharedVariant* var = construct(key, iter.secondRef());
+    if (!storeLocked(key, var, ttl, overwrite)) {
+      rejected.push_back(var);
+      failed.set(key, -1);
+    }
+  }
+  unlockMap();
+
+  for (unsigned int i = 0; i < rejected.size(); i++) {
+    rejected[i]->decRef();
+  }
+  return failed;
+}
+
+bool LockedSharedStore::storeLocked(CStrRef key, SharedVariant *var,
+                                    int64 ttl, bool overwrite) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+  SharedStoreKeyStats::OnStore(key, var);
+
   StoreValue *sval;
-  SharedVariant* var = construct(key, val);
   bool expired = false;
   bool added = false;
   if (find(key, sval, expired) || expired) {
@@ -916,11 +1351,6 @@ bool LockedSharedStore::store(CStrRef key, CVarRef val, int64 ttl,
       }
     }
   }
-
-  unlockMap();
-
-  if (!added) var->decRef();
-
   return added;
 }
 
@@ -929,57 +1359,278 @@ bool ConcurrentTableSharedStore::store(CStrRef key, CVarRef val, int64 ttl,
                                        bool overwrite /* = true */) {
   bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
 
-  StoreValue *sval;
   SharedVariant* var = construct(key, val);
-  ReadLock l(m_lock);
-
-  const char *kcp = strdup(key.data());
-  bool present;
-  time_t expiry;
+  SharedStoreKeyStats::OnStore(key, var);
+  int64 hash = key->hash();
+  StoreValue sval;
+  sval.set(var, ttl);
+  int64 size = entrySize(key.size(), var);
+
+  Node *old;
+  bool added;
   {
-    Map::accessor acc;
-    present = !m_vars.insert(acc, kcp);
-    sval = &acc->second;
-    if (present) {
-      free((void *)kcp);
-      if (overwrite || sval->expired()) {
-        if (RuntimeOption::EnableAPCSizeStats) {
-          SharedStoreStats::onDelete(key.get(), sval->var, true);
-        }
-        sval->var->decRef();
-      } else {
-        var->decRef();
-        return false;
-      }
-    }
-    sval->set(var, ttl);
-    expiry = sval->expiry;
-    if (RuntimeOption::EnableAPCSizeStats) {
-      SharedStoreStats::onStore(key.get(), var, ttl, false);
-    }
+    Lock lock(lockFor(hash));
+    added = storeLocked(key, hash, sval, ttl, size, overwrite, old);
+  }
+  if (!added) {
+    var->decRef();
+    return false;
+  }
+  if (old) {
+    EpochReclaimer::Retire(old, DestroyNode);
+  } else {
+    growIfNeeded();
   }
+  evictIfNeeded();
+  compactIfNeeded();
+
   if (RuntimeOption::ApcExpireOnSets) {
     if (ttl) {
-      addToExpirationQueue(key.data(), expiry);
+      addToExpirationQueue(key.data(), key.size(), sval.expiry);
     }
     purgeExpired();
   }
-  if (stats) {
-    if (present) {
-      ServerStats::Log("apc.update", 1);
-    } else {
-      ServerStats::Log("apc.new", 1);
-      if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCKeyStats) {
-        string prefix = "apc.new.";
-        prefix += GetSkeleton(key);
-        ServerStats::Log(prefix, 1);
-      }
+  if (stats) logStore(key, old != NULL);
+
+  return true;
+}
+
+Array ConcurrentTableSharedStore::storeMulti(CArrRef vars, int64 ttl,
+                                             bool overwrite /* = true */) {
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+
+  // values are built before any lock is taken, like store() does
+  int count = vars.size();
+  std::vector<String> keys;
+  std::vector<StoreValue> svals(count);
+  std::vector<int64> sizes(count);
+  std::vector<std::pair<int, int> > byStripe; // (stripe, item)
+  keys.reserve(count);
+  byStripe.reserve(count);
+  for (ArrayIter iter(vars); iter; ++iter) {
+    int i = keys.size();
+    keys.push_back(iter.first().toString());
+    SharedVariant *var = construct(keys[i], iter.secondRef());
+    SharedStoreKeyStats::OnStore(keys[i], var);
+    svals[i].set(var, ttl);
+    sizes[i] = entrySize(keys[i].size(), var);
+    byStripe.push_back(std::make_pair((int)(keys[i]->hash() &
+                                            (LockCount - 1)), i));
+  }
+  std::sort(byStripe.begin(), byStripe.end());
+
+  // each stripe is locked once for all of its keys
+  std::vector<Node *> olds(count);
+  std::vector<bool> added(count);
+  bool inserted = false;
+  for (int start = 0, end; start < count; start = end) {
+    int stripe = byStripe[start].first;
+    end = start + 1;
+    while (end < count && byStripe[end].first == stripe) end++;
+    Lock lock(m_locks[stripe]);
+    for (int j = start; j < end; j++) {
+      int i = byStripe[j].second;
+      added[i] = storeLocked(keys[i], keys[i]->hash(), svals[i], ttl,
+                             sizes[i], overwrite, olds[i]);
+      if (added[i] && !olds[i]) inserted = true;
     }
   }
 
+  Array failed = Array::Create();
+  for (int i = 0; i < count; i++) {
+    if (!added[i]) {
+      svals[i].var->decRef();
+      failed.set(keys[i], -1);
+      continue;
+    }
+    if (olds[i]) EpochReclaimer::Retire(olds[i], DestroyNode);
+    if (RuntimeOption::ApcExpireOnSets && ttl) {
+      addToExpirationQueue(keys[i].data(), keys[i].size(), svals[i].expiry);
+    }
+    if (stats) logStore(keys[i], olds[i] != NULL);
+  }
+  if (inserted) growIfNeeded();
+  evictIfNeeded();
+  compactIfNeeded();
+  if (RuntimeOption::ApcExpireOnSets) purgeExpired();
+
+  return failed;
+}
+
+/**
+ * Links the value in under key. The caller has locked key's stripe, and
+ * retires old, the node that was replaced, if any, once it has unlocked.
+ * Returns false if key is there already and can't be overwritten.
+ */
+bool ConcurrentTableSharedStore::storeLocked(CStrRef key, int64 hash,
+                                             const StoreValue &sval,
+                                             int64 ttl, int64 size,
+                                             bool overwrite, Node *&old) {
+  tbb::atomic<Node *> *link = FindLink(m_table, key.data(), key.size(),
+                                       hash);
+  old = *link;
+  if (old) {
+    if (!overwrite && !old->value.expired()) {
+      old = NULL;
+      return false;
+    }
+    if (RuntimeOption::EnableAPCSizeStats) {
+      SharedStoreStats::onDelete(key.get(), old->value.var, true);
+    }
+    replace(link, old, sval);
+  } else {
+    *link = NewNode(key.data(), key.size(), hash, sval, size);
+    ++m_count;
+    m_bytes += size;
+  }
+  if (RuntimeOption::EnableAPCSizeStats) {
+    SharedStoreStats::onStore(key.get(), sval.var, ttl, false);
+  }
   return true;
 }
 
+void ConcurrentTableSharedStore::logStore(CStrRef key, bool updated) {
+  if (updated) {
+    ServerStats::Log("apc.update", 1);
+  } else {
+    ServerStats::Log("apc.new", 1);
+    if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCKeyStats) {
+      string prefix = "apc.new.";
+      prefix += GetSkeleton(key);
+      ServerStats::Log(prefix, 1);
+    }
+  }
+}
+
+void ConcurrentTableSharedStore::growIfNeeded() {
+  {
+    EpochReclaimer::ReadSection rs;
+    Table *t = m_table;
+    if ((size_t)m_count <= 2 * (t->mask + 1)) return;
+  }
+
+  Table *old;
+  lockAll();
+  old = m_table;
+  if ((size_t)m_count <= 2 * (old->mask + 1)) {
+    unlockAll();
+    return;
+  }
+  Table *t = NewTable(2 * (old->mask + 1));
+  for (size_t i = 0; i <= old->mask; i++) {
+    for (Node *node = old->buckets[i]; node; node = node->next) {
+      Node *copy = NewNode(node->key, node->len, node->hash, node->value,
+                           node->size);
+      copy->frequency = (char)node->frequency;
+      copy->primed = node->primed;
+      tbb::atomic<Node *> &bucket = t->buckets[node->hash & t->mask];
+      copy->next = bucket;
+      bucket = copy;
+    }
+  }
+  m_table = t;
+  unlockAll();
+  EpochReclaimer::Retire(old, DestroyResizedTable);
+}
+
+void ConcurrentTableSharedStore::evict() {
+  if (m_evicting.compare_and_swap(1, 0) != 0) {
+    return; // another thread is evicting already
+  }
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+
+  // each pass takes one off every frequency, so a few passes are enough to
+  // get to anything that isn't primed
+  size_t steps = 0;
+  size_t maxSteps;
+  {
+    EpochReclaimer::ReadSection rs;
+    Table *t = m_table;
+    maxSteps = (MaxFrequency + 1) * (t->mask + 1);
+  }
+  std::vector<Node *> evicted;
+  while (m_bytes > m_memoryLimit && steps++ < maxSteps) {
+    {
+      // the stripe covers bucket m_hand whatever the table's size
+      Lock lock(lockFor(m_hand));
+      Table *t = m_table;
+      tbb::atomic<Node *> *link = &t->buckets[m_hand & t->mask];
+      for (Node *node = *link; node; node = *link) {
+        char frequency = node->frequency;
+        if (!node->primed && (frequency == 0 || node->value.expired())) {
+          if (RuntimeOption::EnableAPCSizeStats) {
+            StringData sd(node->key, node->len, AttachLiteral);
+            SharedStoreStats::onDelete(&sd, node->value.var, false);
+          }
+          *link = node->next;
+          --m_count;
+          m_bytes -= node->size;
+          evicted.push_back(node);
+        } else {
+          if (frequency > 0) node->frequency = frequency - 1;
+          link = &node->next;
+        }
+      }
+      m_hand++;
+    }
+    for (unsigned int i = 0; i < evicted.size(); i++) {
+      EpochReclaimer::Retire(evicted[i], DestroyNode);
+    }
+    m_evictions += evicted.size();
+    if (stats && !evicted.empty()) {
+      ServerStats::Log("apc.evict", evicted.size());
+    }
+    evicted.clear();
+  }
+  m_evicting = 0;
+}
+
+void ConcurrentTableSharedStore::compact() {
+  if (m_compacting.compare_and_swap(1, 0) != 0) {
+    return; // another thread is compacting already
+  }
+  bool stats = RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats;
+
+  int moved = 0;
+  {
+    EpochReclaimer::ReadSection rs;
+    Table *t = m_table;
+    for (size_t b = 0; b <= t->mask; b++) {
+      for (Node *node = t->buckets[b]; node; node = node->next) {
+        ThreadSharedVariant *var = (ThreadSharedVariant *)node->value.var;
+        if (!var->isPacked() || !SharedBlockAllocator::IsSparse(var)) {
+          continue;
+        }
+        ThreadSharedVariant *copy = var->copyPacked();
+        Node *old = NULL;
+        {
+          Lock lock(lockFor(node->hash));
+          tbb::atomic<Node *> *link = FindLink(m_table, node->key, node->len,
+                                               node->hash);
+          // skipped if it was stored over or the table grew meanwhile
+          if (*link == node) {
+            StoreValue sval = node->value;
+            sval.var = copy;
+            old = replace(link, node, sval);
+          }
+        }
+        if (old) {
+          EpochReclaimer::Retire(old, DestroyNode);
+          moved++;
+        } else {
+          copy->decRef();
+        }
+      }
+    }
+  }
+  EpochReclaimer::Reclaim();
+  if (stats && moved) {
+    ServerStats::Log("apc.compact", moved);
+  }
+  // a pass walks the whole table, even when little can be moved
+  m_nextCompaction = time(NULL) + CompactionInterval;
+  m_compacting = 0;
+}
 
 bool LfuTableSharedStore::store(CStrRef key, CVarRef val, int64 ttl,
                                 bool overwrite /* = true */) {
@@ -1022,6 +1673,7 @@ bool LfuTableSharedStore::store(CStrRef key, CVarRef val, int64 ttl,
     StringData *newkey;
   };
   SharedVariant* var = construct(key, val);
+  SharedStoreKeyStats::OnStore(key, var);
   StoreUpdater updater(ttl, var, key, overwrite);
   m_vars.atomicUpdate(updater.newKey(), updater, true);
   if (!updater.added) {
@@ -1043,23 +1695,43 @@ void LockedSharedStore::prime(const std::vector<KeyValuePair> &vars) {
 
 void ConcurrentTableSharedStore::prime
 (const std::vector<SharedStore::KeyValuePair> &vars) {
-  ReadLock l(m_lock);
   // we are priming, so we are not checking existence or expiration
   for (unsigned int i = 0; i < vars.size(); i++) {
     const SharedStore::KeyValuePair &item = vars[i];
-    Map::accessor acc;
-    const char *copy = strdup(item.key);
-    m_vars.insert(acc, copy);
-    acc->second.set(item.value, 0);
+    int64 hash = hash_string(item.key, item.len);
+    StoreValue sval;
+    sval.set(item.value, 0);
+    Node *old;
+    {
+      Lock lock(lockFor(hash));
+      tbb::atomic<Node *> *link = FindLink(m_table, item.key, item.len, hash);
+      old = *link;
+      if (old) {
+        replace(link, old, sval);
+        Node *copy = *link;
+        copy->primed = true;
+      } else {
+        Node *node = NewNode(item.key, item.len, hash, sval,
+                             entrySize(item.len, item.value));
+        node->primed = true;
+        *link = node;
+        ++m_count;
+        m_bytes += node->size;
+      }
+    }
+    if (old) {
+      EpochReclaimer::Retire(old, DestroyNode);
+    } else {
+      growIfNeeded();
+    }
     if (RuntimeOption::EnableAPCSizeStats &&
         RuntimeOption::APCSizeCountPrime) {
-      StringData sd(copy);
+      StringData sd(item.key, item.len, AttachLiteral);
       SharedStoreStats::onStore(&sd, item.value, 0, true);
     }
   }
 }
 
-
 void LfuTableSharedStore::prime
 (const std::vector<SharedStore::KeyValuePair> &vars) {
   // we are priming, so we are not checking existence or expiration
@@ -1116,25 +1788,32 @@ int64 LockedSharedStore::inc(CStrRef key, int64 step, bool &found) {
 int64 ConcurrentTableSharedStore::inc(CStrRef key, int64 step, bool &found) {
   found = false;
   int64 ret = 0;
-  ReadLock l(m_lock);
-  StoreValue *val;
+  int64 hash = key->hash();
+  Node *old;
   {
-    Map::accessor acc;
-    if (m_vars.find(acc, key.data())) {
-      val = &acc->second;
-      if (val->expired()) {
-        eraseAcc(acc);
+    Lock lock(lockFor(hash));
+    tbb::atomic<Node *> *link = FindLink(m_table, key.data(), key.size(),
+                                         hash);
+    old = *link;
+    if (old) {
+      if (old->value.expired()) {
+        *link = old->next;
+        --m_count;
+        m_bytes -= old->size;
       } else {
-        Variant v = val->var->toLocal();
+        Variant v = old->value.var->toLocal();
         ret = v.toInt64() + step;
         v = ret;
-        SharedVariant *var = construct(key, v);
-        val->var->decRef();
-        val->var = var;
+        StoreValue sval = old->value;
+        sval.var = construct(key, v);
+        replace(link, old, sval);
         found = true;
       }
     }
   }
+  if (old) {
+    EpochReclaimer::Retire(old, DestroyNode);
+  }
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
     ServerStats::Log("apc.inc", 1);
@@ -1142,7 +1821,6 @@ int64 ConcurrentTableSharedStore::inc(CStrRef key, int64 step, bool &found) {
   return ret;
 }
 
-
 int64 LfuTableSharedStore::inc(CStrRef key, int64 step, bool &found) {
   class IncUpdater : public Map::AtomicUpdater {
   public:
@@ -1209,22 +1887,27 @@ bool LockedSharedStore::cas(CStrRef key, int64 old, int64 val) {
 
 bool ConcurrentTableSharedStore::cas(CStrRef key, int64 old, int64 val) {
   bool success = false;
-  ReadLock l(m_lock);
-  StoreValue *sval;
+  int64 hash = key->hash();
+  Node *replaced = NULL;
   {
-    Map::accessor acc;
-    if (m_vars.find(acc, key.data())) {
-      sval = &acc->second;
-      Variant v = sval->var->toLocal();
+    Lock lock(lockFor(hash));
+    tbb::atomic<Node *> *link = FindLink(m_table, key.data(), key.size(),
+                                         hash);
+    Node *node = *link;
+    if (node) {
+      Variant v = node->value.var->toLocal();
       if (v.toInt64() == old) {
         v = val;
-        SharedVariant *var = construct(key, v);
-        sval->var->decRef();
-        sval->var = var;
+        StoreValue sval = node->value;
+        sval.var = construct(key, v);
+        replaced = replace(link, node, sval);
         success = true;
       }
     }
   }
+  if (replaced) {
+    EpochReclaimer::Retire(replaced, DestroyNode);
+  }
 
   if (RuntimeOption::EnableStats && RuntimeOption::EnableAPCStats) {
     ServerStats::Log("apc.cas", 1);
@@ -1232,7 +1915,6 @@ bool ConcurrentTableSharedStore::cas(CStrRef key, int64 old, int64 val) {
   return success;
 }
 
-
 bool LfuTableSharedStore::cas(CStrRef key, int64 old, int64 val) {
   class CasUpdater : public Map::AtomicUpdater {
   public:
@@ -1268,7 +1950,7 @@ bool LfuTableSharedStore::cas(CStrRef key, int64 old, int64 val) {
   return updater.success;
 }
 
-static std::string appendElement(int indent, const char *name, int value) {
+static std::string appendElement(int indent, const char *name, int64 value) {
   string ret;
   for (int i = 0; i < indent; i++) {
     ret += "  ";
@@ -1300,6 +1982,25 @@ std::string LfuTableSharedStore::reportStats(int &reachable, int indent) {
   return ret;
 }
 
+std::string ConcurrentTableSharedStore::reportStats(int &reachable,
+                                                    int indent) {
+  string ret = SharedStore::reportStats(reachable, indent);
+  if (m_memoryLimit) {
+    int64 hits = m_hits;
+    int64 misses = m_misses;
+    ret += appendElement(indent, "Memory", m_bytes);
+    ret += appendElement(indent, "Memory Limit", m_memoryLimit);
+    ret += appendElement(indent, "Evictions", m_evictions);
+    ret += appendElement(indent, "Hits", hits);
+    ret += appendElement(indent, "Misses", misses);
+    ret += appendElement(indent, "Hit Percentage",
+                         hits + misses ? hits * 100 / (hits + misses) : 0);
+  }
+  return ret;
+}
+
+__thread unsigned int ConcurrentTableSharedStore::s_accessTicks;
+
 void StoreValue::set(SharedVariant *v, int64 ttl) {
   var = v;
   expiry = ttl ? time(NULL) + ttl : 0;
@@ -1347,7 +2048,8 @@ void SharedStores::create() {
         }
         break;
       case RuntimeOption::ApcConcurrentTable:
-        m_stores[i] = new ConcurrentTableSharedStore(i);
+        m_stores[i] = new ConcurrentTableSharedStore
+          (i, i == SHARED_STORE_DNS_CACHE ? 0 : RuntimeOption::ApcMemoryLimit);
         break;
       default:
         ASSERT(false);
@@ -1413,28 +2115,167 @@ std::string SharedStores::ReportStats(int indent) {
   return s_apc_store.reportStats(indent);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// snapshots
+
+namespace {
+struct SnapshotItem {
+  std::string key;
+  int64 expiry;
+  ThreadSharedVariant *var;
+};
+}
+
+bool ConcurrentTableSharedStore::dumpSnapshot(const char *file) {
+  SharedStoreSnapshotWriter writer;
+  if (!writer.open(file)) return false;
+
+  // The values are only referenced inside the read section, so retired nodes
+  // can be reclaimed while they're serialized and written out.
+  std::vector<SnapshotItem> items;
+  {
+    EpochReclaimer::ReadSection rs;
+    Table *t = m_table;
+    items.reserve(m_count);
+    for (size_t b = 0; b <= t->mask; b++) {
+      for (Node *node = t->buckets[b]; node; node = node->next) {
+        const StoreValue &val = node->value;
+        if (val.expired()) continue;
+        SnapshotItem item;
+        item.key.assign(node->key, node->len);
+        item.expiry = val.expiry;
+        item.var = (ThreadSharedVariant *)val.var;
+        item.var->incRef();
+        items.push_back(item);
+      }
+    }
+  }
+
+  bool written = true;
+  for (unsigned int i = 0; i < items.size(); i++) {
+    const SnapshotItem &item = items[i];
+    ThreadSharedVariant *var = item.var;
+    if (written && var->is(KindOfString)) {
+      written = writer.add(item.key.data(), item.key.size(), item.expiry,
+                           false, var->stringData(), var->stringLength());
+    } else if (written) {
+      StringBuffer buf;
+      var->serialize(buf);
+      written = writer.add(item.key.data(), item.key.size(), item.expiry,
+                           true, buf.data(), buf.size());
+    }
+    var->decRef();
+  }
+  return written && writer.finish();
+}
+
+bool ConcurrentTableSharedStore::loadSnapshot(const char *file, int threads) {
+  SharedStoreSnapshot *snapshot = SharedStoreSnapshot::Map(file);
+  if (snapshot == NULL) return false;
+
+  int count = snapshot->size();
+  if (threads > count) threads = count;
+  if (threads <= 1) {
+    loadSnapshot(*snapshot, 0, count);
+  } else {
+    std::vector<SnapshotLoader *> loaders;
+    std::vector<AsyncFunc<SnapshotLoader> *> funcs;
+    for (int i = 0; i < threads; i++) {
+      loaders.push_back(new SnapshotLoader(this, snapshot,
+                                           (int64)count * i / threads,
+                                           (int64)count * (i + 1) / threads));
+      funcs.push_back(new AsyncFunc<SnapshotLoader>(loaders[i],
+                                                    &SnapshotLoader::load));
+      funcs[i]->start();
+    }
+    for (int i = 0; i < threads; i++) {
+      funcs[i]->waitForEnd();
+      delete funcs[i];
+      delete loaders[i];
+    }
+  }
+  delete snapshot;
+  evictIfNeeded();
+  return true;
+}
+
+void ConcurrentTableSharedStore::loadSnapshot
+(const SharedStoreSnapshot &snapshot, int begin, int end) {
+  int64 now = time(NULL);
+  for (int i = begin; i < end; i++) {
+    SharedStoreSnapshot::Entry entry;
+    snapshot.get(i, entry);
+    if (entry.expiry && entry.expiry <= now) continue;
+
+    String key(entry.key, entry.len, AttachLiteral);
+    SharedVariant *var;
+    if (entry.serialized && entry.data[0] != 'O' && entry.data[0] != 'C') {
+      // build scalars and arrays the way a store would, so fetches don't
+      // unserialize them every time; objects are unserialized on every
+      // fetch anyway
+      try {
+        var = construct(key, apc_unserialize(String(entry.data, entry.size,
+                                                    AttachLiteral)));
+      } catch (Exception &e) {
+        Logger::Error("Skipping APC snapshot item %s: %s", entry.key,
+                      e.getMessage().c_str());
+        continue;
+      }
+    } else {
+      var = new ThreadSharedVariant(entry.data, entry.size, entry.serialized);
+    }
+
+    int64 hash = key->hash();
+    StoreValue sval;
+    sval.var = var;
+    sval.expiry = entry.expiry;
+    int64 ttl = entry.expiry ? entry.expiry - now : 0;
+    Node *old;
+    bool added;
+    {
+      Lock lock(lockFor(hash));
+      added = storeLocked(key, hash, sval, ttl, entrySize(entry.len, var),
+                          false, old);
+    }
+    if (!added) {
+      var->decRef();
+      continue;
+    }
+    if (old) {
+      EpochReclaimer::Retire(old, DestroyNode);
+    } else {
+      growIfNeeded();
+    }
+    if (RuntimeOption::ApcExpireOnSets && entry.expiry) {
+      addToExpirationQueue(entry.key, entry.len, entry.expiry);
+    }
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // debugging support
 
 void ConcurrentTableSharedStore::dump(std::ostream & out) {
   int i = 0;
-  ReadLock l(m_lock);
-  out << "Total " << m_vars.size() << endl;
-  for (Map::iterator iter = m_vars.begin(); iter != m_vars.end();
-       ++iter, ++i) {
-    const char *key = iter->first;
-    const StoreValue &val = iter->second;
-    if (!val.expired()) {
-      VariableSerializer vs(VariableSerializer::Serialize);
-      out << i << " #### " << key << " #### ";
-      Variant value = val.var->toLocal();
-      try {
-        Variant valS(vs.serialize(value, true));
-        out << valS.toString()->toCPPString();
-      } catch (const Exception &e) {
-        out << "Exception: " << e.what();
+  EpochReclaimer::ReadSection rs;
+  Table *t = m_table;
+  out << "Total " << m_count << endl;
+  for (size_t b = 0; b <= t->mask; b++) {
+    for (Node *node = t->buckets[b]; node; node = node->next, ++i) {
+      const char *key = node->key;
+      const StoreValue &val = node->value;
+      if (!val.expired()) {
+        VariableSerializer vs(VariableSerializer::Serialize);
+        out << i << " #### " << key << " #### ";
+        Variant value = val.var->toLocal();
+        try {
+          Variant valS(vs.serialize(value, true));
+          out << valS.toString()->toCPPString();
+        } catch (const Exception &e) {
+          out << "Exception: " << e.what();
+        }
+        out << endl;
       }
-      out << endl;
     }
   }
 }
@@ -20,6 +20,7 @@
 #include <runtime/base/types.h>
 #include <runtime/base/shared/shared_variant.h>
 #include <util/lock.h>
+#include <util/synchronizable.h>
 #include <runtime/base/complex_types.h>
 
 #define SHARED_STORE_APPLICATION_CACHE 0
@@ -54,6 +55,29 @@ public:
   virtual int64 inc(CStrRef key, int64 step, bool &found) = 0;
   virtual bool cas(CStrRef key, int64 old, int64 val) = 0;
 
+  /**
+   * Batched get() and store(). getMulti() returns what it found, keyed the
+   * same way. storeMulti() stores every key => value in vars, and returns
+   * the keys it couldn't store, each mapped to -1. Stores that lock do it
+   * once per batch or per group of keys, not once per key.
+   */
+  virtual Array getMulti(const std::vector<String> &keys);
+  virtual Array storeMulti(CArrRef vars, int64 ttl, bool overwrite = true);
+
+  /**
+   * Single-flight support for apc_fetch_or_compute(). getStale() is get(),
+   * except that a value that has expired but is still stored comes back too,
+   * with stale set. tryLease() is true for the one caller that gets to
+   * recompute key, until it calls releaseLease() or ApcLeaseTimeout
+   * milliseconds pass. waitForLease() waits that long at most for the lease
+   * to be released, and returns false if it wasn't. Leases only cover the
+   * threads of this process.
+   */
+  virtual bool getStale(CStrRef key, Variant &value, bool &stale);
+  bool tryLease(CStrRef key);
+  void releaseLease(CStrRef key);
+  bool waitForLease(CStrRef key);
+
   // for priming only
   virtual SharedVariant* construct(litstr str, int len, CStrRef v,
                                    bool serialized) = 0;
@@ -74,6 +98,17 @@ public:
   // debug support
   virtual void dump(std::ostream & out) { /* Default does nothing*/ }
 
+  /**
+   * APC.SnapshotFile support, in the format shared_store_snapshot.h
+   * describes. dumpSnapshot() writes every item that hasn't expired to file.
+   * loadSnapshot() maps file and stores its items on the given number of
+   * threads, without overwriting what's there already. Both return false if
+   * the file can't be written or read, and stores that don't support
+   * snapshots always do.
+   */
+  virtual bool dumpSnapshot(const char *file) { return false;}
+  virtual bool loadSnapshot(const char *file, int threads) { return false;}
+
 protected:
   int m_id;
 
@@ -81,6 +116,10 @@ protected:
   virtual SharedVariant* construct(CStrRef key, CVarRef v) = 0;
   virtual SharedVariant* putVar(SharedVariant* v) const { return v; };
   virtual SharedVariant* getVar(SharedVariant* v) const { return v; };
+
+private:
+  Synchronizable m_leaseMonitor;
+  std::map<std::string, int64> m_leases; // key => when it lapses, in ms
 };
 
 ///////////////////////////////////////////////////////////////////////////////
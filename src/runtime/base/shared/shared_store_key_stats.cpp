@@ -0,0 +1,261 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/shared/shared_store_key_stats.h>
+#include <runtime/base/shared/shared_store.h>
+#include <runtime/base/runtime_option.h>
+#include <util/thread_local.h>
+#include <util/lock.h>
+
+using namespace std;
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+typedef SharedStoreKeyStats::Counters Counters;
+typedef hphp_string_map<Counters> CounterMap;
+
+/**
+ * Skeletons past this many, in a buffer or in the totals, are counted
+ * together, so keys without digits in their unique parts can't grow the
+ * maps without bound.
+ */
+static const size_t MaxSkeletons = 10000;
+static const char *OtherSkeleton = "(other)";
+
+static void add_counters(CounterMap &counters, const string &skeleton,
+                         const Counters &c) {
+  CounterMap::iterator iter = counters.find(skeleton);
+  if (iter == counters.end()) {
+    iter = counters.insert(make_pair(counters.size() < MaxSkeletons ?
+                                     skeleton : string(OtherSkeleton),
+                                     Counters())).first;
+  }
+  iter->second.add(c);
+}
+
+/**
+ * A thread's counts since the last merge. Its lock is only ever contended by
+ * Merge(). Buffers are reused by new threads but never freed, so Merge() can
+ * walk them while threads come and go.
+ */
+struct KeyStatsBuffer {
+  KeyStatsBuffer() : used(true) {}
+
+  Mutex lock;
+  CounterMap counters;
+  bool used;                    // guarded by s_buffersLock
+};
+
+static Mutex s_buffersLock;
+static vector<KeyStatsBuffer *> s_buffers;
+
+class KeyStatsBufferOwner {
+public:
+  KeyStatsBufferOwner() : m_buffer(NULL), m_countdown(0) {
+    Lock lock(s_buffersLock);
+    for (unsigned int i = 0; i < s_buffers.size(); i++) {
+      if (!s_buffers[i]->used) {
+        m_buffer = s_buffers[i];
+        m_buffer->used = true;
+        return;
+      }
+    }
+    m_buffer = new KeyStatsBuffer();
+    s_buffers.push_back(m_buffer);
+  }
+  ~KeyStatsBufferOwner() {
+    Lock lock(s_buffersLock);
+    m_buffer->used = false;
+  }
+
+  KeyStatsBuffer *m_buffer;
+  int m_countdown;
+};
+static IMPLEMENT_THREAD_LOCAL(KeyStatsBufferOwner, s_bufferOwner);
+
+class KeyStatsTotal {
+public:
+  KeyStatsTotal() : lastFetches(0) {}
+  Counters all;
+  int64 lastFetches;            // in the last merge
+};
+typedef hphp_string_map<KeyStatsTotal> TotalMap;
+
+static Mutex s_totalsLock;
+static TotalMap s_totals;
+static time_t s_lastMerge;
+static time_t s_window;         // seconds the last merge covered
+
+///////////////////////////////////////////////////////////////////////////////
+
+void SharedStoreKeyStats::OnFetch(CStrRef key, SharedVariant *var) {
+  if (RuntimeOption::ApcKeyStatsSampleRate > 0) Record(key, var, false);
+}
+
+void SharedStoreKeyStats::OnStore(CStrRef key, SharedVariant *var) {
+  if (RuntimeOption::ApcKeyStatsSampleRate > 0) Record(key, var, true);
+}
+
+void SharedStoreKeyStats::Record(CStrRef key, SharedVariant *var,
+                                 bool store) {
+  KeyStatsBufferOwner *owner = s_bufferOwner.get();
+  if (--owner->m_countdown > 0) return;
+  int rate = RuntimeOption::ApcKeyStatsSampleRate;
+  owner->m_countdown = rate;
+
+  // everything that costs anything is done for sampled accesses only
+  Counters c;
+  if (store) {
+    c.stores = rate;
+  } else {
+    c.fetches = rate;
+    if (var) c.hits = rate;
+  }
+  if (var) {
+    SharedVariantStats stats;
+    var->getStats(&stats);
+    c.sized = 1;
+    c.bytes = stats.dataTotalSize;
+  }
+  string skeleton = SharedStore::GetSkeleton(key);
+
+  KeyStatsBuffer *buffer = owner->m_buffer;
+  Lock lock(buffer->lock);
+  add_counters(buffer->counters, skeleton, c);
+}
+
+void SharedStoreKeyStats::Merge() {
+  vector<KeyStatsBuffer *> buffers;
+  {
+    Lock lock(s_buffersLock);
+    buffers = s_buffers;
+  }
+  CounterMap merged;
+  for (unsigned int i = 0; i < buffers.size(); i++) {
+    CounterMap counters;
+    {
+      Lock lock(buffers[i]->lock);
+      counters.swap(buffers[i]->counters);
+    }
+    for (CounterMap::const_iterator iter = counters.begin();
+         iter != counters.end(); ++iter) {
+      add_counters(merged, iter->first, iter->second);
+    }
+  }
+
+  time_t now = time(NULL);
+  Lock lock(s_totalsLock);
+  for (TotalMap::iterator iter = s_totals.begin(); iter != s_totals.end();
+       ++iter) {
+    iter->second.lastFetches = 0;
+  }
+  for (CounterMap::const_iterator iter = merged.begin(); iter != merged.end();
+       ++iter) {
+    TotalMap::iterator total = s_totals.find(iter->first);
+    if (total == s_totals.end()) {
+      total = s_totals.insert(make_pair(s_totals.size() < MaxSkeletons ?
+                                        iter->first : string(OtherSkeleton),
+                                        KeyStatsTotal())).first;
+    }
+    total->second.all.add(iter->second);
+    total->second.lastFetches += iter->second.fetches;
+  }
+  s_window = s_lastMerge ? now - s_lastMerge : 0;
+  s_lastMerge = now;
+}
+
+void SharedStoreKeyStats::Clear() {
+  {
+    Lock lock(s_buffersLock);
+    for (unsigned int i = 0; i < s_buffers.size(); i++) {
+      Lock lock(s_buffers[i]->lock);
+      s_buffers[i]->counters.clear();
+    }
+  }
+  Lock lock(s_totalsLock);
+  s_totals.clear();
+  s_lastMerge = 0;
+  s_window = 0;
+}
+
+Counters SharedStoreKeyStats::Get(const string &skeleton) {
+  Lock lock(s_totalsLock);
+  TotalMap::const_iterator iter = s_totals.find(skeleton);
+  if (iter == s_totals.end()) return Counters();
+  return iter->second.all;
+}
+
+static bool more_fetches(const pair<string, KeyStatsTotal> &a,
+                         const pair<string, KeyStatsTotal> &b) {
+  return a.second.all.fetches > b.second.all.fetches;
+}
+
+/**
+ * Control characters go out as \u00XX, and a '\0' doesn't end the key.
+ */
+static void write_json_string(ostringstream &out, const string &s) {
+  out << '"';
+  for (unsigned int i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < ' ') {
+      char hex[8];
+      snprintf(hex, sizeof(hex), "\\u%04x", c);
+      out << hex;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+string SharedStoreKeyStats::Report(int count) {
+  vector<pair<string, KeyStatsTotal> > totals;
+  time_t window;
+  {
+    Lock lock(s_totalsLock);
+    totals.assign(s_totals.begin(), s_totals.end());
+    window = s_window;
+  }
+  sort(totals.begin(), totals.end(), more_fetches);
+  if (count >= 0 && (int)totals.size() > count) totals.resize(count);
+
+  ostringstream out;
+  out << "{\n";
+  out << "\"APCKeyStats\": {\n";
+  for (unsigned int i = 0; i < totals.size(); i++) {
+    const Counters &c = totals[i].second.all;
+    out << "  ";
+    write_json_string(out, totals[i].first);
+    out << ": {\n";
+    out << "    \"Fetches\": " << c.fetches << ",\n";
+    out << "    \"Hits\": " << c.hits << ",\n";
+    out << "    \"Misses\": " << (c.fetches - c.hits) << ",\n";
+    out << "    \"Stores\": " << c.stores << ",\n";
+    out << "    \"AvgSize\": " << (c.sized ? c.bytes / c.sized : 0) << ",\n";
+    out << "    \"FetchesPerSec\": "
+        << (window ? totals[i].second.lastFetches / window : 0) << "\n";
+    out << "  }" << (i + 1 < totals.size() ? ",\n" : "\n");
+  }
+  out << "}\n";
+  out << "}\n";
+  return out.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
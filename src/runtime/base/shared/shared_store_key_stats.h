@@ -0,0 +1,83 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_SHARED_STORE_KEY_STATS_H__
+#define __HPHP_SHARED_STORE_KEY_STATS_H__
+
+#include <runtime/base/types.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+class SharedVariant;
+
+/**
+ * APC fetches, hits, stores and value sizes by key skeleton, cheap enough to
+ * leave on in production. Only one access in APC.KeyStatsSampleRate is
+ * counted, into a buffer of the thread's own, and Merge(), which the server
+ * calls every second, folds the buffers into the totals that are reported,
+ * so no fetch or store ever waits on another thread for them.
+ */
+class SharedStoreKeyStats {
+public:
+  class Counters {
+  public:
+    Counters() : fetches(0), hits(0), stores(0), sized(0), bytes(0) {}
+
+    int64 fetches;
+    int64 hits;
+    int64 stores;
+    int64 sized;                // samples that had a value to measure
+    int64 bytes;                // and the total size of those values
+
+    void add(const Counters &c) {
+      fetches += c.fetches;
+      hits += c.hits;
+      stores += c.stores;
+      sized += c.sized;
+      bytes += c.bytes;
+    }
+  };
+
+  /**
+   * var is the value that was fetched or stored, or NULL for a miss.
+   */
+  static void OnFetch(CStrRef key, SharedVariant *var);
+  static void OnStore(CStrRef key, SharedVariant *var);
+
+  static void Merge();
+  static void Clear();
+
+  /**
+   * Merged totals of a key skeleton, as SharedStore::GetSkeleton() makes
+   * them. Counts are scaled back up by the sample rate.
+   */
+  static Counters Get(const std::string &skeleton);
+
+  /**
+   * The count skeletons with the most fetches, in JSON, each with its
+   * totals and its fetches per second since the merge before last.
+   */
+  static std::string Report(int count);
+
+private:
+  static void Record(CStrRef key, SharedVariant *var, bool store);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_SHARED_STORE_KEY_STATS_H__
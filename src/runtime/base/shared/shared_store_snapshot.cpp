@@ -0,0 +1,228 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/shared/shared_store_snapshot.h>
+#include <util/logger.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+using namespace std;
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+static const char SnapshotMagic[8] = {'H', 'P', 'H', 'P', 'A', 'P', 'C', '\0'};
+
+struct SnapshotHeader {
+  char magic[8];
+  int32 version;
+  int32 reserved;
+  int64 count;
+  int64 size;      // of the whole file
+};
+
+struct SnapshotEntry {
+  int64 expiry;
+  int32 keyLen;
+  int32 dataLen;
+  int32 serialized;
+  int32 reserved;
+};
+
+static int64 entry_size(int64 keyLen, int64 dataLen) {
+  int64 size = sizeof(SnapshotEntry) + keyLen + 1 + dataLen + 1;
+  return (size + 7) & ~7LL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+SharedStoreSnapshot *SharedStoreSnapshot::Map(const char *file) {
+  int fd = ::open(file, O_RDONLY);
+  if (fd < 0) {
+    Logger::Error("Unable to open APC snapshot %s: %s", file,
+                  strerror(errno));
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+    Logger::Error("APC snapshot %s is too short", file);
+    close(fd);
+    return NULL;
+  }
+  int64 size = st.st_size;
+  void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    Logger::Error("Unable to map APC snapshot %s: %s", file, strerror(errno));
+    return NULL;
+  }
+
+  const char *base = (const char *)mapped;
+  const SnapshotHeader *header = (const SnapshotHeader *)base;
+  const char *error = NULL;
+  SharedStoreSnapshot *snapshot = new SharedStoreSnapshot();
+  if (memcmp(header->magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0) {
+    error = "is not a snapshot";
+  } else if (header->version != Version) {
+    error = "has a different version";
+  } else if (header->size != size || header->count < 0) {
+    error = "is truncated";
+  } else {
+    snapshot->m_entries.reserve(header->count);
+    int64 offset = sizeof(SnapshotHeader);
+    for (int64 i = 0; i < header->count; i++) {
+      const SnapshotEntry *entry = (const SnapshotEntry *)(base + offset);
+      if (offset + (int64)sizeof(SnapshotEntry) > size ||
+          entry->keyLen < 0 || entry->dataLen < 0 ||
+          offset + entry_size(entry->keyLen, entry->dataLen) > size) {
+        error = "is truncated";
+        break;
+      }
+      const char *key = (const char *)(entry + 1);
+      if (key[entry->keyLen] != '\0' ||
+          key[entry->keyLen + 1 + entry->dataLen] != '\0') {
+        error = "has a corrupt entry";
+        break;
+      }
+      snapshot->m_entries.push_back(base + offset);
+      offset += entry_size(entry->keyLen, entry->dataLen);
+    }
+  }
+  if (error) {
+    Logger::Error("APC snapshot %s %s", file, error);
+    delete snapshot;
+    munmap(mapped, size);
+    return NULL;
+  }
+  return snapshot;
+}
+
+void SharedStoreSnapshot::get(int i, Entry &entry) const {
+  ASSERT(i >= 0 && i < size());
+  const SnapshotEntry *e = (const SnapshotEntry *)m_entries[i];
+  entry.key = (const char *)(e + 1);
+  entry.len = e->keyLen;
+  entry.expiry = e->expiry;
+  entry.serialized = e->serialized;
+  entry.data = entry.key + e->keyLen + 1;
+  entry.size = e->dataLen;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+SharedStoreSnapshotWriter::SharedStoreSnapshotWriter()
+  : m_fp(NULL), m_count(0), m_offset(0), m_failed(false) {
+}
+
+SharedStoreSnapshotWriter::~SharedStoreSnapshotWriter() {
+  if (m_fp) {
+    fclose(m_fp);
+    unlink(m_tmpFile.c_str());
+  }
+}
+
+bool SharedStoreSnapshotWriter::open(const char *file) {
+  ASSERT(m_fp == NULL);
+  m_file = file;
+  // unique, so dumps running at the same time don't write into each other's
+  // file, and whichever finishes last is the one that's left
+  std::vector<char> name(m_file.begin(), m_file.end());
+  const char suffix[] = ".tmp.XXXXXX";
+  name.insert(name.end(), suffix, suffix + sizeof(suffix));
+  int fd = mkstemp(&name[0]);
+  m_tmpFile = &name[0];
+  if (fd >= 0) {
+    fchmod(fd, 0644);
+    m_fp = fdopen(fd, "w");
+    if (m_fp == NULL) {
+      ::close(fd);
+      unlink(m_tmpFile.c_str());
+    }
+  }
+  if (m_fp == NULL) {
+    Logger::Error("Unable to write APC snapshot %s: %s", m_tmpFile.c_str(),
+                  strerror(errno));
+    return false;
+  }
+  // the count and size are filled in by finish()
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  return write(&header, sizeof(header));
+}
+
+bool SharedStoreSnapshotWriter::add(const char *key, int len, int64 expiry,
+                                    bool serialized, const char *data,
+                                    int size) {
+  ASSERT(m_fp);
+  SnapshotEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.expiry = expiry;
+  entry.keyLen = len;
+  entry.dataLen = size;
+  entry.serialized = serialized;
+  static const char zeros[8] = {0};
+  int padding = entry_size(len, size) - (sizeof(entry) + len + 1 + size + 1);
+  if (!write(&entry, sizeof(entry)) ||
+      !write(key, len) || !write(zeros, 1) ||
+      !write(data, size) || !write(zeros, 1 + padding)) {
+    return false;
+  }
+  m_count++;
+  return true;
+}
+
+bool SharedStoreSnapshotWriter::finish() {
+  ASSERT(m_fp);
+  if (m_failed) return false;
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+  header.version = SharedStoreSnapshot::Version;
+  header.count = m_count;
+  header.size = m_offset;
+  if (fseek(m_fp, 0, SEEK_SET) != 0 ||
+      fwrite(&header, sizeof(header), 1, m_fp) != 1 ||
+      fflush(m_fp) != 0 || fsync(fileno(m_fp)) != 0) {
+    Logger::Error("Unable to write APC snapshot %s: %s", m_tmpFile.c_str(),
+                  strerror(errno));
+    return false;
+  }
+  fclose(m_fp);
+  m_fp = NULL;
+  if (rename(m_tmpFile.c_str(), m_file.c_str()) != 0) {
+    Logger::Error("Unable to rename APC snapshot to %s: %s", m_file.c_str(),
+                  strerror(errno));
+    unlink(m_tmpFile.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SharedStoreSnapshotWriter::write(const void *data, int64 size) {
+  if (m_failed) return false;
+  if (size && fwrite(data, size, 1, m_fp) != 1) {
+    Logger::Error("Unable to write APC snapshot %s: %s", m_tmpFile.c_str(),
+                  strerror(errno));
+    m_failed = true;
+    return false;
+  }
+  m_offset += size;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
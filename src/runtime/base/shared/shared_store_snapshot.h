@@ -0,0 +1,91 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_SHARED_STORE_SNAPSHOT_H__
+#define __HPHP_SHARED_STORE_SNAPSHOT_H__
+
+#include <runtime/base/types.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A snapshot of a shared store, as written to APC.SnapshotFile. The file has
+ * a header, then one entry per key:
+ *
+ *   fixed-size entry, key, '\0', data, '\0', padding to 8 bytes
+ *
+ * A string's data is its own bytes, and anything else is in serialize()
+ * format, so nothing in the file is a pointer and any later process can map
+ * it. Expiry times are absolute.
+ */
+class SharedStoreSnapshot {
+public:
+  static const int Version = 1;
+
+  struct Entry {
+    const char *key;
+    int len;
+    int64 expiry;     // 0 if it never expires
+    bool serialized;  // false for a plain string
+    const char *data; // '\0' terminated
+    int size;
+  };
+
+  /**
+   * Maps file and checks that every entry is whole. Returns NULL, after
+   * logging why, if it can't. The mapping outlives the snapshot, because
+   * values loaded from it keep pointing into it.
+   */
+  static SharedStoreSnapshot *Map(const char *file);
+
+  int size() const { return m_entries.size();}
+  void get(int i, Entry &entry) const;
+
+private:
+  std::vector<const char *> m_entries;
+};
+
+/**
+ * Writes a snapshot to a temporary file next to the real one, and renames it
+ * over the real one only once finish() has written all of it, so a reader
+ * never maps half a snapshot.
+ */
+class SharedStoreSnapshotWriter {
+public:
+  SharedStoreSnapshotWriter();
+  ~SharedStoreSnapshotWriter();
+
+  bool open(const char *file);
+  bool add(const char *key, int len, int64 expiry, bool serialized,
+           const char *data, int size);
+  bool finish();
+
+private:
+  std::string m_file;
+  std::string m_tmpFile;
+  FILE *m_fp;
+  int64 m_count;
+  int64 m_offset;
+  bool m_failed;
+
+  bool write(const void *data, int64 size);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_SHARED_STORE_SNAPSHOT_H__
@@ -19,6 +19,11 @@
 #include <runtime/ext/ext_apc.h>
 #include <runtime/base/shared/shared_map.h>
 #include <runtime/base/runtime_option.h>
+#include <runtime/base/variable_serializer.h>
+#include <runtime/base/variable_unserializer.h>
+#include <runtime/base/externals.h>
+#include <runtime/base/util/string_buffer.h>
+#include <runtime/base/shared/shared_block_allocator.h>
 
 using namespace std;
 
@@ -31,6 +36,7 @@ ThreadSharedVariant::ThreadSharedVariant(CVarRef source, bool serialized,
 
   setOwner();
   m_ref = 1;
+  m_template = NULL;
 
   switch (source.getType()) {
   case KindOfBoolean:
@@ -80,7 +86,7 @@ ThreadSharedVariant::ThreadSharedVariant(CVarRef source, bool serialized,
           setSerializedArray();
           setShouldCache();
           String s = apc_serialize(source);
-          m_data.str = new StringData(s.data(), s.size(), CopyString);
+          m_data.str = new StringData(s.data(), s.size(), CopyMalloc);
           break;
         }
       }
@@ -121,12 +127,313 @@ ThreadSharedVariant::ThreadSharedVariant(CVarRef source, bool serialized,
       m_type = KindOfObject;
       setShouldCache();
       String s = apc_serialize(source);
-      m_data.str = new StringData(s.data(), s.size(), CopyString);
+      m_data.str = new StringData(s.data(), s.size(), CopyMalloc);
       break;
     }
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// packed layout
+
+/**
+ * A string is its length, then its bytes and a '\0'. An array is a
+ * PackedArray, then for a map a hash table of the first element in each
+ * chain, then its elements: a variant each for a vector, a PackedElem each
+ * for a map. What a variant points to always comes after it, and everything
+ * is 8-byte aligned.
+ */
+struct PackedString {
+  int32 len;
+  char data[4];
+};
+struct PackedArray {
+  int32 size;
+  int32 mask; // of the hash table, maps only
+};
+struct PackedElem {
+  char key[sizeof(ThreadSharedVariant)];
+  char val[sizeof(ThreadSharedVariant)];
+  int64 hash;
+  int32 next;
+  int32 pad;
+};
+
+static int64 align8(int64 n) {
+  return (n + 7) & ~7LL;
+}
+
+static int64 string_bytes(int len) {
+  return align8(sizeof(int32) + len + 1);
+}
+
+static int32 hash_mask(int size) {
+  int32 capacity = 1;
+  while (capacity < size) capacity <<= 1;
+  return capacity - 1;
+}
+
+static int64 array_bytes(int size, bool vector) {
+  if (vector) {
+    return align8(sizeof(PackedArray)) + size * sizeof(ThreadSharedVariant);
+  }
+  return align8(sizeof(PackedArray)) +
+    align8(sizeof(int32) * (hash_mask(size) + 1)) + size * sizeof(PackedElem);
+}
+
+static const PackedString *packed_string(const void *v, int64 offset) {
+  return (const PackedString *)((const char *)v + offset);
+}
+
+static const PackedArray *packed_array(const void *v, int64 offset) {
+  return (const PackedArray *)((const char *)v + offset);
+}
+
+static int32 *packed_hash(const PackedArray *pa) {
+  return (int32 *)((char *)pa + align8(sizeof(PackedArray)));
+}
+
+static PackedElem *packed_elems(const PackedArray *pa) {
+  return (PackedElem *)((char *)packed_hash(pa) +
+                        align8(sizeof(int32) * (pa->mask + 1)));
+}
+
+/**
+ * Sizes a value first, serializing the objects in it on the way, then hands
+ * out the block's bytes in the same order while the variants are built.
+ */
+class ThreadSharedVariant::PackedWriter {
+public:
+  PackedWriter() : m_cursor(NULL), m_next(0) {}
+
+  int64 measure(CVarRef source) {
+    switch (source.getType()) {
+    case KindOfBoolean:
+    case KindOfByte:
+    case KindOfInt16:
+    case KindOfInt32:
+    case KindOfInt64:
+    case KindOfDouble:
+      return 0;
+    case KindOfStaticString:
+    case KindOfString:
+      return string_bytes(source.toString().size());
+    case KindOfArray:
+      {
+        ArrayData *arr = source.getArrayData();
+        bool vector = arr->isVectorData();
+        int64 bytes = array_bytes(arr->size(), vector);
+        for (ArrayIter it(arr); !it.end(); it.next()) {
+          if (!vector) bytes += measure(it.first());
+          bytes += measure(it.second());
+        }
+        return bytes;
+      }
+    default:
+      m_serialized.push_back(apc_serialize(source));
+      return string_bytes(m_serialized.back().size());
+    }
+  }
+
+  char *take(int64 bytes) {
+    char *p = m_cursor;
+    m_cursor += bytes;
+    return p;
+  }
+
+  /**
+   * Copies a string in, and returns its offset from owner.
+   */
+  int64 putString(ThreadSharedVariant *owner, const char *data, int len) {
+    PackedString *ps = (PackedString *)take(string_bytes(len));
+    ps->len = len;
+    memcpy(ps->data, data, len);
+    ps->data[len] = '\0';
+    return (char *)ps - (char *)owner;
+  }
+
+  String nextSerialized() {
+    return m_serialized[m_next++];
+  }
+
+  char *m_cursor;
+
+private:
+  std::vector<String> m_serialized;
+  int m_next;
+};
+
+ThreadSharedVariant *ThreadSharedVariant::Pack(CVarRef source) {
+  ASSERT(source.isArray());
+  PointerSet seen;
+  if (source.getArrayData()->hasInternalReference(seen)) return NULL;
+
+  PackedWriter writer;
+  int64 size = sizeof(ThreadSharedVariant) + writer.measure(source);
+  char *block = (char *)SharedBlockAllocator::Alloc(size);
+  writer.m_cursor = block + sizeof(ThreadSharedVariant);
+  ThreadSharedVariant *root =
+    new (block) ThreadSharedVariant(source, NULL, writer);
+  ASSERT(writer.m_cursor == block + size);
+  return root;
+}
+
+ThreadSharedVariant::ThreadSharedVariant(CVarRef source,
+                                         ThreadSharedVariant *root,
+                                         PackedWriter &writer) {
+  m_flags = Packed | Owner;
+  if (root) {
+    m_flags |= PackedChild;
+    m_ref = (char *)this - (char *)root;
+  } else {
+    m_ref = 1;
+    root = this;
+  }
+  m_template = NULL;
+
+  switch (source.getType()) {
+  case KindOfBoolean:
+    m_type = KindOfBoolean;
+    m_data.num = source.toBoolean();
+    break;
+  case KindOfByte:
+  case KindOfInt16:
+  case KindOfInt32:
+  case KindOfInt64:
+    m_type = KindOfInt64;
+    m_data.num = source.toInt64();
+    break;
+  case KindOfDouble:
+    m_type = KindOfDouble;
+    m_data.dbl = source.toDouble();
+    break;
+  case KindOfStaticString:
+  case KindOfString:
+    {
+      m_type = KindOfString;
+      String s = source.toString();
+      m_data.num = writer.putString(this, s.data(), s.size());
+      break;
+    }
+  case KindOfArray:
+    {
+      m_type = KindOfArray;
+      ArrayData *arr = source.getArrayData();
+      int size = arr->size();
+      bool vector = arr->isVectorData();
+      PackedArray *pa = (PackedArray *)writer.take(array_bytes(size, vector));
+      m_data.num = (char *)pa - (char *)this;
+      pa->size = size;
+      if (vector) {
+        setIsVector();
+        pa->mask = 0;
+        ThreadSharedVariant *vals = (ThreadSharedVariant *)packed_hash(pa);
+        int i = 0;
+        for (ArrayIter it(arr); !it.end(); it.next(), i++) {
+          ThreadSharedVariant *val =
+            new (vals + i) ThreadSharedVariant(it.second(), root, writer);
+          if (val->shouldCache()) setShouldCache();
+        }
+      } else {
+        pa->mask = hash_mask(size);
+        int32 *hash = packed_hash(pa);
+        for (int i = 0; i <= pa->mask; i++) hash[i] = -1;
+        PackedElem *elems = packed_elems(pa);
+        int i = 0;
+        for (ArrayIter it(arr); !it.end(); it.next(), i++) {
+          PackedElem &e = elems[i];
+          ThreadSharedVariant *key =
+            new (e.key) ThreadSharedVariant(it.first(), root, writer);
+          ThreadSharedVariant *val =
+            new (e.val) ThreadSharedVariant(it.second(), root, writer);
+          if (val->shouldCache()) setShouldCache();
+          e.hash = key->is(KindOfInt64) ? key->m_data.num : key->stringHash();
+          e.next = hash[e.hash & pa->mask];
+          hash[e.hash & pa->mask] = i;
+        }
+      }
+      break;
+    }
+  default:
+    {
+      m_type = KindOfObject;
+      setShouldCache();
+      String s = writer.nextSerialized();
+      m_data.num = writer.putString(this, s.data(), s.size());
+      break;
+    }
+  }
+}
+
+ThreadSharedVariant *ThreadSharedVariant::copyPacked() const {
+  ASSERT(getPacked() && !getPackedChild());
+  int64 size = SharedBlockAllocator::Size(this);
+  ThreadSharedVariant *copy =
+    (ThreadSharedVariant *)SharedBlockAllocator::Alloc(size);
+  memcpy((void *)copy, (const void *)this, size);
+  copy->m_ref = 1;
+  return copy;
+}
+
+void ThreadSharedVariant::releasePacked() {
+  // nothing in the block owns anything outside of it
+  SharedBlockAllocator::Free(this);
+}
+
+ThreadSharedVariant *ThreadSharedVariant::packedKey(ssize_t pos) const {
+  const PackedArray *pa = packed_array(this, m_data.num);
+  ASSERT(!getIsVector() && pos < pa->size);
+  return (ThreadSharedVariant *)packed_elems(pa)[pos].key;
+}
+
+ThreadSharedVariant *ThreadSharedVariant::packedValue(ssize_t pos) const {
+  const PackedArray *pa = packed_array(this, m_data.num);
+  ASSERT(pos < pa->size);
+  if (getIsVector()) {
+    return (ThreadSharedVariant *)packed_hash(pa) + pos;
+  }
+  return (ThreadSharedVariant *)packed_elems(pa)[pos].val;
+}
+
+/**
+ * The index of the key with this hash, an int if key is NULL, or -1.
+ */
+int ThreadSharedVariant::packedIndex(int64 hash, const char *key,
+                                     int len) const {
+  const PackedArray *pa = packed_array(this, m_data.num);
+  const PackedElem *elems = packed_elems(pa);
+  for (int i = packed_hash(pa)[hash & pa->mask]; i != -1; i = elems[i].next) {
+    const PackedElem &e = elems[i];
+    if (e.hash != hash) continue;
+    const ThreadSharedVariant *k = (const ThreadSharedVariant *)e.key;
+    if (key == NULL) {
+      if (k->is(KindOfInt64)) return i;
+    } else if (k->is(KindOfString) && k->stringLength() == (size_t)len &&
+               memcmp(k->stringData(), key, len) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+ThreadSharedVariant::ThreadSharedVariant(const char *data, int len,
+                                         bool serialized) {
+  setOwner();
+  m_ref = 1;
+  m_template = NULL;
+  // the StringData is ours, but releasing it leaves a literal's bytes alone
+  m_data.str = new StringData(data, len, AttachLiteral);
+  if (!serialized) {
+    m_type = KindOfString;
+  } else {
+    ASSERT(data[0] == 'O' || data[0] == 'C');
+    m_type = KindOfObject;
+    setShouldCache();
+  }
+}
+
 Variant ThreadSharedVariant::toLocal() {
   ASSERT(getOwner());
   switch (m_type) {
@@ -144,7 +451,7 @@ Variant ThreadSharedVariant::toLocal() {
     }
   case KindOfString:
     {
-      if (m_data.str->isStatic()) return m_data.str;
+      if (!getPacked() && m_data.str->isStatic()) return m_data.str;
       return NEW(StringData)(this);
     }
   case KindOfArray:
@@ -158,12 +465,100 @@ Variant ThreadSharedVariant::toLocal() {
   default:
     {
       ASSERT(m_type == KindOfObject);
+      if (getPacked()) {
+        const PackedString *ps = packed_string(this, m_data.num);
+        return apc_unserialize(String(ps->data, ps->len, AttachLiteral));
+      }
+      ObjectTemplate *t = getObjectTemplate();
+      if (t->props) {
+        Object obj = t->create();
+        if (!obj.isNull()) return obj;
+      }
       return apc_unserialize(String(m_data.str->data(), m_data.str->size(),
                                     AttachLiteral));
     }
   }
 }
 
+ThreadSharedVariant::ObjectTemplate *ThreadSharedVariant::getObjectTemplate() {
+  ObjectTemplate *t = m_template;
+  if (t) return t;
+  t = ObjectTemplate::Parse(m_data.str->data(), m_data.str->size());
+  if (t == NULL) t = new ObjectTemplate();
+  ObjectTemplate *old = m_template.compare_and_swap(t, NULL);
+  if (old) {
+    // another thread parsed it first
+    delete t;
+    return old;
+  }
+  return t;
+}
+
+ThreadSharedVariant::ObjectTemplate *
+ThreadSharedVariant::ObjectTemplate::Parse(const char *data, int len) {
+  if (len < 2 || data[0] != 'O' || data[1] != ':') return NULL;
+  VariableUnserializer uns(data, len, VariableUnserializer::APCSerialize);
+  try {
+    uns.read(2);
+    String cls;
+    cls.unserialize(&uns);
+    if (uns.readChar() != ':') return NULL;
+    int64 size = uns.readInt();
+    if (uns.readChar() != ':' || uns.readChar() != '{') return NULL;
+
+    // the object is the first thing references can point back to, and an
+    // object in its place makes sure any that do are caught below
+    Variant self = create_object("stdClass", Array::Create(), false);
+    uns.add(&self);
+    Array props = Array::Create();
+    for (int64 i = 0; i < size; i++) {
+      String key = uns.unserializeKey().toString();
+      if (key.size() > 1 && key.charAt(0) == '\0' && key.charAt(1) != '*' &&
+          key.find('\0', 1) == String::npos) {
+        return NULL;
+      }
+      props.lvalAt(key).unserialize(&uns);
+    }
+    if (uns.readChar() != '}') return NULL;
+
+    PointerSet seen;
+    if (props->hasInternalReference(seen)) return NULL;
+    ThreadSharedVariant *sprops = new ThreadSharedVariant(props, false, true);
+    if (sprops->shouldCache()) {
+      sprops->decRef();
+      return NULL;
+    }
+    return new ObjectTemplate(cls, sprops);
+  } catch (Exception &e) {
+    return NULL;
+  }
+}
+
+Object ThreadSharedVariant::ObjectTemplate::create() const {
+  ASSERT(props);
+  Object obj;
+  try {
+    obj = create_object(cls.c_str(), Array::Create(), false);
+  } catch (ClassNotFoundException &e) {
+    return Object();
+  }
+  // properties are named as serialize() mangles them
+  String clsName(cls.c_str(), cls.size(), AttachLiteral);
+  ssize_t count = props->arrSize();
+  for (ssize_t i = 0; i < count; i++) {
+    String key = props->getKey(i).toString();
+    Variant tmp;
+    Variant &value =
+      key.charAt(0) != '\0' ? obj->o_lval(key, tmp) :
+      key.charAt(1) == '*' ? obj->o_lval(key.substr(3), tmp, clsName) :
+      obj->o_lval(key.substr(key.find('\0', 1) + 1), tmp,
+                  key.substr(1, key.find('\0', 1) - 1));
+    value = props->getValue(i)->toLocal();
+  }
+  obj->t___wakeup();
+  return obj;
+}
+
 void ThreadSharedVariant::dump(std::string &out) {
   out += "ref(";
   out += boost::lexical_cast<string>(m_ref);
@@ -197,13 +592,15 @@ void ThreadSharedVariant::dump(std::string &out) {
     break;
   default:
     out += "object: ";
-    out += m_data.str->data();
+    out += getPacked() ? packed_string(this, m_data.num)->data :
+      m_data.str->data();
     break;
   }
   out += "\n";
 }
 
 ThreadSharedVariant::~ThreadSharedVariant() {
+  delete m_template;
   switch (m_type) {
   case KindOfString:
   case KindOfObject:
@@ -239,16 +636,19 @@ ThreadSharedVariant::~ThreadSharedVariant() {
 
 const char *ThreadSharedVariant::stringData() const {
   ASSERT(is(KindOfString));
+  if (getPacked()) return packed_string(this, m_data.num)->data;
   return m_data.str->data();
 }
 
 size_t ThreadSharedVariant::stringLength() const {
   ASSERT(is(KindOfString));
+  if (getPacked()) return packed_string(this, m_data.num)->len;
   return m_data.str->size();
 }
 
 size_t ThreadSharedVariant::arrSize() const {
   ASSERT(is(KindOfArray));
+  if (getPacked()) return packed_array(this, m_data.num)->size;
   if (getIsVector()) return m_data.vec->size;
   if (RuntimeOption::ApcUseGnuMap) return m_data.gnuMap->size;
   return m_data.map->size();
@@ -263,9 +663,10 @@ int ThreadSharedVariant::getIndex(CVarRef key) {
   case KindOfInt64: {
     int64 num = key.getNumData();
     if (getIsVector()) {
-      if (num < 0 || (size_t) num >= m_data.vec->size) return -1;
+      if (num < 0 || (size_t) num >= arrSize()) return -1;
       return num;
     }
+    if (getPacked()) return packedIndex(num, NULL, 0);
     if (RuntimeOption::ApcUseGnuMap) {
       Int64ToIntMap::const_iterator it = m_data.gnuMap->intMap->find(num);
       if (it == m_data.gnuMap->intMap->end()) return -1;
@@ -277,6 +678,7 @@ int ThreadSharedVariant::getIndex(CVarRef key) {
   case KindOfString: {
     if (getIsVector()) return -1;
     StringData *sd = key.getStringData();
+    if (getPacked()) return packedIndex(sd->hash(), sd->data(), sd->size());
     if (RuntimeOption::ApcUseGnuMap) {
       StringDataToIntMap::const_iterator it = m_data.gnuMap->strMap->find(sd);
       if (it == m_data.gnuMap->strMap->end()) return -1;
@@ -294,6 +696,7 @@ int ThreadSharedVariant::getIndex(CVarRef key) {
 SharedVariant* ThreadSharedVariant::get(CVarRef key) {
   int idx = getIndex(key);
   if (idx != -1) {
+    if (getPacked()) return packedValue(idx);
     if (getIsVector()) return m_data.vec->vals[idx];
     if (RuntimeOption::ApcUseGnuMap) return m_data.gnuMap->vals[idx];
     return m_data.map->getValIndex(idx);
@@ -316,6 +719,8 @@ void ThreadSharedVariant::loadElems(ArrayData *&elems,
   for (uint i = 0; i < count; i++) {
     if (getIsVector()) {
       ai.add((int64)i, sharedMap.getValue(i), true);
+    } else if (getPacked()) {
+      ai.add(packedKey(i)->toLocal(), sharedMap.getValue(i), true);
     } else {
       if (RuntimeOption::ApcUseGnuMap) {
         ai.add(m_data.gnuMap->keys[i]->toLocal(), sharedMap.getValue(i), true);
@@ -343,6 +748,14 @@ ThreadSharedVariant *ThreadSharedVariant::createAnother
 void ThreadSharedVariant::getStats(SharedVariantStats *stats) {
   stats->initStats();
   stats->variantCount = 1;
+  if (getPacked()) {
+    // the whole block is counted once, by the variant that owns it
+    if (!getPackedChild()) {
+      stats->dataSize = SharedBlockAllocator::Size(this);
+      stats->dataTotalSize = stats->dataSize;
+    }
+    return;
+  }
   switch (m_type) {
   case KindOfBoolean:
   case KindOfInt64:
@@ -363,6 +776,15 @@ void ThreadSharedVariant::getStats(SharedVariantStats *stats) {
     stats->dataSize = m_data.str->size();
     stats->dataTotalSize = sizeof(ThreadSharedVariant) + sizeof(StringData) +
                            stats->dataSize;
+    if (is(KindOfObject)) {
+      ObjectTemplate *t = m_template;
+      if (t && t->props) {
+        SharedVariantStats propStats;
+        t->props->getStats(&propStats);
+        stats->addChildStats(&propStats);
+        stats->dataTotalSize += sizeof(ObjectTemplate);
+      }
+    }
     break;
   default:
     ASSERT(is(KindOfArray));
@@ -401,5 +823,67 @@ void ThreadSharedVariant::getStats(SharedVariantStats *stats) {
   }
 }
 
+void ThreadSharedVariant::serialize(StringBuffer &buf) {
+  switch (m_type) {
+  case KindOfBoolean:
+    buf.append(m_data.num ? "b:1;" : "b:0;");
+    break;
+  case KindOfInt64:
+    buf.append("i:");
+    buf.append(m_data.num);
+    buf.append(';');
+    break;
+  case KindOfDouble:
+    {
+      VariableSerializer vs(VariableSerializer::Serialize);
+      buf.append(vs.serialize(m_data.dbl, true).toString());
+    }
+    break;
+  case KindOfString:
+    buf.append("s:");
+    buf.append((int64)stringLength());
+    buf.append(":\"");
+    buf.append(stringData(), stringLength());
+    buf.append("\";");
+    break;
+  case KindOfArray:
+    if (!getSerializedArray()) {
+      size_t size = arrSize();
+      buf.append("a:");
+      buf.append((int64)size);
+      buf.append(":{");
+      for (size_t i = 0; i < size; i++) {
+        if (getIsVector()) {
+          buf.append("i:");
+          buf.append((int64)i);
+          buf.append(';');
+          ((ThreadSharedVariant *)getValue(i))->serialize(buf);
+        } else if (getPacked()) {
+          packedKey(i)->serialize(buf);
+          packedValue(i)->serialize(buf);
+        } else if (RuntimeOption::ApcUseGnuMap) {
+          m_data.gnuMap->keys[i]->serialize(buf);
+          m_data.gnuMap->vals[i]->serialize(buf);
+        } else {
+          m_data.map->getKeyIndex(i)->serialize(buf);
+          m_data.map->getValIndex(i)->serialize(buf);
+        }
+      }
+      buf.append('}');
+      break;
+    }
+    // fall through
+  default:
+    if (getPacked()) {
+      const PackedString *ps = packed_string(this, m_data.num);
+      buf.append(apc_unreserialize(String(ps->data, ps->len, AttachLiteral)));
+    } else {
+      buf.append(apc_unreserialize(String(m_data.str->data(),
+                                          m_data.str->size(), AttachLiteral)));
+    }
+    break;
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
@@ -24,11 +24,13 @@
 #include <runtime/base/shared/shared_variant.h>
 #include <runtime/base/complex_types.h>
 #include <runtime/base/shared/immutable_map.h>
+#include <tbb/atomic.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
 class ThreadSharedVariant;
+class StringBuffer;
 
 typedef hphp_hash_map<int64, int, int64_hash> Int64ToIntMap;
 typedef hphp_hash_map<StringData *, int, string_data_hash, string_data_same>
@@ -39,16 +41,52 @@ typedef hphp_hash_map<StringData *, int, string_data_hash, string_data_same>
 class ThreadSharedVariant : public SharedVariant {
 public:
   ThreadSharedVariant(CVarRef source, bool serialized, bool inner = false);
+
+  /**
+   * Wraps bytes that live outside the heap, as in a mapped snapshot, without
+   * copying them: a string's own bytes, or an object's serialize() data,
+   * which is unserialized on every fetch the same as a stored object's. The
+   * bytes have to be '\0' terminated and to outlive the variant.
+   */
+  ThreadSharedVariant(const char *data, int len, bool serialized);
   virtual ~ThreadSharedVariant();
 
+  /**
+   * Packs an array into a single block from SharedBlockAllocator, with its
+   * keys, values, strings and nested arrays laid out together and pointing
+   * at each other by offsets, so the block can be moved with memcpy().
+   * Variants inside the block share its reference count. Returns NULL for an
+   * array with internal references, which has to be serialized instead.
+   */
+  static ThreadSharedVariant *Pack(CVarRef source);
+
+  /**
+   * For compaction: whether this is the variant that owns a packed block,
+   * and a copy of the block it owns.
+   */
+  bool isPacked() const { return getPacked() && !getPackedChild();}
+  ThreadSharedVariant *copyPacked() const;
+
   virtual void incRef() {
+    if (getPackedChild()) {
+      packedRoot()->incRef();
+      return;
+    }
     atomic_inc(m_ref);
   }
 
   virtual void decRef() {
+    if (getPackedChild()) {
+      packedRoot()->decRef();
+      return;
+    }
     ASSERT(m_ref);
     if (atomic_dec(m_ref) == 0) {
-      delete this;
+      if (getPacked()) {
+        releasePacked();
+      } else {
+        delete this;
+      }
     }
   }
 
@@ -63,6 +101,9 @@ public:
   size_t stringLength() const;
   virtual int64 stringHash() const {
     ASSERT(is(KindOfString));
+    if (getPacked()) {
+      return hash_string(stringData(), stringLength()) & 0x7fffffffffffffffull;
+    }
     return m_data.str->hash();
   }
 
@@ -77,13 +118,15 @@ public:
   virtual Variant getKey(ssize_t pos) const {
     ASSERT(is(KindOfArray));
     if (getIsVector()) {
-      ASSERT(pos < (ssize_t) m_data.vec->size);
+      ASSERT(pos < (ssize_t) arrSize());
       return pos;
     }
+    if (getPacked()) return packedKey(pos)->toLocal();
     return m_data.map->getKeyIndex(pos)->toLocal();
   }
   virtual SharedVariant* getValue(ssize_t pos) const {
     ASSERT(is(KindOfArray));
+    if (getPacked()) return packedValue(pos);
     if (getIsVector()) {
       ASSERT(pos < (ssize_t) m_data.vec->size);
       return m_data.vec->vals[pos];
@@ -96,8 +139,16 @@ public:
 
   virtual void getStats(SharedVariantStats *stats);
 
+  /**
+   * Appends the value in serialize() format, without the pointers to static
+   * strings and arrays that apc_serialize() writes, so another process can
+   * read it back. Objects are copied as they were stored, without being
+   * unserialized.
+   */
+  void serialize(StringBuffer &buf);
+
   StringData *getStringData() const {
-    ASSERT(is(KindOfString));
+    ASSERT(is(KindOfString) && !getPacked());
     return m_data.str;
   }
 
@@ -108,12 +159,31 @@ protected:
   virtual SharedVariant* getKeySV(ssize_t pos) const {
     ASSERT(is(KindOfArray));
     if (getIsVector()) return NULL;
-    else return m_data.map->getKeyIndex(pos);
+    if (getPacked()) return packedKey(pos);
+    return m_data.map->getKeyIndex(pos);
   }
 
 private:
   const static uint16 IsVector = (1<<13);
   const static uint16 Owner = (1<<12);
+  const static uint16 Packed = (1<<11);
+  const static uint16 PackedChild = (1<<10);
+
+  /**
+   * In a packed block, m_data.num is the offset from the variant to its
+   * string or array, and a child's m_ref is its offset from the block's first
+   * variant, whose count it shares.
+   */
+  class PackedWriter;
+  ThreadSharedVariant(CVarRef source, ThreadSharedVariant *root,
+                      PackedWriter &writer);
+  ThreadSharedVariant *packedRoot() const {
+    return (ThreadSharedVariant *)((char *)this - m_ref);
+  }
+  ThreadSharedVariant *packedKey(ssize_t pos) const;
+  ThreadSharedVariant *packedValue(ssize_t pos) const;
+  int packedIndex(int64 hash, const char *key, int len) const;
+  void releasePacked();
 
   class VectorData {
   public:
@@ -168,6 +238,34 @@ private:
     }
   };
 
+  /**
+   * An object's class and properties, read once from its serialized form so
+   * that later fetches can create it without parsing it again. Arrays among
+   * the properties come back as SharedMaps, like any other APC array. An
+   * object that can't be rebuilt this way, because it's Serializable or has
+   * other objects or references in it, gets a template without properties
+   * and is unserialized every time.
+   */
+  class ObjectTemplate {
+  public:
+    static ObjectTemplate *Parse(const char *data, int len);
+
+    ObjectTemplate(CStrRef cls = null_string, ThreadSharedVariant *props = NULL)
+      : cls(cls.data(), cls.size()), props(props) {}
+    ~ObjectTemplate() {
+      if (props) props->decRef();
+    }
+
+    /**
+     * A new instance, or null if the class is gone.
+     */
+    Object create() const;
+
+    std::string cls;
+    ThreadSharedVariant *props;
+  };
+  ObjectTemplate *getObjectTemplate();
+
   union {
     int64 num;
     double dbl;
@@ -176,6 +274,7 @@ private:
     VectorData* vec;
     MapData *gnuMap;
   } m_data;
+  tbb::atomic<ObjectTemplate *> m_template;
 
   bool getIsVector() const { return (bool)(m_flags & IsVector);}
   void setIsVector() { m_flags |= IsVector;}
@@ -184,6 +283,9 @@ private:
   bool getOwner() const { return (bool)(m_flags & Owner);}
   void setOwner() { m_flags |= Owner;}
   void clearOwner() { m_flags &= ~Owner;}
+
+  bool getPacked() const { return (bool)(m_flags & Packed);}
+  bool getPackedChild() const { return (bool)(m_flags & PackedChild);}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
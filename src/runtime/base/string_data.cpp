@@ -16,6 +16,8 @@
 
 #include <runtime/base/string_data.h>
 #include <runtime/base/shared/shared_variant.h>
+#include <runtime/base/memory/memory_manager.h>
+#include <runtime/base/memory/size_class_allocator.h>
 #include <runtime/base/zend/zend_functions.h>
 #include <runtime/base/util/exceptions.h>
 #include <util/alloc.h>
@@ -32,6 +34,43 @@
 namespace HPHP {
 
 IMPLEMENT_SMART_ALLOCATION(StringData, SmartAllocatorImpl::NeedRestoreOnce);
+///////////////////////////////////////////////////////////////////////////////
+// smart_malloc-ed buffers
+
+/**
+ * Appending to a uniquely referenced string happens in place, so the buffer
+ * of an IsSmart string has room to grow: a buffer holding "size" bytes,
+ * including the terminating NUL, is always smartCapacity(size) bytes long.
+ * Up to SizeClassAllocator::MaxSmallSize that is the size class, and past it
+ * the same 4 steps per power of 2 carry on, so a string built by repeated
+ * appends is only copied when it crosses a step, and a `.=` loop costs
+ * amortized O(1) per appended byte instead of copying the whole string.
+ */
+static inline size_t smartCapacity(size_t size) {
+  if (size <= SizeClassAllocator::MaxSmallSize) {
+    return SizeClassAllocator::ClassSize(SizeClassAllocator::SizeClass(size));
+  }
+  int lg = 63 - __builtin_clzl(size - 1);
+  size_t step = ((size_t)1) << (lg - 2);
+  return (size + step - 1) & ~(step - 1);
+}
+
+static inline char *smartAlloc(size_t size) {
+  return (char*)smart_malloc(smartCapacity(size));
+}
+
+static inline char *smartRealloc(const char *p, size_t oldSize,
+                                 size_t newSize) {
+  size_t oldCapacity = smartCapacity(oldSize);
+  size_t newCapacity = smartCapacity(newSize);
+  if (oldCapacity == newCapacity) return (char*)p;
+  return (char*)smart_realloc((void*)p, oldCapacity, newCapacity);
+}
+
+static inline void smartFree(const char *p, size_t size) {
+  smart_free((void*)p, smartCapacity(size));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // constructor and destructor
 
@@ -77,9 +116,11 @@ StringData::~StringData() {
 }
 
 void StringData::releaseData() {
-  if ((m_len & (IsLinear | IsLiteral)) == 0) {
+  if ((m_len & (IsLinear | IsLiteral | IsSmall)) == 0) {
     if (isShared()) {
       m_shared->decRef();
+    } else if (isSmart()) {
+      smartFree(m_data, size() + 1);
     } else if (m_data) {
       free((void*)m_data);
     }
@@ -87,6 +128,19 @@ void StringData::releaseData() {
   m_hash = 0;
 }
 
+/**
+ * Short strings are copied into the StringData itself, which saves an
+ * allocation and keeps the bytes on the same cache line as the header. That
+ * is most strings made from integers and most array keys.
+ */
+void StringData::assignSmall(const char *data, int len) {
+  ASSERT(len <= MaxSmallSize);
+  memmove(m_small, data, len);
+  m_small[len] = '\0';
+  m_data = m_small;
+  m_len = len | IsSmall;
+}
+
 void StringData::assign(const char *data, StringDataMode mode) {
   ASSERT(data);
   assign(data, strlen(data), mode);
@@ -104,9 +158,23 @@ void StringData::assign(const char *data, int len, StringDataMode mode) {
   releaseData();
   m_hash = 0;
   m_len = len;
-  if (m_len) {
+  if (m_len && len <= MaxSmallSize && mode != AttachLiteral) {
+    assignSmall(data, len);
+    if (mode == AttachString) {
+      free((void*)data);
+    }
+  } else if (m_len) {
     switch (mode) {
     case CopyString:
+      {
+        char *buf = smartAlloc(len + 1);
+        buf[len] = '\0';
+        memcpy(buf, data, len);
+        m_data = buf;
+        m_len |= IsSmart;
+      }
+      break;
+    case CopyMalloc:
       {
         char *buf = (char*)malloc(len + 1);
         buf[len] = '\0';
@@ -146,38 +214,42 @@ void StringData::append(const char *s, int len) {
 
   ASSERT(!isStatic()); // never mess around with static strings!
 
-  if (!isMalloced()) {
-    int newlen;
-    m_data = string_concat(data(), size(), s, len, newlen);
-    if (isShared()) {
-      m_shared->decRef();
-    }
-    m_len = newlen;
-    m_hash = 0;
-  } else if (m_data == s) {
-    int newlen;
-    char *newdata = string_concat(data(), size(), s, len, newlen);
-    releaseData();
-    m_data = newdata;
-    m_len = newlen;
-  } else {
-    int dataLen = size();
-    ASSERT((m_data > s && m_data - s > len) ||
-           (m_data < s && s - m_data > dataLen)); // no overlapping
-    m_len = len + dataLen;
-    m_data = (const char*)realloc((void*)m_data, m_len + 1);
-    memcpy((void*)(m_data + dataLen), s, len);
-    ((char*)m_data)[m_len] = '\0';
+  int dataLen = size();
+  int newlen = dataLen + len;
+  if (newlen & IsMask) {
+    throw FatalErrorException(0, "String length exceeded 2^27 - 1: %d",
+                              newlen);
+  }
+
+  if (isSmall() && !isImmutable() && newlen <= MaxSmallSize) {
+    memmove(m_small + dataLen, s, len);
+    m_small[newlen] = '\0';
+    m_len = newlen | IsSmall;
     m_hash = 0;
+    return;
   }
 
-  if (m_len & IsMask) {
-    int len = m_len;
-    m_len &= ~IsMask;
+  // Anything but a mutable smart buffer, including malloc-ed strings made by
+  // string_concat(), moves to one with room to grow, so the appends that
+  // follow don't have to copy.
+  if (isImmutable() || !isSmart() || m_data == s) {
+    char *newdata = smartAlloc(newlen + 1);
+    memcpy(newdata, data(), dataLen);
+    memcpy(newdata + dataLen, s, len);
+    newdata[newlen] = '\0';
     releaseData();
-    m_data = NULL;
-    throw FatalErrorException(0, "String length exceeded 2^29 - 1: %d", len);
+    m_data = newdata;
+    m_len = newlen | IsSmart;
+    return;
   }
+
+  ASSERT((m_data > s && m_data - s > len) ||
+         (m_data < s && s - m_data > dataLen)); // no overlapping
+  m_data = smartRealloc(m_data, dataLen + 1, newlen + 1);
+  m_len = newlen | IsSmart;
+  memcpy((void*)(m_data + dataLen), s, len);
+  ((char*)m_data)[newlen] = '\0';
+  m_hash = 0;
 }
 
 StringData *StringData::copy(bool sharedMemory /* = false */) const {
@@ -189,7 +261,7 @@ StringData *StringData::copy(bool sharedMemory /* = false */) const {
     // Even if it's literal, it might come from hphpi's class info
     // which will be freed at the end of the request, and so must be
     // copied.
-    return new StringData(m_data, size(), CopyString);
+    return new StringData(m_data, size(), CopyMalloc);
   } else {
     if (isLiteral()) {
       return NEW(StringData)(m_data, size(), AttachLiteral);
@@ -204,10 +276,15 @@ void StringData::escalate() {
   int len = size();
   ASSERT(len);
 
-  char *buf = (char*)malloc(len+1);
+  if (len <= MaxSmallSize) {
+    assignSmall(data(), len);
+    m_hash = 0;
+    return;
+  }
+  char *buf = smartAlloc(len + 1);
   memcpy(buf, data(), len);
   buf[len] = '\0';
-  m_len = len;
+  m_len = len | IsSmart;
   m_data = buf;
   // clear precomputed hashcode
   m_hash = 0;
@@ -229,10 +306,11 @@ void StringData::dump() const {
   const char *p = data();
   int len = size();
 
-  printf("StringData(%d) (%s%s%s%s%d): [", _count,
+  printf("StringData(%d) (%s%s%s%s%s%d): [", _count,
          isLiteral() ? "literal " : "",
          isShared() ? "shared " : "",
          isLinear() ? "linear " : "",
+         isSmall() ? "small " : "",
          isStatic() ? "static " : "",
          len);
   for (int i = 0; i < len; i++) {
@@ -251,10 +329,7 @@ void StringData::dump() const {
 
 StringData *StringData::getChar(int offset) const {
   if (offset >= 0 && offset < size()) {
-    char *buf = (char *)malloc(2);
-    buf[0] = m_data[offset];
-    buf[1] = 0;
-    return NEW(StringData)(buf, 1, AttachString);
+    return NEW(StringData)(m_data + offset, 1, CopyString);
   }
 
   raise_notice("Uninitialized string offset: %d", offset);
@@ -304,20 +379,24 @@ void StringData::removeChar(int offset) {
   ASSERT(!isStatic());
   int len = size();
   if (isImmutable()) {
-    char *data = (char*)malloc(len);
+    char *data = smartAlloc(len);
     if (offset) {
       memcpy(data, this->data(), offset);
     }
     if (offset < len - 1) {
       memcpy(data + offset, this->data() + offset + 1, len - offset - 1);
     }
-    data[len] = 0;
-    m_len = len;
+    data[len - 1] = 0;
     releaseData();
+    m_len = (len - 1) | IsSmart;
     m_data = data;
   } else {
-    m_len = ((m_len & IsMask) | (len - 1));
     memmove((void*)(m_data + offset), m_data + offset + 1, len - offset);
+    if (isSmart()) {
+      // keep the buffer the size that releaseData() will free it as
+      m_data = smartRealloc(m_data, len + 1, len);
+    }
+    m_len = ((m_len & IsMask) | (len - 1));
     m_hash = 0;
   }
 }
@@ -506,7 +585,8 @@ int64 StringData::getSharedStringHash() const {
 ///////////////////////////////////////////////////////////////////////////////
 
 bool StringData::calculate(int &totalSize) {
-  if (m_data && !isLiteral()) {
+  // small strings are saved and restored along with the object itself
+  if (m_data && !isLiteral() && !isSmall()) {
     totalSize += (size() + 1); // ending NULL
     return true;
   }
@@ -50,12 +50,21 @@ class StringData {
     const static unsigned int IsLiteral = ((unsigned)1 << 31); // literal string
     const static unsigned int IsShared  = (1 << 30); // shared memory string
     const static unsigned int IsLinear  = (1 << 29); // linear allocator memory
+    const static unsigned int IsSmart   = (1 << 28); // smart_malloc-ed memory
+    const static unsigned int IsSmall   = (1 << 27); // inline in m_small
 
-    const static unsigned int IsMask = IsLiteral | IsShared | IsLinear;
+    const static unsigned int IsMask = IsLiteral | IsShared | IsLinear |
+                                       IsSmart | IsSmall;
 
  public:
     const static unsigned int LenMask = ~IsMask;
 
+    /**
+     * Copies of strings up to this long are stored in m_small, right after
+     * the other fields, instead of in a buffer of their own.
+     */
+    const static int MaxSmallSize = 15;
+
   /**
    * StringData does not formally derive from Countable, however it has a
    * _count field and implements all of the methods from Countable.
@@ -123,9 +132,15 @@ class StringData {
   bool isLiteral() const { return m_len & IsLiteral;}
   bool isShared() const { return m_len & IsShared;}
   bool isLinear() const { return m_len & IsLinear;}
+  bool isSmart() const { return m_len & IsSmart;}
+  bool isSmall() const { return m_len & IsSmall;}
   bool isMalloced() const { return (m_len & IsMask) == 0 && m_data;}
+  bool isInterned() const {
+    return m_hash < 0 && !isStatic() && !isShared();
+  }
   bool isImmutable() const {
-    return (m_len & (IsLiteral | IsShared | IsLinear)) || isStatic();
+    return (m_len & (IsLiteral | IsShared | IsLinear)) || isStatic() ||
+      isInterned();
   }
   bool isNumeric() const;
   bool isInteger() const;
@@ -178,7 +193,21 @@ class StringData {
     if (m_hash == 0) {
       m_hash = hash_string(data(), size());
     }
-    return m_hash;
+    return m_hash & 0x7fffffffffffffffull;
+  }
+
+  /**
+   * A request has at most one interned string with given contents (see
+   * StringInternTable), flagged by the sign bit of m_hash, which is otherwise
+   * always clear on strings that are neither static nor shared. Only
+   * StringInternTable should call these.
+   */
+  void setInterned() const {
+    ASSERT(!isStatic() && !isShared());
+    m_hash = hash() | (1ull << 63);
+  }
+  void clearInterned() const {
+    if (isInterned()) m_hash &= 0x7fffffffffffffffull;
   }
 
   bool same(const StringData *s) const {
@@ -186,6 +215,7 @@ class StringData {
     int len = size();
     if (s->size() != len) return false;
     if (data() == s->data()) return true;
+    if (isInterned() && s->isInterned()) return false;
     return !memcmp(data(), s->data(), len);
   }
 
@@ -231,8 +261,10 @@ class StringData {
   bitstring m_tainting;
   TaintedMetadata* m_tainted_metadata;
   #endif
+  char m_small[MaxSmallSize + 1];
 
   void releaseData();
+  void assignSmall(const char *data, int len);
 
   /**
    * Helpers.
@@ -0,0 +1,122 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/string_intern_table.h>
+#include <runtime/base/runtime_option.h>
+#include <util/thread_local.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+static IMPLEMENT_THREAD_LOCAL(StringInternTable, s_table);
+
+String StringInternTable::Intern(const char *s, int len) {
+  if (RuntimeOption::InternArrayKeys && len <= MaxLength) {
+    StringInternTable *table = s_table.get();
+    if (table->m_enabled) {
+      StringData *sd = table->intern(s, len, hash_string(s, len), NULL);
+      if (sd) return sd;
+    }
+  }
+  return String(s, len, CopyString);
+}
+
+StringData *StringInternTable::Intern(StringData *s) {
+  ASSERT(s);
+  if (!RuntimeOption::InternArrayKeys || s->size() > MaxLength ||
+      s->isInterned() || s->isStatic() || s->isShared() || s->isLinear()) {
+    return s;
+  }
+  StringInternTable *table = s_table.get();
+  if (!table->m_enabled) return s;
+  StringData *sd = table->intern(s->data(), s->size(), s->hash(), s);
+  return sd ? sd : s;
+}
+
+void StringInternTable::Enable() {
+  s_table->m_enabled = true;
+}
+
+void StringInternTable::Reset() {
+  StringInternTable *table = s_table.get();
+  table->reset();
+  table->m_enabled = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+StringData *StringInternTable::intern(const char *s, int len, int64 hash,
+                                      StringData *sd) {
+  if (m_count * 2 >= (int)m_slots.size() && m_count < MaxEntries) {
+    grow();
+  }
+  StringData **slot = find(s, len, hash);
+  if (*slot) return *slot;
+  if (m_count >= MaxEntries) return NULL;
+
+  if (sd == NULL) {
+    sd = NEW(StringData)(s, len, CopyString);
+  }
+  sd->setInterned();
+  sd->incRefCount();
+  *slot = sd;
+  m_count++;
+  return sd;
+}
+
+StringData **StringInternTable::find(const char *s, int len, int64 hash) {
+  // the table is never more than half full, so there is always an empty slot
+  for (size_t i = hash & m_mask;; i = (i + 1) & m_mask) {
+    StringData *sd = m_slots[i];
+    if (sd == NULL ||
+        (sd->hash() == hash && sd->size() == len &&
+         memcmp(sd->data(), s, len) == 0)) {
+      return &m_slots[i];
+    }
+  }
+}
+
+void StringInternTable::grow() {
+  std::vector<StringData *> old;
+  old.swap(m_slots);
+  m_slots.resize(old.empty() ? 64 : old.size() * 2, NULL);
+  m_mask = m_slots.size() - 1;
+  for (unsigned int i = 0; i < old.size(); i++) {
+    StringData *sd = old[i];
+    if (sd) {
+      *find(sd->data(), sd->size(), sd->hash()) = sd;
+    }
+  }
+}
+
+void StringInternTable::reset() {
+  for (unsigned int i = 0; i < m_slots.size(); i++) {
+    StringData *sd = m_slots[i];
+    if (sd) {
+      // strings that are still referenced are ordinary strings from now on
+      sd->clearInterned();
+      if (sd->decRefCount() == 0) {
+        sd->release();
+      }
+    }
+  }
+  m_slots.clear();
+  m_mask = 0;
+  m_count = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
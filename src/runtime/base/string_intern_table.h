@@ -0,0 +1,84 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_STRING_INTERN_TABLE_H__
+#define __HPHP_STRING_INTERN_TABLE_H__
+
+#include <runtime/base/types.h>
+#include <runtime/base/complex_types.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Request-wide table of short strings used as array keys. A key that keeps
+ * coming back during a request, like a column name in every row of a result
+ * set, is then stored once. Only inserts go through the table: two interned
+ * keys compare by pointer, but looking up a literal or any other key that
+ * isn't interned still compares bytes.
+ *
+ * Interned strings are flagged in StringData (StringData::isInterned()). The
+ * table holds a reference to each of them until the request ends, so none of
+ * them can be modified in place. Nothing is interned outside of a request,
+ * as on the threads loading APC at startup, since nothing would release it.
+ */
+class StringInternTable {
+public:
+  static const int MaxLength  = 64;
+  static const int MaxEntries = 65536;
+
+  /**
+   * Returns the interned copy of these bytes, making it if needed. When
+   * interning is off, when the string is too long or when the table is full,
+   * returns a new copy that is not interned.
+   */
+  static String Intern(const char *s, int len);
+
+  /**
+   * Returns the interned string with the same contents as s. If there isn't
+   * one yet, s itself is interned. Returns s when it can't be interned.
+   */
+  static StringData *Intern(StringData *s);
+
+  /**
+   * Starts interning on this thread. Called at the start of every request.
+   */
+  static void Enable();
+
+  /**
+   * Releases all interned strings and stops interning until the next
+   * Enable(). Called at the end of every request.
+   */
+  static void Reset();
+
+  StringInternTable() : m_mask(0), m_count(0), m_enabled(false) {}
+
+private:
+  std::vector<StringData *> m_slots;
+  size_t m_mask;
+  int m_count;
+  bool m_enabled;
+
+  StringData *intern(const char *s, int len, int64 hash, StringData *sd);
+  StringData **find(const char *s, int len, int64 hash);
+  void grow();
+  void reset();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_STRING_INTERN_TABLE_H__
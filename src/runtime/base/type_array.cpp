@@ -27,6 +27,7 @@
 #include <runtime/base/zend/zend_string.h>
 #include <runtime/base/array/array_util.h>
 #include <runtime/base/runtime_option.h>
+#include <runtime/base/string_intern_table.h>
 #include <runtime/ext/ext_iconv.h>
 #include <unicode/coll.h> // icu
 #include <runtime/base/zend/zend_qsort.h>
@@ -792,14 +793,12 @@ void Array::serialize(VariableSerializer *serializer) const {
 }
 
 void Array::unserialize(VariableUnserializer *unserializer) {
-  std::istream &in = unserializer->in();
-  int64 size;
-  char sep;
-  in >> size >> sep;
+  int64 size = unserializer->readInt();
+  char sep = unserializer->readChar();
   if (sep != ':') {
     throw Exception("Expected ':' but got '%c'", sep);
   }
-  in >> sep;
+  sep = unserializer->readChar();
   if (sep != '{') {
     throw Exception("Expected '{' but got '%c'", sep);
   }
@@ -813,13 +812,14 @@ void Array::unserialize(VariableUnserializer *unserializer) {
     for (int64 i = 0; i < size; i++) {
       Variant key(unserializer->unserializeKey());
       Variant &value =
-        key.isString() ? addLval(key.toString(), true)
+        key.isString() ? addLval(StringInternTable::Intern(key.getStringData()),
+                                 true)
                        : addLval(key);
       value.unserialize(unserializer);
     }
   }
 
-  in >> sep;
+  sep = unserializer->readChar();
   if (sep != '}') {
     throw Exception("Expected '}' but got '%c'", sep);
   }
@@ -20,6 +20,7 @@
 #include <runtime/base/builtin_functions.h>
 #include <runtime/base/comparisons.h>
 #include <runtime/base/variable_serializer.h>
+#include <runtime/base/variable_unserializer.h>
 #include <runtime/base/zend/zend_functions.h>
 #include <runtime/base/zend/zend_string.h>
 #include <runtime/base/zend/zend_printf.h>
@@ -50,14 +51,10 @@ String::String(int n) {
   char *p;
   int is_negative;
   int len;
-  char *buf;
 
   tmpbuf[11] = '\0';
   p = conv_10(n, &is_negative, &tmpbuf[11], &len);
-
-  buf = (char*)malloc(len + 1);
-  memcpy(buf, p, len + 1); // including the null terminator.
-  SmartPtr<StringData>::operator=(NEW(StringData)(buf, len, AttachString));
+  SmartPtr<StringData>::operator=(NEW(StringData)(p, len, CopyString));
 }
 
 String::String(int64 n) {
@@ -65,22 +62,18 @@ String::String(int64 n) {
   char *p;
   int is_negative;
   int len;
-  char *buf;
 
   tmpbuf[20] = '\0';
   p = conv_10(n, &is_negative, &tmpbuf[20], &len);
-
-  buf = (char*)malloc(len + 1);
-  memcpy(buf, p, len + 1); // including the null terminator.
-  m_px = NEW(StringData)(buf, len, AttachString);
+  m_px = NEW(StringData)(p, len, CopyString);
   m_px->incRefCount();
 }
 
 String::String(double n) {
-  char *buf;
+  char buf[32];
   if (n == 0.0) n = 0.0; // so to avoid "-0" output
-  vspprintf(&buf, 0, "%.*G", 14, n);
-  m_px = NEW(StringData)(buf, AttachString);
+  int len = format_double(buf, n, 14, 'G');
+  m_px = NEW(StringData)(buf, len, CopyString);
   m_px->incRefCount();
 }
 
@@ -567,31 +560,31 @@ void String::serialize(VariableSerializer *serializer) const {
   }
 }
 
-void String::unserialize(std::istream &in,
+void String::unserialize(VariableUnserializer *unserializer,
                          char delimiter0 /* = '"' */,
                          char delimiter1 /* = '"' */) {
-  int size;
-  in >> size;
+  int64 size = unserializer->readInt();
   if (size >= SERIALIZE_MAX_SIZE) {
-    throw Exception("Size of serialized string (%d) exceeds max", size);
+    throw Exception("Size of serialized string (%lld) exceeds max", size);
+  }
+  if (size < 0) {
+    throw Exception("Negative size of serialized string (%lld)", size);
   }
 
-  char ch;
-  in >> ch;
+  char ch = unserializer->readChar();
   if (ch != ':') {
     throw Exception("Expected ':' but got '%c'", ch);
   }
-  in >> ch;
+  ch = unserializer->readChar();
   if (ch != delimiter0) {
     throw Exception("Expected '%c' but got '%c'", delimiter0, ch);
   }
 
-  char *buf = (char*)malloc(size + 1);
-  in.read(buf, size);
-  buf[size] = '\0';
-  SmartPtr<StringData>::operator=(NEW(StringData)(buf, size, AttachString));
+  // one copy, from the serialized data into the new string
+  const char *buf = unserializer->read(size);
+  SmartPtr<StringData>::operator=(NEW(StringData)(buf, size, CopyString));
 
-  in >> ch;
+  ch = unserializer->readChar();
   if (ch != delimiter1) {
     throw Exception("Expected '%c' but got '%c'", delimiter1, ch);
   }
@@ -691,7 +684,7 @@ StaticString::StaticString(litstr s, int length)
 }
 
 StaticString::StaticString(std::string s)
-  : m_data(s.c_str(), s.size(), CopyString) {
+  : m_data(s.c_str(), s.size(), CopyMalloc) {
   String::operator=(&m_data);
   m_px->setStatic();
   if (!checkStatic()) {
@@ -2897,9 +2897,8 @@ void Variant::serialize(VariableSerializer *serializer,
 }
 
 void Variant::unserialize(VariableUnserializer *unserializer) {
-  std::istream &in = unserializer->in();
-  char type, sep;
-  in >> type >> sep;
+  char type = unserializer->readChar();
+  char sep = unserializer->readChar();
 
   if (type != 'R') {
     unserializer->add(this);
@@ -2917,8 +2916,7 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
   switch (type) {
   case 'r':
     {
-      int64 id;
-      in >> id;
+      int64 id = unserializer->readInt();
       Variant *v = unserializer->get(id);
       if (v == NULL) {
         throw Exception("Id %ld out of range", id);
@@ -2928,8 +2926,7 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
     break;
   case 'R':
     {
-      int64 id;
-      in >> id;
+      int64 id = unserializer->readInt();
       Variant *v = unserializer->get(id);
       if (v == NULL) {
         throw Exception("Id %ld out of range", id);
@@ -2937,33 +2934,33 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
       operator=(ref(*v));
     }
     break;
-  case 'b': { int64 v;  in >> v; operator=((bool)v); } break;
-  case 'i': { int64 v;  in >> v; operator=(v);       } break;
+  case 'b': { int64 v = unserializer->readInt(); operator=((bool)v); } break;
+  case 'i': { int64 v = unserializer->readInt(); operator=(v);       } break;
   case 'd':
     {
       double v;
-      char ch = in.peek();
+      char ch = unserializer->peek();
       bool negative = false;
       char buf[4];
       if (ch == '-') {
         negative = true;
-        in >> ch;
-        ch = in.peek();
+        unserializer->readChar();
+        ch = unserializer->peek();
       }
       if (ch == 'I') {
-        in.read(buf, 3); buf[3] = '\0';
+        memcpy(buf, unserializer->read(3), 3); buf[3] = '\0';
         if (strcmp(buf, "INF")) {
           throw Exception("Expected 'INF' but got '%s'", buf);
         }
         v = atof("inf");
       } else if (ch == 'N') {
-        in.read(buf, 3); buf[3] = '\0';
+        memcpy(buf, unserializer->read(3), 3); buf[3] = '\0';
         if (strcmp(buf, "NAN")) {
           throw Exception("Expected 'NAN' but got '%s'", buf);
         }
         v = atof("nan");
       } else {
-        in >> v;
+        v = unserializer->readDouble();
       }
       operator=(negative ? -v : v);
     }
@@ -2971,7 +2968,7 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
   case 's':
     {
       String v;
-      v.unserialize(in);
+      v.unserialize(unserializer);
       operator=(v);
     }
     break;
@@ -2981,7 +2978,7 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
         char buf[8];
         StringData *sd;
       } u;
-      in.read(u.buf, 8);
+      memcpy(u.buf, unserializer->read(8), 8);
       operator=(u.sd);
     } else {
       throw Exception("Unknown type '%c'", type);
@@ -3001,7 +2998,7 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
         char buf[8];
         ArrayData *ad;
       } u;
-      in.read(u.buf, 8);
+      memcpy(u.buf, unserializer->read(8), 8);
       operator=(u.ad);
     } else {
       throw Exception("Unknown type '%c'", type);
@@ -3010,9 +3007,9 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
   case 'o':
     {
       String clsName;
-      clsName.unserialize(in);
+      clsName.unserialize(unserializer);
 
-      in >> sep;
+      sep = unserializer->readChar();
       if (sep != ':') {
         throw Exception("Expected ':' but got '%c'", sep);
       }
@@ -3036,9 +3033,9 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
   case 'O':
     {
       String clsName;
-      clsName.unserialize(in);
+      clsName.unserialize(unserializer);
 
-      in >> sep;
+      sep = unserializer->readChar();
       if (sep != ':') {
         throw Exception("Expected ':' but got '%c'", sep);
       }
@@ -3051,13 +3048,12 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
         obj->o_set("__PHP_Incomplete_Class_Name", clsName);
       }
       operator=(obj);
-      int64 size;
-      char sep;
-      in >> size >> sep;
+      int64 size = unserializer->readInt();
+      char sep = unserializer->readChar();
       if (sep != ':') {
         throw Exception("Expected ':' but got '%c'", sep);
       }
-      in >> sep;
+      sep = unserializer->readChar();
       if (sep != '{') {
         throw Exception("Expected '{' but got '%c'", sep);
       }
@@ -3085,7 +3081,7 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
           value.unserialize(unserializer);
         }
       }
-      in >> sep;
+      sep = unserializer->readChar();
       if (sep != '}') {
         throw Exception("Expected '}' but got '%c'", sep);
       }
@@ -3097,14 +3093,14 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
   case 'C':
     {
       String clsName;
-      clsName.unserialize(in);
+      clsName.unserialize(unserializer);
 
-      in >> sep;
+      sep = unserializer->readChar();
       if (sep != ':') {
         throw Exception("Expected ':' but got '%c'", sep);
       }
       String serialized;
-      serialized.unserialize(in, '{', '}');
+      serialized.unserialize(unserializer, '{', '}');
 
       Object obj;
       try {
@@ -3128,7 +3124,7 @@ void Variant::unserialize(VariableUnserializer *unserializer) {
   default:
     throw Exception("Unknown type '%c'", type);
   }
-  in >> sep;
+  sep = unserializer->readChar();
   if (sep != ';') {
     throw Exception("Expected ';' but got '%c'", sep);
   }
@@ -136,6 +136,7 @@ enum StringDataMode {
   AttachLiteral, // const char * points to a literal string
   AttachString,  // const char * points to a malloc-ed string
   CopyString,    // make a real copy of the string
+  CopyMalloc,    // make a malloc-ed copy that may outlive the request
 
   StringDataModeCount
 };
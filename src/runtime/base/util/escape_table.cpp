@@ -0,0 +1,150 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/util/escape_table.h>
+#include <runtime/base/zend/zend_string.h>
+
+#if defined(__SSE2__)
+#include <tmmintrin.h>
+#endif
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+EscapeTable::EscapeTable() {
+  memset(m_replacement, 0, sizeof(m_replacement));
+  memset(m_lowRows, 0, sizeof(m_lowRows));
+  memset(m_highRows, 0, sizeof(m_highRows));
+  for (int c = 0; c < 256; c++) {
+    m_size[c] = 1;
+    m_replacement[c][0] = c;
+  }
+}
+
+void EscapeTable::setSpecial(unsigned char c) {
+  ((c & 0x80) ? m_highRows : m_lowRows)[c & 15] |= 1 << ((c >> 4) & 7);
+}
+
+void EscapeTable::replace(unsigned char c, const char *replacement) {
+  int len = strlen(replacement);
+  ASSERT(len > 0 && len <= MaxReplacement);
+  memcpy(m_replacement[c], replacement, len + 1);
+  m_size[c] = len;
+  setSpecial(c);
+}
+
+void EscapeTable::replaceWithHex(unsigned char c, const char *prefix,
+                                 const char *digits) {
+  char buf[MaxReplacement + 1];
+  int len = strlen(prefix);
+  ASSERT(len + 2 <= MaxReplacement);
+  memcpy(buf, prefix, len);
+  buf[len] = digits[c >> 4];
+  buf[len + 1] = digits[c & 15];
+  buf[len + 2] = '\0';
+  replace(c, buf);
+}
+
+void EscapeTable::reject(unsigned char c) {
+  m_size[c] = 0;
+  setSpecial(c);
+}
+
+#if defined(__SSE2__)
+/**
+ * Index of the first special byte in a block of 16, or 16. Each byte's low
+ * nibble picks its bitmap row and its high nibble picks the bit.
+ */
+__attribute__((target("sse4.2")))
+static int special_in_block(__m128i v, __m128i lowRows, __m128i highRows) {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                     1, 2, 4, 8, 16, 32, 64, -128);
+  __m128i lo = _mm_and_si128(v, nibble);
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+  __m128i low = _mm_cmplt_epi8(hi, _mm_set1_epi8(8));
+  __m128i row = _mm_or_si128(
+    _mm_and_si128(low, _mm_shuffle_epi8(lowRows, lo)),
+    _mm_andnot_si128(low, _mm_shuffle_epi8(highRows, lo)));
+  __m128i bit = _mm_shuffle_epi8(bits, hi);
+  int mask = _mm_movemask_epi8(
+    _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit));
+  return mask ? __builtin_ctz(mask) : 16;
+}
+#endif
+
+const char *EscapeTable::skip(const char *p, const char *end) const {
+#if defined(__SSE2__)
+  if (end - p >= 16 && string_simd_level() >= StringSimdSSE42) {
+    __m128i lowRows = _mm_loadu_si128((const __m128i *)m_lowRows);
+    __m128i highRows = _mm_loadu_si128((const __m128i *)m_highRows);
+    for (; end - p >= 16; p += 16) {
+      int i = special_in_block(_mm_loadu_si128((const __m128i *)p),
+                               lowRows, highRows);
+      if (i < 16) return p + i;
+    }
+  }
+#endif
+  for (; p < end; p++) {
+    if (special(*p)) break;
+  }
+  return p;
+}
+
+int64 EscapeTable::escapedSize(const char *s, int len) const {
+  const char *end = s + len;
+  int64 size = len;
+  for (const char *p = skip(s, end); p < end; p = skip(p + 1, end)) {
+    int n = m_size[(unsigned char)*p];
+    if (n == 0) return -1;
+    size += n - 1;
+  }
+  return size;
+}
+
+char *EscapeTable::escape(const char *s, int len, char *out) const {
+  const char *end = s + len;
+  while (true) {
+    const char *p = skip(s, end);
+    memcpy(out, s, p - s);
+    out += p - s;
+    if (p == end) break;
+    unsigned char c = *p;
+    if (m_size[c] == 0) {
+      *out++ = c;
+    } else {
+      memcpy(out, m_replacement[c], m_size[c]);
+      out += m_size[c];
+    }
+    s = p + 1;
+  }
+  return out;
+}
+
+char *EscapeTable::escape(const char *s, int &len) const {
+  int64 size = escapedSize(s, len);
+  if (size < 0 || size > INT_MAX) return NULL;
+  char *ret = (char *)malloc(size + 1);
+  if (!ret) return NULL;
+  char *end = escape(s, len, ret);
+  ASSERT(end == ret + size);
+  *end = '\0';
+  len = size;
+  return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,102 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_ESCAPE_TABLE_H__
+#define __HPHP_ESCAPE_TABLE_H__
+
+#include <util/base.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Table-driven escaping shared by the HTML, URL, slash and JSON encoders.
+ * Each byte is copied as it is, replaced with a short string, or rejected.
+ *
+ * Encoding takes two passes: the first one adds up the exact size of the
+ * result so it's allocated once, and the second one writes it. Both skip
+ * runs of bytes that are copied as they are 16 bytes at a time when the CPU
+ * can (see string_simd_level()), and such runs are copied with memcpy().
+ */
+class EscapeTable {
+public:
+  static const int MaxReplacement = 7;
+
+  EscapeTable();
+
+  /**
+   * Replaces c with a string of up to MaxReplacement bytes.
+   */
+  void replace(unsigned char c, const char *replacement);
+
+  /**
+   * Replaces c with prefix followed by its two hex digits.
+   */
+  void replaceWithHex(unsigned char c, const char *prefix,
+                      const char *digits);
+
+  /**
+   * Makes escaping fail when c is found, so the caller can take another
+   * route for such strings.
+   */
+  void reject(unsigned char c);
+
+  /**
+   * Size of s once escaped, or -1 if s has a rejected byte.
+   */
+  int64 escapedSize(const char *s, int len) const;
+
+  /**
+   * Writes s escaped to out, which needs room for escapedSize() bytes, and
+   * returns the end of what was written. Rejected bytes are copied as they
+   * are.
+   */
+  char *escape(const char *s, int len, char *out) const;
+
+  /**
+   * Returns s escaped in a malloc-ed, NULL terminated buffer of the exact
+   * size and sets len to its length, or returns NULL if s has a rejected
+   * byte.
+   */
+  char *escape(const char *s, int &len) const;
+
+private:
+  // bytes written for each input byte, 0 when it's rejected
+  unsigned char m_size[256];
+  char m_replacement[256][MaxReplacement + 1];
+
+  // bitmaps of the bytes that aren't copied as they are, indexed by the low
+  // nibble, with one bit for each high nibble; the layout lets the vector
+  // kernel look them up with byte shuffles
+  unsigned char m_lowRows[16];  // bytes 0x00 to 0x7f
+  unsigned char m_highRows[16]; // bytes 0x80 to 0xff
+
+  bool special(unsigned char c) const {
+    return ((c & 0x80) ? m_highRows : m_lowRows)[c & 15] &
+      (1 << ((c >> 4) & 7));
+  }
+  void setSpecial(unsigned char c);
+
+  /**
+   * First byte in [p, end) that isn't copied as it is, or end.
+   */
+  const char *skip(const char *p, const char *end) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_ESCAPE_TABLE_H__
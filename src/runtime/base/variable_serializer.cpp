@@ -136,11 +136,10 @@ void VariableSerializer::write(double v) {
   switch (m_type) {
   case JSON:
     if (!isinf(v) && !isnan(v)) {
-      char *buf;
+      char buf[32];
       if (v == 0.0) v = 0.0; // so to avoid "-0" output
-      vspprintf(&buf, 0, "%.*k", 14, v);
-      m_buf->append(buf);
-      free(buf);
+      int len = format_double(buf, v, 14, 'k');
+      m_buf->append(buf, len);
     } else {
       // PHP issues a warning: double INF/NAN does not conform to the
       // JSON spec, encoded as 0.
@@ -151,22 +150,22 @@ void VariableSerializer::write(double v) {
   case PrintR:
   case DebuggerDump:
     {
-      char *buf;
+      char buf[32];
       if (v == 0.0) v = 0.0; // so to avoid "-0" output
-      vspprintf(&buf, 0, "%.*G", 14, v);
-      m_buf->append(buf);
-      free(buf);
+      int len = format_double(buf, v, 14, 'G');
+      m_buf->append(buf, len);
     }
     break;
   case VarDump:
   case DebugDump:
     {
-      char *buf;
+      char buf[32];
       if (v == 0.0) v = 0.0; // so to avoid "-0" output
-      vspprintf(&buf, 0, "float(%.*G)", 14, v);
+      int len = format_double(buf, v, 14, 'G');
       indent();
-      m_buf->append(buf);
-      free(buf);
+      m_buf->append("float(");
+      m_buf->append(buf, len);
+      m_buf->append(')');
       writeRefCount();
       m_buf->append('\n');
     }
@@ -180,11 +179,10 @@ void VariableSerializer::write(double v) {
       if (v < 0) m_buf->append('-');
       m_buf->append("INF");
     } else {
-      char *buf;
+      char buf[32];
       if (v == 0.0) v = 0.0; // so to avoid "-0" output
-      vspprintf(&buf, 0, "%.*G", 14, v);
-      m_buf->append(buf);
-      free(buf);
+      int len = format_double(buf, v, 14, 'G');
+      m_buf->append(buf, len);
     }
     m_buf->append(';');
     break;
@@ -252,9 +250,7 @@ void VariableSerializer::write(const char *v, int len /* = -1 */,
   case JSON:
     {
       if (len < 0) len = strlen(v);
-      char *escaped = string_json_escape(v, len, m_option);
-      m_buf->append(escaped);
-      free(escaped);
+      string_json_escape(*m_buf, v, len, m_option);
     }
     break;
   default:
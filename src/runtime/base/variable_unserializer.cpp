@@ -0,0 +1,77 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/complex_types.h>
+#include <runtime/base/variable_unserializer.h>
+#include <runtime/base/zend/zend_strtod.h>
+#include <util/exception.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+int64 VariableUnserializer::readInt() {
+  skipSpace();
+  const char *p = m_buf;
+  bool negative = false;
+  if (p < m_end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  if (p == m_end || *p < '0' || *p > '9') {
+    if (p == m_end) throwUnexpectedEnd();
+    throw Exception("Expected an integer but got '%c'", *p);
+  }
+  uint64 n = 0;
+  for (; p < m_end && *p >= '0' && *p <= '9'; p++) {
+    n = n * 10 + (*p - '0');
+  }
+  m_buf = p;
+  return negative ? (int64)(0 - n) : (int64)n;
+}
+
+double VariableUnserializer::readDouble() {
+  skipSpace();
+  const char *p = m_buf;
+  while (p < m_end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' ||
+                       *p == 'E' || *p == '-' || *p == '+')) {
+    p++;
+  }
+
+  // zend_strtod() stops at the first byte that can't be in a number, so it
+  // can read the input directly unless the number runs into the end of it
+  char *end;
+  double v;
+  if (p < m_end) {
+    v = zend_strtod(m_buf, &end);
+    if (end == m_buf) {
+      throw Exception("Expected a double but got '%c'", *m_buf);
+    }
+    m_buf = end;
+  } else {
+    std::string number(m_buf, p - m_buf);
+    v = zend_strtod(number.c_str(), &end);
+    if (end == number.c_str()) throwUnexpectedEnd();
+    m_buf += end - number.c_str();
+  }
+  return v;
+}
+
+void VariableUnserializer::throwUnexpectedEnd() const {
+  throw Exception("Unexpected end of serialized data");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
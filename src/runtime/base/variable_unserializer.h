@@ -22,6 +22,12 @@
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Reads what VariableSerializer wrote straight from the bytes of a string,
+ * without copying them into a stream first. Like the istream operators it
+ * replaces, it skips whitespace before every character and number it reads,
+ * but not before raw bytes.
+ */
 class VariableUnserializer {
 public:
   /**
@@ -33,9 +39,9 @@ public:
   };
 
 public:
-  VariableUnserializer(std::istream &in, Type type,
+  VariableUnserializer(const char *str, size_t len, Type type,
                        bool allowUnknownSerializableClass = false)
-      : m_type(type), m_in(in), m_key(false),
+      : m_type(type), m_buf(str), m_end(str + len), m_key(false),
         m_unknownSerializable(allowUnknownSerializableClass) {}
 
   Type getType() const { return m_type;}
@@ -55,9 +61,35 @@ public:
     return v;
   }
 
-  std::istream &in() const {
-    return m_in;
+  /**
+   * Where reading stopped.
+   */
+  const char *head() const { return m_buf;}
+
+  /**
+   * Next byte, without skipping whitespace or moving on; '\0' at the end.
+   */
+  char peek() const { return m_buf < m_end ? *m_buf : '\0';}
+
+  char readChar() {
+    skipSpace();
+    if (m_buf == m_end) throwUnexpectedEnd();
+    return *m_buf++;
+  }
+
+  int64 readInt();
+  double readDouble();
+
+  /**
+   * Returns the next n bytes as they are, pointing into the input.
+   */
+  const char *read(int64 n) {
+    if (n < 0 || n > m_end - m_buf) throwUnexpectedEnd();
+    const char *ret = m_buf;
+    m_buf += n;
+    return ret;
   }
+
   void add(Variant* v) {
     if (!m_key) {
       m_refs.push_back(v);
@@ -70,10 +102,16 @@ public:
 
  private:
   Type m_type;
-  std::istream &m_in;
+  const char *m_buf;
+  const char *m_end;
   std::vector<Variant*> m_refs;
   bool m_key;
   bool m_unknownSerializable;
+
+  void skipSpace() {
+    while (m_buf < m_end && isspace((unsigned char)*m_buf)) m_buf++;
+  }
+  void throwUnexpectedEnd() const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,356 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include <runtime/base/zend/fast_dtoa.h>
+#include <float.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+// Grisu2
+//
+// Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers", PLDI 2010.
+
+/**
+ * A number f * 2^e, with a 64-bit significand and no implicit bit.
+ */
+struct DiyFp {
+  static const uint64 HiddenBit = 0x0010000000000000ULL;
+  static const uint64 SignificandMask = 0x000FFFFFFFFFFFFFULL;
+
+  DiyFp() : f(0), e(0) {}
+  DiyFp(uint64 f, int e) : f(f), e(e) {}
+  explicit DiyFp(double d) {
+    union {
+      double d;
+      uint64 u;
+    } u;
+    u.d = d;
+    int biased = (int)((u.u >> 52) & 0x7ff);
+    uint64 significand = u.u & SignificandMask;
+    if (biased) {
+      f = significand + HiddenBit;
+      e = biased - 1075;
+    } else {
+      f = significand;
+      e = -1074;
+    }
+  }
+
+  DiyFp operator-(const DiyFp &rhs) const {
+    ASSERT(e == rhs.e && f >= rhs.f);
+    return DiyFp(f - rhs.f, e);
+  }
+
+  // the upper 64 bits of the product, rounded
+  DiyFp operator*(const DiyFp &rhs) const {
+    const uint64 M32 = 0xFFFFFFFFULL;
+    uint64 a = f >> 32, b = f & M32;
+    uint64 c = rhs.f >> 32, d = rhs.f & M32;
+    uint64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64 tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1ULL << 31;
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+  }
+
+  DiyFp normalize() const {
+    int shift = __builtin_clzll(f);
+    return DiyFp(f << shift, e - shift);
+  }
+
+  /**
+   * The boundaries halfway to the neighboring doubles, sharing the
+   * normalized exponent of the upper one.
+   */
+  void normalizedBoundaries(DiyFp *minus, DiyFp *plus) const {
+    DiyFp pl = DiyFp((f << 1) + 1, e - 1).normalize();
+    DiyFp mi = (f == HiddenBit) ? DiyFp((f << 2) - 1, e - 2)
+                                : DiyFp((f << 1) - 1, e - 1);
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *plus = pl;
+    *minus = mi;
+  }
+
+  uint64 f;
+  int e;
+};
+
+// 10^k for k = -348, -340, ..., 340, as normalized DiyFps
+static const uint64 s_cached_powers_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const short s_cached_powers_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+/**
+ * A cached power of 10 that scales a number with binary exponent e into
+ * [2^-60, 2^-32) relative to 2^64, and its decimal exponent.
+ */
+static DiyFp get_cached_power(int e, int *k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347; // dk = ceil(...)
+  int ik = (int)dk;
+  if (dk - ik > 0.0) ik++;
+  unsigned int index = (ik >> 3) + 1;
+  *k = -(-348 + (int)index * 8);
+  return DiyFp(s_cached_powers_f[index], s_cached_powers_e[index]);
+}
+
+static const uint64 s_pow10[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+  10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+  100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static int count_decimal_digits(uint32 n) {
+  int digits = 1;
+  while (digits < 10 && n >= s_pow10[digits]) digits++;
+  return digits;
+}
+
+/**
+ * Moves the last digit down while that gets closer to the real value and
+ * stays inside the rounding interval.
+ */
+static void grisu_round(char *buffer, int len, uint64 delta, uint64 rest,
+                        uint64 ten_kappa, uint64 wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w ||
+          wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static void digit_gen(const DiyFp &w, const DiyFp &mp, uint64 delta,
+                      char *buffer, int *len, int *k) {
+  const DiyFp one(1ULL << -mp.e, mp.e);
+  const DiyFp wp_w = mp - w;
+  uint32 p1 = (uint32)(mp.f >> -one.e);
+  uint64 p2 = mp.f & (one.f - 1);
+  int kappa = count_decimal_digits(p1);
+  *len = 0;
+
+  while (kappa > 0) {
+    uint32 div = (uint32)s_pow10[kappa - 1];
+    uint32 d = p1 / div;
+    p1 %= div;
+    if (d || *len) buffer[(*len)++] = '0' + d;
+    kappa--;
+    uint64 tmp = ((uint64)p1 << -one.e) + p2;
+    if (tmp <= delta) {
+      *k += kappa;
+      grisu_round(buffer, *len, delta, tmp, s_pow10[kappa] << -one.e,
+                  wp_w.f);
+      return;
+    }
+  }
+
+  while (true) {
+    p2 *= 10;
+    delta *= 10;
+    char d = (char)(p2 >> -one.e);
+    if (d || *len) buffer[(*len)++] = '0' + d;
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      int index = -kappa;
+      grisu_round(buffer, *len, delta, p2, one.f,
+                  wp_w.f * (index < 20 ? s_pow10[index] : 0));
+      return;
+    }
+  }
+}
+
+/**
+ * Digits of a positive normal double, which is buffer * 10^k.
+ */
+static void grisu2(double value, char *buffer, int *len, int *k) {
+  const DiyFp v(value);
+  DiyFp w_m, w_p;
+  v.normalizedBoundaries(&w_m, &w_p);
+
+  const DiyFp c_mk = get_cached_power(w_p.e, k);
+  const DiyFp w = v.normalize() * c_mk;
+  DiyFp wp = w_p * c_mk;
+  DiyFp wm = w_m * c_mk;
+  wm.f++;
+  wp.f--;
+  digit_gen(w, wp, wp.f - wm.f, buffer, len, k);
+}
+
+bool fast_dtoa(double d, int ndigit, char *digits, int *decpt, int *sign) {
+  if (ndigit <= 0 || ndigit > FastDtoaMaxDigits) return false;
+
+  *sign = d < 0 || (d == 0 && 1 / d < 0);
+  if (d == 0) {
+    digits[0] = '0';
+    digits[1] = '\0';
+    *decpt = 1;
+    return true;
+  }
+  if (*sign) d = -d;
+  if (!(d >= DBL_MIN && d <= DBL_MAX)) return false; // subnormal, inf, nan
+
+  int len, k;
+  grisu2(d, digits, &len, &k);
+  while (len > 1 && digits[len - 1] == '0') {
+    len--;
+    k++;
+  }
+  if (len > ndigit) return false;
+  digits[len] = '\0';
+  *decpt = len + k;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Clinger's fast path
+
+// every power of 10 up to 10^22 is a double
+static const double s_exact_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+bool fast_strtod(const char *s00, char **se, double *result) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  const uint64 MaxExact = 1ULL << 53;
+  const char *s = s00;
+  while (isspace((unsigned char)*s)) s++;
+
+  bool negative = false;
+  if (*s == '-') {
+    negative = true;
+    s++;
+  } else if (*s == '+') {
+    s++;
+  }
+
+  // up to 19 significant digits fit in w
+  uint64 w = 0;
+  int digits = 0;
+  int exp10 = 0;
+  bool seen = false;
+  for (; *s >= '0' && *s <= '9'; s++) {
+    seen = true;
+    if (w == 0 && *s == '0') continue;
+    if (digits == 19) return false;
+    w = w * 10 + (*s - '0');
+    digits++;
+  }
+  if (*s == '.') {
+    for (s++; *s >= '0' && *s <= '9'; s++) {
+      seen = true;
+      exp10--;
+      if (w == 0 && *s == '0') continue;
+      if (digits == 19) return false;
+      w = w * 10 + (*s - '0');
+      digits++;
+    }
+  }
+  if (!seen) return false;
+
+  // an exponent without digits isn't part of the number
+  if (*s == 'e' || *s == 'E') {
+    const char *p = s + 1;
+    bool negativeExp = false;
+    if (*p == '-') {
+      negativeExp = true;
+      p++;
+    } else if (*p == '+') {
+      p++;
+    }
+    if (*p >= '0' && *p <= '9') {
+      int e = 0;
+      for (; *p >= '0' && *p <= '9'; p++) {
+        if (e < 100000) e = e * 10 + (*p - '0');
+      }
+      exp10 += negativeExp ? -e : e;
+      s = p;
+    }
+  }
+
+  double d;
+  if (w == 0) {
+    d = 0.0;
+  } else {
+    if (w > MaxExact || exp10 < -22 || exp10 > 22 + 15) return false;
+    if (exp10 > 22) {
+      // 123e25 is 123000e22, as long as that's still exact
+      for (; exp10 > 22; exp10--) {
+        w *= 10;
+        if (w > MaxExact) return false;
+      }
+    }
+    d = (double)w;
+    if (exp10 < 0) {
+      d /= s_exact_pow10[-exp10];
+    } else {
+      d *= s_exact_pow10[exp10];
+    }
+  }
+
+  if (se) *se = (char *)s;
+  *result = negative ? -d : d;
+  return true;
+#else
+  return false;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+}
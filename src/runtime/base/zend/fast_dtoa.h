@@ -0,0 +1,62 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __HPHP_FAST_DTOA_H__
+#define __HPHP_FAST_DTOA_H__
+
+#include <runtime/base/types.h>
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Quick paths for zend_dtoa() and zend_strtod(), which work with big
+ * integers and are exact for every input. These only take inputs they are
+ * sure to handle the same way, and return false for the others, so the
+ * caller can fall back to the zend functions.
+ */
+
+/**
+ * Largest ndigit fast_dtoa() can take.
+ */
+const int FastDtoaMaxDigits = 15;
+
+/**
+ * Same digits, decimal point and sign as zend_dtoa(d, 2, ndigit, ...): the
+ * first ndigit digits of d, rounded, without trailing zeros. digits needs
+ * room for 18 bytes and ends up NUL terminated.
+ *
+ * Grisu2 finds short digits that read back as d. When there are at most
+ * ndigit of them, rounding d to ndigit digits gives the same ones, because
+ * they are within a unit in the last place of d, and digits that far apart
+ * are much farther apart than that. That holds for any ndigit up to
+ * FastDtoaMaxDigits and any normal double; it fails for others and for
+ * infinities and NaNs.
+ */
+bool fast_dtoa(double d, int ndigit, char *digits, int *decpt, int *sign);
+
+/**
+ * Same value and end pointer as zend_strtod(s, se), for decimals of up to
+ * 19 significant digits whose value is an exact integer times or divided by
+ * an exact power of 10. Such a product or quotient is correctly rounded by
+ * the FPU.
+ */
+bool fast_strtod(const char *s, char **se, double *result);
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __HPHP_FAST_DTOA_H__
@@ -32,7 +32,7 @@ static const char long_min_digits[] = "9223372036854775808";
 DataType is_numeric_string(const char *str, int length, int64 *lval,
                            double *dval, int allow_errors /* = 1 */) {
   DataType type;
-  const char *ptr;
+  const char *ptr, *first = NULL;
   int base = 10, digits = 0, dp_or_e = 0;
   double local_dval = 0.0;
 
@@ -69,6 +69,7 @@ DataType is_numeric_string(const char *str, int length, int64 *lval,
     while (*ptr == '0') {
       ptr++;
     }
+    first = ptr;
 
     /* Count the number of digits. If a decimal point/exponent is found,
      * it's a double. Otherwise, if there's a dval or no need to check for
@@ -116,7 +117,7 @@ DataType is_numeric_string(const char *str, int length, int64 *lval,
     /* If there's a dval, do the conversion; else continue checking
      * the digits if we need to check for a full match */
     if (dval) {
-      local_dval = strtod(str, (char **)&ptr);
+      local_dval = zend_strtod(str, (char **)&ptr);
     } else if (allow_errors != 1 && dp_or_e != -1) {
       dp_or_e = (*ptr++ == '.') ? 1 : 2;
       goto check_digits;
@@ -139,13 +140,22 @@ DataType is_numeric_string(const char *str, int length, int64 *lval,
       int cmp = strcmp(&ptr[-digits], long_min_digits);
       if (!(cmp < 0 || (cmp == 0 && *str == '-'))) {
         if (dval) {
-          *dval = strtod(str, NULL);
+          *dval = zend_strtod(str, NULL);
         }
         return KindOfDouble;
       }
     }
     if (lval) {
-      *lval = strtol(str, NULL, base);
+      if (base == 10) {
+        // at most 19 digits, and no more than -LONG_MIN, so this can't wrap
+        uint64 n = 0;
+        for (const char *p = first; IS_DIGIT(*p); p++) {
+          n = n * 10 + (*p - '0');
+        }
+        *lval = *str == '-' ? (int64)(0 - n) : (int64)n;
+      } else {
+        *lval = strtol(str, NULL, base);
+      }
     }
     return KindOfInt64;
   }
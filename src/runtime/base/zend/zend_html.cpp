@@ -17,6 +17,7 @@
 
 #include <runtime/base/zend/zend_html.h>
 #include <runtime/base/complex_types.h>
+#include <runtime/base/util/escape_table.h>
 #include <util/lock.h>
 
 namespace HPHP {
@@ -346,6 +347,36 @@ static void init_entity_table() {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * One escape table for each combination of encode_double_quote,
+ * encode_single_quote and nbsp in ISO-8859-1. A UTF-8 nbsp takes two bytes,
+ * so encoding it is left to the loop in string_html_encode().
+ */
+class HtmlEscapeTables {
+public:
+  HtmlEscapeTables() {
+    for (int i = 0; i < 8; i++) {
+      EscapeTable &table = m_tables[i];
+      table.replace('<', "&lt;");
+      table.replace('>', "&gt;");
+      table.replace('&', "&amp;");
+      if (i & 1) table.replace('"', "&quot;");
+      if (i & 2) table.replace('\'', "&#039;");
+      if (i & 4) table.replace(0xa0, "&nbsp;");
+    }
+  }
+
+  const EscapeTable &get(bool encode_double_quote, bool encode_single_quote,
+                         bool nbsp) const {
+    return m_tables[(encode_double_quote ? 1 : 0) |
+                    (encode_single_quote ? 2 : 0) | (nbsp ? 4 : 0)];
+  }
+
+private:
+  EscapeTable m_tables[8];
+};
+static HtmlEscapeTables s_html_escape_tables;
+
 char *string_html_encode(const char *input, int &len, bool encode_double_quote,
                          bool encode_single_quote, bool utf8, bool nbsp) {
   ASSERT(input);
@@ -353,6 +384,13 @@ char *string_html_encode(const char *input, int &len, bool encode_double_quote,
     return NULL;
   }
 
+  if (!(nbsp && utf8)) {
+    // like the loop below, stop at the first NUL
+    len = strlen(input);
+    return s_html_escape_tables.get(encode_double_quote, encode_single_quote,
+                                    nbsp).escape(input, len);
+  }
+
   /**
    * Though seems to be wasting memory a lot, we have to realize most of the
    * time this function is called with small strings, or fragments of HTMLs.
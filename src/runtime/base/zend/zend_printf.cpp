@@ -17,6 +17,7 @@
 
 #include <runtime/base/zend/zend_printf.h>
 #include <runtime/base/zend/zend_strtod.h>
+#include <runtime/base/zend/fast_dtoa.h>
 #include <runtime/base/zend/zend_string.h>
 #include <runtime/base/complex_types.h>
 #include <runtime/base/type_conversions.h>
@@ -217,8 +218,11 @@ static inline char *php_gcvt(double value, int ndigit, char dec_point,
                              char exponent, char *buf) {
   char *digits, *dst, *src;
   int i, decpt, sign;
+  char fast[FastDtoaMaxDigits + 3];
+  bool slow = !fast_dtoa(value, ndigit, fast, &decpt, &sign);
 
-  digits = zend_dtoa(value, 2, ndigit, &decpt, &sign, NULL);
+  // zend_dtoa() is only needed for the digits Grisu2 can't prove correct
+  digits = slow ? zend_dtoa(value, 2, ndigit, &decpt, &sign, NULL) : fast;
   if (decpt == 9999) {
     /*
      * Infinity or NaN, convert to inf or nan with sign.
@@ -226,7 +230,7 @@ static inline char *php_gcvt(double value, int ndigit, char dec_point,
      */
     snprintf(buf, ndigit + 1, "%s%s", (sign && *digits == 'I') ? "-" : "",
              *digits == 'I' ? "INF" : "NAN");
-    zend_freedtoa(digits);
+    if (slow) zend_freedtoa(digits);
     return (buf);
   }
 
@@ -307,7 +311,7 @@ static inline char *php_gcvt(double value, int ndigit, char dec_point,
     }
     *dst = '\0';
   }
-  zend_freedtoa(digits);
+  if (slow) zend_freedtoa(digits);
   return (buf);
 }
 
@@ -1607,6 +1611,31 @@ int vspprintf_ap(char **pbuf, size_t max_len, const char *format, va_list ap)
   return len;
 }
 
+int format_double(char *buf, double value, int precision, char fmt) {
+  ASSERT(fmt == 'g' || fmt == 'k' || fmt == 'G' || fmt == 'H');
+  if (isnan(value)) {
+    strcpy(buf, "NAN");
+    return 3;
+  }
+  if (isinf(value)) {
+    strcpy(buf, value > 0 ? "INF" : "-INF");
+    return value > 0 ? 3 : 4;
+  }
+  if (precision == 0) {
+    precision = 1;
+  }
+  char dec_point = '.';
+  if (fmt != 'H' && fmt != 'k') {
+#ifdef HAVE_LOCALE_H
+    struct lconv *lconv = localeconv();
+#endif
+    dec_point = LCONV_DECIMAL_POINT;
+  }
+  php_gcvt(value, precision, dec_point,
+           (fmt == 'G' || fmt == 'H') ? 'E' : 'e', buf);
+  return strlen(buf);
+}
+
 int spprintf(char **pbuf, size_t max_len, const char *format, ...)
 {
   int cc;
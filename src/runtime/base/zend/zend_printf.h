@@ -32,6 +32,13 @@ int vspprintf(char **pbuf, size_t max_len, const char *format, ...);
 int vspprintf_ap(char **pbuf, size_t max_len, const char *format, va_list ap);
 int spprintf(char **pbuf, size_t max_len, const char *format, ...);
 
+/**
+ * Formats a double the same way as vspprintf() with "%.*G", "%.*H", "%.*g"
+ * or "%.*k" (fmt is the conversion character), without allocating. buf needs
+ * room for precision + 10 bytes. Returns the length written.
+ */
+int format_double(char *buf, double value, int precision, char fmt);
+
 ///////////////////////////////////////////////////////////////////////////////
 }
 
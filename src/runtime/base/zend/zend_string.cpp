@@ -27,10 +27,17 @@
 #include <runtime/base/util/exceptions.h>
 #include <runtime/base/complex_types.h>
 #include <runtime/base/util/string_buffer.h>
+#include <runtime/base/util/escape_table.h>
 #include <runtime/base/runtime_error.h>
 #include <runtime/base/type_conversions.h>
 #include <runtime/base/builtin_functions.h>
 
+#if defined(__SSE2__)
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <nmmintrin.h>
+#endif
+
 #ifdef __APPLE__
 #ifndef isnan
 #define isnan(x)  \
@@ -130,6 +137,178 @@ void string_charmask(const char *sinput, int len, char *mask) {
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// vector kernels
+//
+// The kernels below are used by the search, case mapping, trim and span
+// functions when the CPU has the instructions for them. Each one returns
+// exactly what the byte-at-a-time loop it replaces would, and those loops are
+// still used on other CPUs and for inputs a kernel can't handle.
+
+static StringSimdLevel detect_simd_level() {
+#if defined(__SSE2__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    if (ecx & bit_SSE4_2) return StringSimdSSE42;
+    if (edx & bit_SSE2) return StringSimdSSE2;
+  }
+#endif
+  return StringSimdNone;
+}
+
+static const StringSimdLevel s_simd_supported = detect_simd_level();
+static StringSimdLevel s_simd_level = s_simd_supported;
+
+StringSimdLevel string_simd_level() {
+  return s_simd_level;
+}
+
+StringSimdLevel string_set_simd_level(StringSimdLevel level) {
+  StringSimdLevel old = s_simd_level;
+  s_simd_level = level < s_simd_supported ? level : s_simd_supported;
+  return old;
+}
+
+#if defined(__SSE2__)
+
+/**
+ * First occurrence of needle in [p, end), or NULL. Candidates are the
+ * positions where both the first and the last byte of the needle match,
+ * tested 16 at a time, and only those are compared in full.
+ */
+static const char *simd_memmem(const char *p, const char *end,
+                               const char *needle, int needle_len) {
+  ASSERT(needle_len > 0);
+  if (needle_len == 1) {
+    return (const char *)memchr(p, *needle, end - p);
+  }
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+  for (; end - p >= needle_len + 15; p += 16) {
+    __m128i f = _mm_loadu_si128((const __m128i *)p);
+    __m128i l = _mm_loadu_si128((const __m128i *)(p + needle_len - 1));
+    unsigned int bits = _mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last)));
+    while (bits) {
+      int i = __builtin_ctz(bits);
+      if (memcmp(p + i + 1, needle + 1, needle_len - 2) == 0) {
+        return p + i;
+      }
+      bits &= bits - 1;
+    }
+  }
+  for (end -= needle_len; p <= end; p++) {
+    if (*p == needle[0] && memcmp(p, needle, needle_len) == 0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Whether the current locale maps ASCII letters the usual way, so the case
+ * kernels can work on ASCII bytes without calling tolower() or toupper().
+ * This isn't true in a Turkish locale, for example, where 'I' doesn't lower
+ * to 'i'.
+ */
+static bool simd_ascii_case() {
+  return tolower('I') == 'i' && toupper('i') == 'I';
+}
+
+/**
+ * Copies len bytes from s to dst, flipping the case of the ASCII letters
+ * between lo and hi. Chunks that have bytes above 0x7f go through tolower()
+ * or toupper() the same way the plain loops do, since the locale decides
+ * how those are mapped.
+ */
+static void simd_case_map(char *dst, const char *s, int len,
+                          char lo, char hi, int (*mapper)(int)) {
+  const __m128i below = _mm_set1_epi8(lo - 1);
+  const __m128i above = _mm_set1_epi8(hi + 1);
+  const __m128i flip = _mm_set1_epi8(0x20);
+  int i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    if (_mm_movemask_epi8(v)) {
+      for (int j = i; j < i + 16; j++) {
+        dst[j] = mapper(s[j]);
+      }
+      continue;
+    }
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(v, below),
+                                    _mm_cmplt_epi8(v, above));
+    v = _mm_xor_si128(v, _mm_and_si128(letters, flip));
+    _mm_storeu_si128((__m128i *)(dst + i), v);
+  }
+  for (; i < len; i++) {
+    dst[i] = mapper(s[i]);
+  }
+}
+
+/**
+ * Index of the first byte of s that is in the set (or isn't, when accept is
+ * true), or len if there isn't one. The set is at most 16 bytes. The last
+ * partial chunk is copied out first, so nothing past s + len is read.
+ */
+__attribute__((target("sse4.2")))
+static int simd_span_forward(const char *s, int len,
+                             const char *set, int set_len, bool accept) {
+  ASSERT(set_len > 0 && set_len <= 16);
+  char buf[16];
+  memset(buf, 0, sizeof(buf));
+  memcpy(buf, set, set_len);
+  const __m128i chars = _mm_loadu_si128((const __m128i *)buf);
+  const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+    _SIDD_LEAST_SIGNIFICANT;
+  for (int i = 0; i < len; i += 16) {
+    int n = len - i < 16 ? len - i : 16;
+    __m128i v;
+    if (n == 16) {
+      v = _mm_loadu_si128((const __m128i *)(s + i));
+    } else {
+      memcpy(buf, s + i, n);
+      v = _mm_loadu_si128((const __m128i *)buf);
+    }
+    int found = accept ?
+      _mm_cmpestri(chars, set_len, v, n,
+                   mode | _SIDD_MASKED_NEGATIVE_POLARITY) :
+      _mm_cmpestri(chars, set_len, v, n, mode);
+    if (found < n) return i + found;
+  }
+  return len;
+}
+
+/**
+ * Index of the last byte of s that isn't in the set, or -1 if there isn't
+ * one.
+ */
+__attribute__((target("sse4.2")))
+static int simd_span_backward(const char *s, int len,
+                              const char *set, int set_len) {
+  ASSERT(set_len > 0 && set_len <= 16);
+  char buf[16];
+  memset(buf, 0, sizeof(buf));
+  memcpy(buf, set, set_len);
+  const __m128i chars = _mm_loadu_si128((const __m128i *)buf);
+  const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+    _SIDD_MASKED_NEGATIVE_POLARITY | _SIDD_MOST_SIGNIFICANT;
+  for (int end = len; end > 0; end -= 16) {
+    int n = end < 16 ? end : 16;
+    __m128i v;
+    if (n == 16) {
+      v = _mm_loadu_si128((const __m128i *)(s + end - 16));
+    } else {
+      memcpy(buf, s, n);
+      v = _mm_loadu_si128((const __m128i *)buf);
+    }
+    int found = _mm_cmpestri(chars, set_len, v, n, mode);
+    if (found < n) return end - n + found;
+  }
+  return -1;
+}
+
+#endif // __SSE2__
+
 int string_copy(char *dst, const char *src, int siz) {
   register char *d = dst;
   register const char *s = src;
@@ -350,6 +529,13 @@ int string_natural_cmp(char const *a, size_t a_len,
 char *string_to_lower(const char *s, int len) {
   ASSERT(s);
   char *ret = (char *)malloc(len + 1);
+#if defined(__SSE2__)
+  if (s_simd_level >= StringSimdSSE2 && simd_ascii_case()) {
+    simd_case_map(ret, s, len, 'A', 'Z', tolower);
+    ret[len] = '\0';
+    return ret;
+  }
+#endif
   for (int i = 0; i < len; i++) {
     ret[i] = tolower(s[i]);
   }
@@ -360,6 +546,13 @@ char *string_to_lower(const char *s, int len) {
 char *string_to_upper(const char *s, int len) {
   ASSERT(s);
   char *ret = (char *)malloc(len + 1);
+#if defined(__SSE2__)
+  if (s_simd_level >= StringSimdSSE2 && simd_ascii_case()) {
+    simd_case_map(ret, s, len, 'a', 'z', toupper);
+    ret[len] = '\0';
+    return ret;
+  }
+#endif
   for (int i = 0; i < len; i++) {
     ret[i] = toupper(s[i]);
   }
@@ -398,6 +591,23 @@ char *string_trim(const char *s, int &len,
   char mask[256];
   string_charmask(charlist, charlistlen, mask);
 
+#if defined(__SSE2__)
+  // a short charlist without ranges is the set of bytes to trim as it is
+  if (s_simd_level >= StringSimdSSE42 &&
+      charlistlen > 0 && charlistlen <= 16 &&
+      !string_memnstr(charlist, "..", 2, charlist + charlistlen)) {
+    if (mode & 1) {
+      int trimmed = simd_span_forward(s, len, charlist, charlistlen, true);
+      len -= trimmed;
+      s += trimmed;
+    }
+    if (mode & 2) {
+      len = simd_span_backward(s, len, charlist, charlistlen) + 1;
+    }
+    return string_duplicate(s, len);
+  }
+#endif
+
   int trimmed = 0;
   if (mode & 1) {
     for (int i = 0; i < len; i++) {
@@ -518,6 +728,12 @@ int string_find(const char *input, int len, char ch, int pos,
     if (!string_substr_check(len, pos, l)) {
       return -1;
     }
+#if defined(__SSE2__)
+    if (s_simd_level >= StringSimdSSE2) {
+      const char *p = (const char *)memchr(input + pos, ch, len - pos);
+      return p ? p - input : -1;
+    }
+#endif
     for (int i = pos; i < len; i++) {
       if (input[i] == ch) {
         return i;
@@ -584,6 +800,12 @@ int string_find(const char *input, int len, const char *s, int s_len,
     if (!string_substr_check(len, pos, l)) {
       return -1;
     }
+#if defined(__SSE2__)
+    if (s_simd_level >= StringSimdSSE2) {
+      const char *p = simd_memmem(input + pos, input + len, s, s_len);
+      return p ? p - input : -1;
+    }
+#endif
     int i_max = len - s_len + 1;
     for (int i = pos; i < i_max; i++) {
       if (input[i] == s[0] && memcmp(input+i, s, s_len) == 0) {
@@ -636,6 +858,12 @@ int string_rfind(const char *input, int len, const char *s, int s_len,
 
 const char *string_memnstr(const char *haystack, const char *needle,
                            int needle_len, const char *end) {
+#if defined(__SSE2__)
+  if (s_simd_level >= StringSimdSSE2 && needle_len > 0) {
+    return end - haystack < needle_len ? NULL :
+      simd_memmem(haystack, end, needle, needle_len);
+  }
+#endif
   const char *p = haystack;
   char ne = needle[needle_len-1];
 
@@ -710,24 +938,34 @@ char *string_replace(const char *input, int &len,
     return NULL;
   }
 
+  // lower both strings once, instead of on every string_find()
+  const char *haystack = input;
+  char *lowered = NULL, *lowered_search = NULL;
+  if (!case_sensitive) {
+    haystack = lowered = string_to_lower(input, len);
+    search = lowered_search = string_to_lower(search, len_search);
+  }
+
   std::vector<int> founds;
   founds.reserve(16);
   if (len_search == 1) {
-    for (int pos = string_find(input, len, *search, 0, case_sensitive);
+    for (int pos = string_find(haystack, len, *search, 0, true);
          pos >= 0;
-         pos = string_find(input, len, *search, pos + len_search,
-                           case_sensitive)) {
+         pos = string_find(haystack, len, *search, pos + len_search, true)) {
       founds.push_back(pos);
     }
   } else {
-    for (int pos = string_find(input, len, search, len_search, 0,
-                               case_sensitive);
+    for (int pos = string_find(haystack, len, search, len_search, 0, true);
          pos >= 0;
-         pos = string_find(input, len, search, len_search,
-                           pos + len_search, case_sensitive)) {
+         pos = string_find(haystack, len, search, len_search,
+                           pos + len_search, true)) {
       founds.push_back(pos);
     }
   }
+  if (lowered) {
+    free(lowered);
+    free(lowered_search);
+  }
 
   count = founds.size();
   if (count == 0) {
@@ -767,6 +1005,11 @@ char *string_replace(const char *input, int &len,
 }
 
 int string_span(const char *s1, int s1_len, const char *s2, int s2_len) {
+#if defined(__SSE2__)
+  if (s_simd_level >= StringSimdSSE42 && s2_len > 0 && s2_len <= 16) {
+    return simd_span_forward(s1, s1_len, s2, s2_len, true);
+  }
+#endif
   const char *s1_end = s1 + s1_len;
   const char *s2_end = s2 + s2_len;
   register const char *p = s1, *spanp;
@@ -783,6 +1026,11 @@ int string_span(const char *s1, int s1_len, const char *s2, int s2_len) {
 }
 
 int string_cspan(const char *s1, int s1_len, const char *s2, int s2_len) {
+#if defined(__SSE2__)
+  if (s_simd_level >= StringSimdSSE42 && s2_len > 0 && s2_len <= 16) {
+    return simd_span_forward(s1, s1_len, s2, s2_len, false);
+  }
+#endif
   const char *s1_end = s1 + s1_len;
   const char *s2_end = s2 + s2_len;
   register const char *p, *spanp;
@@ -1454,39 +1702,23 @@ char *string_stripcslashes(const char *input, int &nlen) {
   return str;
 }
 
+class SlashEscapeTable : public EscapeTable {
+public:
+  SlashEscapeTable() {
+    replace('\0', "\\0");
+    replace('\'', "\\'");
+    replace('"', "\\\"");
+    replace('\\', "\\\\");
+  }
+};
+static SlashEscapeTable s_slash_escape_table;
+
 char *string_addslashes(const char *str, int &length) {
   ASSERT(str);
   if (length == 0) {
     return NULL;
   }
-
-  char *new_str = (char *)malloc((length << 1) + 1);
-  const char *source = str;
-  const char *end = source + length;
-  char *target = new_str;
-
-  while (source < end) {
-    switch (*source) {
-    case '\0':
-      *target++ = '\\';
-      *target++ = '0';
-      break;
-    case '\'':
-    case '\"':
-    case '\\':
-      *target++ = '\\';
-      /* break is missing *intentionally* */
-    default:
-      *target++ = *source;
-      break;
-    }
-
-    source++;
-  }
-
-  *target = 0;
-  length = target - new_str;
-  return new_str;
+  return s_slash_escape_table.escape(str, length);
 }
 
 char *string_stripslashes(const char *input, int &l) {
@@ -2228,54 +2460,94 @@ char *string_cplus_escape(const char *s, int len)
 
 #define REVERSE16(us) (((us & 0xf) << 12) | (((us >> 4) & 0xf) << 8) | (((us >> 8) & 0xf) << 4) | ((us >> 12) & 0xf))
 
-char *string_json_escape(const char *s, int &len, bool loose) {
-  StringBuffer sb;
+/**
+ * JSON escapes for ASCII strings. Other strings are converted to UTF-16 first
+ * to find their code points, so their first byte above 0x7f is rejected.
+ */
+class JsonEscapeTable : public EscapeTable {
+public:
+  JsonEscapeTable() {
+    for (int c = 0; c < ' '; c++) {
+      replaceWithHex(c, "\\u00", "0123456789abcdef");
+    }
+    replace('"',  "\\\"");
+    replace('\\', "\\\\");
+    replace('/',  "\\/");
+    replace('\b', "\\b");
+    replace('\f', "\\f");
+    replace('\n', "\\n");
+    replace('\r', "\\r");
+    replace('\t', "\\t");
+    for (int c = 0x80; c < 0x100; c++) {
+      reject(c);
+    }
+  }
+};
+static JsonEscapeTable s_json_escape_table;
+
+void string_json_escape(StringBuffer &sb, const char *s, int len,
+                        bool loose) {
   if (len == 0) {
     sb.append("\"\"", 2);
+    return;
+  }
+
+  int64 size = s_json_escape_table.escapedSize(s, len);
+  if (size >= 0) {
+    char *p = sb.reserve(size + 3);
+    *p++ = '"';
+    p = s_json_escape_table.escape(s, len, p);
+    *p = '"';
+    sb.resize(sb.size() + size + 2);
+    return;
+  }
+
+  unsigned short *utf16 =
+    (unsigned short *)malloc(len * sizeof(unsigned short));
+
+  len = utf8_to_utf16(utf16, (char*)s, len, loose ? 1 : 0);
+  if (len < 0) {
+    sb.append("null", 4);
+  } else if (len == 0) {
+    sb.append("\"\"", 2);
   } else {
-    unsigned short *utf16 =
-      (unsigned short *)malloc(len * sizeof(unsigned short));
-
-    len = utf8_to_utf16(utf16, (char*)s, len, loose ? 1 : 0);
-    if (len < 0) {
-      sb.append("null", 4);
-    } else if (len == 0) {
-      sb.append("\"\"", 2);
-    } else {
-      static const char digits[] = "0123456789abcdef";
-
-      sb += '"';
-      for (int pos = 0; pos < len; pos++) {
-        unsigned short us = utf16[pos];
-        switch (us) {
-        case '"':  sb.append("\\\"", 2); break;
-        case '\\': sb.append("\\\\", 2); break;
-        case '/':  sb.append("\\/", 2);  break;
-        case '\b': sb.append("\\b", 2);  break;
-        case '\f': sb.append("\\f", 2);  break;
-        case '\n': sb.append("\\n", 2);  break;
-        case '\r': sb.append("\\r", 2);  break;
-        case '\t': sb.append("\\t", 2);  break;
-        default:
-          if (us >= ' ' && (us & 127) == us) {
-            sb.append((char)us);
-          } else {
-            sb.append("\\u", 2);
-            us = REVERSE16(us);
-            sb.append(digits[us & ((1 << 4) - 1)]); us >>= 4;
-            sb.append(digits[us & ((1 << 4) - 1)]); us >>= 4;
-            sb.append(digits[us & ((1 << 4) - 1)]); us >>= 4;
-            sb.append(digits[us & ((1 << 4) - 1)]);
-          }
-          break;
+    static const char digits[] = "0123456789abcdef";
+
+    sb += '"';
+    for (int pos = 0; pos < len; pos++) {
+      unsigned short us = utf16[pos];
+      switch (us) {
+      case '"':  sb.append("\\\"", 2); break;
+      case '\\': sb.append("\\\\", 2); break;
+      case '/':  sb.append("\\/", 2);  break;
+      case '\b': sb.append("\\b", 2);  break;
+      case '\f': sb.append("\\f", 2);  break;
+      case '\n': sb.append("\\n", 2);  break;
+      case '\r': sb.append("\\r", 2);  break;
+      case '\t': sb.append("\\t", 2);  break;
+      default:
+        if (us >= ' ' && (us & 127) == us) {
+          sb.append((char)us);
+        } else {
+          sb.append("\\u", 2);
+          us = REVERSE16(us);
+          sb.append(digits[us & ((1 << 4) - 1)]); us >>= 4;
+          sb.append(digits[us & ((1 << 4) - 1)]); us >>= 4;
+          sb.append(digits[us & ((1 << 4) - 1)]); us >>= 4;
+          sb.append(digits[us & ((1 << 4) - 1)]);
         }
+        break;
       }
-      sb += '"';
     }
-
-    free(utf16);
+    sb += '"';
   }
 
+  free(utf16);
+}
+
+char *string_json_escape(const char *s, int &len, bool loose) {
+  StringBuffer sb;
+  string_json_escape(sb, s, len, loose);
   return sb.detach(len);
 }
 
@@ -23,6 +23,9 @@
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
+
+class StringBuffer;
+
 /**
  * Low-level string functions PHP uses.
  *
@@ -246,6 +249,12 @@ char *string_escape_shell_cmd(const char *str);
 char *string_cplus_escape(const char *s, int len);
 char *string_json_escape(const char *s, int &len, bool loose);
 
+/**
+ * Appends s to sb as a quoted JSON string.
+ */
+void string_json_escape(StringBuffer &sb, const char *s, int len,
+                        bool loose);
+
 /**
  * Convert between strings and numbers.
  */
@@ -322,6 +331,21 @@ bool string_substr_check(int len, int &f, int &l);
  */
 void string_charmask(const char *input, int len, char *mask);
 
+/**
+ * Vector instructions used by string_find(), string_memnstr(), case mapping,
+ * string_trim(), string_span() and string_cspan(). The level is detected
+ * with CPUID at startup. Setting it is meant for tests comparing the vector
+ * kernels with the plain loops; it can't go above what the CPU supports.
+ * Returns the previous level.
+ */
+enum StringSimdLevel {
+  StringSimdNone,
+  StringSimdSSE2,
+  StringSimdSSE42
+};
+StringSimdLevel string_simd_level();
+StringSimdLevel string_set_simd_level(StringSimdLevel level);
+
 ///////////////////////////////////////////////////////////////////////////////
 // mac doesn't have memrchr
 
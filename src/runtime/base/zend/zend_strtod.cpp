@@ -90,6 +90,7 @@
  */
 
 #include <runtime/base/zend/zend_strtod.h>
+#include <runtime/base/zend/fast_dtoa.h>
 #include <runtime/base/util/exceptions.h>
 #include <util/thread_local.h>
 
@@ -1938,6 +1939,11 @@ double zend_strtod (CONST char *s00, char **se)
 
   CONST char decimal_point = '.';
 
+  // most numbers have few enough digits to be converted with one FPU operation
+  if (fast_strtod(s00, se, &result)) {
+    return result;
+  }
+
   sign = nz0 = nz = 0;
   value(rv) = 0.;
 
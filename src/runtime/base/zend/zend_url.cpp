@@ -17,6 +17,7 @@
 
 #include <runtime/base/zend/zend_url.h>
 #include <runtime/base/zend/zend_string.h>
+#include <runtime/base/util/escape_table.h>
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -310,35 +311,31 @@ static int php_htoi(char *s) {
 
 static unsigned char hexchars[] = "0123456789ABCDEF";
 
-char *url_encode(const char *s, int &len) {
-  register unsigned char c;
-  unsigned char *to, *start;
-  unsigned char const *from, *end;
-
-  from = (unsigned char const *)s;
-  end = (unsigned char const *)s + len;
-  start = to = (unsigned char *)malloc(3 * len + 1);
-
-  while (from < end) {
-    c = *from++;
-
-    if (c == ' ') {
-      *to++ = '+';
-    } else if ((c < '0' && c != '-' && c != '.') ||
-           (c < 'A' && c > '9') ||
-           (c > 'Z' && c < 'a' && c != '_') ||
-           (c > 'z')) {
-      to[0] = '%';
-      to[1] = hexchars[c >> 4];
-      to[2] = hexchars[c & 15];
-      to += 3;
-    } else {
-      *to++ = c;
+/**
+ * Escape tables for url_encode() and url_raw_encode(): the only difference
+ * is that url_encode() turns spaces into '+'.
+ */
+class UrlEscapeTable : public EscapeTable {
+public:
+  UrlEscapeTable(bool raw) {
+    for (int c = 0; c < 256; c++) {
+      if ((c < '0' && c != '-' && c != '.') ||
+          (c < 'A' && c > '9') ||
+          (c > 'Z' && c < 'a' && c != '_') ||
+          (c > 'z')) {
+        replaceWithHex(c, "%", (const char *)hexchars);
+      }
+    }
+    if (!raw) {
+      replace(' ', "+");
     }
   }
-  *to = 0;
-  len = to - start;
-  return (char *) start;
+};
+static UrlEscapeTable s_url_escape_table(false);
+static UrlEscapeTable s_url_raw_escape_table(true);
+
+char *url_encode(const char *s, int &len) {
+  return s_url_escape_table.escape(s, len);
 }
 
 char *url_decode(const char *s, int &len) {
@@ -420,24 +417,7 @@ int url_decode_ex(char *value, int len) {
 }
 
 char *url_raw_encode(const char *s, int &len) {
-  register int x, y;
-  unsigned char *str;
-
-  str = (unsigned char *)malloc(3 * len + 1);
-  for (x = 0, y = 0; len--; x++, y++) {
-    str[y] = (unsigned char) s[x];
-    if ((str[y] < '0' && str[y] != '-' && str[y] != '.') ||
-      (str[y] < 'A' && str[y] > '9') ||
-        (str[y] > 'Z' && str[y] < 'a' && str[y] != '_') ||
-      (str[y] > 'z')) {
-      str[y++] = '%';
-      str[y++] = hexchars[(unsigned char) s[x] >> 4];
-      str[y] = hexchars[(unsigned char) s[x] & 15];
-    }
-  }
-  str[y] = '\0';
-  len = y;
-  return ((char *)str);
+  return s_url_raw_escape_table.escape(s, len);
 }
 
 char *url_raw_decode(const char *s, int &len) {
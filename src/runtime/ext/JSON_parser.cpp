@@ -33,6 +33,8 @@ SOFTWARE.
 #include <runtime/base/complex_types.h>
 #include <runtime/base/type_conversions.h>
 #include <runtime/base/builtin_functions.h>
+#include <runtime/base/string_intern_table.h>
+#include <runtime/base/zend/zend_strtod.h>
 #include <system/gen/php/classes/stdclass.h>
 
 #define MAX_LENGTH_OF_LONG 20
@@ -358,11 +360,11 @@ static void json_create_zval(Variant &z, StringBuffer &buf, int type) {
         if (len == MAX_LENGTH_OF_LONG - 1) {
           int cmp = strcmp(p + (neg ? 1 : 0), long_min_digits);
           if (!(cmp < 0 || (cmp == 0 && neg))) {
-            z = strtod(p, NULL);
+            z = zend_strtod(p, NULL);
             return;
           }
         } else {
-          z = strtod(p, NULL);
+          z = zend_strtod(p, NULL);
           return;
         }
       }
@@ -370,7 +372,7 @@ static void json_create_zval(Variant &z, StringBuffer &buf, int type) {
     }
     break;
   case KindOfDouble:
-    z = buf.data() ? strtod(buf.data(), NULL) : 0.0;
+    z = buf.data() ? zend_strtod(buf.data(), NULL) : 0.0;
     break;
   case KindOfString:
     z = buf.detach();
@@ -417,7 +419,8 @@ static void utf16_to_utf8(StringBuffer &buf, unsigned short utf16) {
 
 static void object_set(Variant &var, StringBuffer &key, Variant &value,
                        int assoc) {
-  String data = key.detach();
+  String data = (assoc && key.size() > 0) ?
+    StringInternTable::Intern(key.data(), key.size()) : key.detach();
   if (!assoc) {
     if (data.empty()) {
       var.toObject()->o_set("_empty_", ref(value));
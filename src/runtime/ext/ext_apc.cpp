@@ -32,19 +32,22 @@ namespace HPHP {
 IMPLEMENT_DEFAULT_EXTENSION(apc);
 ///////////////////////////////////////////////////////////////////////////////
 
-bool f_apc_store(CStrRef key, CVarRef var, int64 ttl /* = 0 */,
-                 int64 cache_id /* = 0 */) {
+Variant f_apc_store(CVarRef key, CVarRef var, int64 ttl /* = 0 */,
+                    int64 cache_id /* = 0 */) {
   if (!RuntimeOption::EnableApc) return false;
 
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
     throw_invalid_argument("cache_id: %d", cache_id);
     return false;
   }
-  return s_apc_store[cache_id].store(key, var, ttl);
+  if (key.is(KindOfArray)) {
+    return s_apc_store[cache_id].storeMulti(key.toArray(), ttl);
+  }
+  return s_apc_store[cache_id].store(key.toString(), var, ttl);
 }
 
-bool f_apc_add(CStrRef key, CVarRef var, int64 ttl /* = 0 */,
-               int64 cache_id /* = 0 */) {
+Variant f_apc_add(CVarRef key, CVarRef var, int64 ttl /* = 0 */,
+                  int64 cache_id /* = 0 */) {
   if (!RuntimeOption::EnableApc) return false;
 
   if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
@@ -52,7 +55,10 @@ bool f_apc_add(CStrRef key, CVarRef var, int64 ttl /* = 0 */,
     return false;
   }
   SharedStore &sharedStore = s_apc_store[cache_id];
-  return sharedStore.store(key, var, ttl, false);
+  if (key.is(KindOfArray)) {
+    return sharedStore.storeMulti(key.toArray(), ttl, false);
+  }
+  return sharedStore.store(key.toString(), var, ttl, false);
 }
 
 Variant f_apc_fetch(CVarRef key, Variant success /* = null */,
@@ -67,23 +73,20 @@ Variant f_apc_fetch(CVarRef key, Variant success /* = null */,
   Variant v;
 
   if (key.is(KindOfArray)) {
-    bool tmp = false;
     Array keys = key.toArray();
-    ArrayInit init(keys.size(), false);
+    std::vector<String> strKeys;
+    strKeys.reserve(keys.size());
     for (ArrayIter iter(keys); iter; ++iter) {
       Variant k = iter.second();
       if (!k.isString()) {
         throw_invalid_argument("apc key: (not a string)");
         return false;
       }
-      String strKey = k.toString();
-      if (s_apc_store[cache_id].get(strKey, v)) {
-        tmp = true;
-        init.set(strKey, v, true);
-      }
+      strKeys.push_back(k.toString());
     }
-    success = tmp;
-    return init.create();
+    Array values = s_apc_store[cache_id].getMulti(strKeys);
+    success = !values.empty();
+    return values;
   }
 
   if (s_apc_store[cache_id].get(key.toString(), v)) {
@@ -95,6 +98,45 @@ Variant f_apc_fetch(CVarRef key, Variant success /* = null */,
   return v;
 }
 
+Variant f_apc_fetch_or_compute(CStrRef key, CVarRef compute,
+                               int64 ttl /* = 0 */,
+                               int64 cache_id /* = 0 */) {
+  if (!RuntimeOption::EnableApc) {
+    return f_call_user_func_array(compute, Array::Create());
+  }
+
+  if (cache_id < 0 || cache_id >= MAX_SHARED_STORE) {
+    throw_invalid_argument("cache_id: %d", cache_id);
+    return false;
+  }
+
+  SharedStore &store = s_apc_store[cache_id];
+  Variant v;
+  bool stale = false;
+  bool found = store.getStale(key, v, stale);
+  if (found && !stale) return v;
+
+  if (!store.tryLease(key)) {
+    // someone else is computing it already
+    if (found) return v;
+    if (store.waitForLease(key) && store.get(key, v)) return v;
+    // it failed or is taking too long, so this caller computes it as well
+    v = f_call_user_func_array(compute, Array::Create());
+    store.store(key, v, ttl);
+    return v;
+  }
+
+  try {
+    v = f_call_user_func_array(compute, Array::Create());
+  } catch (...) {
+    store.releaseLease(key);
+    throw;
+  }
+  store.store(key, v, ttl);
+  store.releaseLease(key);
+  return v;
+}
+
 Variant f_apc_delete(CVarRef key, int64 cache_id /* = 0 */) {
   if (!RuntimeOption::EnableApc) return false;
 
@@ -254,6 +296,15 @@ void apc_load(int thread) {
   dlclose(handle);
 }
 
+void apc_load_snapshot(int thread) {
+  if (RuntimeOption::ApcSnapshotFile.empty() || !RuntimeOption::EnableApc ||
+      access(RuntimeOption::ApcSnapshotFile.c_str(), F_OK) != 0) {
+    return;
+  }
+  Timer timer(Timer::WallTime, "loading APC snapshot");
+  s_apc_store[0].loadSnapshot(RuntimeOption::ApcSnapshotFile.c_str(), thread);
+}
+
 //define in ext_fb.cpp
 extern void const_load_set(Variant key, Variant value);
 
@@ -957,9 +1008,15 @@ Variant apc_unserialize(CStrRef str) {
   return unserialize_ex(str, VariableUnserializer::APCSerialize);
 }
 
-void reserialize(istream &in, StringBuffer &buf) {
-  char type, sep;
-  in >> type >> sep;
+/**
+ * Copies one value in APC's serialize() format. With pointers, static strings
+ * are written as pointers to them, as apc_serialize() does. Without, static
+ * strings and arrays that were written as pointers are written out in full.
+ */
+void reserialize(VariableUnserializer *uns, StringBuffer &buf,
+                 bool pointers) {
+  char type = uns->readChar();
+  char sep = uns->readChar();
 
   if (type == 'N') {
     buf.append(type);
@@ -976,30 +1033,46 @@ void reserialize(istream &in, StringBuffer &buf) {
     {
       buf.append(type);
       buf.append(sep);
-      while (in.peek() != ';') {
-        char ch;
-        in >> ch;
-        buf.append(ch);
+      while (uns->peek() != ';') {
+        buf.append(uns->readChar());
       }
     }
     break;
   case 'S':
   case 'A':
+    if (!pointers) {
+      union {
+        char pointer[8];
+        StringData *sd;
+        ArrayData *ad;
+      } u;
+      memcpy(u.pointer, uns->read(8), 8);
+      uns->readChar(); // ';'
+      if (type == 'S') {
+        buf.append("s:");
+        buf.append(u.sd->size());
+        buf.append(":\"");
+        buf.append(u.sd->data(), u.sd->size());
+        buf.append("\";");
+      } else {
+        VariableSerializer vs(VariableSerializer::Serialize);
+        buf.append(vs.serialize(Array(u.ad), true).toString());
+      }
+      return;
+    }
     {
       // shouldn't happen, but keep the code here anyway.
       buf.append(type);
       buf.append(sep);
-      char pointer[8];
-      in.read(pointer, 8);
-      buf.append(pointer, 8);
+      buf.append(uns->read(8), 8);
     }
     break;
   case 's':
     {
       String v;
-      v.unserialize(in);
+      v.unserialize(uns);
       ASSERT(!v.isNull());
-      if (v->isStatic()) {
+      if (pointers && v->isStatic()) {
         union {
           char pointer[8];
           StringData *sd;
@@ -1015,25 +1088,24 @@ void reserialize(istream &in, StringBuffer &buf) {
         buf.append(v.data(), v.size());
         buf.append("\";");
       }
-      in >> sep; // ';'
+      uns->readChar(); // ';'
       return;
     }
     break;
   case 'a':
     {
       buf.append("a:");
-      int64 size;
-      char sep2;
-      in >> size >> sep2;
+      int64 size = uns->readInt();
+      char sep2 = uns->readChar();
       buf.append(size);
       buf.append(sep2);
-      in >> sep2; // '{'
+      sep2 = uns->readChar(); // '{'
       buf.append(sep2);
       for (int64 i = 0; i < size; i++) {
-        reserialize(in, buf); // key
-        reserialize(in, buf); // value
+        reserialize(uns, buf, pointers); // key
+        reserialize(uns, buf, pointers); // value
       }
-      in >> sep2; // '}'
+      sep2 = uns->readChar(); // '}'
       buf.append(sep2);
       return;
     }
@@ -1045,24 +1117,24 @@ void reserialize(istream &in, StringBuffer &buf) {
       buf.append(sep);
 
       String clsName;
-      clsName.unserialize(in);
+      clsName.unserialize(uns);
       buf.append(clsName.size());
       buf.append(":\"");
       buf.append(clsName.data(), clsName.size());
       buf.append("\":");
 
-      int64 size;
-      char sep2;
-      in >> sep2 >> size >> sep2;
+      uns->readChar(); // ':'
+      int64 size = uns->readInt();
+      char sep2 = uns->readChar();
       buf.append(size);
       buf.append(sep2);
-      in >> sep2; // '{'
+      sep2 = uns->readChar(); // '{'
       buf.append(sep2);
       for (int64 i = 0; i < size; i++) {
-        reserialize(in, buf); // property name
-        reserialize(in, buf); // property value
+        reserialize(uns, buf, pointers); // property name
+        reserialize(uns, buf, pointers); // property value
       }
-      in >> sep2; // '}'
+      sep2 = uns->readChar(); // '}'
       buf.append(sep2);
       return;
     }
@@ -1073,15 +1145,15 @@ void reserialize(istream &in, StringBuffer &buf) {
       buf.append(sep);
 
       String clsName;
-      clsName.unserialize(in);
+      clsName.unserialize(uns);
       buf.append(clsName.size());
       buf.append(":\"");
       buf.append(clsName.data(), clsName.size());
       buf.append("\":");
 
-      in >> sep; // ':'
+      uns->readChar(); // ':'
       String serialized;
-      serialized.unserialize(in, '{', '}');
+      serialized.unserialize(uns, '{', '}');
       buf.append(serialized.size());
       buf.append(":{");
       buf.append(serialized.data(), serialized.size());
@@ -1093,16 +1165,28 @@ void reserialize(istream &in, StringBuffer &buf) {
     throw Exception("Unknown type '%c'", type);
   }
 
-  in >> sep; // the last ';'
+  sep = uns->readChar(); // the last ';'
   buf.append(sep);
 }
 
 String apc_reserialize(CStrRef str) {
   if (str.empty()) return str;
 
-  istringstream in(std::string(str.data(), str.size()));
+  VariableUnserializer uns(str.data(), str.size(),
+                           VariableUnserializer::APCSerialize);
   StringBuffer buf;
-  reserialize(in, buf);
+  reserialize(&uns, buf, true);
+
+  return buf.detach();
+}
+
+String apc_unreserialize(CStrRef str) {
+  if (str.empty()) return str;
+
+  VariableUnserializer uns(str.data(), str.size(),
+                           VariableUnserializer::APCSerialize);
+  StringBuffer buf;
+  reserialize(&uns, buf, false);
 
   return buf.detach();
 }
@@ -1121,5 +1205,13 @@ bool apc_dump(const char *filename) {
   return true;
 }
 
+bool apc_dump_snapshot() {
+  if (RuntimeOption::ApcSnapshotFile.empty() || !RuntimeOption::EnableApc) {
+    return false;
+  }
+  Timer timer(Timer::WallTime, "dumping APC snapshot");
+  return s_apc_store[0].dumpSnapshot(RuntimeOption::ApcSnapshotFile.c_str());
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 }
@@ -25,9 +25,10 @@
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
-bool f_apc_add(CStrRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0);
-bool f_apc_store(CStrRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0);
+Variant f_apc_add(CVarRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0);
+Variant f_apc_store(CVarRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0);
 Variant f_apc_fetch(CVarRef key, Variant success = null, int64 cache_id = 0);
+Variant f_apc_fetch_or_compute(CStrRef key, CVarRef compute, int64 ttl = 0, int64 cache_id = 0);
 Variant f_apc_delete(CVarRef key, int64 cache_id = 0);
 bool f_apc_clear_cache(int64 cache_id = 0);
 Variant f_apc_inc(CStrRef key, int64 step = 1, Variant success = null, int64 cache_id = 0);
@@ -80,6 +81,14 @@ inline bool f_apc_bin_loadfile(CStrRef filename, CObjRef context = null,
 
 void apc_load(int thread);
 
+/**
+ * APC.SnapshotFile support: apc_dump_snapshot() writes what the application
+ * cache holds to the snapshot file, and apc_load_snapshot() loads it back,
+ * if there is one, on the given number of threads.
+ */
+bool apc_dump_snapshot();
+void apc_load_snapshot(int thread);
+
 // needed by generated apc archive .cpp files
 void apc_load_impl(const char **int_keys, int64 *int_values,
                    const char **char_keys, char *char_values,
@@ -115,6 +124,7 @@ void const_load_impl(const char **int_keys, int64 *int_values,
 String apc_serialize(CVarRef value);
 Variant apc_unserialize(CStrRef str);
 String apc_reserialize(CStrRef str);
+String apc_unreserialize(CStrRef str);
 
 ///////////////////////////////////////////////////////////////////////////////
 // debugging support
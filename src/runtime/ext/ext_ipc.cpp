@@ -224,8 +224,9 @@ bool f_msg_receive(CObjRef queue, int64 desiredmsgtype, Variant msgtype,
 
   msgtype = (int)MSGBUF_MTYPE(buffer);
   if (unserialize) {
-    istringstream in((const char *)MSGBUF_MTEXT(buffer));
-    VariableUnserializer vu(in, VariableUnserializer::Serialize);
+    const char *text = (const char *)MSGBUF_MTEXT(buffer);
+    VariableUnserializer vu(text, strlen(text),
+                            VariableUnserializer::Serialize);
     try {
       message = vu.unserialize();
     } catch (Exception &e) {
@@ -20,6 +20,7 @@
 #include <runtime/ext/ext_network.h>
 #include <runtime/ext/mysql_stats.h>
 #include <runtime/base/runtime_option.h>
+#include <runtime/base/string_intern_table.h>
 #include <runtime/base/server/server_stats.h>
 #include <runtime/base/util/request_local.h>
 #include <runtime/base/util/extended_logger.h>
@@ -1036,7 +1037,8 @@ static Variant php_mysql_fetch_hash(CVarRef result, int result_type) {
       ret.set(i, data);
     }
     if (result_type & MYSQL_ASSOC) {
-      ret.set(String(mysql_field->name, CopyString), data);
+      ret.set(StringInternTable::Intern(mysql_field->name,
+                                        strlen(mysql_field->name)), data);
     }
   }
   return ret;
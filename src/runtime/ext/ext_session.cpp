@@ -808,13 +808,11 @@ public:
       String key(p + 1, namelen, CopyString);
       p += namelen + 1;
       if (has_value) {
-        istringstream in(std::string(p, endptr - p));
-        VariableUnserializer vu(in, VariableUnserializer::Serialize);
+        VariableUnserializer vu(p, endptr - p,
+                                VariableUnserializer::Serialize);
         try {
           g->gv__SESSION.set(key, vu.unserialize());
-          if (in.tellg() > 0 && in.tellg() < endptr - p) {
-            p += in.tellg();
-          }
+          p = vu.head();
         } catch (Exception &e) {
         }
       }
@@ -871,13 +869,11 @@ public:
       String key(p, q - p, CopyString);
       q++;
       if (has_value) {
-        istringstream in(std::string(q, endptr - q));
-        VariableUnserializer vu(in, VariableUnserializer::Serialize);
+        VariableUnserializer vu(q, endptr - q,
+                                VariableUnserializer::Serialize);
         try {
           g->gv__SESSION.set(key, vu.unserialize());
-          if (in.tellg() > 0 && in.tellg() < endptr - q) {
-            q += in.tellg();
-          }
+          q = vu.head();
         } catch (Exception &e) {
         }
       }
@@ -25,12 +25,12 @@
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
-inline bool x_apc_add(CStrRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0) {
+inline Variant x_apc_add(CVarRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0) {
   FUNCTION_INJECTION_BUILTIN(apc_add);
   return f_apc_add(key, var, ttl, cache_id);
 }
 
-inline bool x_apc_store(CStrRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0) {
+inline Variant x_apc_store(CVarRef key, CVarRef var, int64 ttl = 0, int64 cache_id = 0) {
   FUNCTION_INJECTION_BUILTIN(apc_store);
   return f_apc_store(key, var, ttl, cache_id);
 }
@@ -40,6 +40,11 @@ inline Variant x_apc_fetch(CVarRef key, CVarRef success = null, int64 cache_id =
   return f_apc_fetch(key, success, cache_id);
 }
 
+inline Variant x_apc_fetch_or_compute(CStrRef key, CVarRef compute, int64 ttl = 0, int64 cache_id = 0) {
+  FUNCTION_INJECTION_BUILTIN(apc_fetch_or_compute);
+  return f_apc_fetch_or_compute(key, compute, ttl, cache_id);
+}
+
 inline Variant x_apc_delete(CVarRef key, int64 cache_id = 0) {
   FUNCTION_INJECTION_BUILTIN(apc_delete);
   return f_apc_delete(key, cache_id);
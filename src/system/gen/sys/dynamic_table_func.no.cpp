@@ -33826,6 +33826,28 @@ Variant ifa_apc_store(void *extra, int count, INVOKE_FEW_ARGS_IMPL_ARGS) {
   if (count == 3) return (f_apc_store(a0, a1, a2));
   return (f_apc_store(a0, a1, a2, a3));
 }
+Variant i_apc_fetch_or_compute(void *extra, CArrRef params) {
+  FUNCTION_INJECTION(apc_fetch_or_compute);
+  int count __attribute__((__unused__)) = params.size();
+  if (count < 2 || count > 4) return throw_wrong_arguments("apc_fetch_or_compute", count, 2, 4, 1);
+  {
+    ArrayData *ad(params.get());
+    ssize_t pos = ad ? ad->iter_begin() : ArrayData::invalid_index;
+    CVarRef arg0((ad->getValue(pos)));
+    CVarRef arg1((ad->getValue(pos = ad->iter_advance(pos))));
+    if (count <= 2) return (f_apc_fetch_or_compute(arg0, arg1));
+    CVarRef arg2((ad->getValue(pos = ad->iter_advance(pos))));
+    if (count == 3) return (f_apc_fetch_or_compute(arg0, arg1, arg2));
+    CVarRef arg3((ad->getValue(pos = ad->iter_advance(pos))));
+    return (f_apc_fetch_or_compute(arg0, arg1, arg2, arg3));
+  }
+}
+Variant ifa_apc_fetch_or_compute(void *extra, int count, INVOKE_FEW_ARGS_IMPL_ARGS) {
+  if (count < 2 || count > 4) return throw_wrong_arguments("apc_fetch_or_compute", count, 2, 4, 1);
+  if (count <= 2) return (f_apc_fetch_or_compute(a0, a1));
+  if (count == 3) return (f_apc_fetch_or_compute(a0, a1, a2));
+  return (f_apc_fetch_or_compute(a0, a1, a2, a3));
+}
 Variant i_magickresetiterator(void *extra, CArrRef params) {
   FUNCTION_INJECTION(magickresetiterator);
   int count __attribute__((__unused__)) = params.size();
@@ -76606,6 +76628,37 @@ Variant ei_apc_store(Eval::VariableEnvironment &env, const Eval::FunctionCallExp
   else if (count == 3) return (x_apc_store(a0, a1, a2));
   else return (x_apc_store(a0, a1, a2, a3));
 }
+Variant ei_apc_fetch_or_compute(Eval::VariableEnvironment &env, const Eval::FunctionCallExpression *caller) {
+  Variant a0;
+  Variant a1;
+  Variant a2;
+  Variant a3;
+  const std::vector<Eval::ExpressionPtr> &params = caller->params();
+  int count __attribute__((__unused__)) = params.size();
+  if (count < 2 || count > 4) return throw_wrong_arguments("apc_fetch_or_compute", count, 2, 4, 1);
+  std::vector<Eval::ExpressionPtr>::const_iterator it = params.begin();
+  do {
+    if (it == params.end()) break;
+    a0 = (*it)->eval(env);
+    it++;
+    if (it == params.end()) break;
+    a1 = (*it)->eval(env);
+    it++;
+    if (it == params.end()) break;
+    a2 = (*it)->eval(env);
+    it++;
+    if (it == params.end()) break;
+    a3 = (*it)->eval(env);
+    it++;
+  } while(false);
+  for (; it != params.end(); ++it) {
+    (*it)->eval(env);
+  }
+  INTERCEPT_INJECTION_ALWAYS("apc_fetch_or_compute", "apc_fetch_or_compute", ArrayUtil::Slice(Array(ArrayInit(4, true).set(0, a0).set(1, a1).set(2, a2).set(3, a3).create()), 0, count, false), r);
+  if (count <= 2) return (x_apc_fetch_or_compute(a0, a1));
+  else if (count == 3) return (x_apc_fetch_or_compute(a0, a1, a2));
+  else return (x_apc_fetch_or_compute(a0, a1, a2, a3));
+}
 Variant ei_magickresetiterator(Eval::VariableEnvironment &env, const Eval::FunctionCallExpression *caller) {
   Variant a0;
   const std::vector<Eval::ExpressionPtr> &params = caller->params();
@@ -81396,6 +81449,9 @@ Variant Eval::invoke_from_eval_builtin(const char *s, Eval::VariableEnvironment
     case 4560:
       HASH_INVOKE_FROM_EVAL(0x03012F3DDD7AB1D0LL, getservbyport);
       break;
+    case 4561:
+      HASH_INVOKE_FROM_EVAL(0x623D6D8EA3EBB1D1LL, apc_fetch_or_compute);
+      break;
     case 4564:
       HASH_INVOKE_FROM_EVAL(0x219F3257BA3371D4LL, decbin);
       break;
@@ -85920,6 +85976,7 @@ CallInfo ci_posix_isatty((void*)&i_posix_isatty, (void*)&ifa_posix_isatty, 1, 0,
 CallInfo ci_dom_document_relaxng_validate_file((void*)&i_dom_document_relaxng_validate_file, (void*)&ifa_dom_document_relaxng_validate_file, 2, 0, 0x0000000000000000LL);
 CallInfo ci_escapeshellcmd((void*)&i_escapeshellcmd, (void*)&ifa_escapeshellcmd, 1, 0, 0x0000000000000000LL);
 CallInfo ci_apc_store((void*)&i_apc_store, (void*)&ifa_apc_store, 4, 0, 0x0000000000000000LL);
+CallInfo ci_apc_fetch_or_compute((void*)&i_apc_fetch_or_compute, (void*)&ifa_apc_fetch_or_compute, 4, 0, 0x0000000000000000LL);
 CallInfo ci_magickresetiterator((void*)&i_magickresetiterator, (void*)&ifa_magickresetiterator, 1, 0, 0x0000000000000000LL);
 CallInfo ci_libxml_disable_entity_loader((void*)&i_libxml_disable_entity_loader, (void*)&ifa_libxml_disable_entity_loader, 1, 0, 0x0000000000000000LL);
 CallInfo ci_magickmotionblurimage((void*)&i_magickmotionblurimage, (void*)&ifa_magickmotionblurimage, 4, 0, 0x0000000000000000LL);
@@ -92762,6 +92819,12 @@ bool get_call_info_builtin(const CallInfo *&ci, void *&extra, const char *s, int
         return true;
       }
       break;
+    case 4561:
+      HASH_GUARD(0x623D6D8EA3EBB1D1LL, apc_fetch_or_compute) {
+        ci = &ci_apc_fetch_or_compute;
+        return true;
+      }
+      break;
     case 4564:
       HASH_GUARD(0x219F3257BA3371D4LL, decbin) {
         ci = &ci_decbin;
@@ -19,13 +19,30 @@
 #include <util/logger.h>
 #include <runtime/base/memory/memory_manager.h>
 #include <runtime/base/builtin_functions.h>
+#include <runtime/base/program_functions.h>
 #include <runtime/ext/ext_variable.h>
 #include <runtime/ext/ext_apc.h>
 #include <runtime/ext/ext_mysql.h>
 #include <runtime/ext/ext_curl.h>
 #include <runtime/base/shared/shared_store.h>
+#include <runtime/base/shared/thread_shared_variant.h>
+#include <runtime/base/shared/shared_block_allocator.h>
+#include <runtime/base/shared/epoch_reclaimer.h>
+#include <runtime/base/shared/shared_store_key_stats.h>
 #include <runtime/base/runtime_option.h>
+#include <runtime/base/array/vector_array.h>
+#include <runtime/base/array/hphp_array.h>
+#include <runtime/base/string_intern_table.h>
+#include <runtime/base/zend/zend_string.h>
+#include <runtime/base/zend/zend_html.h>
+#include <runtime/base/zend/zend_url.h>
+#include <runtime/base/zend/zend_printf.h>
+#include <runtime/base/zend/zend_strtod.h>
+#include <runtime/base/zend/zend_functions.h>
+#include <runtime/base/zend/fast_dtoa.h>
 #include <runtime/base/server/ip_block_map.h>
+#include <runtime/base/server/http_protocol.h>
+#include <util/async_func.h>
 #include <test/test_mysql_info.inc>
 
 using namespace std;
@@ -40,14 +57,27 @@ TestCppBase::TestCppBase() {
 bool TestCppBase::RunTests(const std::string &which) {
   bool ret = true;
   RUN_TEST(TestSmartAllocator);
+  RUN_TEST(TestSizeClassAllocator);
   RUN_TEST(TestString);
+  RUN_TEST(TestStringKernels);
+  RUN_TEST(TestDoubleConversions);
   RUN_TEST(TestArray);
+  RUN_TEST(TestVectorArray);
+  RUN_TEST(TestTaggedHphpArray);
+  RUN_TEST(TestStringInternTable);
   RUN_TEST(TestObject);
   RUN_TEST(TestVariant);
 #ifndef DEBUGGING_SMART_ALLOCATOR
   RUN_TEST(TestMemoryManager);
 #endif
+  RUN_TEST(TestApcContention);
+  RUN_TEST(TestApcEviction);
+  RUN_TEST(TestApcSnapshot);
+  RUN_TEST(TestApcPackedArrays);
+  RUN_TEST(TestApcLazyObjects);
+  RUN_TEST(TestApcKeyStats);
   RUN_TEST(TestIpBlockMap);
+  RUN_TEST(TestHttpRange);
   RUN_TEST(TestEqualAsStr);
   return ret;
 }
@@ -126,6 +156,121 @@ bool TestCppBase::TestSmartAllocator() {
   return Count(true);
 }
 
+bool TestCppBase::TestSizeClassAllocator() {
+  // size classes
+  {
+    VERIFY(SizeClassAllocator::SizeClass(1) == 0);
+    VERIFY(SizeClassAllocator::SizeClass(16) == 0);
+    VERIFY(SizeClassAllocator::SizeClass(17) == 1);
+    VERIFY(SizeClassAllocator::SizeClass(128) == 7);
+    VERIFY(SizeClassAllocator::SizeClass(129) == 8);
+    VERIFY(SizeClassAllocator::SizeClass(4096) ==
+           SizeClassAllocator::NumSizeClasses - 1);
+    for (size_t size = 1; size <= SizeClassAllocator::MaxSmallSize; size++) {
+      int index = SizeClassAllocator::SizeClass(size);
+      VERIFY(SizeClassAllocator::ClassSize(index) >= size);
+      VERIFY(index == 0 || SizeClassAllocator::ClassSize(index - 1) < size);
+    }
+  }
+
+  // free lists and rollback
+  {
+    SizeClassAllocator allocator;
+    char *p1 = (char *)allocator.alloc(10);
+    allocator.dealloc(p1, 10);
+    VERIFY(allocator.alloc(16) == p1);
+
+    allocator.checkpoint();
+    char *p2 = (char *)allocator.alloc(100);
+    char *p3 = (char *)allocator.realloc(p2, 100, 110);
+    VERIFY(p3 == p2); // same size class
+    memset(p3, 'x', 110);
+    char *p4 = (char *)allocator.realloc(p3, 110, 10000);
+    VERIFY(p4[109] == 'x');
+    allocator.dealloc(p4, 10000);
+    allocator.dealloc(p1, 10);
+    allocator.rollback();
+
+    VERIFY(allocator.alloc(100) == p2);
+  }
+
+  // without a checkpoint, sweep() lets everything go
+  {
+    MemoryUsageStats stats;
+    memset(&stats, 0, sizeof(stats));
+    SizeClassAllocator allocator;
+    allocator.registerStats(&stats);
+    for (int i = 0; i < 1000; i++) {
+      allocator.alloc(1000);
+    }
+    VERIFY(stats.alloc > 0);
+    allocator.sweep();
+    VERIFY(stats.alloc == 0);
+    char *p = (char *)allocator.alloc(100);
+    memset(p, 'x', 100);
+    allocator.sweep();
+  }
+
+  // nor does it go back further than the baseline
+  {
+    SizeClassAllocator allocator;
+    char *kept = (char *)allocator.alloc(100);
+    memset(kept, 'k', 100);
+    allocator.baseline();
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < 1000; j++) {
+        memset(allocator.alloc(100), 'x', 100);
+      }
+      allocator.sweep();
+    }
+    VERIFY(kept[0] == 'k' && kept[99] == 'k');
+  }
+
+  // two requests without a checkpoint leave static arrays alone
+  {
+    Array arr(NEW(HphpArray)());
+    for (int i = 0; i < 20; i++) {
+      arr.set(i, i * 2);
+    }
+    arr.setStatic();
+    MemoryManager::TheMemoryManager()->baseline();
+    for (int i = 0; i < 2; i++) {
+      hphp_session_init();
+      for (size_t size = 1; size <= SizeClassAllocator::MaxSmallSize;
+           size += 15) {
+        memset(smart_malloc(size), 'x', size);
+      }
+      hphp_session_exit();
+    }
+    for (int i = 0; i < 20; i++) {
+      VS(arr[i], i * 2);
+    }
+  }
+
+  int iMax = 1000000;
+  {
+    Timer t;
+    for (int i = 0; i < iMax; i++) {
+      void *p = smart_malloc((i & 1023) + 1);
+      smart_free(p, (i & 1023) + 1);
+    }
+    if (!Test::s_quiet) {
+      printf("smart_malloc/smart_free: %lld us\n", t.getMicroSeconds());
+    }
+  }
+  {
+    Timer t;
+    for (int i = 0; i < iMax; i++) {
+      void *p = malloc((i & 1023) + 1);
+      free(p);
+    }
+    if (!Test::s_quiet) {
+      printf("malloc/free: %lld us\n", t.getMicroSeconds());
+    }
+  }
+  return Count(true);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // data types
 
@@ -166,6 +311,36 @@ bool TestCppBase::TestString() {
     VERIFY(!String("23.3").isInteger());
   }
 
+  // short strings are stored inline
+  {
+    String s(12345);
+    VERIFY(s->isSmall());
+    VERIFY(s.data() >= (const char *)s.get() &&
+           s.data() < (const char *)s.get() + sizeof(StringData));
+    VERIFY(String(std::string(StringData::MaxSmallSize, 'x'))->isSmall());
+    VERIFY(!String(std::string(StringData::MaxSmallSize + 1, 'x'))->isSmall());
+    VERIFY(!String("literal")->isSmall());
+
+    // appends stay inline until they don't fit
+    String t("ab", CopyString);
+    t += "cd";
+    VS(t, "abcd");
+    VERIFY(t->isSmall());
+    t += t;
+    VS(t, "abcdabcd");
+    t += "0123456789";
+    VS(t, "abcdabcd0123456789");
+    VERIFY(!t->isSmall());
+
+    // mutations happen in place, copies don't share the bytes
+    String u("xyz", CopyString);
+    String v = u;
+    v.lvalAt(0) = "a";
+    VS(u, "xyz");
+    VS(v, "ayz");
+    VERIFY(v->isSmall());
+  }
+
   // operators
   {
     String s;
@@ -215,6 +390,247 @@ bool TestCppBase::TestString() {
     VS((const char *)s, "tez q");
   }
 
+  // appends grow in place
+  {
+    String s;
+    Variant v = String("");
+    std::string expected;
+    int moves = 0;
+    const char *last = NULL;
+    for (int i = 0; i < 20000; i++) {
+      String piece(i);
+      concat_assign(s, piece);
+      concat_assign(v, piece);
+      expected += piece.data();
+      if (s.data() != last) {
+        last = s.data();
+        moves++;
+      }
+    }
+    VS(s, String(expected));
+    VS(v, String(expected));
+    VERIFY(moves < 100);
+
+    // readers see an ordinary string
+    String copy = s;
+    concat_assign(s, "x");
+    VERIFY(copy.size() == (int)expected.size());
+    VERIFY(s.size() == (int)expected.size() + 1);
+  }
+
+  return Count(true);
+}
+
+static std::string random_string(int max_len) {
+  // mostly a few letters, blanks and dots, so searches and spans have hits
+  static const char alphabet[] = "abAB \t\nxyZ.";
+  std::string s;
+  for (int n = rand() % (max_len + 1); n > 0; n--) {
+    s += (rand() % 8 == 0) ? (char)(rand() % 256) :
+      alphabet[rand() % (sizeof(alphabet) - 1)];
+  }
+  return s;
+}
+
+static std::string take_string(char *s, const int &len) {
+  if (!s) return "(null)";
+  std::string ret(s, len);
+  free(s);
+  return ret;
+}
+
+bool TestCppBase::TestStringKernels() {
+  StringSimdLevel saved = string_simd_level();
+  if (saved == StringSimdNone && !Test::s_quiet) {
+    printf("no vector string kernels on this CPU\n");
+  }
+
+  // the vector kernels, including the ones escaping strings, return exactly
+  // what the plain loops do
+  srand(0);
+  for (int i = 0; i < 20000; i++) {
+    std::string input = random_string(80);
+    std::string search = random_string(4);
+    std::string charlist = random_string(18);
+    std::string replacement = random_string(5);
+    int pos = rand() % 100 - 50;
+    int mode = rand() % 3 + 1;
+    bool cs = rand() % 2;
+    const char *s = input.data();
+    int len = input.size();
+
+    std::string results[2];
+    for (int vector = 0; vector < 2; vector++) {
+      string_set_simd_level(vector ? saved : StringSimdNone);
+      std::ostringstream out;
+      char ch = search.empty() ? 'a' : search[0];
+      out << string_find(s, len, ch, pos, cs) << ' '
+          << string_span(s, len, search.c_str(), search.size()) << ' '
+          << string_cspan(s, len, search.c_str(), search.size()) << ' '
+          << take_string(string_to_lower(s, len), len) << ' '
+          << take_string(string_to_upper(s, len), len) << ' ';
+      int trimmed = len;
+      char *t = string_trim(s, trimmed, charlist.data(), charlist.size(),
+                            mode);
+      out << take_string(t, trimmed) << ' ';
+      int escaped = len;
+      out << take_string(string_addslashes(s, escaped), escaped) << ' ';
+      escaped = len;
+      out << take_string(url_encode(s, escaped), escaped) << ' ';
+      escaped = len;
+      out << take_string(string_json_escape(s, escaped, false), escaped)
+          << ' ';
+      escaped = len;
+      out << take_string(string_html_encode(input.c_str(), escaped, cs,
+                                            mode & 1, false, mode & 2),
+                         escaped) << ' ';
+      if (!search.empty()) {
+        const char *found = string_memnstr(s, search.data(), search.size(),
+                                           s + len);
+        int replaced = len;
+        int count = 0;
+        char *r = string_replace(s, replaced, search.data(), search.size(),
+                                 replacement.data(), replacement.size(),
+                                 count, cs);
+        out << string_find(s, len, search.data(), search.size(), pos, cs)
+            << ' ' << (found ? found - s : -1) << ' '
+            << take_string(r, replaced) << ' ' << count;
+      }
+      results[vector] = out.str();
+    }
+    VS(results[1], results[0]);
+  }
+  string_set_simd_level(saved);
+
+  // searching long strings
+  std::string haystack(1 << 20, 'a');
+  haystack.replace(haystack.size() - 3, 3, "abc");
+  int iMax = 200;
+  for (int vector = 0; vector < 2; vector++) {
+    string_set_simd_level(vector ? saved : StringSimdNone);
+    int found = 0;
+    Timer t;
+    for (int i = 0; i < iMax; i++) {
+      found += string_find(haystack.data(), haystack.size(), "abc", 3, 0,
+                           true);
+    }
+    int64 time = t.getMicroSeconds();
+    VERIFY(found == iMax * ((1 << 20) - 3));
+    if (!Test::s_quiet) {
+      printf("%s string_find: %lld us\n", vector ? "vector" : "plain", time);
+    }
+  }
+  string_set_simd_level(saved);
+
+  return Count(true);
+}
+
+static double random_double() {
+  // random bits cover every exponent, the others are what programs print
+  union { uint64 bits; double d; } u;
+  switch (rand() % 4) {
+  case 0:
+    u.bits = ((uint64)rand() << 62) ^ ((uint64)rand() << 31) ^ rand();
+    return u.d;
+  case 1:
+    return (rand() % 2000000 - 1000000) / 100.0;
+  case 2:
+    return rand() / 1e6 * pow(10.0, rand() % 40 - 20);
+  default:
+    return (double)(((int64)rand() << 31) ^ rand());
+  }
+}
+
+bool TestCppBase::TestDoubleConversions() {
+  // fast_dtoa() gives zend_dtoa()'s digits or declines
+  srand(0);
+  int fast = 0, iMax = 200000;
+  for (int i = 0; i < iMax; i++) {
+    double d = random_double();
+    if (isinf(d) || isnan(d)) continue;
+    for (int ndigit = 14; ndigit <= FastDtoaMaxDigits; ndigit++) {
+      char digits[FastDtoaMaxDigits + 3];
+      int decpt, sign;
+      if (!fast_dtoa(d, ndigit, digits, &decpt, &sign)) continue;
+      fast++;
+      int zdecpt, zsign;
+      char *zdigits = zend_dtoa(d, 2, ndigit, &zdecpt, &zsign, NULL);
+      VS(digits, zdigits);
+      VERIFY(decpt == zdecpt);
+      VERIFY(sign == zsign);
+      zend_freedtoa(zdigits);
+    }
+  }
+  VERIFY(fast > iMax / 2);
+
+  // fast_strtod() gives what the bignum code does for the same number; 20
+  // more zeros make the number too long for the fast path
+  for (int i = 0; i < 200000; i++) {
+    std::string mantissa, exponent;
+    if (rand() % 3 == 0) mantissa += (rand() % 2) ? '-' : '+';
+    for (int n = rand() % 20; n > 0; n--) mantissa += '0' + rand() % 10;
+    mantissa += '.';
+    for (int n = rand() % 20; n > 0; n--) mantissa += '0' + rand() % 10;
+    if (rand() % 2) {
+      exponent += (rand() % 2) ? 'e' : 'E';
+      if (rand() % 2) exponent += (rand() % 2) ? '-' : '+';
+      for (int n = rand() % 4; n > 0; n--) exponent += '0' + rand() % 10;
+    }
+    std::string shortForm = mantissa + exponent + "x";
+    std::string longForm = mantissa + std::string(20, '0') + exponent + "x";
+    char *end;
+    double value;
+    if (!fast_strtod(shortForm.c_str(), &end, &value)) continue;
+    char *zend;
+    double zvalue = zend_strtod(longForm.c_str(), &zend);
+    VERIFY(memcmp(&value, &zvalue, sizeof(double)) == 0);
+    VERIFY(end - shortForm.c_str() + 20 == zend - longForm.c_str());
+  }
+
+  // formatting without vspprintf()
+  for (int i = 0; i < 100000; i++) {
+    double d = random_double();
+    char buf[32];
+    for (const char *fmt = "GHgk"; *fmt; fmt++) {
+      char format[] = "%.*G";
+      format[3] = *fmt;
+      char *expected;
+      vspprintf(&expected, 0, format, 14, d);
+      int len = format_double(buf, d, 14, *fmt);
+      VS(std::string(buf, len), expected);
+      free(expected);
+    }
+  }
+
+  // integers don't need strtol()
+  int64 lval;
+  double dval;
+  VERIFY(is_numeric_string("  -0042", 7, &lval, &dval) == KindOfInt64);
+  VERIFY(lval == -42);
+  VERIFY(is_numeric_string("+9223372036854775807", 20, &lval, &dval) ==
+         KindOfInt64);
+  VERIFY(lval == LLONG_MAX);
+  VERIFY(is_numeric_string("-9223372036854775808", 20, &lval, &dval) ==
+         KindOfInt64);
+  VERIFY(lval == LLONG_MIN);
+  VERIFY(is_numeric_string("9223372036854775808", 19, &lval, &dval) ==
+         KindOfDouble);
+  VERIFY(dval == 9223372036854775808.0);
+  VERIFY(is_numeric_string("12e+", 4, &lval, &dval) == KindOfInt64);
+  VERIFY(lval == 12);
+
+  // the usual print-heavy workload
+  double sum = 0;
+  Timer t;
+  for (int i = 0; i < 200000; i++) {
+    String s((i - 100000) / 128.0);
+    sum += s.toDouble();
+  }
+  if (!Test::s_quiet) {
+    printf("String(double) and back: %lld us\n", t.getMicroSeconds());
+  }
+  VERIFY(sum == -781.25);
+
   return Count(true);
 }
 
@@ -627,6 +1043,257 @@ bool TestCppBase::TestArray() {
   return Count(true);
 }
 
+bool TestCppBase::TestVectorArray() {
+  bool saved = RuntimeOption::UseVectorArray;
+  RuntimeOption::UseVectorArray = true;
+
+  // lists stay packed
+  {
+    Array arr = CREATE_VECTOR3("a", "b", "c");
+    VERIFY(dynamic_cast<VectorArray*>(arr.get()));
+    arr.append("d");
+    arr.set(0, "A");
+    arr.set(4, "e");
+    VERIFY(dynamic_cast<VectorArray*>(arr.get()));
+    VERIFY(arr.size() == 5);
+    VS(arr[0], "A"); VS(arr[3], "d"); VS(arr[4], "e");
+    VERIFY(!arr.exists(5)); VERIFY(!arr.exists("k"));
+    int64 i = 0;
+    for (ArrayIter iter(arr); iter; ++iter, ++i) {
+      VS(iter.first(), i);
+      VS(iter.second(), arr[i]);
+    }
+    VS(i, 5);
+    VS(arr, Array(ArrayInit(5, false).set(0, "A").set(1, "b").set(2, "c").
+                  set(3, "d").set(4, "e").create()));
+
+    Array copy = arr;
+    copy.append("f");
+    VERIFY(arr.size() == 5);
+    VERIFY(copy.size() == 6);
+  }
+  {
+    Array arr = Array::Create();
+    for (int i = 0; i < 100; i++) {
+      arr.append(i);
+    }
+    VERIFY(dynamic_cast<VectorArray*>(arr.get()));
+    VS(arr[99], 99);
+    VS(arr.pop(), 99);
+    arr.append("x");
+    VS(arr[99], "x");
+    VS(arr.dequeue(), 0);
+    VS(arr[0], 1);
+    arr.prepend("y");
+    VS(arr[0], "y"); VS(arr[1], 1); VERIFY(arr.size() == 100);
+    VERIFY(dynamic_cast<VectorArray*>(arr.get()));
+  }
+
+  // everything else escalates
+  {
+    Array arr = CREATE_VECTOR2("a", "b");
+    arr.set("k", "v");
+    VERIFY(!dynamic_cast<VectorArray*>(arr.get()));
+    VS(arr, CREATE_MAP3(0, "a", 1, "b", "k", "v"));
+  }
+  {
+    Array arr = CREATE_VECTOR2("a", "b");
+    arr.set(5, "c");
+    VERIFY(!dynamic_cast<VectorArray*>(arr.get()));
+    arr.append("d");
+    VS(arr, CREATE_MAP4(0, "a", 1, "b", 5, "c", 6, "d"));
+  }
+  {
+    Array arr = CREATE_VECTOR3("a", "b", "c");
+    arr.remove(2);
+    arr.append("d");
+    VS(arr, CREATE_MAP3(0, "a", 1, "b", 3, "d"));
+  }
+  {
+    Array arr = CREATE_VECTOR2("a", "b");
+    arr->next();
+    arr += CREATE_MAP2(1, "x", 2, "c");
+    VS(arr, CREATE_VECTOR3("a", "b", "c"));
+    arr += CREATE_MAP1("k", "v");
+    VS(arr, CREATE_MAP4(0, "a", 1, "b", 2, "c", "k", "v"));
+    VS(arr->current(), "b");
+  }
+  {
+    Array arr = Array(ArrayInit(2, true).set("k1", 1).set("k2", 2).create());
+    VS(arr, CREATE_MAP2("k1", 1, "k2", 2));
+  }
+
+  RuntimeOption::UseVectorArray = saved;
+  return Count(true);
+}
+
+bool TestCppBase::TestTaggedHphpArray() {
+  bool saved = RuntimeOption::UseTaggedHphpArray;
+
+  // both hash table layouts behave the same
+  for (int tagged = 0; tagged < 2; tagged++) {
+    RuntimeOption::UseTaggedHphpArray = tagged;
+
+    Array arr(NEW(HphpArray)());
+    for (int i = 0; i < 1000; i++) {
+      arr.set(String("key") + String(i), i);
+      arr.set(i, String("val") + String(i));
+    }
+    VERIFY(arr.size() == 2000);
+    for (int i = 0; i < 1000; i += 2) {
+      arr.remove(String("key") + String(i));
+      arr.remove(i);
+    }
+    VERIFY(arr.size() == 1000);
+    for (int i = 0; i < 1000; i++) {
+      VERIFY(arr.exists(String("key") + String(i)) == (bool)(i & 1));
+      VERIFY(arr.exists(i) == (bool)(i & 1));
+    }
+    VERIFY(!arr.exists("missing"));
+    VERIFY(!arr.exists(1000));
+
+    // reuse the tombstones
+    for (int i = 0; i < 1000; i += 2) {
+      arr.set(String("key") + String(i), -i);
+    }
+    VERIFY(arr.size() == 1500);
+    VS(arr["key0"], 0);
+    VS(arr["key998"], -998);
+    VS(arr["key999"], 999);
+    VS(arr[999], "val999");
+
+    Array copy = arr;
+    copy.set("new", 1);
+    VERIFY(!arr.exists("new"));
+    VERIFY(copy.size() == arr.size() + 1);
+    for (ArrayIter iter(arr); iter; ++iter) {
+      VS(copy[iter.first()], iter.second());
+    }
+
+    // copies of an empty array can be written to
+    Array empty(NEW(HphpArray)());
+    Array emptyCopy = empty;
+    emptyCopy.set("k", 1);
+    VERIFY(empty.size() == 0);
+    VS(emptyCopy["k"], 1);
+  }
+
+  // string key lookups with each layout
+  int iMax = 1000;
+  std::vector<String> keys, hits, misses;
+  for (int i = 0; i < iMax; i++) {
+    keys.push_back(String("key") + String(i));
+    hits.push_back(String("key") + String(i));
+    misses.push_back(String("miss") + String(i));
+  }
+  for (int tagged = 0; tagged < 2; tagged++) {
+    RuntimeOption::UseTaggedHphpArray = tagged;
+    Array arr(NEW(HphpArray)());
+    for (int i = 0; i < iMax; i++) {
+      arr.set(keys[i], i);
+    }
+    int found = 0;
+    Timer t;
+    for (int n = 0; n < 1000; n++) {
+      for (int i = 0; i < iMax; i++) {
+        if (arr.exists(hits[i])) found++;
+        if (arr.exists(misses[i])) found++;
+      }
+    }
+    int64 time = t.getMicroSeconds();
+    VERIFY(found == 1000 * iMax);
+    if (!Test::s_quiet) {
+      printf("%s HphpArray string lookups: %lld us\n",
+             tagged ? "tagged" : "untagged", time);
+    }
+  }
+
+  RuntimeOption::UseTaggedHphpArray = saved;
+  return Count(true);
+}
+
+bool TestCppBase::TestStringInternTable() {
+  bool saved = RuntimeOption::InternArrayKeys;
+
+  // interning off
+  {
+    RuntimeOption::InternArrayKeys = false;
+    String s1 = StringInternTable::Intern("name", 4);
+    String s2 = StringInternTable::Intern("name", 4);
+    VS(s1, "name");
+    VERIFY(s1.get() != s2.get());
+    VERIFY(!s1->isInterned());
+  }
+
+  RuntimeOption::InternArrayKeys = true;
+
+  // outside of a request
+  {
+    String s1 = StringInternTable::Intern("name", 4);
+    String s2 = StringInternTable::Intern("name", 4);
+    VERIFY(s1.get() != s2.get());
+    VERIFY(!s1->isInterned());
+    String s3 = String("na") + String("me");
+    VERIFY(StringInternTable::Intern(s3.get()) == s3.get());
+    VERIFY(!s3->isInterned());
+  }
+
+  StringInternTable::Enable();
+  {
+    String s1 = StringInternTable::Intern("name", 4);
+    String s2 = StringInternTable::Intern("name", 4);
+    String s3 = StringInternTable::Intern("other", 5);
+    VS(s1, "name");
+    VERIFY(s1.get() == s2.get());
+    VERIFY(s1->isInterned());
+    VERIFY(s1->isImmutable());
+    VERIFY(!s1->same(s3.get()));
+    VS(s1->hash(), hash_string("name", 4));
+
+    // an existing string becomes the interned copy
+    String s4 = String("oth") + String("er2");
+    VERIFY(StringInternTable::Intern(s4.get()) == s4.get());
+    VERIFY(s4->isInterned());
+    String s5 = String("oth") + String("er2");
+    VERIFY(StringInternTable::Intern(s5.get()) == s4.get());
+    VERIFY(!s5->isInterned());
+    VERIFY(s4->same(s5.get()));
+
+    // interned strings are copied on write
+    String s6 = s4;
+    s6 += "x";
+    VS(s4, "other2");
+    VS(s6, "other2x");
+
+    // too long
+    String s7(std::string(StringInternTable::MaxLength + 1, 'x'));
+    VERIFY(StringInternTable::Intern(s7.get()) == s7.get());
+    VERIFY(!s7->isInterned());
+
+    // array keys
+    Array arr1(NEW(HphpArray)());
+    Array arr2(NEW(HphpArray)());
+    arr1.set(String("k") + String("ey"), 1);
+    arr2.set(String("k") + String("ey"), 2);
+    ArrayIter iter1(arr1), iter2(arr2);
+    VERIFY(iter1.first().getStringData() == iter2.first().getStringData());
+    VERIFY(iter1.first().getStringData()->isInterned());
+
+    StringInternTable::Reset();
+    VERIFY(!s1->isInterned());
+    VERIFY(!s4->isInterned());
+    VS(s1, "name");
+    VS(arr2["key"], 2);
+    StringInternTable::Enable();
+    String s8 = StringInternTable::Intern("name", 4);
+    VERIFY(s8.get() != s1.get());
+  }
+  StringInternTable::Reset();
+
+  RuntimeOption::InternArrayKeys = saved;
+  return Count(true);
+}
+
 bool TestCppBase::TestObject() {
   {
     String s = "O:1:\"B\":1:{s:3:\"obj\";O:1:\"A\":1:{s:1:\"a\";i:10;}}";
@@ -958,6 +1625,397 @@ bool TestCppBase::TestMemoryManager() {
   return Count(true);
 }
 
+/**
+ * Gives a test an APC store of its own. Every option the APC tests change is
+ * put back when it goes out of scope, on failures too, along with a fresh
+ * store for whatever runs next.
+ */
+class ApcTestStore {
+public:
+  ApcTestStore(RuntimeOption::ApcTableTypes type)
+    : m_tableType(RuntimeOption::ApcTableType),
+      m_useSharedMemory(RuntimeOption::ApcUseSharedMemory),
+      m_memoryLimit(RuntimeOption::ApcMemoryLimit),
+      m_packArrays(RuntimeOption::ApcPackArrays),
+      m_keyStatsSampleRate(RuntimeOption::ApcKeyStatsSampleRate),
+      m_expireOnSets(RuntimeOption::ApcExpireOnSets),
+      m_purgeFrequency(RuntimeOption::ApcPurgeFrequency) {
+    RuntimeOption::ApcTableType = type;
+    RuntimeOption::ApcUseSharedMemory = false;
+  }
+
+  ~ApcTestStore() {
+    RuntimeOption::ApcTableType = m_tableType;
+    RuntimeOption::ApcUseSharedMemory = m_useSharedMemory;
+    RuntimeOption::ApcMemoryLimit = m_memoryLimit;
+    RuntimeOption::ApcPackArrays = m_packArrays;
+    RuntimeOption::ApcKeyStatsSampleRate = m_keyStatsSampleRate;
+    RuntimeOption::ApcExpireOnSets = m_expireOnSets;
+    RuntimeOption::ApcPurgeFrequency = m_purgeFrequency;
+    s_apc_store.reset();
+  }
+
+  /**
+   * A new store, made with the options as they are now.
+   */
+  SharedStore &reset() {
+    s_apc_store.reset();
+    return s_apc_store[0];
+  }
+
+private:
+  RuntimeOption::ApcTableTypes m_tableType;
+  bool m_useSharedMemory;
+  int64 m_memoryLimit;
+  bool m_packArrays;
+  int m_keyStatsSampleRate;
+  bool m_expireOnSets;
+  int m_purgeFrequency;
+};
+
+static const int ApcContentionKeys = 64;
+
+/**
+ * Fetches the same few keys over and over, checking what comes back, the way
+ * every request of a busy server fetches its configuration from APC.
+ */
+class ApcContentionReader {
+public:
+  ApcContentionReader(SharedStore &store, const std::vector<String> &keys)
+    : m_store(store), m_keys(keys), m_iterations(0), m_errors(0) {}
+
+  void fetch() {
+    for (int i = 0; i < m_iterations; i++) {
+      int k = i % ApcContentionKeys;
+      Variant v;
+      if (!m_store.get(m_keys[k], v) || v.toInt64() != k) m_errors++;
+    }
+  }
+
+  SharedStore &m_store;
+  const std::vector<String> &m_keys;
+  int m_iterations;
+  int m_errors;
+};
+
+/**
+ * Stores the keys the readers fetch again, with the same values, while adding
+ * and removing others, so readers run into replaced nodes and a growing table.
+ */
+class ApcContentionWriter {
+public:
+  ApcContentionWriter(SharedStore &store, const std::vector<String> &keys)
+    : m_store(store), m_keys(keys), m_iterations(0) {}
+
+  void update() {
+    for (int i = 0; i < m_iterations; i++) {
+      int k = i % ApcContentionKeys;
+      m_store.store(m_keys[k], k, 0);
+      String churn = String("churn") + String(i % 4096);
+      if (i % 3 == 0) {
+        m_store.erase(churn);
+      } else {
+        m_store.store(churn, i, 0);
+      }
+    }
+  }
+
+  SharedStore &m_store;
+  const std::vector<String> &m_keys;
+  int m_iterations;
+};
+
+bool TestCppBase::TestApcContention() {
+  ApcTestStore apc(RuntimeOption::ApcConcurrentTable);
+  SharedStore &store = apc.reset();
+
+  std::vector<String> keys;
+  for (int i = 0; i < ApcContentionKeys; i++) {
+    keys.push_back(String("config.") + String(i));
+    keys.back()->hash(); // cached now, not by every reader at once
+    store.store(keys.back(), i, 0);
+  }
+
+  const int iterations = 200000;
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    std::vector<ApcContentionReader *> readers;
+    std::vector<AsyncFunc<ApcContentionReader> *> funcs;
+    for (int i = 0; i < threads; i++) {
+      readers.push_back(new ApcContentionReader(store, keys));
+      readers.back()->m_iterations = iterations;
+      funcs.push_back(new AsyncFunc<ApcContentionReader>
+                      (readers.back(), &ApcContentionReader::fetch));
+    }
+    ApcContentionWriter writer(store, keys);
+    writer.m_iterations = iterations / 10;
+    AsyncFunc<ApcContentionWriter> writerFunc(&writer,
+                                              &ApcContentionWriter::update);
+
+    Timer t;
+    writerFunc.start();
+    for (int i = 0; i < threads; i++) funcs[i]->start();
+    for (int i = 0; i < threads; i++) funcs[i]->waitForEnd();
+    int64 time = t.getMicroSeconds();
+    writerFunc.waitForEnd();
+
+    int errors = 0;
+    for (int i = 0; i < threads; i++) {
+      errors += readers[i]->m_errors;
+      delete funcs[i];
+      delete readers[i];
+    }
+    VS(errors, 0);
+    if (!Test::s_quiet) {
+      printf("%d threads: %lld ns per apc fetch\n", threads,
+             time * 1000 / iterations);
+    }
+  }
+
+  for (int i = 0; i < ApcContentionKeys; i++) {
+    Variant v;
+    VERIFY(store.get(keys[i], v));
+    VS(v, i);
+  }
+
+  // expired keys are purged whole, even with a '\0' in them
+  {
+    RuntimeOption::ApcExpireOnSets = true;
+    RuntimeOption::ApcPurgeFrequency = 1;
+    SharedStore &store = apc.reset();
+    String key("a\0b", 3, AttachLiteral);
+    VERIFY(store.store("a", 1, 0));
+    VERIFY(store.store(key, 2, -2));
+    VERIFY(store.store("c", 3, 0));
+    VS(store.size(), 2);
+    Variant v;
+    VERIFY(store.get("a", v));
+    VS(v, 1);
+  }
+  return Count(true);
+}
+
+bool TestCppBase::TestApcEviction() {
+  ApcTestStore apc(RuntimeOption::ApcConcurrentTable);
+  RuntimeOption::ApcMemoryLimit = 1 << 20;
+  SharedStore &store = apc.reset();
+
+  // hot keys keep being fetched while a scan stores far more than fits
+  String padding(string(100, 'x'));
+  for (int i = 0; i < 16; i++) {
+    store.store(String("hot.") + String(i), padding, 0);
+  }
+  const int cold = 20000;
+  for (int i = 0; i < cold; i++) {
+    store.store(String("cold.") + String(i), padding, 0);
+    if (i % 100 == 0) {
+      for (int j = 0; j < 16; j++) {
+        Variant v;
+        store.get(String("hot.") + String(j), v);
+      }
+    }
+  }
+  for (int i = 0; i < 16; i++) {
+    Variant v;
+    VERIFY(store.get(String("hot.") + String(i), v));
+    VS(v, padding);
+  }
+  VERIFY(store.size() < cold / 2);
+
+  int reachable;
+  string stats = store.reportStats(reachable, 0);
+  VERIFY(stats.find("<Evictions>") != string::npos);
+  VERIFY(stats.find("<Evictions>0<") == string::npos);
+  return Count(true);
+}
+
+bool TestCppBase::TestApcSnapshot() {
+  ApcTestStore apc(RuntimeOption::ApcConcurrentTable);
+  const char *file = "/tmp/hphp_apc_snapshot";
+  unlink(file);
+
+  Array arr = CREATE_MAP3("name", "value", 1, 1.5,
+                          "list", CREATE_VECTOR3(true, null, "nested"));
+  {
+    SharedStore &store = apc.reset();
+    VERIFY(!store.loadSnapshot(file, 2));
+    store.store("string", "value", 0);
+    store.store("int", 123, 0);
+    store.store("double", 1.5, 0);
+    store.store("array", arr, 0);
+    store.store("expiring", "value", 3600);
+    store.store("expired", "value", -1);
+    for (int i = 0; i < 1000; i++) {
+      store.store(String("many.") + String(i), i, 0);
+    }
+    VERIFY(store.dumpSnapshot(file));
+  }
+
+  {
+    SharedStore &store = apc.reset();
+    store.store("int", 456, 0);
+    VERIFY(store.loadSnapshot(file, 4));
+    Variant v;
+    VERIFY(store.get("string", v)); VS(v, "value");
+    VERIFY(store.get("int", v));    VS(v, 456);
+    VERIFY(store.get("double", v)); VS(v, 1.5);
+    VERIFY(store.get("array", v));  VS(v, arr);
+    // arrays come back as shared maps, not unserialized on every fetch
+    VERIFY(v.getArrayData()->getSharedVariant() != NULL);
+    VERIFY(store.get("expiring", v));
+    VERIFY(!store.get("expired", v));
+    for (int i = 0; i < 1000; i++) {
+      VERIFY(store.get(String("many.") + String(i), v));
+      VS(v, i);
+    }
+
+    // storing over a mapped value leaves the mapping alone
+    store.store("string", "other", 0);
+    VERIFY(store.get("string", v)); VS(v, "other");
+  }
+
+  unlink(file);
+  return Count(true);
+}
+
+bool TestCppBase::TestApcPackedArrays() {
+  ApcTestStore apc(RuntimeOption::ApcConcurrentTable);
+  RuntimeOption::ApcPackArrays = true;
+  SharedStore &store = apc.reset();
+
+  Array inner = CREATE_MAP2("a", 1, "b", "two");
+  Array arr = CREATE_MAP4("name", "value", 7, 1.5,
+                          "list", CREATE_VECTOR3(true, null, "nested"),
+                          "map", inner);
+  {
+    ThreadSharedVariant *packed = ThreadSharedVariant::Pack(arr);
+    ThreadSharedVariant unpacked(arr, false);
+    SharedVariantStats packedStats, unpackedStats;
+    packed->getStats(&packedStats);
+    unpacked.getStats(&unpackedStats);
+    VERIFY(packedStats.dataTotalSize < unpackedStats.dataTotalSize);
+    packed->decRef();
+  }
+
+  Variant v;
+  store.store("packed", arr, 0);
+  VERIFY(store.get("packed", v));
+  VS(v, arr);
+  VS(v[7], 1.5);
+  VS(v["list"][2], "nested");
+  VS(v["map"]["b"], "two");
+  VERIFY(!v.toArray().exists("missing"));
+  VERIFY(!v.toArray().exists(8));
+
+  // a nested array fetched from APC can be stored under a key of its own
+  store.store("inner", v["map"], 0);
+  store.erase("packed");
+  VERIFY(store.get("inner", v));
+  VS(v, inner);
+
+  // erasing 3 of every 4 leaves chunks mostly free, and the next store
+  // moves what's left out of them
+  int64 heldBefore = SharedBlockAllocator::HeldBytes();
+  String padding(string(1000, 'x'));
+  const int count = 20000;
+  for (int i = 0; i < count; i++) {
+    store.store(String("frag.") + String(i), CREATE_VECTOR2(i, padding), 0);
+  }
+  int64 heldFull = SharedBlockAllocator::HeldBytes();
+  for (int i = 0; i < count; i++) {
+    if (i % 4) store.erase(String("frag.") + String(i));
+  }
+  EpochReclaimer::Reclaim();
+  store.store("trigger", CREATE_VECTOR1(1), 0);
+  EpochReclaimer::Reclaim();
+  VERIFY(SharedBlockAllocator::HeldBytes() - heldBefore <
+         (heldFull - heldBefore) / 2);
+  for (int i = 0; i < count; i += 4) {
+    VERIFY(store.get(String("frag.") + String(i), v));
+    VS(v[0], i);
+    VS(v[1], padding);
+  }
+  return Count(true);
+}
+
+bool TestCppBase::TestApcLazyObjects() {
+  ApcTestStore apc(RuntimeOption::ApcTableType);
+  SharedStore &store = apc.reset();
+
+  Array config = CREATE_MAP2("host", "localhost",
+                             "ports", CREATE_VECTOR2(80, 443));
+  Object obj(NEW(c_stdClass)());
+  obj->o_set("name", "config");
+  obj->o_set("config", config);
+  store.store("object", obj, 0);
+
+  Variant v1, v2;
+  VERIFY(store.get("object", v1));
+  VERIFY(store.get("object", v2));
+  VS(v1.toObject()->o_get("name"), "config");
+  VS(v1.toObject()->o_get("config"), config);
+  VS(v2.toObject()->o_get("config"), config);
+  // the array is still the one in APC, until it's written to
+  VERIFY(v1.toObject()->o_get("config").getArrayData()->getSharedVariant());
+  // and every fetch is an instance of its own
+  VERIFY(!same(v1, v2));
+  v1.toObject()->o_set("name", "changed");
+  VS(v2.toObject()->o_get("name"), "config");
+
+  // an object referring to itself is unserialized as it always was
+  Object self(NEW(c_stdClass)());
+  self->o_set("self", self);
+  store.store("self", self, 0);
+  VERIFY(store.get("self", v1));
+  VERIFY(store.get("self", v2));
+  VERIFY(same(v1.toObject()->o_get("self"), v1));
+  VERIFY(!same(v1, v2));
+  return Count(true);
+}
+
+bool TestCppBase::TestApcKeyStats() {
+  ApcTestStore apc(RuntimeOption::ApcTableType);
+  RuntimeOption::ApcKeyStatsSampleRate = 1;
+  SharedStore &store = apc.reset();
+  SharedStoreKeyStats::Clear();
+
+  store.store("user:12:name", "alice", 0);
+  store.store("user:345:name", "bob", 0);
+  Variant v;
+  VERIFY(store.get("user:12:name", v));
+  VERIFY(store.get("user:345:name", v));
+  VERIFY(!store.get("user:6:name", v));
+
+  // nothing is reported until the thread's buffer is merged
+  VS(SharedStoreKeyStats::Get("user:#:name").fetches, 0);
+  SharedStoreKeyStats::Merge();
+  SharedStoreKeyStats::Counters c = SharedStoreKeyStats::Get("user:#:name");
+  VS(c.fetches, 3);
+  VS(c.hits, 2);
+  VS(c.stores, 2);
+  VS(c.sized, 4);
+  VERIFY(c.bytes > 0);
+  VERIFY(SharedStoreKeyStats::Report(10).find("\"user:#:name\"") !=
+         string::npos);
+
+  // control characters in a key still make valid JSON
+  store.store(String("tab\there\n\0", 10, AttachLiteral), 1, 0);
+  SharedStoreKeyStats::Merge();
+  VERIFY(SharedStoreKeyStats::Report(-1).find
+         ("\"tab\\u0009here\\u000a\\u0000\"") != string::npos);
+
+  // with a rate of 2, every other access is counted twice
+  RuntimeOption::ApcKeyStatsSampleRate = 2;
+  SharedStoreKeyStats::Clear();
+  for (int i = 0; i < 10; i++) {
+    store.get("user:12:name", v);
+  }
+  SharedStoreKeyStats::Merge();
+  VS(SharedStoreKeyStats::Get("user:#:name").fetches, 10);
+
+  SharedStoreKeyStats::Clear();
+  return Count(true);
+}
+
 bool TestCppBase::TestIpBlockMap() {
   unsigned int start, end;
 
@@ -992,6 +2050,41 @@ bool TestCppBase::TestIpBlockMap() {
   return Count(true);
 }
 
+bool TestCppBase::TestHttpRange() {
+  int start = -1, end = -1;
+
+  VS(HttpProtocol::ParseRange("bytes=0-99", 1000, start, end), 1);
+  VS(start, 0); VS(end, 99);
+  VS(HttpProtocol::ParseRange("bytes=500-", 1000, start, end), 1);
+  VS(start, 500); VS(end, 999);
+  VS(HttpProtocol::ParseRange("bytes=-100", 1000, start, end), 1);
+  VS(start, 900); VS(end, 999);
+  VS(HttpProtocol::ParseRange("bytes=-2000", 1000, start, end), 1);
+  VS(start, 0); VS(end, 999);
+  VS(HttpProtocol::ParseRange("bytes=900-2000", 1000, start, end), 1);
+  VS(start, 900); VS(end, 999);
+
+  VS(HttpProtocol::ParseRange("bytes=1000-", 1000, start, end), -1);
+  VS(HttpProtocol::ParseRange("bytes=-0", 1000, start, end), -1);
+  VS(HttpProtocol::ParseRange("bytes=0-", 0, start, end), -1);
+
+  VS(HttpProtocol::ParseRange("bytes=0-1,5-6", 1000, start, end), 0);
+  VS(HttpProtocol::ParseRange("bytes=5-1", 1000, start, end), 0);
+  VS(HttpProtocol::ParseRange("bytes=a-b", 1000, start, end), 0);
+  VS(HttpProtocol::ParseRange("lines=0-1", 1000, start, end), 0);
+
+  string etag = HttpProtocol::MakeETag(1000, 0x4d2);
+  VERIFY(etag == "\"3e8-4d2\"");
+  VERIFY(HttpProtocol::MatchETag(etag, etag));
+  VERIFY(HttpProtocol::MatchETag("W/" + etag, etag));
+  VERIFY(HttpProtocol::MatchETag("\"x\", " + etag, etag));
+  VERIFY(HttpProtocol::MatchETag("*", etag));
+  VERIFY(!HttpProtocol::MatchETag("\"3e8-4d20\"", etag));
+  VERIFY(!HttpProtocol::MatchETag(etag, ""));
+
+  return Count(true);
+}
+
 bool TestCppBase::TestEqualAsStr() {
 
   const int arr_len = 18;
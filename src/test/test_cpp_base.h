@@ -39,8 +39,16 @@ class TestCppBase : public TestBase {
 
   // building blocks
   bool TestSmartAllocator();
+  bool TestSizeClassAllocator();
   bool TestMemoryManager();
+  bool TestApcContention();
+  bool TestApcEviction();
+  bool TestApcSnapshot();
+  bool TestApcPackedArrays();
+  bool TestApcLazyObjects();
+  bool TestApcKeyStats();
   bool TestIpBlockMap();
+  bool TestHttpRange();
 
   /**
    * Date types. This in turn tests StringData, ArrayData, StringOffset,
@@ -55,7 +63,12 @@ class TestCppBase : public TestBase {
    * PHP's results.
    */
   bool TestString();
+  bool TestStringKernels();
+  bool TestDoubleConversions();
   bool TestArray();
+  bool TestVectorArray();
+  bool TestTaggedHphpArray();
+  bool TestStringInternTable();
   bool TestObject();
   bool TestVariant();
   bool TestListAssignment();
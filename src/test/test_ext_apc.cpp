@@ -35,6 +35,7 @@ bool TestExtApc::RunTests(const std::string &which) {
   RUN_TEST(test_apc_add);
   RUN_TEST(test_apc_store);
   RUN_TEST(test_apc_fetch);
+  RUN_TEST(test_apc_fetch_or_compute);
   RUN_TEST(test_apc_delete);
   RUN_TEST(test_apc_compile_file);
   RUN_TEST(test_apc_cache_info);
@@ -59,6 +60,7 @@ bool TestExtApc::RunTests(const std::string &which) {
   RUN_TEST(test_apc_add);
   RUN_TEST(test_apc_store);
   RUN_TEST(test_apc_fetch);
+  RUN_TEST(test_apc_fetch_or_compute);
   RUN_TEST(test_apc_delete);
   RUN_TEST(test_apc_compile_file);
   RUN_TEST(test_apc_cache_info);
@@ -82,6 +84,7 @@ bool TestExtApc::RunTests(const std::string &which) {
   RUN_TEST(test_apc_add);
   RUN_TEST(test_apc_store);
   RUN_TEST(test_apc_fetch);
+  RUN_TEST(test_apc_fetch_or_compute);
   RUN_TEST(test_apc_delete);
   RUN_TEST(test_apc_compile_file);
   RUN_TEST(test_apc_cache_info);
@@ -106,6 +109,7 @@ bool TestExtApc::RunTests(const std::string &which) {
   RUN_TEST(test_apc_add);
   RUN_TEST(test_apc_store);
   RUN_TEST(test_apc_fetch);
+  RUN_TEST(test_apc_fetch_or_compute);
   RUN_TEST(test_apc_delete);
   RUN_TEST(test_apc_compile_file);
   RUN_TEST(test_apc_cache_info);
@@ -187,6 +191,14 @@ bool TestExtApc::test_apc_store() {
   VS(f_apc_fetch("ta"), CREATE_VECTOR1("newelement"));
   VS(f_apc_fetch("complexMap"), complexMap);
 
+  // several at once
+  VS(f_apc_store(CREATE_MAP2("m1", "one", "m2", CREATE_VECTOR1(2)), null),
+     Array::Create());
+  VS(f_apc_add(CREATE_MAP2("m2", "two", "m3", 3), null),
+     CREATE_MAP1("m2", -1));
+  VS(f_apc_fetch(CREATE_VECTOR4("m1", "m2", "m3", "m4")),
+     CREATE_MAP3("m1", "one", "m2", CREATE_VECTOR1(2), "m3", 3));
+
   // Make sure it doesn't change the shared value.
   Array complexMapFetched = f_apc_fetch("complexMap");
   VERIFY(complexMapFetched.exists("a"));
@@ -227,6 +239,38 @@ bool TestExtApc::test_apc_fetch() {
   return Count(true);
 }
 
+bool TestExtApc::test_apc_fetch_or_compute() {
+  int64 pid = getpid();
+  f_apc_delete("computed");
+  VS(f_apc_fetch_or_compute("computed", "getmypid"), pid);
+  VS(f_apc_fetch("computed"), pid);
+
+  f_apc_store("computed", "cached");
+  VS(f_apc_fetch_or_compute("computed", "getmypid"), "cached");
+
+  // while someone else recomputes it, callers get the expired value if the
+  // store keeps it, or wait for the lease to lapse and compute it themselves
+  int savedTimeout = RuntimeOption::ApcLeaseTimeout;
+  RuntimeOption::ApcLeaseTimeout = 100;
+  f_apc_store("computed", "stale", 1);
+  sleep(1);
+  VERIFY(s_apc_store[0].tryLease("computed"));
+  bool keepsStale = !RuntimeOption::ApcUseSharedMemory &&
+    RuntimeOption::ApcTableType == RuntimeOption::ApcConcurrentTable;
+  if (keepsStale) {
+    VS(f_apc_fetch_or_compute("computed", "getmypid"), "stale");
+  } else {
+    VS(f_apc_fetch_or_compute("computed", "getmypid"), pid);
+  }
+  s_apc_store[0].releaseLease("computed");
+  RuntimeOption::ApcLeaseTimeout = savedTimeout;
+
+  f_apc_store("computed", "stale", 1);
+  sleep(1);
+  VS(f_apc_fetch_or_compute("computed", "getmypid"), pid);
+  return Count(true);
+}
+
 bool TestExtApc::test_apc_delete() {
   f_apc_store("ts", "TestString");
   f_apc_store("ta", CREATE_MAP2("a", 1, "b", 2));
@@ -30,6 +30,7 @@ class TestExtApc : public TestCppExt {
   bool test_apc_add();
   bool test_apc_store();
   bool test_apc_fetch();
+  bool test_apc_fetch_or_compute();
   bool test_apc_delete();
   bool test_apc_compile_file();
   bool test_apc_cache_info();
@@ -38,6 +38,10 @@ bool TestExtJson::test_json_encode() {
 
   VS(f_json_encode("a\xE0"), "null");
   VS(f_json_encode("a\xE0", true), "\"a?\"");
+  VS(f_json_encode(String("\"/\\\b\f\n\r\t\x01\x1f\x7f", 11, AttachLiteral)),
+     "\"\\\"\\/\\\\\\b\\f\\n\\r\\t\\u0001\\u001f\x7f\"");
+  VS(f_json_encode("caf\xc3\xa9 <a href=\"/\">"),
+     "\"caf\\u00e9 <a href=\\\"\\/\\\">\"");
 
   VS(f_json_encode(CREATE_MAP2("0", "apple", "1", "banana")),
      "[\"apple\",\"banana\"]");
@@ -348,6 +348,19 @@ bool TestExtVariable::test_unserialize() {
     Variant v2 = f_unserialize("a:3:{s:1:\"a\";s:5:\"apple\";s:1:\"b\";i:2;s:1:\"c\";a:3:{i:0;i:1;i:1;s:1:\"y\";i:2;i:3;}}");
     VS(v1, v2);
   }
+  {
+    Variant v = f_unserialize("a:5:{i:0;d:-1.5E+25;i:1;d:-INF;i:2;i:-42;"
+                              "i:3;b:1;i:4;d:0.1;}");
+    VS(v, CREATE_VECTOR5(-1.5e25, atof("-inf"), -42, true, 0.1));
+    VS(f_unserialize(" i : 7 ;"), 7);
+    VS(f_unserialize("d:12345678901234567890;"), 12345678901234567890.0);
+  }
+  {
+    // running out of input is an error, not a read past the end
+    VS(f_unserialize(String("s:5:\"ab", 7, AttachLiteral)), false);
+    VS(f_unserialize(String("i:12", 3, AttachLiteral)), false);
+    VS(f_unserialize(String("d:1.5;", 4, AttachLiteral)), false);
+  }
   return Count(true);
 }
 
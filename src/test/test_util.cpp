@@ -16,6 +16,14 @@
 
 #include <test/test_util.h>
 #include <util/lfu_table.h>
+#include <util/job_queue.h>
+#include <util/ring_buffer.h>
+#include <util/queue_admission.h>
+#include <util/ready_signal.h>
+#include <util/async_func.h>
+#include <poll.h>
+#include <util/file_cache.h>
+#include <util/compression.h>
 #include <runtime/base/complex_types.h>
 #include <util/logger.h>
 #include <runtime/base/shared/shared_string.h>
@@ -43,6 +51,11 @@ bool TestUtil::RunTests(const std::string &which) {
   //RUN_TEST(TestLFUTable);
   RUN_TEST(TestSharedString);
   RUN_TEST(TestCanonicalize);
+  RUN_TEST(TestWorkStealingQueue);
+  RUN_TEST(TestRingBuffer);
+  RUN_TEST(TestQueueAdmission);
+  RUN_TEST(TestFileCache);
+  RUN_TEST(TestStreamCompressor);
   return ret;
 }
 
@@ -260,3 +273,352 @@ bool TestUtil::TestCanonicalize() {
   VERIFY(Util::canonicalize("./../../") == "../../");
   return Count(true);
 }
+
+class CountingWorker : public JobQueueWorker<int*> {
+public:
+  virtual void doJob(int *job) {
+    atomic_inc(*job);
+  }
+};
+
+bool TestUtil::TestWorkStealingQueue() {
+  {
+    // one worker sees its own jobs in LIFO or FIFO order
+    int j1, j2, j3;
+    int *job;
+    WorkStealingQueue<int*> lifo(1, 0, true);
+    lifo.enqueue(&j1);
+    lifo.enqueue(&j2);
+    lifo.enqueue(&j3);
+    VERIFY(lifo.getQueuedJobs() == 3);
+    VERIFY(lifo.dequeue(0, job) && job == &j3);
+    VERIFY(lifo.dequeue(0, job) && job == &j2);
+    VERIFY(lifo.dequeue(0, job) && job == &j1);
+    VERIFY(lifo.getQueuedJobs() == 0);
+
+    WorkStealingQueue<int*> fifo(1, 0, false);
+    fifo.enqueue(&j1);
+    fifo.enqueue(&j2);
+    fifo.enqueue(&j3, true);
+    VERIFY(fifo.dequeue(0, job) && job == &j3);
+    VERIFY(fifo.dequeue(0, job) && job == &j1);
+    VERIFY(fifo.dequeue(0, job) && job == &j2);
+    fifo.stop();
+    VERIFY(!fifo.dequeue(0, job));
+  }
+  {
+    // jobs queued for a worker that isn't running are stolen by the other
+    int j1, j2;
+    int *job;
+    WorkStealingQueue<int*> queue(2, 0, false, 1);
+    queue.enqueue(&j1);
+    queue.enqueue(&j2);
+    VERIFY(queue.dequeue(1, job));
+    VERIFY(queue.dequeue(1, job));
+    VERIFY(queue.getQueuedJobs() == 0);
+  }
+  {
+    // priority jobs jump the queue without work stealing, too
+    int j1, j2, j3;
+    JobQueue<int*> queue(1, false, 0, false);
+    queue.enqueue(&j1);
+    queue.enqueue(&j2);
+    queue.enqueue(&j3, true);
+    VERIFY(queue.dequeue(0) == &j3);
+    VERIFY(queue.dequeue(0) == &j1);
+    VERIFY(queue.dequeue(0) == &j2);
+  }
+  {
+    int count = 0;
+    JobQueueDispatcher<int*, CountingWorker>
+      dispatcher(8, false, 0, NULL, true, true);
+    dispatcher.start();
+    for (int i = 0; i < 10000; i++) {
+      dispatcher.enqueue(&count);
+    }
+    dispatcher.stop();
+    VERIFY(count == 10000);
+  }
+  return Count(true);
+}
+
+bool TestUtil::TestQueueAdmission() {
+  const int64 target = 5000;
+  const int64 interval = 100000;
+  {
+    // while the queue has drained within an interval, waits up to an
+    // interval are fine; once it hasn't, only waits up to target are
+    VERIFY(!QueueAdmission::ShouldShed(interval, 1000000, 950000,
+                                       target, interval));
+    VERIFY(QueueAdmission::ShouldShed(interval + 1, 1000000, 950000,
+                                      target, interval));
+    VERIFY(!QueueAdmission::ShouldShed(target, 1000000, 900000,
+                                       target, interval));
+    VERIFY(!QueueAdmission::ShouldShed(target, 1000000, 800000,
+                                       target, interval));
+    VERIFY(QueueAdmission::ShouldShed(target + 1, 1000000, 800000,
+                                      target, interval));
+  }
+  {
+    // < 1ms, < 2ms, < 4ms, ... and everything from 16s on in the last one
+    VERIFY(QueueAdmission::LatencyBucket(0) == 0);
+    VERIFY(QueueAdmission::LatencyBucket(999) == 0);
+    VERIFY(QueueAdmission::LatencyBucket(1000) == 1);
+    VERIFY(QueueAdmission::LatencyBucket(1999) == 1);
+    VERIFY(QueueAdmission::LatencyBucket(2000) == 2);
+    VERIFY(QueueAdmission::LatencyBucket(3999) == 2);
+    VERIFY(QueueAdmission::LatencyBucket(4000) == 3);
+    VERIFY(QueueAdmission::LatencyBucket(16384000) ==
+           QueueAdmission::LatencyBuckets - 1);
+    VERIFY(QueueAdmission::LatencyBucket(1000000000) ==
+           QueueAdmission::LatencyBuckets - 1);
+  }
+  {
+    QueueAdmission admission(0);
+    int64 now = 0;
+    for (int i = 0; i < 3; i++) {
+      admission.record(500);
+      VERIFY(!admission.shed(500, now += 1000, true, false,
+                             target, interval));
+    }
+    // standing queue: fine for one interval, then shed past target
+    admission.record(20000);
+    VERIFY(!admission.shed(20000, now += 50000, false, false,
+                           target, interval));
+    admission.record(20000);
+    VERIFY(admission.shed(20000, now += 60000, false, false,
+                          target, interval));
+    admission.record(20000);
+    VERIFY(!admission.shed(20000, now += 1000, false, true,
+                           target, interval));
+    admission.record(4000);
+    VERIFY(!admission.shed(4000, now += 1000, false, false,
+                           target, interval));
+    admission.record(20000);
+    VERIFY(admission.shed(20000, now += 1000, false, false,
+                          target, interval));
+    // a priority job that finds the queue empty restores the interval
+    VERIFY(!admission.shed(20000, now += 1000, true, true,
+                           target, interval));
+    VERIFY(!admission.shed(20000, now += 1000, false, false,
+                           target, interval));
+
+    VERIFY(admission.getShed() == 2);
+    VERIFY(admission.getLatency(0) == 3);
+    VERIFY(admission.getLatency(3) == 1);
+    VERIFY(admission.getLatency(5) == 4);
+    int64 total = 0;
+    for (int i = 0; i < QueueAdmission::LatencyBuckets; i++) {
+      total += admission.getLatency(i);
+    }
+    VERIFY(total == 8);
+  }
+  return Count(true);
+}
+
+class RingProducer {
+public:
+  RingProducer(RingBuffer<int> &ring, ReadySignal &ready, int count)
+    : m_ring(ring), m_ready(ready), m_count(count) {}
+
+  void run() {
+    for (int i = 0; i < m_count; i++) {
+      while (!m_ring.push(i)) {
+        sched_yield(); // full until the consumer catches up
+      }
+      m_ready.signal();
+    }
+  }
+
+private:
+  RingBuffer<int> &m_ring;
+  ReadySignal &m_ready;
+  int m_count;
+};
+
+static bool is_readable(int fd) {
+  pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, 0) == 1;
+}
+
+bool TestUtil::TestRingBuffer() {
+  {
+    // rounded up to a power of two, full at capacity, FIFO across wrapping
+    RingBuffer<int> ring(3);
+    VERIFY(ring.capacity() == 4);
+    VERIFY(ring.empty());
+    int value;
+    for (int round = 0; round < 3; round++) {
+      for (int i = 0; i < 4; i++) {
+        VERIFY(ring.push(round * 10 + i));
+      }
+      VERIFY(!ring.push(99));
+      VERIFY(ring.pop(value) && value == round * 10);
+      VERIFY(ring.push(round * 10 + 4));
+      for (int i = 1; i <= 4; i++) {
+        VERIFY(ring.pop(value) && value == round * 10 + i);
+      }
+      VERIFY(ring.empty());
+      VERIFY(!ring.pop(value));
+    }
+  }
+  {
+    // one wakeup for however many signals come before clear()
+    ReadySignal ready;
+    VERIFY(ready.open());
+    VERIFY(!is_readable(ready.getFd()));
+    VERIFY(ready.signal());
+    VERIFY(!ready.signal());
+    VERIFY(!ready.signal());
+    VERIFY(is_readable(ready.getFd()));
+    ready.clear();
+    VERIFY(!is_readable(ready.getFd()));
+    VERIFY(ready.signal());
+    VERIFY(is_readable(ready.getFd()));
+    ready.clear();
+  }
+  {
+    // a producer blocked on a tiny ring hands everything over, in order
+    RingBuffer<int> ring(2);
+    ReadySignal ready;
+    VERIFY(ready.open());
+    const int count = 100000;
+    RingProducer producer(ring, ready, count);
+    AsyncFunc<RingProducer> func(&producer, &RingProducer::run);
+    func.start();
+    int expected = 0;
+    while (expected < count) {
+      pollfd pfd;
+      pfd.fd = ready.getFd();
+      pfd.events = POLLIN;
+      poll(&pfd, 1, 1000);
+      ready.clear();
+      int value;
+      while (ring.pop(value)) {
+        VERIFY(value == expected);
+        expected++;
+      }
+    }
+    func.waitForEnd();
+    VERIFY(ring.empty());
+  }
+  return Count(true);
+}
+
+bool TestUtil::TestFileCache() {
+  char dir[] = "/tmp/test_file_cache.XXXXXX";
+  VERIFY(mkdtemp(dir));
+  string small = string(dir) + "/small.txt";
+  string big = string(dir) + "/big.txt";
+  string archive = string(dir) + "/archive";
+
+  string smallData = "hello, world";
+  string bigData;
+  for (int i = 0; bigData.size() < 100000; i++) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d,", i);
+    bigData += buf;
+  }
+  FILE *f = fopen(small.c_str(), "w");
+  fwrite(smallData.data(), 1, smallData.size(), f);
+  fclose(f);
+  f = fopen(big.c_str(), "w");
+  fwrite(bigData.data(), 1, bigData.size(), f);
+  fclose(f);
+
+  {
+    FileCache fc;
+    fc.write("a/b/small.txt", small.c_str());
+    fc.write("a/big.txt", big.c_str());
+    fc.write("a/c.php");
+    fc.save(archive.c_str());
+  }
+  {
+    FileCache fc;
+    short version = fc.getVersion(archive.c_str());
+    fc.load(archive.c_str(), true, version);
+    VERIFY(fc.fileExists("a/b/small.txt"));
+    VERIFY(fc.fileExists("a/c.php"));
+    VERIFY(fc.dirExists("a/b"));
+    VERIFY(!fc.dirExists("a/c.php"));
+    VERIFY(!fc.exists("a/missing.txt"));
+
+    int len;
+    bool compressed = false;
+    FileCache::Pin pin;
+    char *data = fc.read("a/b/small.txt", len, compressed, pin);
+    VERIFY(data && !compressed);
+    VERIFY(string(data, len) == smallData);
+    data = fc.read("a/big.txt", len, compressed, pin);
+    VERIFY(data && !compressed);
+    VERIFY(string(data, len) == bigData);
+
+    // the gzipped copy only when it's asked for
+    compressed = true;
+    data = fc.read("a/big.txt", len, compressed, pin);
+    VERIFY(data && compressed && len < (int)bigData.size());
+    char *unzipped = gzdecode(data, len);
+    VERIFY(unzipped && string(unzipped, len) == bigData);
+    free(unzipped);
+
+    compressed = false;
+    VERIFY(fc.read("a/missing.txt", len, compressed, pin) == NULL);
+  }
+
+  unlink(small.c_str());
+  unlink(big.c_str());
+  unlink(archive.c_str());
+  rmdir(dir);
+  return Count(true);
+}
+
+static bool gzip_round_trip(StreamCompressor *compressor, const string &data) {
+  int len1 = data.size() / 2;
+  char *out1 = compressor->compress(data.data(), len1, false);
+  int len2 = data.size() - data.size() / 2;
+  char *out2 = compressor->compress(data.data() + data.size() / 2, len2, true);
+  string zipped = string(out1, len1) + string(out2, len2);
+  free(out1);
+  free(out2);
+
+  int len = zipped.size();
+  char *unzipped = gzdecode(zipped.data(), len);
+  bool same = unzipped && string(unzipped, len) == data;
+  free(unzipped);
+  return same;
+}
+
+bool TestUtil::TestStreamCompressor() {
+  string data;
+  for (int i = 0; data.size() < 100000; i++) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d,", i);
+    data += buf;
+  }
+
+  StreamCompressor *compressor =
+    StreamCompressor::Acquire(6, CODING_GZIP, true);
+  VERIFY(gzip_round_trip(compressor, data));
+  StreamCompressor::Release(compressor);
+
+  // the thread gets it back, reset at another level
+  StreamCompressor *reused = StreamCompressor::Acquire(1, CODING_GZIP, true);
+  VERIFY(reused == compressor);
+  VERIFY(gzip_round_trip(reused, data));
+
+  // even a stream that was never finished starts over cleanly
+  int len = data.size();
+  free(reused->compress(data.data(), len, false));
+  StreamCompressor::Release(reused);
+  reused = StreamCompressor::Acquire(9, CODING_GZIP, true);
+  StreamCompressor *other = StreamCompressor::Acquire(3, CODING_GZIP, true);
+  VERIFY(other != reused);
+  VERIFY(gzip_round_trip(reused, data));
+  VERIFY(gzip_round_trip(other, data));
+  StreamCompressor::Release(reused);
+  StreamCompressor::Release(other);
+  return Count(true);
+}
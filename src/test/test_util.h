@@ -31,6 +31,11 @@ class TestUtil : public TestBase {
   bool TestLFUTable();
   bool TestSharedString();
   bool TestCanonicalize();
+  bool TestWorkStealingQueue();
+  bool TestRingBuffer();
+  bool TestQueueAdmission();
+  bool TestFileCache();
+  bool TestStreamCompressor();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -18,6 +18,7 @@
 #include "compression.h"
 #include "logger.h"
 #include "exception.h"
+#include "thread_local.h"
 
 #define PHP_ZLIB_MODIFIER 1000
 #define GZIP_HEADER_LENGTH 10
@@ -166,14 +167,23 @@ bool is_compressible_file(const char *filename) {
 
 StreamCompressor::StreamCompressor(int level, int encoding_mode, bool header)
   : m_level(level), m_encoding(encoding_mode), m_header(header),
-    m_ended(false) {
+    m_ended(true) {
   if (level < -1 || level > 9) {
     throw Exception("compression level(%ld) must be within -1..9", level);
   }
   if (encoding_mode != CODING_GZIP && encoding_mode != CODING_DEFLATE) {
     throw Exception("encoding mode must be FORCE_GZIP or FORCE_DEFLATE");
   }
+  init();
+}
+
+StreamCompressor::~StreamCompressor() {
+  if (!m_ended) {
+    deflateEnd(&m_stream);
+  }
+}
 
+void StreamCompressor::init() {
   m_stream.zalloc = Z_NULL;
   m_stream.zfree = Z_NULL;
   m_stream.opaque = Z_NULL;
@@ -186,25 +196,82 @@ StreamCompressor::StreamCompressor(int level, int encoding_mode, bool header)
   m_crc = crc32(0L, Z_NULL, 0);
 
   int status;
-  switch (encoding_mode) {
+  switch (m_encoding) {
   case CODING_GZIP:
     /* windowBits is passed < 0 to suppress zlib header & trailer */
-    if ((status = deflateInit2(&m_stream, level, Z_DEFLATED, -MAX_WBITS,
+    if ((status = deflateInit2(&m_stream, m_level, Z_DEFLATED, -MAX_WBITS,
                                MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY)) != Z_OK) {
       throw Exception("%s", zError(status));
     }
     break;
   case CODING_DEFLATE:
-    if ((status = deflateInit(&m_stream, level)) != Z_OK) {
+    if ((status = deflateInit(&m_stream, m_level)) != Z_OK) {
       throw Exception("%s", zError(status));
     }
     break;
   }
+  m_ended = false;
 }
 
-StreamCompressor::~StreamCompressor() {
-  if (!m_ended) {
+void StreamCompressor::reset(int level, bool header) {
+  if (level < -1 || level > 9) {
+    throw Exception("compression level(%ld) must be within -1..9", level);
+  }
+  m_header = header;
+  if (m_ended) {
+    // a failed stream has freed its state already
+    m_level = level;
+    init();
+    return;
+  }
+
+  int status = deflateReset(&m_stream);
+  if (status == Z_OK && level != m_level) {
+    // nothing is pending right after a reset, so this doesn't flush
+    status = deflateParams(&m_stream, level, Z_DEFAULT_STRATEGY);
+  }
+  m_level = level;
+  if (status != Z_OK) {
     deflateEnd(&m_stream);
+    m_ended = true;
+    init();
+    return;
+  }
+  m_crc = crc32(0L, Z_NULL, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// one idle compressor per thread
+
+class StreamCompressorSlot {
+public:
+  StreamCompressorSlot() : compressor(NULL) {}
+  ~StreamCompressorSlot() {
+    delete compressor;
+  }
+  StreamCompressor *compressor;
+};
+static IMPLEMENT_THREAD_LOCAL(StreamCompressorSlot, s_idleCompressor);
+
+StreamCompressor *StreamCompressor::Acquire(int level, int encoding_mode,
+                                            bool header) {
+  StreamCompressorSlot *slot = s_idleCompressor.get();
+  StreamCompressor *compressor = slot->compressor;
+  if (compressor && compressor->m_encoding == encoding_mode) {
+    slot->compressor = NULL;
+    compressor->reset(level, header);
+    return compressor;
+  }
+  return new StreamCompressor(level, encoding_mode, header);
+}
+
+void StreamCompressor::Release(StreamCompressor *compressor) {
+  if (compressor == NULL) return;
+  StreamCompressorSlot *slot = s_idleCompressor.get();
+  if (slot->compressor == NULL) {
+    slot->compressor = compressor;
+  } else {
+    delete compressor;
   }
 }
 
@@ -237,7 +304,10 @@ char *StreamCompressor::compress(const char *data, int &len, bool trailer) {
   }
 
   int status = deflate(&m_stream, trailer ? Z_FINISH : Z_SYNC_FLUSH);
-  if (status == Z_BUF_ERROR || status == Z_STREAM_END) {
+  if (status == Z_STREAM_END) {
+    // keeping the state for reset(), the destructor frees it
+    status = Z_OK;
+  } else if (status == Z_BUF_ERROR) {
     status = deflateEnd(&m_stream);
     m_ended = true;
   }
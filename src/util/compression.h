@@ -44,18 +44,34 @@ public:
   StreamCompressor(int level, int encoding_mode, bool header);
   ~StreamCompressor();
 
+  /**
+   * Starts a new stream on the deflate state of the finished one, which
+   * saves deflateInit()'s allocations. The level may differ from last time.
+   */
+  void reset(int level, bool header);
+
   /**
    * Compress one chunk a time.
    */
   char *compress(const char *data, int &len, bool trailer);
 
+  /**
+   * A compressor for a new stream, reusing the one this thread released last
+   * if there is one. Release() hands it back to the calling thread, which
+   * keeps one and deletes others.
+   */
+  static StreamCompressor *Acquire(int level, int encoding_mode, bool header);
+  static void Release(StreamCompressor *compressor);
+
 private:
   int m_level;
   int m_encoding;
   bool m_header;
   z_stream m_stream;
   uLong m_crc;
-  bool m_ended;
+  bool m_ended; // deflateEnd() called
+
+  void init();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
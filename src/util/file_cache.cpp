@@ -19,7 +19,9 @@
 #include "compression.h"
 #include "util.h"
 #include "logger.h"
+#include "lock.h"
 #include <sys/mman.h>
+#include <algorithm>
 
 using namespace std;
 
@@ -27,6 +29,7 @@ namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
 
 std::string FileCache::SourceRoot;
+int64 FileCache::BlockCacheSize = 64 * 1024 * 1024;
 
 ///////////////////////////////////////////////////////////////////////////////
 // helper
@@ -48,6 +51,134 @@ static bool read_bytes(char *&ptr, char *end, char *buf, int len) {
   return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// indexed archives
+//
+//   short -1, short version, padding to IndexHeaderOffset
+//   IndexHeader
+//   int seeds[bucketCount]
+//   IndexEntry entries[entryCount], by hash slot
+//   names, each followed by \0
+//   BlockInfo blocks[blockCount]
+//   data: blocks, gzipped copies and big files, each followed by \0
+//
+// IndexHeader offsets are from the start of the file. BlockInfo::offset,
+// IndexEntry::offset and IndexEntry::coffset are from the start of the data,
+// except for a file in a block, where offset is from the start of the
+// uncompressed block. A file with a gzipped copy is stored plain as well.
+
+struct FileCache::IndexHeader {
+  int entryCount;
+  int bucketCount;
+  int blockCount;
+  int reserved;
+  int64 seedsOffset;
+  int64 entriesOffset;
+  int64 namesOffset;
+  int64 blocksOffset;
+  int64 dataOffset;
+};
+
+struct FileCache::IndexEntry {
+  int name;      // offset into names
+  int nameLen;
+  int len;       // uncompressed len     -1: PHP file, -2: directories
+  int clen;      // len of the gzipped copy at coffset, or -1
+  int block;     // block the file is in, or -1
+  int reserved;
+  int64 offset;
+  int64 coffset;
+};
+
+struct FileCache::BlockInfo {
+  int64 offset;
+  int len;       // uncompressed
+  int clen;      // as stored, same as len if it wasn't worth compressing
+};
+
+class FileCache::BlockData {
+public:
+  BlockData(char *d, int l) : data(d), len(l) {}
+  ~BlockData() { free(data); }
+  char *data;
+  int len;
+};
+
+static const int64 IndexHeaderOffset = 8;
+static const char s_empty[1] = "";
+static const int BlockSize = 64 * 1024;
+static const int BlockFileLimit = 16 * 1024; // bigger files aren't blocked
+static const int MaxIndexSeed = 1 << 24;
+
+static int64 align8(int64 offset) {
+  return (offset + 7) & ~7LL;
+}
+
+static void write_padding(FILE *f, int64 offset) {
+  static const char zeros[8] = {0};
+  long pos = ftell(f);
+  if (pos < offset) {
+    fwrite(zeros, offset - pos, 1, f);
+  }
+}
+
+/**
+ * FNV-1a with a seed and a murmur finalizer. hash_string() won't do, since
+ * it ignores case and so can't tell some file names apart.
+ */
+static uint64 index_hash(const char *s, int len, int seed) {
+  uint64 h = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+  for (int i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+struct bucket_size_greater {
+  bucket_size_greater(const vector<vector<int> > &b) : buckets(b) {}
+  bool operator()(int b1, int b2) const {
+    if (buckets[b1].size() != buckets[b2].size()) {
+      return buckets[b1].size() > buckets[b2].size();
+    }
+    return b1 < b2;
+  }
+  const vector<vector<int> > &buckets;
+};
+
+/**
+ * Appends block to the data section, compressed if that saves a quarter.
+ */
+static void flush_block(string &block, vector<FileCache::BlockInfo> &blocks,
+                        deque<string> &stored,
+                        vector<pair<const char *, int> > &chunks,
+                        int64 &dataSize) {
+  if (block.empty()) return;
+
+  FileCache::BlockInfo info;
+  info.offset = dataSize;
+  info.len = block.size();
+  int clen = block.size();
+  char *compressed = gzcompress(block.data(), clen, 9);
+  if (compressed && clen < ((info.len * 3) / 4)) {
+    stored.push_back(string(compressed, clen));
+  } else {
+    stored.push_back(block);
+    clen = info.len;
+  }
+  free(compressed);
+  info.clen = clen;
+  blocks.push_back(info);
+  chunks.push_back(make_pair(stored.back().data(), clen));
+  dataSize += clen + 1;
+  block.clear();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 FileCache::~FileCache() {
@@ -165,11 +296,131 @@ void FileCache::write(const char *name, const char *fullpath) {
 }
 
 #define FILE_CACHE_VERSION_1 1
-#define CURRENT_FILE_CACHE_VERSION FILE_CACHE_VERSION_1
+#define FILE_CACHE_VERSION_2 2 // indexed
+#define CURRENT_FILE_CACHE_VERSION FILE_CACHE_VERSION_2
 
 void FileCache::save(const char *filename) {
   ASSERT(filename && *filename);
 
+  // in order, so files of a directory share blocks, and so the archive is
+  // the same from one build to the next
+  vector<string> names;
+  names.reserve(m_files.size());
+  for (FileMap::const_iterator iter = m_files.begin(); iter != m_files.end();
+       ++iter) {
+    names.push_back(iter->first);
+  }
+  sort(names.begin(), names.end());
+  int count = names.size();
+
+  // Perfect hash, the "hash and displace" way: names are put in buckets by
+  // one hash, then each bucket, biggest first, is given the first seed that
+  // sends all of its names to slots no other name has taken.
+  int bucketCount = count / 2 + 1;
+  vector<vector<int> > buckets(bucketCount);
+  for (int i = 0; i < count; i++) {
+    const string &name = names[i];
+    buckets[index_hash(name.data(), name.size(), 0) % bucketCount]
+      .push_back(i);
+  }
+  vector<int> order(bucketCount);
+  for (int b = 0; b < bucketCount; b++) order[b] = b;
+  sort(order.begin(), order.end(), bucket_size_greater(buckets));
+
+  vector<int> seeds(bucketCount, 0);
+  vector<int> slotOf(count, -1);
+  vector<bool> taken(count, false);
+  vector<int> tried;
+  for (int k = 0; k < bucketCount; k++) {
+    const vector<int> &bucket = buckets[order[k]];
+    if (bucket.empty()) break;
+    for (int seed = 1; ; seed++) {
+      if (seed > MaxIndexSeed) {
+        throw Exception("Unable to index %d files for %s", count, filename);
+      }
+      tried.clear();
+      for (unsigned int j = 0; j < bucket.size(); j++) {
+        const string &name = names[bucket[j]];
+        int slot = index_hash(name.data(), name.size(), seed) % count;
+        if (taken[slot] ||
+            find(tried.begin(), tried.end(), slot) != tried.end()) {
+          break;
+        }
+        tried.push_back(slot);
+      }
+      if (tried.size() == bucket.size()) {
+        for (unsigned int j = 0; j < bucket.size(); j++) {
+          slotOf[bucket[j]] = tried[j];
+          taken[tried[j]] = true;
+        }
+        seeds[order[k]] = seed;
+        break;
+      }
+    }
+  }
+
+  // lay out the data: gzipped copies and big files on their own, small
+  // files packed into blocks that are compressed if it's worth it
+  vector<IndexEntry> entries(count);
+  string nameData;
+  vector<BlockInfo> blocks;
+  deque<string> stored; // compressed blocks, owned until written
+  vector<pair<const char *, int> > chunks; // the data section, in order
+  int64 dataSize = 0;
+  string block;
+  for (int i = 0; i < count; i++) {
+    const Buffer &buffer = m_files[names[i]];
+    IndexEntry &entry = entries[slotOf[i]];
+    entry.name = nameData.size();
+    entry.nameLen = names[i].size();
+    entry.len = buffer.len;
+    entry.clen = -1;
+    entry.block = -1;
+    entry.reserved = 0;
+    entry.offset = 0;
+    entry.coffset = 0;
+    nameData += names[i];
+    nameData += '\0';
+
+    if (buffer.cdata) {
+      ASSERT(buffer.clen > 0);
+      entry.clen = buffer.clen;
+      entry.coffset = dataSize;
+      chunks.push_back(make_pair((const char *)buffer.cdata, buffer.clen));
+      dataSize += buffer.clen + 1;
+    }
+    if (buffer.len >= BlockFileLimit) {
+      ASSERT(buffer.data);
+      entry.offset = dataSize;
+      chunks.push_back(make_pair((const char *)buffer.data, buffer.len));
+      dataSize += buffer.len + 1;
+    } else if (buffer.len > 0) {
+      ASSERT(buffer.data);
+      if (block.size() + buffer.len + 1 > (size_t)BlockSize) {
+        flush_block(block, blocks, stored, chunks, dataSize);
+      }
+      entry.block = blocks.size();
+      entry.offset = block.size();
+      block.append(buffer.data, buffer.len);
+      block += '\0';
+    }
+  }
+  flush_block(block, blocks, stored, chunks, dataSize);
+
+  IndexHeader header;
+  header.entryCount = count;
+  header.bucketCount = bucketCount;
+  header.blockCount = blocks.size();
+  header.reserved = 0;
+  header.seedsOffset = IndexHeaderOffset + sizeof(IndexHeader);
+  header.entriesOffset =
+    align8(header.seedsOffset + sizeof(int) * bucketCount);
+  header.namesOffset =
+    header.entriesOffset + sizeof(IndexEntry) * (int64)count;
+  header.blocksOffset = align8(header.namesOffset + nameData.size());
+  header.dataOffset =
+    header.blocksOffset + sizeof(BlockInfo) * (int64)blocks.size();
+
   FILE *f = fopen(filename, "w");
   if (f == NULL) {
     throw Exception("Unable to open %s: %s", filename,
@@ -181,34 +432,23 @@ void FileCache::save(const char *filename) {
   short version = CURRENT_FILE_CACHE_VERSION;
   fwrite(&minus_one, sizeof(minus_one), 1, f);
   fwrite(&version, sizeof(version), 1, f);
-  for (FileMap::const_iterator iter = m_files.begin(); iter != m_files.end();
-       ++iter) {
-    short name_len = iter->first.size();
-    const char *name = iter->first.data();
-    ASSERT(name_len);
-    fwrite(&name_len, sizeof(short), 1, f);
-    fwrite(name, name_len, 1, f);
-
-    const Buffer &buffer = iter->second;
-    char c = buffer.cdata ? 1 : 0;
-    fwrite(&c, 1, 1, f);
-    if (c) {
-      ASSERT(buffer.clen > 0);
-      fwrite(&buffer.clen, sizeof(int), 1, f);
-      ASSERT(buffer.cdata);
-      fwrite(buffer.cdata, buffer.clen, 1, f);
-      fwrite("\0", 1, 1, f);
-    } else {
-      fwrite(&buffer.len, sizeof(int), 1, f);
-      if (buffer.len > 0) {
-        ASSERT(buffer.data);
-        fwrite(buffer.data, buffer.len, 1, f);
-        fwrite("\0", 1, 1, f);
-      }
-    }
+  write_padding(f, IndexHeaderOffset);
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(&seeds[0], sizeof(int), bucketCount, f);
+  write_padding(f, header.entriesOffset);
+  if (count) fwrite(&entries[0], sizeof(IndexEntry), count, f);
+  fwrite(nameData.data(), nameData.size(), 1, f);
+  write_padding(f, header.blocksOffset);
+  if (!blocks.empty()) fwrite(&blocks[0], sizeof(BlockInfo), blocks.size(), f);
+  for (unsigned int i = 0; i < chunks.size(); i++) {
+    fwrite(chunks[i].first, chunks[i].second, 1, f);
+    fwrite("\0", 1, 1, f);
   }
 
-  fclose(f);
+  if (fclose(f) != 0) {
+    throw Exception("Unable to write %s: %s", filename,
+                    Util::safe_strerror(errno).c_str());
+  }
 }
 
 short FileCache::getVersion(const char *filename) {
@@ -232,6 +472,12 @@ void FileCache::load(const char *filename, bool onDemandUncompress,
                      short version) {
   ASSERT(filename && *filename);
 
+  if (version >= FILE_CACHE_VERSION_2) {
+    // there's nothing to load, blocks are uncompressed as they are read
+    loadMmap(filename, version);
+    return;
+  }
+
   FILE *f = fopen(filename, "r");
   if (f == NULL) {
     throw Exception("Unable to open %s: %s", filename,
@@ -341,6 +587,11 @@ void FileCache::loadMmap(const char *filename, short version) {
                     Util::safe_strerror(errno).c_str());
   }
   m_size = sbuf.st_size;
+  if (version >= FILE_CACHE_VERSION_2) {
+    openIndex(filename);
+    return;
+  }
+
   char *p = (char *)m_addr;
   char *e = p + m_size;
 
@@ -397,9 +648,100 @@ void FileCache::loadMmap(const char *filename, short version) {
   adviseOutMemory();
 }
 
+void FileCache::openIndex(const char *filename) {
+  const char *base = (const char *)m_addr;
+  if (m_size < IndexHeaderOffset + (int64)sizeof(IndexHeader)) {
+    throw Exception("Bad index header in archive %s", filename);
+  }
+  const IndexHeader *header = (const IndexHeader *)(base + IndexHeaderOffset);
+  if (header->entryCount < 0 || header->bucketCount <= 0 ||
+      header->blockCount < 0 ||
+      header->seedsOffset + sizeof(int) * header->bucketCount >
+      (uint64)header->entriesOffset ||
+      header->entriesOffset + sizeof(IndexEntry) * header->entryCount >
+      (uint64)header->namesOffset ||
+      header->namesOffset > header->blocksOffset ||
+      header->blocksOffset + sizeof(BlockInfo) * header->blockCount >
+      (uint64)header->dataOffset ||
+      header->dataOffset > m_size) {
+    throw Exception("Bad index in archive %s", filename);
+  }
+
+  m_index = header;
+  m_seeds = (const int *)(base + header->seedsOffset);
+  m_entries = (const IndexEntry *)(base + header->entriesOffset);
+  m_names = base + header->namesOffset;
+  m_blocks = (const BlockInfo *)(base + header->blocksOffset);
+  m_data = base + header->dataOffset;
+}
+
+const FileCache::IndexEntry *FileCache::findEntry(const char *name) const {
+  ASSERT(m_index);
+  if (m_index->entryCount == 0) return NULL;
+  int len = strlen(name);
+  int bucket = index_hash(name, len, 0) % m_index->bucketCount;
+  int slot = index_hash(name, len, m_seeds[bucket]) % m_index->entryCount;
+  const IndexEntry *entry = &m_entries[slot];
+  if (entry->nameLen == len && memcmp(m_names + entry->name, name, len) == 0) {
+    return entry;
+  }
+  return NULL;
+}
+
+char *FileCache::readBlock(int block, Pin &pin) const {
+  ASSERT(block >= 0 && block < m_index->blockCount);
+  const BlockInfo &info = m_blocks[block];
+  const char *stored = m_data + info.offset;
+  if (info.clen == info.len) {
+    return (char *)stored;
+  }
+
+  {
+    Lock lock(m_blockLock);
+    BlockMap::iterator iter = m_blockMap.find(block);
+    if (iter != m_blockMap.end()) {
+      m_blockList.splice(m_blockList.begin(), m_blockList, iter->second);
+      pin = iter->second->second;
+      return iter->second->second->data;
+    }
+  }
+
+  // uncompressing without holding the lock, at the risk of doing it twice
+  int len = info.clen;
+  char *data = gzuncompress(stored, len, info.len);
+  if (data == NULL || len != info.len) {
+    free(data);
+    throw Exception("Bad block %d in file cache", block);
+  }
+  BlockDataPtr blockData(new BlockData(data, len));
+
+  Lock lock(m_blockLock);
+  BlockMap::iterator iter = m_blockMap.find(block);
+  if (iter != m_blockMap.end()) {
+    m_blockList.splice(m_blockList.begin(), m_blockList, iter->second);
+    pin = iter->second->second;
+    return iter->second->second->data;
+  }
+  m_blockList.push_front(make_pair(block, blockData));
+  m_blockMap[block] = m_blockList.begin();
+  m_blockCacheBytes += len;
+  while (m_blockCacheBytes > BlockCacheSize && m_blockList.size() > 1) {
+    // readers still holding a pin keep the data until they're done
+    m_blockCacheBytes -= m_blockList.back().second->len;
+    m_blockMap.erase(m_blockList.back().first);
+    m_blockList.pop_back();
+  }
+  pin = blockData;
+  return blockData->data;
+}
+
 bool FileCache::fileExists(const char *name,
                            bool isRelative /* = true */) const {
   if (isRelative) {
+    if (m_index) {
+      const IndexEntry *entry = name && *name ? findEntry(name) : NULL;
+      return entry && entry->len >= -1;
+    }
     if (name && *name) {
       FileMap::const_iterator iter = m_files.find(name);
       if (iter != m_files.end() && iter->second.len >= -1) {
@@ -414,6 +756,10 @@ bool FileCache::fileExists(const char *name,
 bool FileCache::dirExists(const char *name,
                           bool isRelative /* = true */) const {
   if (isRelative) {
+    if (m_index) {
+      const IndexEntry *entry = name && *name ? findEntry(name) : NULL;
+      return entry && entry->len == -2;
+    }
     if (name && *name) {
       FileMap::const_iterator iter = m_files.find(name);
       if (iter != m_files.end() && iter->second.len == -2) {
@@ -428,6 +774,9 @@ bool FileCache::dirExists(const char *name,
 bool FileCache::exists(const char *name,
                        bool isRelative /* = true */) const {
   if (isRelative) {
+    if (m_index) {
+      return name && *name && findEntry(name);
+    }
     if (name && *name) {
       return m_files.find(name) != m_files.end();
     }
@@ -436,7 +785,24 @@ bool FileCache::exists(const char *name,
   return exists(GetRelativePath(name).c_str());
 }
 
-char *FileCache::read(const char *name, int &len, bool &compressed) const {
+char *FileCache::read(const char *name, int &len, bool &compressed,
+                      Pin &pin) const {
+  if (m_index) {
+    const IndexEntry *entry = name && *name ? findEntry(name) : NULL;
+    if (entry == NULL) return NULL;
+    if (compressed && entry->clen > 0) {
+      len = entry->clen;
+      return (char *)m_data + entry->coffset;
+    }
+    compressed = false;
+    len = entry->len;
+    if (len == 0) return (char *)s_empty;
+    if (len < 0) return NULL;
+    if (entry->block < 0) {
+      return (char *)m_data + entry->offset;
+    }
+    return readBlock(entry->block, pin) + entry->offset;
+  }
   if (name && *name) {
     FileMap::const_iterator iter = m_files.find(name);
     if (iter != m_files.end()) {
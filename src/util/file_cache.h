@@ -18,6 +18,7 @@
 #define __FILE_CACHE_H__
 
 #include "base.h"
+#include "mutex.h"
 
 namespace HPHP {
 ///////////////////////////////////////////////////////////////////////////////
@@ -25,14 +26,30 @@ namespace HPHP {
 /**
  * Stores file contents in memory. Used by web server for faster static
  * content serving.
+ *
+ * Archives are saved in an indexed format: a perfect hash over file names,
+ * then the files, with small ones packed into blocks that are compressed
+ * independently. Opening one only maps it; a lookup is one probe into the
+ * index, and a block is only decompressed when a file in it is read, and
+ * kept in an LRU of BlockCacheSize bytes. Older archives, with no index,
+ * are still loaded the way they always were.
  */
 DECLARE_BOOST_TYPES(FileCache);
 class FileCache {
 public:
   static std::string SourceRoot;
+  static int64 BlockCacheSize;
+
+  /**
+   * Keeps what read() returned alive, when it came out of a decompressed
+   * block that could otherwise be evicted.
+   */
+  typedef boost::shared_ptr<void> Pin;
 
 public:
-  FileCache() : m_fd(-1), m_size(0), m_addr(NULL) {}
+  FileCache() : m_fd(-1), m_size(0), m_addr(NULL), m_index(NULL),
+                m_seeds(NULL), m_entries(NULL), m_names(NULL),
+                m_blocks(NULL), m_data(NULL), m_blockCacheBytes(0) {}
   ~FileCache();
 
   /**
@@ -52,10 +69,18 @@ public:
   bool fileExists(const char *name, bool isRelative = true) const;
   bool dirExists(const char *name, bool isRelative = true) const;
   bool exists(const char *name, bool isRelative = true) const;
-  char *read(const char *name, int &len, bool &compressed) const;
+  char *read(const char *name, int &len, bool &compressed, Pin &pin) const;
 
   static std::string GetRelativePath(const char *path);
+
+  // layout of an indexed archive, in file_cache.cpp
+  struct IndexHeader;
+  struct IndexEntry;
+  struct BlockInfo;
+
 private:
+  DECLARE_BOOST_TYPES(BlockData);
+
   struct Buffer {
     int len;     // uncompressed len     -1: PHP file, -2: directories
     char *data;  // uncompressed data
@@ -69,7 +94,26 @@ private:
   int m_size;
   void *m_addr;
 
+  // indexed archives only
+  const IndexHeader *m_index;
+  const int *m_seeds;
+  const IndexEntry *m_entries;
+  const char *m_names;
+  const BlockInfo *m_blocks;
+  const char *m_data;
+
+  // decompressed blocks, most recently used first
+  typedef std::list<std::pair<int, BlockDataPtr> > BlockList;
+  typedef std::map<int, BlockList::iterator> BlockMap;
+  mutable Mutex m_blockLock;
+  mutable BlockList m_blockList;
+  mutable BlockMap m_blockMap;
+  mutable int64 m_blockCacheBytes;
+
   void writeDirectories(const char *name);
+  void openIndex(const char *filename);
+  const IndexEntry *findEntry(const char *name) const;
+  char *readBlock(int block, Pin &pin) const;
 
 };
 
@@ -20,6 +20,7 @@
 #include "async_func.h"
 #include <vector>
 #include "synchronizable_multi.h"
+#include "work_stealing_queue.h"
 #include "lock.h"
 #include "atomic.h"
 #include "alloc.h"
@@ -61,6 +62,10 @@ namespace HPHP {
  * store prepared jobs. With JobQueueDispatcher, job queue is normally empty
  * initially and new jobs are pushed into the queue over time. Also, workers
  * can be stopped individually.
+ *
+ * With workStealing, each worker has a queue of its own and takes jobs from
+ * others when it runs out, so enqueuing and dequeuing don't all contend on
+ * one lock. See WorkStealingQueue.
  */
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -79,18 +84,36 @@ public:
    * Constructor.
    */
   JobQueue(int threadCount, bool threadRoundRobin, int dropCacheTimeout,
-           bool lifo)
+           bool lifo, bool workStealing = false)
       : SynchronizableMulti(threadRoundRobin ? 1 : threadCount),
         m_jobCount(0), m_stopped(false), m_workerCount(0),
-        m_dropCacheTimeout(dropCacheTimeout), m_lifo(lifo) {
+        m_dropCacheTimeout(dropCacheTimeout), m_lifo(lifo),
+        m_stealing(NULL) {
+    if (workStealing) {
+      m_stealing = new WorkStealingQueue<TJob>(threadCount, dropCacheTimeout,
+                                               lifo);
+    }
+  }
+
+  ~JobQueue() {
+    delete m_stealing;
   }
 
   /**
-   * Put a job into the queue and notify a worker to pick it up.
+   * Put a job into the queue and notify a worker to pick it up. A priority
+   * job is picked up before any other that's queued.
    */
-  void enqueue(TJob job) {
+  void enqueue(TJob job, bool priority = false) {
+    if (m_stealing) {
+      m_stealing->enqueue(job, priority);
+      return;
+    }
     Lock lock(this);
-    m_jobs.push_back(job);
+    if (priority && !m_lifo) {
+      m_jobs.push_front(job);
+    } else {
+      m_jobs.push_back(job);
+    }
     m_jobCount = m_jobs.size();
     notify();
   }
@@ -101,6 +124,13 @@ public:
    * the job object correctly.
    */
   TJob dequeue(int id) {
+    if (m_stealing) {
+      TJob job;
+      if (!m_stealing->dequeue(id, job)) {
+        throw StopSignal();
+      }
+      return job;
+    }
     Lock lock(this);
     bool flushed = false;
     while (m_jobs.empty()) {
@@ -132,6 +162,10 @@ public:
    * Purely for making sure no new jobs are queued when we are stopping.
    */
   void stop() {
+    if (m_stealing) {
+      m_stealing->stop();
+      return;
+    }
     Lock lock(this);
     m_stopped = true;
     notifyAll(); // so all waiting threads can find out queue is stopped
@@ -154,6 +188,9 @@ public:
    * Keep track of how many jobs are queued, but not yet been serviced.
    */
   int getQueuedJobs() {
+    if (m_stealing) {
+      return m_stealing->getQueuedJobs();
+    }
     return m_jobCount;
   }
 
@@ -164,6 +201,7 @@ public:
   int m_workerCount;
   int m_dropCacheTimeout;
   bool m_lifo;
+  WorkStealingQueue<TJob> *m_stealing;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -249,9 +287,11 @@ public:
    * Constructor.
    */
   JobQueueDispatcher(int threadCount, bool threadRoundRobin,
-                     int dropCacheTimeout, void *opaque, bool lifo = false)
+                     int dropCacheTimeout, void *opaque, bool lifo = false,
+                     bool workStealing = false)
       : m_stopped(true),
-        m_queue(threadCount, threadRoundRobin, dropCacheTimeout, lifo) {
+        m_queue(threadCount, threadRoundRobin, dropCacheTimeout, lifo,
+                workStealing) {
     ASSERT(threadCount >= 1);
     m_workers.resize(threadCount);
     m_funcs.resize(threadCount);
@@ -292,8 +332,8 @@ public:
   /**
    * Enqueue a new job.
    */
-  void enqueue(TJob job) {
-    m_queue.enqueue(job);
+  void enqueue(TJob job, bool priority = false) {
+    m_queue.enqueue(job, priority);
   }
 
   /**
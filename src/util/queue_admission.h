@@ -0,0 +1,102 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __CONCURRENCY_QUEUE_ADMISSION_H__
+#define __CONCURRENCY_QUEUE_ADMISSION_H__
+
+#include <string.h>
+#include "base.h"
+#include "atomic.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * CoDel style admission control for a job queue. A queue is in trouble when
+ * jobs keep waiting even though it has had time to drain: as long as it went
+ * empty within the last interval, a job may wait for up to one interval; once
+ * it hasn't, anything that waited longer than target is shed. Every dequeue
+ * is counted in a histogram of queuing time, too.
+ *
+ * All times are in microseconds, and the clock is the caller's, so the
+ * decision itself is a pure function of its arguments.
+ */
+class QueueAdmission {
+public:
+  enum { LatencyBuckets = 16 }; // < 1ms, < 2ms, ... < 16s, longer
+
+  /**
+   * Which histogram bucket a job that was queued this long falls into.
+   */
+  static int LatencyBucket(int64 queued) {
+    int bucket = 0;
+    for (int64 ms = queued / 1000; ms && bucket < LatencyBuckets - 1;
+         ms >>= 1) {
+      bucket++;
+    }
+    return bucket;
+  }
+
+  /**
+   * Whether a job queued this long should be shed, given when the queue was
+   * last seen empty.
+   */
+  static bool ShouldShed(int64 queued, int64 now, int64 lastEmpty,
+                         int64 target, int64 interval) {
+    int64 limit = now - lastEmpty > interval ? target : interval;
+    return queued > limit;
+  }
+
+  QueueAdmission(int64 now) : m_lastEmpty(now), m_shed(0) {
+    memset(m_latency, 0, sizeof(m_latency));
+  }
+
+  /**
+   * Counts a dequeued job in the histogram.
+   */
+  void record(int64 queued) {
+    atomic_add(m_latency[LatencyBucket(queued)], (int64)1);
+  }
+
+  /**
+   * Decides whether to shed a dequeued job, counting it if so. Priority jobs
+   * are never shed, but still tell us whether the queue went empty.
+   */
+  bool shed(int64 queued, int64 now, bool queueEmpty, bool priority,
+            int64 target, int64 interval) {
+    if (queueEmpty) {
+      m_lastEmpty = now;
+    }
+    if (priority || !ShouldShed(queued, now, m_lastEmpty, target, interval)) {
+      return false;
+    }
+    atomic_add(m_shed, (int64)1);
+    return true;
+  }
+
+  int64 getLatency(int bucket) const { return m_latency[bucket]; }
+  int64 getShed() const { return m_shed; }
+
+private:
+  volatile int64 m_lastEmpty;
+  int64 m_latency[LatencyBuckets];
+  int64 m_shed;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __CONCURRENCY_QUEUE_ADMISSION_H__
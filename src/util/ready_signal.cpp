@@ -0,0 +1,111 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#include "ready_signal.h"
+#include <fcntl.h>
+#if !defined(__APPLE__)
+#include <sys/eventfd.h>
+#endif
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+bool ReadySignal::signal() {
+  __sync_synchronize();
+  if (m_signaled || !__sync_bool_compare_and_swap(&m_signaled, 0, 1)) {
+    return false;
+  }
+  wake();
+  return true;
+}
+
+void ReadySignal::clear() {
+  drain();
+  m_signaled = 0;
+  __sync_synchronize();
+}
+
+#if defined(__APPLE__)
+
+ReadySignal::ReadySignal() : m_signaled(0) {
+}
+
+ReadySignal::~ReadySignal() {
+}
+
+bool ReadySignal::open() {
+  return m_pipe.open() &&
+    fcntl(m_pipe.getOut(), F_SETFL, O_NONBLOCK) >= 0 &&
+    fcntl(m_pipe.getOut(), F_SETFD, FD_CLOEXEC) >= 0 &&
+    fcntl(m_pipe.getIn(), F_SETFD, FD_CLOEXEC) >= 0;
+}
+
+int ReadySignal::getFd() const {
+  return m_pipe.getOut();
+}
+
+void ReadySignal::wake() {
+  if (write(m_pipe.getIn(), "", 1) < 0) {
+    // an error occured but nothing we can really do
+  }
+}
+
+void ReadySignal::drain() {
+  char buf[64];
+  while (read(m_pipe.getOut(), buf, sizeof(buf)) == (int)sizeof(buf)) {
+  }
+}
+
+#else
+
+ReadySignal::ReadySignal() : m_fd(-1), m_signaled(0) {
+}
+
+ReadySignal::~ReadySignal() {
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+bool ReadySignal::open() {
+  m_fd = eventfd(0, 0);
+  return m_fd >= 0 &&
+    fcntl(m_fd, F_SETFL, O_NONBLOCK) >= 0 &&
+    fcntl(m_fd, F_SETFD, FD_CLOEXEC) >= 0;
+}
+
+int ReadySignal::getFd() const {
+  return m_fd;
+}
+
+void ReadySignal::wake() {
+  uint64_t one = 1;
+  if (write(m_fd, &one, sizeof(one)) < 0) {
+    // an error occured but nothing we can really do
+  }
+}
+
+void ReadySignal::drain() {
+  uint64_t count;
+  if (read(m_fd, &count, sizeof(count)) < 0) {
+    // an error occured but nothing we can really do
+  }
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,66 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __CONCURRENCY_READY_SIGNAL_H__
+#define __CONCURRENCY_READY_SIGNAL_H__
+
+#include "base.h"
+#include "process.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Wakes up an event loop waiting on getFd() to be readable, only once for
+ * however many signal() calls come before the loop calls clear(). It's an
+ * eventfd, or a pipe where there's no eventfd.
+ */
+class ReadySignal {
+public:
+  ReadySignal();
+  ~ReadySignal();
+
+  bool open();
+  int getFd() const;
+
+  /**
+   * Returns true if this call made the fd readable, false if an earlier one
+   * did and clear() hasn't been called since.
+   */
+  bool signal();
+
+  /**
+   * Called by the loop before it looks for work, so anything queued after
+   * that signals again.
+   */
+  void clear();
+
+private:
+#if defined(__APPLE__)
+  CPipe m_pipe;
+#else
+  int m_fd;
+#endif
+  volatile int m_signaled;
+
+  void wake();
+  void drain();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __CONCURRENCY_READY_SIGNAL_H__
@@ -0,0 +1,78 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __CONCURRENCY_RING_BUFFER_H__
+#define __CONCURRENCY_RING_BUFFER_H__
+
+#include "base.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A fixed-size queue for one producer thread and one consumer thread, that
+ * takes neither a lock nor an allocation: m_tail is only moved by the
+ * producer, m_head only by the consumer. The size is rounded up to a power
+ * of two, and push() returns false while the ring is full.
+ */
+template<typename T>
+class RingBuffer {
+public:
+  RingBuffer(int size) : m_head(0), m_tail(0) {
+    unsigned int capacity = 1;
+    while (capacity < (unsigned int)size) capacity <<= 1;
+    m_slots = new T[capacity];
+    m_mask = capacity - 1;
+  }
+
+  ~RingBuffer() {
+    delete [] m_slots;
+  }
+
+  int capacity() const { return m_mask + 1;}
+  bool empty() const { return m_head == m_tail;}
+
+  bool push(const T &item) {
+    unsigned int tail = m_tail;
+    if (tail - m_head > m_mask) return false; // full
+    m_slots[tail & m_mask] = item;
+    __sync_synchronize(); // the slot is written before it's published
+    m_tail = tail + 1;
+    return true;
+  }
+
+  bool pop(T &item) {
+    unsigned int head = m_head;
+    if (head == m_tail) return false;
+    __sync_synchronize(); // the slot is read after it's published
+    item = m_slots[head & m_mask];
+    __sync_synchronize(); // and before it's handed back
+    m_head = head + 1;
+    return true;
+  }
+
+private:
+  T *m_slots;
+  unsigned int m_mask;
+  volatile unsigned int m_head;
+  char m_padding[64]; // keeps the two ends off each other's lines
+  volatile unsigned int m_tail;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __CONCURRENCY_RING_BUFFER_H__
@@ -0,0 +1,306 @@
+/*
+   +----------------------------------------------------------------------+
+   | HipHop for PHP                                                       |
+   +----------------------------------------------------------------------+
+   | Copyright (c) 2010 Facebook, Inc. (http://www.facebook.com)          |
+   +----------------------------------------------------------------------+
+   | This source file is subject to version 3.01 of the PHP license,      |
+   | that is bundled with this package in the file LICENSE, and is        |
+   | available through the world-wide-web at the following url:           |
+   | http://www.php.net/license/3_01.txt                                  |
+   | If you did not receive a copy of the PHP license and are unable to   |
+   | obtain it through the world-wide-web, please send a note to          |
+   | license@php.net so we can mail you a copy immediately.               |
+   +----------------------------------------------------------------------+
+*/
+
+#ifndef __CONCURRENCY_WORK_STEALING_QUEUE_H__
+#define __CONCURRENCY_WORK_STEALING_QUEUE_H__
+
+#include <deque>
+#include <vector>
+#include <sched.h>
+#include "synchronizable.h"
+#include "lock.h"
+#include "atomic.h"
+#include "alloc.h"
+
+namespace HPHP {
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The queue behind JobQueue when it's asked for work stealing. Instead of one
+ * deque behind one mutex, every worker has a deque of its own:
+ *
+ *   - enqueue() picks a worker, the one that went idle last if lifo is set,
+ *     or the one that has been idle longest otherwise, or if all of them are
+ *     busy, the next one with fewer than maxBacklog jobs. It pushes the job
+ *     onto that worker's inbox with a compare-and-swap and wakes only that
+ *     worker, so the thread enqueuing never takes a lock unless it has a
+ *     sleeping thread to wake.
+ *   - A worker moves its inbox into its deque and takes the newest job if
+ *     lifo is set, or the oldest one otherwise.
+ *   - A worker with nothing of its own steals the oldest job of another.
+ *
+ * Deques are only locked by their owner and the odd thief, for as long as it
+ * takes to push or pop one job. Priority jobs go to a lane shared by all
+ * workers, which they look at before their own deques.
+ */
+template<typename TJob>
+class WorkStealingQueue {
+public:
+  WorkStealingQueue(int threadCount, int dropCacheTimeout, bool lifo,
+                    int maxBacklog = 64)
+      : m_jobCount(0), m_stopped(false), m_sleeping(0), m_idleTicket(0),
+        m_next(0), m_priorityCount(0), m_dropCacheTimeout(dropCacheTimeout),
+        m_lifo(lifo), m_maxBacklog(maxBacklog) {
+    ASSERT(threadCount >= 1);
+    m_workers.resize(threadCount);
+    for (int i = 0; i < threadCount; i++) {
+      m_workers[i] = new Worker();
+    }
+  }
+
+  ~WorkStealingQueue() {
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+      Node *node = m_workers[i]->inbox;
+      while (node) {
+        Node *next = node->next;
+        delete node;
+        node = next;
+      }
+      delete m_workers[i];
+    }
+  }
+
+  void enqueue(TJob job, bool priority = false) {
+    atomic_inc(m_jobCount);
+    Worker *w = pickWorker();
+    if (priority) {
+      {
+        Lock lock(m_priorityLock);
+        m_priorityJobs.push_back(job);
+      }
+      atomic_inc(m_priorityCount);
+    } else {
+      Node *node = new Node(job);
+      Node *head;
+      do {
+        head = w->inbox;
+        node->next = head;
+      } while (!__sync_bool_compare_and_swap(&w->inbox, head, node));
+      atomic_inc(w->backlog);
+    }
+
+    // a worker going idle counts itself as sleeping before it looks for
+    // jobs one last time, so either it sees this job or we see it sleeping
+    if (!wake(w) && m_sleeping > 0) {
+      for (unsigned int i = 0; i < m_workers.size(); i++) {
+        if (wake(m_workers[i])) break;
+      }
+    }
+  }
+
+  /**
+   * Waits for a job for worker id. Returns false once the queue is stopped
+   * and there are no jobs left.
+   */
+  bool dequeue(int id, TJob &job) {
+    Worker *w = m_workers[id];
+    bool flushed = false;
+    while (true) {
+      if (take(id, job)) return true;
+
+      bool flush = false;
+      {
+        Lock lock(w);
+        w->idleTicket = atomic_inc(m_idleTicket);
+        w->sleeping = true;
+        atomic_inc(m_sleeping);
+        bool found = take(id, job);
+        bool stopped = !found && m_stopped;
+        if (!found && !stopped) {
+          if (m_dropCacheTimeout <= 0 || flushed) {
+            w->wait();
+          } else {
+            flush = !w->wait(m_dropCacheTimeout);
+          }
+        }
+        if (w->sleeping) {
+          w->sleeping = false;
+          atomic_dec(m_sleeping);
+        }
+        if (found) return true;
+        if (stopped) return false;
+      }
+      if (flush) {
+        // since we timed out, maybe we can turn idle without holding memory
+        Util::flush_thread_caches();
+        flushed = true;
+      }
+    }
+  }
+
+  void stop() {
+    m_stopped = true;
+    __sync_synchronize();
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+      Lock lock(m_workers[i]);
+      m_workers[i]->notify();
+    }
+  }
+
+  int getQueuedJobs() {
+    return m_jobCount;
+  }
+
+private:
+  class SpinLock {
+  public:
+    SpinLock(int &lock) : m_lock(lock) {
+      while (__sync_lock_test_and_set(&m_lock, 1)) {
+        while (m_lock) sched_yield();
+      }
+    }
+    ~SpinLock() {
+      __sync_lock_release(&m_lock);
+    }
+  private:
+    int &m_lock;
+  };
+
+  struct Node {
+    Node(TJob j) : job(j), next(NULL) {}
+    TJob job;
+    Node *next;
+  };
+
+  class Worker : public Synchronizable {
+  public:
+    Worker()
+      : inbox(NULL), spin(0), backlog(0), sleeping(false), idleTicket(0) {}
+
+    Node * volatile inbox;      // newest first, pushed without a lock
+    std::deque<TJob> jobs;      // moved out of inbox, guarded by spin
+    int spin;
+    int backlog;                // in inbox and jobs together
+    volatile bool sleeping;     // guarded by getMutex()
+    int idleTicket;             // when it last went idle
+    char padding[64];           // keeps workers off each other's lines
+  };
+
+  int m_jobCount;
+  volatile bool m_stopped;
+  int m_sleeping;
+  int m_idleTicket;
+  int m_next;
+  Mutex m_priorityLock;
+  std::deque<TJob> m_priorityJobs;
+  int m_priorityCount;
+  int m_dropCacheTimeout;
+  bool m_lifo;
+  int m_maxBacklog;
+  std::vector<Worker *> m_workers;
+
+  Worker *pickWorker() {
+    int count = m_workers.size();
+    if (m_sleeping > 0) {
+      Worker *best = NULL;
+      for (int i = 0; i < count; i++) {
+        Worker *w = m_workers[i];
+        if (!w->sleeping) continue;
+        if (best == NULL ||
+            (m_lifo ? w->idleTicket > best->idleTicket :
+                      w->idleTicket < best->idleTicket)) {
+          best = w;
+        }
+      }
+      if (best) return best;
+    }
+    unsigned int start = (unsigned int)atomic_inc(m_next);
+    for (int i = 0; i < count; i++) {
+      Worker *w = m_workers[(start + i) % count];
+      if (w->backlog < m_maxBacklog) return w;
+    }
+    return m_workers[start % count];
+  }
+
+  bool wake(Worker *w) {
+    if (!w->sleeping) return false;
+    Lock lock(w);
+    if (!w->sleeping) return false;
+    w->sleeping = false;
+    atomic_dec(m_sleeping);
+    w->notify();
+    return true;
+  }
+
+  /**
+   * Moves w's inbox into its deque, oldest first.
+   */
+  void drain(Worker *w) {
+    Node *node = __sync_lock_test_and_set(&w->inbox, (Node *)NULL);
+    Node *list = NULL;
+    while (node) {
+      Node *next = node->next;
+      node->next = list;
+      list = node;
+      node = next;
+    }
+    if (list == NULL) return;
+    {
+      SpinLock lock(w->spin);
+      for (node = list; node; node = node->next) {
+        w->jobs.push_back(node->job);
+      }
+    }
+    while (list) {
+      Node *next = list->next;
+      delete list;
+      list = next;
+    }
+  }
+
+  bool pop(Worker *w, TJob &job, bool newest) {
+    if (w->inbox) drain(w);
+    {
+      SpinLock lock(w->spin);
+      if (w->jobs.empty()) return false;
+      if (newest) {
+        job = w->jobs.back();
+        w->jobs.pop_back();
+      } else {
+        job = w->jobs.front();
+        w->jobs.pop_front();
+      }
+    }
+    atomic_dec(w->backlog);
+    atomic_dec(m_jobCount);
+    return true;
+  }
+
+  bool take(int id, TJob &job) {
+    if (m_priorityCount > 0) {
+      Lock lock(m_priorityLock);
+      if (!m_priorityJobs.empty()) {
+        job = m_priorityJobs.front();
+        m_priorityJobs.pop_front();
+        atomic_dec(m_priorityCount);
+        atomic_dec(m_jobCount);
+        return true;
+      }
+    }
+    if (pop(m_workers[id], job, m_lifo)) return true;
+    int count = m_workers.size();
+    for (int i = 1; i < count; i++) {
+      Worker *victim = m_workers[(id + i) % count];
+      if (victim->backlog > 0 && pop(victim, job, false)) return true;
+    }
+    return false;
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+}
+
+#endif // __CONCURRENCY_WORK_STEALING_QUEUE_H__